@@ -0,0 +1,137 @@
+#include <backend.hpp>
+#include <null-backend.hpp>
+#include <parser.hpp>
+#include <scanner.hpp>
+#include <simd.hpp>
+
+#include <chrono>
+#include <fstream>
+
+class Bexpression {};
+class Bstatement  {};
+
+// Deletes a statement.
+void delete_stmt(Bstatement* stmt)
+{ delete stmt; }
+
+/*
+ * Timing harness for the scanner and parser. Generates its own inputs,
+ * so that runs are comparable across commits, and prints the best of
+ * several runs of each measurement:
+ *
+ *   chains:   long arithmetic chains, the expression parser's hot path
+ *   comments: deep indentation and line and block comments, which the
+ *             scanner skips with the scans in simd.hpp
+ *
+ * Each input is lexed on its own and then parsed into the null backend,
+ * once with every scan variant the CPU supports.
+ */
+
+static const char* isa_name(Scan_isa isa)
+{
+        switch (isa) {
+        case SCAN_SCALAR: return "scalar";
+        case SCAN_SSE2:   return "sse2";
+        case SCAN_AVX2:   return "avx2";
+        }
+        return "unknown";
+}
+
+// Write lines declarations, each initialised by a chain of terms additions.
+static std::string chains_source(unsigned lines, unsigned terms)
+{
+        std::string text;
+        for (unsigned i = 0; i < lines; i++) {
+                text += "int v" + std::to_string(i) + " = 1";
+                for (unsigned t = 1; t < terms; t++)
+                        text += (t % 2) ? " + 2" : " * 3";
+                text += "\n";
+        }
+        return text;
+}
+
+// Write lines short declarations, buried in blanks and comments.
+static std::string comments_source(unsigned lines)
+{
+        std::string indent(64, ' ');
+        std::string text;
+        for (unsigned i = 0; i < lines; i++) {
+                text += indent + "/* a block comment that runs on for a while before it ends */\n";
+                text += indent + "\t\t\tint c" + std::to_string(i) + " = " + std::to_string(i);
+                text += "    // and a line comment trailing the declaration\n";
+        }
+        return text;
+}
+
+// Time fn runs times and return the fastest, in milliseconds.
+template <typename Fn>
+static double best_of(unsigned runs, Fn fn)
+{
+        double best = 0;
+        for (unsigned i = 0; i < runs; i++) {
+                auto start = std::chrono::steady_clock::now();
+                fn();
+                auto end = std::chrono::steady_clock::now();
+                double ms = std::chrono::duration<double, std::milli>(end - start).count();
+                if (i == 0 || ms < best)
+                        best = ms;
+        }
+        return best;
+}
+
+static size_t lex(const std::string& path)
+{
+        size_t tokens = 0;
+        Scanner sc(path);
+        while (sc.has_next()) {
+                sc.next_token();
+                tokens++;
+        }
+        return tokens;
+}
+
+static size_t parse(const std::string& path)
+{
+        Parser parser(new Scanner(path), new Null_backend);
+        parser.set_jobs(1);
+        parser.parse();
+        return parser.statement_count();
+}
+
+static void measure(const std::string& name, const std::string& text, unsigned runs)
+{
+        std::string path = "rin_bench_" + name + ".rin";
+        std::ofstream out(path, std::ios::trunc | std::ios::binary);
+        out << text;
+        out.close();
+
+        Scan_isa selected = scan_isa();
+        const Scan_isa isas[] = {SCAN_SCALAR, SCAN_SSE2, SCAN_AVX2};
+        for (Scan_isa isa : isas) {
+                if (!scan_select_isa(isa))
+                        continue;
+
+                size_t tokens = 0, statements = 0;
+                double lex_ms = best_of(runs, [&]() { tokens = lex(path); });
+                double parse_ms = best_of(runs, [&]() { statements = parse(path); });
+                printf("%-9s %-7s %8.2f KiB %9zu tokens %6zu stmts   lex %9.3f ms   parse %9.3f ms\n",
+                       name.c_str(), isa_name(isa), text.size() / 1024.0, tokens, statements,
+                       lex_ms, parse_ms);
+        }
+        scan_select_isa(selected);
+        std::remove(path.c_str());
+}
+
+// The benchmark program
+int main(int argc, char** argv)
+{
+        unsigned runs = 5;
+        if (argc > 1)
+                runs = std::max(1, atoi(argv[1]));
+
+        printf("\n ---- BENCHMARK: SCANNER AND PARSER (best of %u) ---- \n\n", runs);
+        measure("chains", chains_source(2000, 400), runs);
+        measure("comments", comments_source(20000), runs);
+        printf("\n ---- END BENCHMARK ----\n\n");
+        return 0;
+}
@@ -3,28 +3,32 @@
 const char open_quote[]  = "'";
 const char close_quote[] = "'";
 
+/*
+ * Errors, warnings and fatal errors go to stderr, so that they stay apart
+ * from what a tool writes to stdout, such as the C of --emit-c.
+ */
 void rin_be_error_at(const Location& loc, const std::string& errmsg)
 {
-        printf("[DEBUG ERROR] %s:%d:%d: %s\n", loc.filename.c_str(),
-               loc.line, loc.column, errmsg.c_str());
+        fprintf(stderr, "[DEBUG ERROR] %s:%d:%d: %s\n", loc.filename().c_str(),
+                loc.line(), loc.column(), errmsg.c_str());
 }
 
 void rin_be_warning_at(const Location& loc, int opt, const std::string& warningmsg)
 {
-        printf("[DEBUG WARNING] %s:%d:%d: %s\n", loc.filename.c_str(),
-               loc.line, loc.column, warningmsg.c_str());
+        fprintf(stderr, "[DEBUG WARNING] %s:%d:%d: %s\n", loc.filename().c_str(),
+                loc.line(), loc.column(), warningmsg.c_str());
 }
 
 void rin_be_fatal_error(const Location& loc, const std::string& errmsg)
 {
-        printf("[DEBUG FATAL] %s:%d:%d: %s\n", loc.filename.c_str(),
-               loc.line, loc.column, errmsg.c_str());
+        fprintf(stderr, "[DEBUG FATAL] %s:%d:%d: %s\n", loc.filename().c_str(),
+                loc.line(), loc.column(), errmsg.c_str());
 }
 
 void rin_be_inform(const Location& loc, const std::string& infomsg)
 {
-        printf("[DEBUG INFORM] %s:%d:%d: %s\n", loc.filename.c_str(),
-               loc.line, loc.column, infomsg.c_str());
+        printf("[DEBUG INFORM] %s:%d:%d: %s\n", loc.filename().c_str(),
+                loc.line(), loc.column(), infomsg.c_str());
 }
 
 void rin_be_get_quotechars(const char** open_quo, const char** close_quo)
@@ -1,5 +1,10 @@
 #include <backend.hpp>
+#include <c-backend.hpp>
+#include <interp-backend.hpp>
+#include <null-backend.hpp>
 #include <parser.hpp>
+#include <token-cache.hpp>
+#include <vm-backend.hpp>
 
 class Bexpression {};
 class Bstatement  {};
@@ -41,6 +46,13 @@ void delete_stmt(Bstatement* stmt)
 class Parser_backend : public Backend
 {
 public:
+        /*
+         * A quiet backend reports nothing of what it is asked to make,
+         * leaving only the frontend's own diagnostics.
+         */
+        explicit Parser_backend(bool quiet = false)
+                : _quiet(quiet)
+        {}
 
         /*
          * Some expressions/statements require non-NULL Bexpression
@@ -63,7 +75,7 @@ public:
                         var->set_location(loc);
                 }
 
-                rin_inform(loc, "CREATED VAR OBJECT: '%s'",
+                this->trace(loc, "CREATED VAR OBJECT: '%s'",
                         identifier.c_str());
 
                 return var;
@@ -73,8 +85,9 @@ public:
 
         Bexpression* invalid_expression() override
         {
-                rin_warning_at(File::unknown_location(), 0,
-                        "RECEIVED INVALID EXPRESSION SIGNAL");
+                if (!this->_quiet)
+                        rin_warning_at(File::unknown_location(), 0,
+                                "RECEIVED INVALID EXPRESSION SIGNAL");
                 return new Bexpression;
         }
 
@@ -86,7 +99,7 @@ public:
 
                 delete var;
 
-                rin_inform(loc, "CREATED VAR REF WITH IDENT: %s",
+                this->trace(loc, "CREATED VAR REF WITH IDENT: %s",
                         identifier.c_str());
 
                 return new Bexpression;
@@ -94,7 +107,7 @@ public:
 
         Bexpression* conditional_expression(Bexpression* cond, const Location& loc) override
         {
-                rin_inform(loc, "CREATED COND EXPRESSION");
+                this->trace(loc, "CREATED COND EXPRESSION");
                 delete cond;
                 return new Bexpression;
         }
@@ -102,7 +115,7 @@ public:
         Bexpression* unary_expression
         (RIN_OPERATOR op, Bexpression* expr, const Location& loc) override
         {
-                rin_inform(loc, "CREATED UNARY EXPRESSION WITH OP: %s",
+                this->trace(loc, "CREATED UNARY EXPRESSION WITH OP: %s",
                         operator_name(op).c_str());
                 delete expr;
                 return new Bexpression;
@@ -113,12 +126,12 @@ public:
                 if (val) {
                         long i;
                         char* abc = mpfr_get_str(NULL, &i, 10, 16, *val, MPFR_RNDN);
-                        rin_inform(loc, "CREATED FLOAT EXPRESSION WITH VAL: %s", abc);
+                        this->trace(loc, "CREATED FLOAT EXPRESSION WITH VAL: %s", abc);
                         mpfr_free_str(abc);
                         return new Bexpression;
                 }
 
-                rin_inform(loc, "CREATED FLOAT EXPRESSION WITH VAL: NULL");
+                this->trace(loc, "CREATED FLOAT EXPRESSION WITH VAL: NULL");
                 return new Bexpression;
         }
 
@@ -127,19 +140,19 @@ public:
                 if (val) {
                         long i;
                         char* abc = mpfr_get_str(NULL, &i, 10, 16, *val, MPFR_RNDN);
-                        rin_inform(loc, "CREATED INTEGER EXPRESSION WITH VAL: %s", abc);
+                        this->trace(loc, "CREATED INTEGER EXPRESSION WITH VAL: %s", abc);
                         mpfr_free_str(abc);
                         return new Bexpression;
                 }
 
-                rin_inform(loc, "CREATED INTEGER EXPRESSION WITH VAL: NULL");
+                this->trace(loc, "CREATED INTEGER EXPRESSION WITH VAL: NULL");
                 return new Bexpression;
         }
 
         Bexpression* binary_expression
         (RIN_OPERATOR op, Bexpression* left, Bexpression* right, const Location& loc) override
         {
-                rin_inform(loc, "CREATED BINARY EXPRESSION WITH: %s",
+                this->trace(loc, "CREATED BINARY EXPRESSION WITH: %s",
                         operator_name(op).c_str());
                 delete left;
                 delete right;
@@ -151,13 +164,13 @@ public:
 
         Bstatement* invalid_statement() override
         {
-                rin_inform(File::unknown_location(), "CREATED INVALID STATEMENT\n");
+                this->trace(File::unknown_location(), "CREATED INVALID STATEMENT\n");
                 return new Bstatement;
         }
 
         Bstatement* var_dec_statement(Bvariable* var) override
         {
-                rin_inform(var->location(),
+                this->trace(var->location(),
                         "CREATED VARIABLE DECLARATION STMT FOR VAR: %s\n",
                         var->identifier().c_str());
                 delete var;
@@ -166,21 +179,21 @@ public:
 
         Bstatement* inc_statement(Bexpression* var, const Location& loc) override
         {
-                rin_inform(loc, "CREATED INC STMT\n");
+                this->trace(loc, "CREATED INC STMT\n");
                 delete var;
                 return new Bstatement;
         }
 
         Bstatement* dec_statement(Bexpression* var, const Location& loc) override
         {
-                rin_inform(loc, "CREATED DEC STMT\n");
+                this->trace(loc, "CREATED DEC STMT\n");
                 delete var;
                 return new Bstatement;
         }
 
         Bstatement* expression_statement(Bexpression* expr, const Location& loc) override
         {
-                rin_inform(loc, "CREATED EXPRESSION STATEMENT\n");
+                this->trace(loc, "CREATED EXPRESSION STATEMENT\n");
                 delete expr;
                 return new Bstatement;
         }
@@ -188,7 +201,7 @@ public:
         Bstatement* compound_statement
         (Bstatement* first, Bstatement* second, const Location& loc) override
         {
-                rin_inform(loc, "CREATED COMPOUND STATEMENT\n");
+                this->trace(loc, "CREATED COMPOUND STATEMENT\n");
                 delete first;
                 delete second;
 
@@ -199,9 +212,9 @@ public:
         (Bexpression* expr, Scope* scope, Scope* else_block, const Location& loc) override
         {
                 if (else_block)
-                        rin_inform(loc, "CREATED IF-ELSE STATEMENT\n");
+                        this->trace(loc, "CREATED IF-ELSE STATEMENT\n");
                 else
-                        rin_inform(loc, "CREATED IF STATEMENT\n");
+                        this->trace(loc, "CREATED IF STATEMENT\n");
                 delete expr;
                 // Scopes are owned by the If_statement; do not delete here.
 
@@ -211,7 +224,7 @@ public:
         Bstatement* assignment_statement
         (Bexpression* lhs, Bexpression* rhs, const Location& loc) override
         {
-                rin_inform(loc, "CREATED ASSIGNMENT STATEMENT\n");
+                this->trace(loc, "CREATED ASSIGNMENT STATEMENT\n");
                 delete lhs;
                 delete rhs;
 
@@ -221,7 +234,7 @@ public:
         Bstatement* for_statement
         (Bstatement* ind, Bstatement* cond, Bstatement* inc, Scope* then, const Location& loc) override
         {
-                rin_inform(loc, "CREATED FOR STATEMENT\n");
+                this->trace(loc, "CREATED FOR STATEMENT\n");
                 delete ind;
                 delete cond;
                 delete inc;
@@ -232,7 +245,7 @@ public:
 
         Bstatement* return_statement(Bexpression* expr, const Location& loc) override
         {
-                rin_inform(loc, "CREATED RETURN STATEMENT\n");
+                this->trace(loc, "CREATED RETURN STATEMENT\n");
                 delete expr;
                 return new Bstatement;
         }
@@ -241,7 +254,7 @@ public:
         (const std::string& name, const std::vector<std::string>& params,
          Scope* body, const Location& loc) override
         {
-                rin_inform(loc, "CREATED FUNCTION DECLARATION: %s\n",
+                this->trace(loc, "CREATED FUNCTION DECLARATION: %s\n",
                         name.c_str());
                 // Scope owned by Function_declaration_statement; do not delete here.
                 return new Bstatement;
@@ -251,7 +264,7 @@ public:
         (const std::string& name, const std::vector<Bexpression*>& args,
          const Location& loc) override
         {
-                rin_inform(loc, "CREATED CALL EXPRESSION: %s\n",
+                this->trace(loc, "CREATED CALL EXPRESSION: %s\n",
                         name.c_str());
                 for (auto itr = args.begin(); itr != args.end(); ++itr)
                         delete *itr;
@@ -260,45 +273,442 @@ public:
 
         Bstatement* break_statement(const Location& loc) override
         {
-                rin_inform(loc, "CREATED BREAK STATEMENT\n");
+                this->trace(loc, "CREATED BREAK STATEMENT\n");
                 return new Bstatement;
         }
 
         Bstatement* continue_statement(const Location& loc) override
         {
-                rin_inform(loc, "CREATED CONTINUE STATEMENT\n");
+                this->trace(loc, "CREATED CONTINUE STATEMENT\n");
                 return new Bstatement;
         }
 
+        // Top-level functions may be parsed on other threads.
+        Backend* fork() override
+        { return new Parser_backend(this->_quiet); }
+
         // Scope Signals.
 
         Scope* enter_scope() override
         {
-                rin_inform(File::unknown_location(), "ENTERED SCOPE");
+                this->trace(File::unknown_location(), "ENTERED SCOPE");
                 return Backend::enter_scope();
         }
 
         Scope* leave_scope() override
         {
-                rin_inform(File::unknown_location(), "LEFT SCOPE");
+                this->trace(File::unknown_location(), "LEFT SCOPE");
                 return Backend::leave_scope();
         }
+
+private:
+        bool _quiet;
+
+        template<typename... Args>
+        void trace(const Location& loc, const char* fmt, Args... args)
+        {
+                if (!this->_quiet)
+                        rin_inform(loc, fmt, args...);
+        }
 };
 
+// --- Batch mode ---
+
+// One file of a batch, and what parsing it produced.
+struct Batch_file {
+        std::string path;
+        Diagnostic_buffer diagnostics;
+        double milliseconds = 0;
+        uint64_t tokens = 0;
+        size_t statements = 0;
+        unsigned errors = 0;
+        bool done = false;
+};
+
+// Whether path names a Rinto source file.
+static bool is_rin_file(const std::string& path)
+{
+        static const std::string ext = ".rin";
+        return path.size() > ext.size()
+                && path.compare(path.size() - ext.size(), ext.size(), ext) == 0;
+}
+
+// Join dir and name with exactly one separator between them.
+static std::string join_path(const std::string& dir, const std::string& name)
+{
+        if (dir.empty() || dir.back() == '/')
+                return dir + name;
+        return dir + "/" + name;
+}
+
+// Append path to paths, or every .rin file below it if it is a directory.
+static void collect_files(const std::string& path, std::vector<std::string>* paths)
+{
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0 || !S_ISDIR(info.st_mode)) {
+                paths->push_back(path);
+                return;
+        }
+
+        DIR* dir = opendir(path.c_str());
+        if (!dir) {
+                paths->push_back(path);
+                return;
+        }
+
+        std::vector<std::string> entries;
+        while (struct dirent* entry = readdir(dir)) {
+                std::string name = entry->d_name;
+                if (name == "." || name == "..")
+                        continue;
+                entries.push_back(join_path(path, name));
+        }
+        closedir(dir);
+
+        // Walk directories in a stable order, so reports come out the same.
+        std::sort(entries.begin(), entries.end());
+        for (auto itr = entries.begin(); itr != entries.end(); ++itr) {
+                if (stat(itr->c_str(), &info) == 0 && S_ISDIR(info.st_mode))
+                        collect_files(*itr, paths);
+                else if (is_rin_file(*itr))
+                        paths->push_back(*itr);
+        }
+}
+
+/*
+ * Parse file on the calling thread, holding its diagnostics. A syntax-only
+ * parse lowers to the null backend rather than the mock one; a pipelined
+ * one lexes on a second thread. Given a token cache, tokens are replayed
+ * from it where they can be.
+ */
+static void parse_file(Batch_file* file, bool syntax_only, bool pipelined, Token_cache* cache)
+{
+        Diagnostic_buffer* outer = Diagnostic_buffer::capture(&file->diagnostics);
+        auto start = std::chrono::steady_clock::now();
+
+        Backend* be = (syntax_only) ? (Backend*)new Null_backend : new Parser_backend(true);
+        Parser parser(new Scanner(file->path, cache), be);
+
+        // Files are already spread over the workers, one thread each.
+        parser.set_jobs(1);
+        parser.set_pipelined(pipelined);
+        if (parser.scanner()->source()->is_open())
+                parser.parse();
+        else
+                rin_error_at(File::unknown_location(), "Cannot open %s", file->path.c_str());
+
+        auto end = std::chrono::steady_clock::now();
+        file->milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+        file->tokens = parser.token_count();
+        file->statements = parser.statement_count();
+        Diagnostic_buffer::capture(outer);
+
+        const std::vector<Diagnostic_buffer::Diagnostic>& held = file->diagnostics.diagnostics();
+        for (auto itr = held.begin(); itr != held.end(); ++itr) {
+                if (itr->kind == Diagnostic_buffer::DIAGNOSTIC_ERROR)
+                        file->errors++;
+        }
+}
+
+// Issue the errors and warnings held for file; informs are only the trace.
+static void report(Batch_file* file)
+{
+        const std::vector<Diagnostic_buffer::Diagnostic>& held = file->diagnostics.diagnostics();
+        for (auto diag = held.begin(); diag != held.end(); ++diag) {
+                if (diag->kind != Diagnostic_buffer::DIAGNOSTIC_INFORM)
+                        Diagnostic_buffer::issue(diag->kind, diag->opt, diag->location,
+                                                 diag->message);
+        }
+}
+
+/*
+ * Parse every file on jobs worker threads and report each in the order
+ * given: its errors and warnings, then one summary line. Returns the
+ * number of files with errors.
+ */
+static unsigned parse_batch(const std::vector<std::string>& paths, unsigned jobs,
+                            bool syntax_only, bool pipelined, Token_cache* cache)
+{
+        std::vector<Batch_file> files(paths.size());
+        for (size_t i = 0; i < paths.size(); i++)
+                files[i].path = paths[i];
+
+        std::mutex lock;
+        std::condition_variable finished;
+        size_t next = 0;
+
+        auto work = [&]() {
+                for (;;) {
+                        Batch_file* file;
+                        {
+                                std::lock_guard<std::mutex> hold(lock);
+                                if (next == files.size())
+                                        return;
+                                file = &files[next++];
+                        }
+
+                        parse_file(file, syntax_only, pipelined, cache);
+
+                        {
+                                std::lock_guard<std::mutex> hold(lock);
+                                file->done = true;
+                        }
+                        finished.notify_one();
+                }
+        };
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (unsigned i = 0; i < jobs && i < files.size(); i++)
+                workers.emplace_back(work);
+
+        uint64_t tokens = 0;
+        size_t statements = 0;
+        unsigned failed = 0;
+
+        // Report each file as soon as it and every file before it are done.
+        for (auto itr = files.begin(); itr != files.end(); ++itr) {
+                {
+                        std::unique_lock<std::mutex> hold(lock);
+                        finished.wait(hold, [&]() { return itr->done; });
+                }
+
+                report(&*itr);
+                printf("%s: %.3f ms, %llu tokens, %zu statements, %u errors\n",
+                       itr->path.c_str(), itr->milliseconds,
+                       (unsigned long long)itr->tokens, itr->statements, itr->errors);
+                fflush(stdout);
+
+                tokens += itr->tokens;
+                statements += itr->statements;
+                if (itr->errors > 0)
+                        failed++;
+        }
+
+        for (auto itr = workers.begin(); itr != workers.end(); ++itr)
+                itr->join();
+
+        auto end = std::chrono::steady_clock::now();
+        printf("%zu files, %llu tokens, %zu statements, %u with errors, %.3f ms on %u threads\n",
+               files.size(), (unsigned long long)tokens, statements, failed,
+               std::chrono::duration<double, std::milli>(end - start).count(), jobs);
+
+        return failed;
+}
+
+/*
+ * Parse for a run, holding diagnostics until the parse is done. Returns
+ * whether the program parsed without errors.
+ */
+static bool parse_to_run(Parser* parser, const std::string& path, bool pipelined)
+{
+        parser->set_pipelined(pipelined);
+        Diagnostic_buffer diagnostics;
+        Diagnostic_buffer* outer = Diagnostic_buffer::capture(&diagnostics);
+        if (parser->scanner()->source()->is_open())
+                parser->parse();
+        else
+                rin_error_at(File::unknown_location(), "Cannot open %s", path.c_str());
+        Diagnostic_buffer::capture(outer);
+
+        unsigned errors = 0;
+        const std::vector<Diagnostic_buffer::Diagnostic>& held = diagnostics.diagnostics();
+        for (auto itr = held.begin(); itr != held.end(); ++itr) {
+                if (itr->kind == Diagnostic_buffer::DIAGNOSTIC_ERROR)
+                        errors++;
+        }
+        diagnostics.replay();
+        return errors == 0;
+}
+
+// Print the top-level variables a run left behind.
+template<typename Runner>
+static void print_globals(Runner* be)
+{
+        Scope::Var_map* globals = be->supercontext()->variables();
+        for (auto itr = globals->begin(); itr != globals->end(); ++itr)
+                printf("%s = %s\n", (*itr)->identifier().c_str(), be->value(*itr).str().c_str());
+}
+
+/*
+ * Parse path into the interpreter, or into the bytecode VM, and, if it
+ * parsed without errors, run it and print the top-level variables it left
+ * behind. Returns nonzero if it did not parse or stopped on a runtime
+ * error. A listing prints the VM's bytecode before it runs; without the
+ * JIT, hot loops stay with the VM too.
+ */
+static int run_file(const std::string& path, Token_cache* cache, bool vm, bool listing, bool jit,
+                    bool pipelined)
+{
+        if (vm) {
+                Vm_backend* be = new Vm_backend;
+                if (!jit)
+                        be->set_jit_threshold(0);
+                Parser parser(new Scanner(path, cache), be);
+                if (!parse_to_run(&parser, path, pipelined))
+                        return 1;
+                if (listing)
+                        fputs(be->disassemble().c_str(), stdout);
+                if (!be->run())
+                        return 1;
+                print_globals(be);
+                return 0;
+        }
+
+        Interp_backend* be = new Interp_backend;
+        Parser parser(new Scanner(path, cache), be);
+        if (!parse_to_run(&parser, path, pipelined) || !be->run())
+                return 1;
+        print_globals(be);
+        return 0;
+}
+
+/*
+ * Run path on the VM twice, without the peephole pass and then with it,
+ * and print what each run dispatched: the total, the drop, and the most
+ * frequent opcodes and pairs of opcodes. The pairs of the first run are
+ * what superinstructions are chosen by.
+ */
+static int profile_file(const std::string& path, Token_cache* cache, bool pipelined)
+{
+        std::vector<Vm_profile> profiles(2);
+        for (int peephole = 0; peephole < 2; peephole++) {
+                Vm_backend* be = new Vm_backend;
+                be->set_peephole(peephole);
+                Parser parser(new Scanner(path, cache), be);
+                if (!parse_to_run(&parser, path, pipelined) || !be->run(&profiles[peephole]))
+                        return 1;
+        }
+
+        printf("---- without superinstructions: %s", profiles[0].report(12).c_str());
+        printf("---- with superinstructions: %s", profiles[1].report(12).c_str());
+
+        uint64_t before = profiles[0].dispatches;
+        uint64_t after = profiles[1].dispatches;
+        printf("%llu -> %llu dispatches (%.1f%% fewer)\n", (unsigned long long)before,
+               (unsigned long long)after, (before) ? 100.0 * (before - after) / before : 0.0);
+        return 0;
+}
+
+/*
+ * Parse path with the C backend and, if it parsed without errors, print
+ * the C program it translates to.
+ */
+static int emit_c_file(const std::string& path, Token_cache* cache, bool pipelined)
+{
+        C_backend* be = new C_backend;
+        Parser parser(new Scanner(path, cache), be);
+        if (!parse_to_run(&parser, path, pipelined))
+                return 1;
+        fputs(be->emit().c_str(), stdout);
+        return 0;
+}
+
+static void usage()
+{
+        rin_inform(File::unknown_location(),
+                   "\tSample usage: ./a.out [--pipeline] [--syntax-only] [--token-cache DIR] MY_FILE.rin");
+        rin_inform(File::unknown_location(),
+                   "\t              ./a.out --batch [--pipeline] [--syntax-only] [--token-cache DIR] "
+                   "[-j THREADS] FILE_OR_DIR...");
+        rin_inform(File::unknown_location(),
+                   "\t              ./a.out --run [--vm [--bytecode] [--no-jit]] [--pipeline] [--token-cache DIR] "
+                   "MY_FILE.rin");
+        rin_inform(File::unknown_location(),
+                   "\t              ./a.out --profile [--pipeline] [--token-cache DIR] MY_FILE.rin");
+        rin_inform(File::unknown_location(),
+                   "\t              ./a.out --emit-c [--pipeline] [--token-cache DIR] "
+                   "MY_FILE.rin > MY_FILE.c");
+}
+
 int main(int argc, char** argv)
 {
+        bool batch = false;
+        bool syntax_only = false;
+        bool pipelined = false;
+        bool run = false;
+        bool vm = false;
+        bool listing = false;
+        bool jit = true;
+        bool profile = false;
+        bool emit_c = false;
+        std::unique_ptr<Token_cache> cache;
+        unsigned jobs = Parser::default_jobs();
+        std::vector<std::string> paths;
+        for (int i = 1; i < argc; i++) {
+                std::string arg(argv[i]);
+                if (arg == "--batch") {
+                        batch = true;
+                } else if (arg == "--syntax-only") {
+                        syntax_only = true;
+                } else if (arg == "--run") {
+                        run = true;
+                } else if (arg == "--vm") {
+                        run = vm = true;
+                } else if (arg == "--bytecode") {
+                        run = vm = listing = true;
+                } else if (arg == "--no-jit") {
+                        run = vm = true;
+                        jit = false;
+                } else if (arg == "--profile") {
+                        profile = true;
+                } else if (arg == "--emit-c") {
+                        emit_c = true;
+                } else if (arg == "--pipeline") {
+                        pipelined = true;
+                } else if (arg == "--token-cache" && i + 1 < argc) {
+                        cache.reset(new Token_cache(argv[++i]));
+                } else if (arg == "-j" && i + 1 < argc) {
+                        int n = atoi(argv[++i]);
+                        jobs = (n > 0) ? n : 1;
+                } else {
+                        paths.push_back(arg);
+                }
+        }
+
+        if (batch) {
+                std::vector<std::string> files;
+                for (auto itr = paths.begin(); itr != paths.end(); ++itr)
+                        collect_files(*itr, &files);
+
+                if (files.empty()) {
+                        rin_error_at(File::unknown_location(), "No .rin files to parse");
+                        usage();
+                        return 1;
+                }
+                return (parse_batch(files, jobs, syntax_only, pipelined, cache.get()) > 0) ? 1 : 0;
+        }
+
+        if (emit_c && !paths.empty())
+                return emit_c_file(paths[0], cache.get(), pipelined);
+
+        if (profile && !paths.empty())
+                return profile_file(paths[0], cache.get(), pipelined);
+
+        if (run && !paths.empty())
+                return run_file(paths[0], cache.get(), vm, listing, jit, pipelined);
+
+        // Only diagnostics are printed when checking a single file.
+        if (syntax_only && !paths.empty()) {
+                Batch_file file;
+                file.path = paths[0];
+                parse_file(&file, true, pipelined, cache.get());
+                report(&file);
+                return (file.errors > 0) ? 1 : 0;
+        }
+
         printf("\n ---- DEBUG TOOL: PARSER ---- \n\n");
-        if (argc < 2) {
+        if (paths.empty()) {
                 rin_fatal_error(File::unknown_location(),
                                 "Expected .rin file directory as command line argument");
-                rin_inform(File::unknown_location(),
-                           "\tSample usage: ./a.out MY_FILE.rin");
+                usage();
                 return 0;
         }
 
-        std::string path(argv[1]);
+        std::string path(paths[0]);
         Parser_backend* be = new Parser_backend;
-        Parser parser(path, be);
+        Parser parser(new Scanner(path, cache.get()), be);
+        parser.set_pipelined(pipelined);
         parser.parse();
 
         printf("\n ---- END DEBUG TOOL ----\n\n");
@@ -5,13 +5,31 @@
 #include <stdlib.h>
 #include <mpfr.h>
 #include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
-#include <regex>
 #include <iostream>
 #include <stack>
 #include <sstream>
 
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
 #ifdef WIN32
 #ifdef XP_WIN
 #include <windows.h>
@@ -19,7 +37,9 @@
 #undef SetProp
 #endif // XP_WIN
 #else
+#include <dirent.h>
 #include <signal.h>
+#include <sys/stat.h>
 #endif // WIN32
 
 // debug-diagnostics.cc
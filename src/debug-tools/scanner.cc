@@ -26,8 +26,8 @@ int main(int argc, char** argv)
         while (sc.has_next()) {
                 Token tk = sc.next_token();
                 Location l = tk.location();
-                printf("%s:%d:%d: %s \t %s\n", l.filename.c_str(), l.line, l.column,
-                       tk.classification_as_string().c_str(), tk.str());
+                printf("%s:%d:%d: %s \t %s\n", l.filename().c_str(), l.line(), l.column(),
+                       tk.classification_as_string().c_str(), tk.string().c_str());
         }
 
         printf("\n\nSCANNER ERRORS: \n");
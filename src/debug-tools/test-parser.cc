@@ -1,8 +1,19 @@
 // test-parser.cc - Comprehensive unit tests for the Rinto parser
 #include <backend.hpp>
+#include <c-backend.hpp>
 #include <parser.hpp>
+#include <flat.hpp>
+#include <interp-backend.hpp>
+#include <null-backend.hpp>
+#include <token-cache.hpp>
+#include <vm-backend.hpp>
+#include <vm-jit.hpp>
 #include <fstream>
+#include <functional>
 #include <cstdlib>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 class Bexpression {};
 class Bstatement  {};
@@ -44,6 +55,11 @@ public:
 	bool had_error() const { return _had_error; }
 	void reset_error() { _had_error = false; }
 
+	void join(Backend* fork) override {
+		_had_error |= static_cast<Test_backend*>(fork)->_had_error;
+		Backend::join(fork);
+	}
+
 	Bvariable* variable(Named_object* obj) override {
 		Bvariable* var = new Bvariable;
 		if (obj) { var->set_identifier(obj->identifier()); var->set_location(obj->location()); }
@@ -734,6 +750,1225 @@ static void test_expression_many_operators() {
 	PASS();
 }
 
+/* Records the operators of built expressions in post-order */
+class Order_backend : public Test_backend
+{
+public:
+	std::vector<RIN_OPERATOR> ops;
+
+	Bexpression* unary_expression(RIN_OPERATOR op, Bexpression* e, const Location& loc) override {
+		ops.push_back(op);
+		return Test_backend::unary_expression(op, e, loc);
+	}
+	Bexpression* binary_expression(RIN_OPERATOR op, Bexpression* l, Bexpression* r, const Location& loc) override {
+		ops.push_back(op);
+		return Test_backend::binary_expression(op, l, r, loc);
+	}
+};
+
+static bool builds_ops(const std::string& content, const std::vector<RIN_OPERATOR>& want) {
+	std::string path = write_temp(content);
+	Order_backend* be = new Order_backend;
+	Parser parser(path, be);
+	parser.parse();
+	return !be->had_error() && be->ops == want;
+}
+
+static void test_expression_precedence_shape() {
+	BEGIN_TEST("Precedence and associativity shape the tree");
+	const char* decls = "float a = 1.0f\nfloat b = 2.0f\nfloat c = 3.0f\n";
+	if (!builds_ops(std::string(decls) + "float r = a - b * c + a\n",
+			{ OPER_MUL, OPER_SUB, OPER_ADD }))
+		FAIL("a - b * c + a");
+	if (!builds_ops(std::string(decls) + "float r = a - b - c\n",
+			{ OPER_SUB, OPER_SUB }))
+		FAIL("a - b - c");
+	if (!builds_ops(std::string(decls) + "float r = (a - b) * c\n",
+			{ OPER_SUB, OPER_MUL }))
+		FAIL("(a - b) * c");
+	if (!builds_ops(std::string(decls) + "float r = - -a * ~b\n",
+			{ OPER_NEG, OPER_NEG, OPER_BNOT, OPER_MUL }))
+		FAIL("- -a * ~b");
+	if (!builds_ops(std::string(decls) + "float r = a < b && b < c || a\n",
+			{ OPER_LSS, OPER_LSS, OPER_LAND, OPER_LOR }))
+		FAIL("a < b && b < c || a");
+	PASS();
+}
+
+static void test_expression_long_chain() {
+	BEGIN_TEST("Long arithmetic chains parse in one pass");
+	std::string src = "float a = 1.0f\nfloat b = 2.0f\nfloat r = a";
+	for (int i = 0; i < 20000; i++)
+		src += (i % 2) ? " * b" : " + (a - b)";
+	src += "\n";
+	if (!parses_ok(src)) FAIL("parse error");
+	PASS();
+}
+
+static void test_expression_missing_operands() {
+	BEGIN_TEST("Operators missing an operand are errors");
+	if (parses_ok("float a = 1.0f\nfloat r = a +\n")) FAIL("a + accepted");
+	if (parses_ok("float a = 1.0f\nfloat r = -\n")) FAIL("- accepted");
+	if (parses_ok("float a = 1.0f\nfloat r = (a\n")) FAIL("(a accepted");
+	if (parses_ok("float a = 1.0f\nfloat r = a a\n")) FAIL("a a accepted");
+	if (parses_ok("float a = 1.0f\nfloat r = ()\n")) FAIL("() accepted");
+	PASS();
+}
+
+static void test_flat_ast_post_order() {
+	BEGIN_TEST("Flat AST lays expressions out in post-order");
+	Arena arena;
+	Scope scope(&arena);
+	Named_object* obj = scope.define_obj(intern("flat_a"), Location());
+	Location loc;
+	const char* two = "2";
+	Expression* expr = Expression::make_binary(&arena, OPER_SUB,
+		Expression::make_var_reference(&arena, obj, loc),
+		Expression::make_binary(&arena, OPER_MUL,
+			Expression::make_var_reference(&arena, obj, loc),
+			Expression::make_integer(&arena, Source_span(two, 1), loc), loc),
+		loc);
+
+	Flat_ast flat;
+	if (flat.flatten(expr) != 4) FAIL("wrong root");
+	Flat_ast::Node_kind want[] = {
+		Flat_ast::NODE_VAR, Flat_ast::NODE_VAR, Flat_ast::NODE_INTEGER,
+		Flat_ast::NODE_BINARY, Flat_ast::NODE_BINARY
+	};
+	if (flat.size() != 5) FAIL("wrong node count");
+	for (uint32_t i = 0; i < 5; i++)
+		if (flat.kind(i) != want[i]) FAIL("wrong node order");
+	if (flat.op(3) != OPER_MUL || flat.op(4) != OPER_SUB) FAIL("wrong operators");
+	if (flat.first_child(4) != 0 || flat.first_child(3) != 1) FAIL("wrong first child");
+	if (flat.first_child(0) != Flat_ast::NO_CHILD) FAIL("leaf has a child");
+	scope.leave();
+	PASS();
+}
+
+static void test_flat_ast_built_by_parser() {
+	BEGIN_TEST("Parsed expressions are lowered without reflattening");
+	std::string path = write_temp("float a = 1.0f\nfloat r = a - a * a\nr = (r + a)\n");
+	Test_backend* be = new Test_backend;
+	Parser parser(path, be);
+	parser.parse();
+	if (be->had_error()) FAIL("parse error");
+	// 1.0f, then a - a * a, then r + a: every node appended exactly once.
+	if (be->flat_ast()->end() != 9) FAIL("expression flattened again");
+	if (be->flat_ast()->size() != 0) FAIL("top-level nodes kept");
+	PASS();
+}
+
+static void test_flat_ast_lvalue_error() {
+	BEGIN_TEST("Incrementing a non-variable is an error");
+	if (parses_ok("float a = 1.0f\nfloat r = (a + a)++\n")) FAIL("(a + a)++ accepted");
+	if (!parses_ok("float a = 1.0f\nfloat r = a++ * 2\n")) FAIL("a++ * 2 rejected");
+	PASS();
+}
+
+/* Counts variable declarations that reach the backend */
+class Count_backend : public Test_backend
+{
+public:
+	int declarations = 0;
+
+	Bstatement* var_dec_statement(Bvariable* v) override {
+		declarations++;
+		return Test_backend::var_dec_statement(v);
+	}
+};
+
+// Parse content with the given nesting limit; return declarations lowered, or -1 on error.
+static int parse_nested(const std::string& content, unsigned limit) {
+	std::string path = write_temp(content);
+	Count_backend* be = new Count_backend;
+	Parser parser(path, be);
+	parser.set_max_nesting(limit);
+	parser.parse();
+	return be->had_error() ? -1 : be->declarations;
+}
+
+static void test_deep_nesting() {
+	BEGIN_TEST("Deep nesting parses without recursion");
+	const int depth = 50000;
+	std::string parens = "float a = 1.0f\nfloat r = ";
+	parens += std::string(depth, '(') + "a" + std::string(depth, ')') + "\n";
+	if (!parses_ok(parens)) FAIL("nested parentheses");
+
+	std::string prefixes = "float a = 1.0f\nfloat r = ";
+	for (int i = 0; i < depth / 2; i++)
+		prefixes += (i % 2) ? "-(" : "!";
+	prefixes += "a" + std::string(depth / 4, ')') + "\n";
+	if (!parses_ok(prefixes)) FAIL("nested prefix operators");
+
+	std::string blocks = "float a = 1.0f\n";
+	for (int i = 0; i < depth; i++)
+		blocks += (i % 2) ? "if a {\n" : "while a {\n";
+	blocks += "a = a + 1\n" + std::string(depth, '}') + "\n";
+	if (!parses_ok(blocks)) FAIL("nested blocks");
+
+	std::string chain = "float a = 1.0f\nif a {\n}";
+	for (int i = 0; i < depth; i++)
+		chain += " else if a {\n}";
+	chain += " else {\n}\n";
+	if (!parses_ok(chain)) FAIL("else-if chain");
+	PASS();
+}
+
+static void test_nesting_limit() {
+	BEGIN_TEST("Nesting past the limit is an error");
+	std::string decl = "float a = 1.0f\nfloat r = ";
+	if (parse_nested(decl + "((((a))))\n", 4) < 0) FAIL("4 parentheses rejected");
+	if (parse_nested(decl + "(((((a)))))\n", 4) >= 0) FAIL("5 parentheses accepted");
+	if (parse_nested(decl + "-(-(a))\n", 4) < 0) FAIL("4 operands rejected");
+	if (parse_nested(decl + "-(-(-a))\n", 4) >= 0) FAIL("5 operands accepted");
+
+	// Each block declares one variable; a block past the limit is skipped.
+	std::string blocks = "float a = 1.0f\n";
+	for (int i = 0; i < 6; i++)
+		blocks += "if a {\nfloat v" + std::to_string(i) + "\n";
+	blocks += std::string(6, '}') + "\nfloat b\n";
+	if (parse_nested(blocks, 6) != 8) FAIL("6 blocks not parsed");
+	if (parse_nested(blocks, 4) != 6) FAIL("blocks past the limit parsed");
+	PASS();
+}
+
+static void test_stray_close_brace() {
+	BEGIN_TEST("A stray '}' is skipped");
+	if (!parses_ok("}\nfloat a = 1.0f\na = a + 1\n")) FAIL("parse error");
+	// Used to loop forever on the '}' left after the malformed if.
+	parses_ok("float a = 1.0f\nif a + {\n}\nfloat b\n");
+	PASS();
+}
+
+// ==== PARALLEL FUNCTION TESTS ====
+
+/*
+ * Forks to parse functions on worker threads, and names the top-level
+ * declarations it makes so their order can be checked.
+ */
+class Fork_backend : public Test_backend
+{
+public:
+	static int forks;
+	std::vector<std::pair<Bstatement*, std::string>> names;
+
+	Backend* fork() override { forks++; return new Fork_backend; }
+
+	void join(Backend* fork) override {
+		Fork_backend* other = static_cast<Fork_backend*>(fork);
+		names.insert(names.end(), other->names.begin(), other->names.end());
+		Test_backend::join(fork);
+	}
+
+	Bstatement* var_dec_statement(Bvariable* v) override {
+		std::string name = v->identifier();
+		Bstatement* stmt = Test_backend::var_dec_statement(v);
+		names.push_back(std::make_pair(stmt, name));
+		return stmt;
+	}
+
+	Bstatement* function_statement(const std::string& name, const std::vector<std::string>& p,
+				       Scope* body, const Location& loc) override {
+		Bstatement* stmt = Test_backend::function_statement(name, p, body, loc);
+		names.push_back(std::make_pair(stmt, name));
+		return stmt;
+	}
+
+	// Names of the top-level statements in order; '-' for unnamed ones.
+	std::string order() {
+		std::string out;
+		Scope::Statement_list* stmts = supercontext()->statements();
+		for (auto s = stmts->begin(); s != stmts->end(); ++s) {
+			std::string name = "-";
+			for (auto n = names.begin(); n != names.end(); ++n)
+				if (n->first == *s) name = n->second;
+			out += name + " ";
+		}
+		return out;
+	}
+};
+
+int Fork_backend::forks = 0;
+
+// Parse content with jobs threads; return the top-level order and collect diagnostics.
+static std::string parse_functions(const std::string& content, unsigned jobs, std::string* diagnostics,
+				   bool pipelined = false, Token_cache* cache = NULL) {
+	std::string path = write_temp(content);
+	Fork_backend* be = new Fork_backend;
+	Parser parser(new Scanner(path, cache), be);
+	parser.set_jobs(jobs);
+	parser.set_pipelined(pipelined);
+
+	Diagnostic_buffer buffer;
+	Diagnostic_buffer* outer = Diagnostic_buffer::capture(&buffer);
+	parser.parse();
+	Diagnostic_buffer::capture(outer);
+
+	for (auto d = buffer.diagnostics().begin(); d != buffer.diagnostics().end(); ++d)
+		*diagnostics += std::to_string(d->location.offset) + ": " + d->message + "\n";
+	return be->order();
+}
+
+static const char* FUNCTIONS_PROGRAM =
+	"int g\n"
+	"fn f1(a) {\n\ta = a + g\n\t// }\n}\n"
+	"int h\n"
+	"fn f2(a, b) {\n\t/* { */ return a + h + late\n}\n"
+	"fn f3() {\n\tif g > 1 {\n\t\tg = 3\n\t}\n}\n"
+	"h = g\n"
+	"fn f4(h) {\n\treturn h\n}\n"
+	"int late\n";
+
+static void test_parallel_functions_in_order() {
+	BEGIN_TEST("Functions parsed on threads keep source order");
+	std::string d1, d4;
+	Fork_backend::forks = 0;
+	std::string sequential = parse_functions(FUNCTIONS_PROGRAM, 1, &d1);
+	if (Fork_backend::forks != 0) FAIL("one job forked");
+	std::string parallel = parse_functions(FUNCTIONS_PROGRAM, 4, &d4);
+	// One fork per function, and one for the rest of the file.
+	if (Fork_backend::forks != 5) FAIL("functions not forked");
+	if (sequential != "g f1 h f2 f3 - f4 late ") FAIL(sequential.c_str());
+	if (parallel != sequential) FAIL(parallel.c_str());
+	PASS();
+}
+
+static void test_parallel_functions_diagnostics() {
+	BEGIN_TEST("Functions parsed on threads report in order");
+	std::string program = std::string(FUNCTIONS_PROGRAM) + "x = 1\n"
+		+ "fn f5(a) {\n\ta = = 2\n}\ny = 2\nfn f6() {\n\treturn z\n}\n";
+	std::string d1, d4;
+	parse_functions(program, 1, &d1);
+	for (int i = 0; i < 4; i++) {
+		d4.clear();
+		parse_functions(program, 3, &d4);
+		if (d4 != d1) FAIL(d4.c_str());
+	}
+	// 'late' is undefined in f2 and 'h' is redefined by f4.
+	if (std::count(d1.begin(), d1.end(), '\n') != 6) FAIL(d1.c_str());
+	PASS();
+}
+
+static void test_parallel_functions_errors() {
+	BEGIN_TEST("Functions with errors parse as on one thread");
+	// Error recovery in each of these resynchronises past where the raw brace matching ends a function.
+	const char* programs[] = {
+		"fn c() {\n\tint k = 5 +\n}\nfn d(x) {\n\treturn x\n}\nint after\n",
+		"fn a(x) {\n\tif x > {\n\t\tx = 1\n\t}\n}\nfn b() {\n\treturn 2\n}\n",
+		"int g\nfn e() {\n\tfor int i = 0; i < ; i++ {\n\t}\n}\nfn f(y) {\n\ty = g\n}\ng = 1\n",
+		"fn h(a, {\n}\nfn i() {\n\tfloat\n\tx +\n\t{\n}\nfn j() {\n\treturn 3\n}\n",
+		"// from examples/errors.rin\nfn k() {\n\tfloat\n\tx +\n\t{\n\tfloat x =\n}\nfn l() {\n}\n",
+	};
+	for (const char* program : programs) {
+		std::string d1, d4;
+		std::string sequential = parse_functions(program, 1, &d1);
+		if (d1.empty()) FAIL("expected errors");
+		for (unsigned jobs = 2; jobs <= 4; jobs++) {
+			d4.clear();
+			std::string parallel = parse_functions(program, jobs, &d4, jobs == 3);
+			if (parallel != sequential) FAIL(parallel.c_str());
+			if (d4 != d1) FAIL(d4.c_str());
+		}
+	}
+
+	// Parsing again sequentially replays cached tokens from the start.
+	mkdir("rin_ps_cache", 0755);
+	Token_cache cache("rin_ps_cache");
+	std::string entry = cache.path(Token_cache::hash(programs[0], strlen(programs[0])));
+	std::string d1, dc;
+	std::string sequential = parse_functions(programs[0], 1, &d1);
+	for (int pass = 0; pass < 2; pass++) {
+		dc.clear();
+		if (parse_functions(programs[0], 3, &dc, false, &cache) != sequential)
+			FAIL("statements differ with cached tokens");
+		if (dc != d1) FAIL("diagnostics differ with cached tokens");
+	}
+	std::remove(entry.c_str());
+	rmdir("rin_ps_cache");
+	PASS();
+}
+
+static void test_parallel_functions_counts() {
+	BEGIN_TEST("Functions parsed on threads are counted once");
+	std::string path = write_temp(FUNCTIONS_PROGRAM);
+	uint64_t tokens[2];
+	size_t statements[2];
+	for (unsigned jobs = 1; jobs <= 2; jobs++) {
+		Parser parser(path, new Fork_backend);
+		parser.set_jobs(jobs * 2 - 1);
+		Diagnostic_buffer buffer;
+		Diagnostic_buffer* outer = Diagnostic_buffer::capture(&buffer);
+		parser.parse();
+		Diagnostic_buffer::capture(outer);
+		tokens[jobs - 1] = parser.token_count();
+		statements[jobs - 1] = parser.statement_count();
+	}
+	if (tokens[0] == 0 || tokens[1] != tokens[0]) FAIL("token counts differ");
+	// Eight at the top, one each in f1 and f4 and two in f3; f2's is invalid.
+	if (statements[0] != 12) FAIL(std::to_string(statements[0]).c_str());
+	if (statements[1] != statements[0]) FAIL("statement counts differ");
+	PASS();
+}
+
+// ==== COMPILATION CONTEXT TESTS ====
+
+static void test_context_warning_level() {
+	BEGIN_TEST("Warnings follow the current context's level");
+	Diagnostic_buffer buffer;
+	Diagnostic_buffer* outer = Diagnostic_buffer::capture(&buffer);
+	Compilation_context quiet;
+	quiet.set_warning_level(-1);
+	Compilation_context* previous = Compilation_context::enter(&quiet);
+	rin_warning_at(File::unknown_location(), 0, "dropped");
+	Compilation_context::enter(previous);
+	rin_warning_at(File::unknown_location(), 0, "kept");
+	Diagnostic_buffer::capture(outer);
+	if (buffer.diagnostics().size() != 1) FAIL("wrong number of warnings");
+	if (buffer.diagnostics()[0].message != "kept") FAIL("wrong warning kept");
+	PASS();
+}
+
+/* Checks that it is called in its own context */
+class Context_backend : public Test_backend
+{
+public:
+	bool in_context = true;
+
+	Bstatement* var_dec_statement(Bvariable* v) override {
+		in_context = in_context && Compilation_context::current() == context();
+		return Test_backend::var_dec_statement(v);
+	}
+};
+
+// Parse path in its own context; return the diagnostics, or "" if the context was wrong.
+static std::string parse_in_context(const std::string& path) {
+	Diagnostic_buffer buffer;
+	Diagnostic_buffer* outer = Diagnostic_buffer::capture(&buffer);
+	Context_backend* be = new Context_backend;
+	bool in_context;
+	{
+		Parser parser(path, be);
+		parser.parse();
+		in_context = be->in_context;
+	}
+	Diagnostic_buffer::capture(outer);
+
+	std::string out;
+	for (auto d = buffer.diagnostics().begin(); d != buffer.diagnostics().end(); ++d)
+		out += d->location.filename() + ":" + std::to_string(d->location.line()) + ": " + d->message + "\n";
+	return in_context ? out : "";
+}
+
+static void test_concurrent_compilations() {
+	BEGIN_TEST("Compilations run concurrently on threads");
+	const int count = 4;
+	std::vector<std::string> paths, expected(count), got(count);
+	for (int i = 0; i < count; i++) {
+		paths.push_back("rin_test_parser_tmp" + std::to_string(i) + ".rin");
+		std::ofstream out(paths[i], std::ios::trunc | std::ios::binary);
+		for (int j = 0; j < 200; j++)
+			out << "int v" << j << "\nv" << j << " = u" << (j + i) % 7 << " + 1\n";
+		out.close();
+		expected[i] = parse_in_context(paths[i]);
+	}
+
+	std::vector<std::thread> threads;
+	for (int i = 0; i < count; i++)
+		threads.emplace_back([&, i] { got[i] = parse_in_context(paths[i]); });
+	for (auto t = threads.begin(); t != threads.end(); ++t)
+		t->join();
+	for (int i = 0; i < count; i++)
+		std::remove(paths[i].c_str());
+
+	for (int i = 0; i < count; i++) {
+		if (expected[i].empty()) FAIL("parsed outside its context");
+		if (got[i] != expected[i]) FAIL("diagnostics differ");
+	}
+	PASS();
+}
+
+// ==== NULL BACKEND TESTS ====
+
+// Parse path into be on jobs threads; return the diagnostics.
+static std::string parse_into(const std::string& path, Backend* be, unsigned jobs,
+			      size_t* statements, size_t* kept) {
+	Diagnostic_buffer buffer;
+	Diagnostic_buffer* outer = Diagnostic_buffer::capture(&buffer);
+	{
+		Parser parser(path, be);
+		parser.set_jobs(jobs);
+		parser.parse();
+		*statements = parser.statement_count();
+		*kept = be->supercontext()->size();
+	}
+	Diagnostic_buffer::capture(outer);
+
+	std::string out;
+	for (auto d = buffer.diagnostics().begin(); d != buffer.diagnostics().end(); ++d)
+		out += std::to_string(d->location.offset) + ": " + d->message + "\n";
+	return out;
+}
+
+static void test_null_backend_diagnostics() {
+	BEGIN_TEST("Null backend reports what a real backend does");
+	std::string path = write_temp(std::string(FUNCTIONS_PROGRAM)
+		+ "float f = 1.5 + g\ng = = 2\n5++\nfor int i = 0; i < 3; i++ {\n\tbreak\n}\n");
+	size_t statements, kept, null_statements, null_kept;
+	std::string expected = parse_into(path, new Fork_backend, 1, &statements, &kept);
+	if (expected.empty() || kept == 0) FAIL("nothing to compare");
+	for (unsigned jobs = 1; jobs <= 3; jobs += 2) {
+		std::string got = parse_into(path, new Null_backend, jobs, &null_statements, &null_kept);
+		if (got != expected) FAIL(got.c_str());
+		if (null_statements != statements) FAIL("statement counts differ");
+		if (null_kept != 0) FAIL("statements kept");
+	}
+	PASS();
+}
+
+static void test_malformed_expression_errors() {
+	BEGIN_TEST("Malformed expressions are reported once, at the last stray operand");
+	const char* programs[] = { "int x = 1 2 3\n", "int x = (1 2) 3\n", "int x = 3 ] 4\n", "int x = 3 ) 4\n" };
+	const char* want[] = { "13: Expected ';' before '3'\n", "15: Expected ';' before '3'\n",
+			       "11: Unexpected ']' operator\n", "11: Unexpected ')' operator\n" };
+	for (size_t i = 0; i < sizeof(programs) / sizeof(programs[0]); i++) {
+		size_t statements, kept;
+		std::string got = parse_into(write_temp(programs[i]), new Fork_backend, 1, &statements, &kept);
+		if (got != want[i]) FAIL(got.c_str());
+	}
+	PASS();
+}
+
+static void test_null_backend_sentinels() {
+	BEGIN_TEST("Null backend hands out shared sentinels");
+	Null_backend be;
+	Location loc = File::unknown_location();
+	Bexpression* expr = be.native_integer_expression(1, loc);
+	if (expr == NULL || be.binary_expression(OPER_ADD, expr, expr, loc) != expr)
+		FAIL("expressions differ");
+	Bstatement* stmt = be.expression_statement(expr, loc);
+	if (stmt == NULL || be.break_statement(loc) != stmt) FAIL("statements differ");
+	if (be.variable(NULL) == NULL) FAIL("no variable");
+	be.push_statement(stmt);
+	if (be.supercontext()->size() != 0) FAIL("statement kept");
+	PASS();
+}
+
+// ==== PIPELINED SCANNING TESTS ====
+
+static void test_pipelined_parse() {
+	BEGIN_TEST("Pipelined parse matches, with functions on threads");
+	std::string program;
+	for (int i = 0; i < 400; i++)
+		program += std::string(FUNCTIONS_PROGRAM) + "x" + std::to_string(i) + " = 1abc + (2\n";
+	std::string d1, dp;
+	std::string sequential = parse_functions(program, 1, &d1);
+	if (d1.find("Unknown keyword") == std::string::npos) FAIL("no scan error");
+	for (unsigned jobs = 1; jobs <= 3; jobs += 2) {
+		dp.clear();
+		if (parse_functions(program, jobs, &dp, true) != sequential) FAIL("statements differ");
+		if (dp != d1) FAIL("diagnostics differ");
+	}
+	PASS();
+}
+
+static void test_token_cache_parse() {
+	BEGIN_TEST("Parse from cached tokens matches, with functions on threads");
+	std::string program;
+	for (int i = 0; i < 50; i++)
+		program += std::string(FUNCTIONS_PROGRAM) + "x" + std::to_string(i) + " = 1abc + (2\n";
+	std::string d1, dc;
+	std::string sequential = parse_functions(program, 1, &d1);
+
+	mkdir("rin_ps_cache", 0755);
+	Token_cache cache("rin_ps_cache");
+	std::string entry = cache.path(Token_cache::hash(program.data(), program.size()));
+	std::remove(entry.c_str());
+	for (int pass = 0; pass < 2; pass++) {
+		for (unsigned jobs = 1; jobs <= 3; jobs += 2) {
+			dc.clear();
+			if (parse_functions(program, jobs, &dc, false, &cache) != sequential)
+				FAIL("statements differ");
+			if (dc != d1) FAIL("diagnostics differ");
+		}
+	}
+	std::remove(entry.c_str());
+	rmdir("rin_ps_cache");
+	PASS();
+}
+
+// ==== INTERPRETER TESTS ====
+
+/*
+ * Parse content into an interpreter, or into be if given, and run it if
+ * it parsed cleanly. Returns the top-level variables as "name=value"
+ * lines, then any diagnostics; ran is whether the run finished without
+ * an error. The parser owns the backend, so anything else to look at
+ * after the run is passed to inspect while it is still alive.
+ */
+template<typename Runner = Interp_backend>
+static std::string run_program(const std::string& content, bool* ran, Runner* be = NULL,
+			       std::function<void(Runner*)> inspect = nullptr) {
+	std::string path = write_temp(content);
+	Diagnostic_buffer buffer;
+	Diagnostic_buffer* outer = Diagnostic_buffer::capture(&buffer);
+	std::string out;
+	*ran = false;
+	{
+		if (!be)
+			be = new Runner;
+		Parser parser(path, be);
+		parser.parse();
+		if (buffer.diagnostics().empty()) {
+			*ran = be->run();
+			Scope::Var_map* globals = be->supercontext()->variables();
+			for (auto obj = globals->begin(); obj != globals->end(); ++obj)
+				out += (*obj)->identifier() + "=" + be->value(*obj).str() + "\n";
+			if (inspect)
+				inspect(be);
+		}
+	}
+	Diagnostic_buffer::capture(outer);
+
+	for (auto d = buffer.diagnostics().begin(); d != buffer.diagnostics().end(); ++d)
+		out += d->message + "\n";
+	return out;
+}
+
+static void test_interp_arithmetic() {
+	BEGIN_TEST("Interpreter: arithmetic on globals");
+	bool ran;
+	std::string out = run_program(
+		"int a = 7\nint b = a * 3 - 1\nint c = b / 3\nint d = -b % 3\n"
+		"float f = a / 2.0\nint e = (a << 4) | 3 ^ 1\nint t = a > 5 && !(b == 0)\n"
+		"a += 1\nb--\n", &ran);
+	if (!ran) FAIL(out.c_str());
+	if (out != "a=8\nb=19\nc=6\nd=-2\nf=3.5\ne=114\nt=1\n") FAIL(out.c_str());
+	PASS();
+}
+
+static void test_interp_loops() {
+	BEGIN_TEST("Interpreter: loops, break and continue");
+	bool ran;
+	std::string out = run_program(
+		"int s = 0\n"
+		"for int i = 0; i < 100; i++ {\n"
+		"\tif i % 2 == 0 {\n\t\tcontinue\n\t}\n"
+		"\tif i > 10 {\n\t\tbreak\n\t} else {\n\t\ts += i\n\t}\n"
+		"}\n"
+		"int k = 10\nwhile k > 3 {\n\tk--\n}\n", &ran);
+	if (!ran) FAIL(out.c_str());
+	if (out != "s=25\nk=3\n") FAIL(out.c_str());
+	PASS();
+}
+
+static void test_interp_recursion() {
+	BEGIN_TEST("Interpreter: recursive calls keep their own locals");
+	bool ran;
+	std::string out = run_program(
+		"int total = 0\n"
+		"fn sum(n, step) {\n"
+		"\tif n > 0 {\n\t\tint m = n\n\t\tsum(n - step, step)\n\t\ttotal += m\n\t}\n"
+		"}\n"
+		"sum(100, 1)\nsum(10, 5)\n", &ran);
+	if (!ran) FAIL(out.c_str());
+	if (out != "total=5065\n") FAIL(out.c_str());
+	PASS();
+}
+
+static void test_interp_runtime_errors() {
+	BEGIN_TEST("Interpreter: runtime errors stop the run");
+	bool ran;
+	std::string out = run_program("int a = 3\nint z = 1\nz = a / (a - 3)\nz = 5\n", &ran);
+	if (ran || out != "a=3\nz=1\nDivision by zero\n") FAIL(out.c_str());
+	out = run_program("fn f(n) {\n\tf(n + 1)\n}\nf(0)\n", &ran);
+	if (ran || out.find("Call depth exceeds") == std::string::npos) FAIL(out.c_str());
+	out = run_program("fn f(n) {\n}\nf(1, 2)\n", &ran);
+	if (ran || out.find("takes 1 arguments") == std::string::npos) FAIL(out.c_str());
+	PASS();
+}
+
+static void test_interp_stray_break() {
+	BEGIN_TEST("Interpreter: a break outside a loop is reported where it is");
+	const char* programs[] = {"int a = 1\nfn f() {\n\tbreak\n}\nf()\n",
+				  "int a = 1\n\ncontinue\n"};
+	for (const char* program : programs) {
+		std::string path = write_temp(program);
+		Diagnostic_buffer buffer;
+		Diagnostic_buffer* outer = Diagnostic_buffer::capture(&buffer);
+		{
+			Interp_backend* be = new Interp_backend;
+			Parser parser(path, be);
+			parser.parse();
+			if (buffer.diagnostics().empty())
+				be->run();
+		}
+		Diagnostic_buffer::capture(outer);
+
+		if (buffer.diagnostics().size() != 1) FAIL(program);
+		const Location& loc = buffer.diagnostics().front().location;
+		if (loc.filename() != path || loc.line() != 2) FAIL(buffer.diagnostics().front().message.c_str());
+	}
+	PASS();
+}
+
+static void test_interp_nesting_limit() {
+	BEGIN_TEST("Interpreter: nesting past its limit is an error, not a crash");
+	std::string chain = "int a = 1", ifs, ends;
+	for (unsigned i = 0; i < Interp_backend::MAX_DEPTH; i++)
+		chain += " + 1";
+	for (unsigned i = 0; i <= Interp_backend::MAX_DEPTH; i++) {
+		ifs += "if a {\n";
+		ends += "}\n";
+	}
+	bool ran;
+	std::string out = run_program(chain + "\n", &ran);
+	if (!ran || out != "a=" + std::to_string(Interp_backend::MAX_DEPTH + 1) + "\n") FAIL(out.c_str());
+	out = run_program(chain + " + 1\n", &ran);
+	if (ran || out.find("Expression nesting exceeds the interpreter's limit") == std::string::npos)
+		FAIL(out.c_str());
+	out = run_program("int a = 1\n" + ifs + ends, &ran);
+	if (ran || out.find("Block nesting exceeds the interpreter's limit") == std::string::npos)
+		FAIL(out.c_str());
+	PASS();
+}
+
+static void test_interp_enclosing_locals() {
+	BEGIN_TEST("Interpreter: locals of an enclosing function are an error");
+	const char* programs[] = {
+		"int a = 0\nfn outer(p) {\n\tint l = p\n\tfn inner(q) {\n\t\ta += l\n\t}\n\tinner(l)\n}\nouter(3)\n",
+		"int a = 0\nfn outer(p) {\n\tint l = p\n\tfn inner(q) {\n\t\tl = q\n\t}\n\tinner(l)\n}\nouter(3)\n",
+		"int a = 0\nfn outer(p) {\n\tint l = p\n\tfn inner(q) {\n\t\tl++\n\t}\n\tinner(l)\n}\nouter(3)\n",
+	};
+	for (const char* program : programs) {
+		bool ran;
+		std::string out = run_program(program, &ran);
+		if (ran || out != "a=0\n'l' belongs to an enclosing function\n") FAIL(out.c_str());
+	}
+
+	// Its own locals, and the top level's variables, are still fine.
+	bool ran;
+	std::string out = run_program("int a = 0\nfn outer(p) {\n\tint l = p\n\tfn inner(q) {\n"
+				      "\t\tint m = q\n\t\tm++\n\t\ta += m\n\t}\n\tinner(l)\n}\nouter(3)\n", &ran);
+	if (!ran || out != "a=4\n") FAIL(out.c_str());
+	PASS();
+}
+
+static void test_interp_stack_budget() {
+	BEGIN_TEST("Interpreter: deep bodies in deep calls are an error, not a crash");
+	std::string ifs, ends;
+	for (int i = 0; i < 30; i++) {
+		ifs += "if n > " + std::to_string(-1 - i) + " {\n";
+		ends += "}\n";
+	}
+	std::string program = "int a = 0\nfn f(n) {\n\tif n <= 0 {\n\t\treturn 0\n\t}\n"
+		+ ifs + "a += 1\nf(n - 1)\n" + ends + "}\n";
+	bool ran;
+	std::string out = run_program(program + "f(100)\n", &ran);
+	if (!ran || out != "a=100\n") FAIL(out.c_str());
+	out = run_program(program + "f(4000)\n", &ran);
+	if (ran || out.find("Calls nest deeper than the interpreter's stack") == std::string::npos)
+		FAIL(out.c_str());
+	PASS();
+}
+
+// ==== BYTECODE VM TESTS ====
+
+static const char* VM_PROGRAMS[] = {
+	"int a = 7\nint b = a * 3 - 1\nint c = b / 3\nint d = -b % 3\n"
+	"float f = a / 2.0\nint e = (a << 4) | 3 ^ 1\nint t = a > 5 && !(b == 0)\n"
+	"int u = 0 || a - 7\nint v = ~a >> 1\na += 1\nb--\n",
+	"int s = 0\nfor int i = 0; i < 100; i++ {\n\tif i % 2 == 0 {\n\t\tcontinue\n\t}\n"
+	"\tif i > 10 {\n\t\tbreak\n\t} else {\n\t\ts += i\n\t}\n}\n"
+	"int k = 10\nwhile k > 3 {\n\tk--\n}\n",
+	"int total = 0\nfn sum(n, step) {\n\tif n > 0 {\n\t\tint m = n\n"
+	"\t\tsum(n - step, step)\n\t\ttotal += m\n\t}\n}\nsum(100, 1)\nsum(10, 5)\n",
+	// Variables holding both integers and floats are checked as they run.
+	"var m = 1\nint i = 0\nwhile i < 6 {\n\tif i == 3 {\n\t\tm = m * 0.5\n\t}\n"
+	"\tm = m + i\n\ti++\n}\nvar q = m % 4\nm++\n",
+	"float acc = 0\nfn scale(x) {\n\tacc = acc + x * 2\n}\nscale(1)\nscale(2.5)\n",
+	"int a = 3\nint z = 1\nz = a / (a - 3)\nz = 5\n",
+	// A declaration holds integer 0 until it is assigned, whatever the variable's type.
+	"float x\nint q = 7 / (x + 2)\nx = 1.5\nvar s = 0\nfn f(n) {\n\tfloat a\n"
+	"\ts = s + n / (a + 2)\n\ta = 0.5\n\ts = s + a\n}\nf(5)\nf(7)\n",
+	// A run stops at its first error, however deep in an expression.
+	"int a = 2\nint d = 0\nint b = 1\nb = ((!(a) << (a <= 3.6)) / -((1 % d)))\n",
+	"int d = 0\nint b = 1\nb = -(1 / d) + ~(2 % d) || (3 / d) && !(4 % d)\n",
+	"var f = 1.5\nint g = 2\nf = g | f\n",
+	"fn f(n) {\n\tf(n + 1)\n}\nf(0)\n",
+	"fn f(n) {\n}\nf(1, 2)\n",
+	"int x = 1\nreturn x + 1\nx = 5\n",
+	// Sequences the peephole pass fuses, and some it must leave alone.
+	"float t = 0\nint g = 0\nfn add(v, w) {\n\tt += v\n\tg += 2\n\tg++\n\tg += w\n}\n"
+	"for float y = 0.5; y <= 4; y++ {\n\tadd(y, 3)\n}\n"
+	"int r = 0\nfor int i = -3; 0 < 10 - i; i++ {\n\tr += i % -1 + i % 4 * 3\n}\n"
+	"int z = 9\nz = z % 0\n",
+};
+
+static void test_vm_matches_interpreter() {
+	BEGIN_TEST("VM: runs programs as the interpreter does");
+	for (size_t i = 0; i < sizeof(VM_PROGRAMS) / sizeof(VM_PROGRAMS[0]); i++) {
+		bool interp_ran, vm_ran;
+		std::string expected = run_program<Interp_backend>(VM_PROGRAMS[i], &interp_ran);
+		std::string got = run_program<Vm_backend>(VM_PROGRAMS[i], &vm_ran);
+		if (got != expected || vm_ran != interp_ran) FAIL((expected + "--\n" + got).c_str());
+	}
+	PASS();
+}
+
+static void test_vm_typed_instructions() {
+	BEGIN_TEST("VM: proven types compile to typed instructions");
+	std::string path = write_temp(
+		"int s = 0\nfloat x = 1.0\nvar m = 1\n"
+		"for int i = 0; i < 10; i++ {\n\ts += i * 2\n\tx = x * 1.5\n\tm = m + x\n}\n");
+	Vm_backend* be = new Vm_backend;
+	be->set_peephole(false);
+	Parser parser(path, be);
+	parser.parse();
+	std::string listing = be->disassemble();
+	if (listing.find("MUL_II") == std::string::npos) FAIL("no integer multiply");
+	if (listing.find("MUL_FF") == std::string::npos) FAIL("no float multiply");
+	if (listing.find("STEP_I") == std::string::npos) FAIL("no integer step");
+	if (listing.find("BINARY") == std::string::npos) FAIL("mixed variable not checked");
+	if (!be->run()) FAIL("run failed");
+	Scope::Var_map* globals = be->supercontext()->variables();
+	if (be->value((*globals)[0]).str() != "90") FAIL("wrong sum");
+	if (!be->value((*globals)[1]).is_float()) FAIL("float variable holds an integer");
+	PASS();
+}
+
+static void test_vm_deep_calls() {
+	BEGIN_TEST("VM: calls run without the native stack");
+	bool ran;
+	std::string out = run_program<Vm_backend>(
+		"int n = 0\nfn down(k) {\n\tif k > 0 {\n\t\tn++\n\t\tdown(k - 1)\n\t}\n}\n"
+		"for int i = 0; i < 50; i++ {\n\tdown(4000)\n}\n", &ran);
+	if (!ran || out != "n=200000\n") FAIL(out.c_str());
+	PASS();
+}
+
+static void test_vm_superinstructions() {
+	BEGIN_TEST("VM: superinstructions cut dispatches, not results");
+	std::string path = write_temp(
+		"int s = 0\nint n = 0\nfn count(k) {\n\tif k > 0 {\n\t\tn++\n\t\ts += k\n"
+		"\t\tcount(k - 1)\n\t}\n}\n"
+		"for int i = 0; i < 1000; i++ {\n\tif i % 3 == 0 {\n\t\ts += i & 7\n\t}\n}\n"
+		"count(100)\n");
+	std::vector<Vm_profile> profiles(2);
+	std::string values[2], listing;
+	for (int peephole = 0; peephole < 2; peephole++) {
+		Vm_backend* be = new Vm_backend;
+		be->set_peephole(peephole);
+		Parser parser(path, be);
+		parser.parse();
+		if (peephole)
+			listing = be->disassemble();
+		if (!be->run(&profiles[peephole])) FAIL("run failed");
+		Scope::Var_map* globals = be->supercontext()->variables();
+		for (auto obj = globals->begin(); obj != globals->end(); ++obj)
+			values[peephole] += be->value(*obj).str() + " ";
+	}
+	if (values[0] != "6219 100 " || values[1] != values[0]) FAIL(values[1].c_str());
+
+	const char* fused[] = { "JNOT_LSS_IK", "JNOT_EQL_IK", "REM_IK", "BAND_IK",
+				"STEP_JMP_I", "JNOT_GTR_IK", "STEPG_I", "ADDG_II", "SUB_IK" };
+	for (size_t i = 0; i < sizeof(fused) / sizeof(fused[0]); i++) {
+		if (listing.find(fused[i]) == std::string::npos) FAIL(fused[i]);
+	}
+	if (listing.find("JMPF") != std::string::npos) FAIL("conditional jump left unfused");
+
+	// Every loop iteration is at least a third shorter.
+	if (profiles[1].dispatches * 3 > profiles[0].dispatches * 2) FAIL(profiles[1].report(8).c_str());
+	if (profiles[1].opcodes[VM_LOADK] >= profiles[0].opcodes[VM_LOADK] / 10) FAIL("constants still loaded");
+	PASS();
+}
+
+static const char* JIT_PROGRAMS[] = {
+	// Division by zero, and by -1, are left to the VM.
+	"int q = 0\nfor int i = 3; i > -3; i-- {\n\tq += 100 / i\n}\n",
+	"int a = 0\nfor int i = 0; i < 3; i++ {\n\ta += 17 / (i - 3) + 17 % (i - 3) + i % 2\n}\n",
+	// So is the truth of a float.
+	"float f = 0.5\nint c = 0\nfor int i = 0; i < 6; i++ {\n\tif f {\n\t\tc++\n\t}\n"
+	"\tf = f - 0.25\n}\n",
+	"float z = 0.0\nfloat nan = z / z\nint c = 0\nint e = 0\nfor int i = 0; i < 4; i++ {\n"
+	"\tif nan < 1.0 {\n\t\tc += 1\n\t}\n\tif nan >= 1.0 {\n\t\tc += 10\n\t}\n"
+	"\tif nan != nan {\n\t\tc += 100\n\t}\n\te = e + (nan == nan) + (1.0 <= i)\n}\n",
+	"int h = 1\nfloat g = 1.5\nint b = 0\nfor int i = 0; i < 40; i++ {\n"
+	"\th = (h << 3) ^ (h >> 2) | i & 5\n\th = -h + ~i * 3 - h % 7\n"
+	"\tg = -g * 1.5 / 1.25 - i\n\tb = b + (i >= 20) + (g > 0.0)\n}\n",
+	"int t = 0\nfn f(n) {\n\tfor int i = 0; i < n; i++ {\n\t\tt += i\n\t\tt++\n\t}\n}\n"
+	"f(10)\nf(20)\n",
+	"int s = 0\nfor int i = 0; i < 30; i++ {\n\tfor int j = i; j > 0; j-- {\n"
+	"\t\tif j == 7 {\n\t\t\tbreak\n\t\t}\n\t\ts += j\n\t}\n}\n",
+};
+
+static void test_vm_jit_matches_interpreter() {
+	BEGIN_TEST("VM: compiled loops run as the interpreter does");
+	for (size_t i = 0; i < sizeof(VM_PROGRAMS) / sizeof(VM_PROGRAMS[0])
+		     + sizeof(JIT_PROGRAMS) / sizeof(JIT_PROGRAMS[0]); i++) {
+		const char* program = (i < sizeof(VM_PROGRAMS) / sizeof(VM_PROGRAMS[0])) ?
+			VM_PROGRAMS[i] : JIT_PROGRAMS[i - sizeof(VM_PROGRAMS) / sizeof(VM_PROGRAMS[0])];
+
+		// Every loop is compiled the first time it comes round.
+		Vm_backend* be = new Vm_backend;
+		be->set_jit_threshold(1);
+		bool interp_ran, vm_ran;
+		std::string expected = run_program<Interp_backend>(program, &interp_ran);
+		std::string got = run_program<Vm_backend>(program, &vm_ran, be);
+		if (got != expected || vm_ran != interp_ran) FAIL((expected + "--\n" + got).c_str());
+	}
+	PASS();
+}
+
+static void test_vm_jit_compiles_hot_loops() {
+	BEGIN_TEST("VM: only hot loops without calls are compiled");
+	const char* program =
+		"int s = 0\nint n = 0\nfn g() {\n\tn++\n}\n"
+		"for int i = 0; i < 5000; i++ {\n\ts += i % 7\n}\n"
+		"for int i = 0; i < 5000; i++ {\n\tg()\n}\n"
+		"for int i = 0; i < 10; i++ {\n\ts++\n}\n";
+	bool ran;
+	unsigned loops = 0;
+	auto count_loops = [&loops](Vm_backend* be) { loops = be->jit_loops(); };
+	std::string out = run_program<Vm_backend>(program, &ran, NULL, count_loops);
+	if (!ran || out != "s=15005\nn=5000\n") FAIL(out.c_str());
+	if (loops != (Vm_jit::supported() ? 1u : 0u)) FAIL("wrong loops compiled");
+
+	Vm_backend* be = new Vm_backend;
+	be->set_jit_threshold(0);
+	out = run_program<Vm_backend>(program, &ran, be, count_loops);
+	if (!ran || out != "s=15005\nn=5000\n" || loops != 0) FAIL(out.c_str());
+	PASS();
+}
+
+static void test_vm_long_expressions() {
+	BEGIN_TEST("VM: long expressions are fused all along");
+	const unsigned terms = Vm_backend::MAX_DEPTH - 1;
+	std::string program = "int a = 1", nested = "int b = ";
+	for (unsigned i = 0; i < terms; i++) {
+		program += " + 1";
+		nested += "(1 + ";
+	}
+	program += "\n" + nested + "1" + std::string(terms, ')') + "\n"
+		"int c = 0\nfor int i = 0; i < 10; i++ {\n\tif i > 2 && i < 8 || i == a - " +
+		std::to_string(terms - 8) + " {\n\t\tc += i\n\t}\n}\n";
+
+	bool interp_ran, vm_ran;
+	std::string listing;
+	auto list = [&listing](Vm_backend* be) { listing = be->disassemble(); };
+	std::string expected = run_program<Interp_backend>(program, &interp_ran);
+	std::string got = run_program<Vm_backend>(program, &vm_ran, NULL, list);
+	if (!interp_ran || !vm_ran || got != expected) FAIL((expected + "--\n" + got).c_str());
+
+	size_t fused = 0;
+	for (size_t at = listing.find("ADD_IK"); at != std::string::npos; at = listing.find("ADD_IK", at + 1))
+		fused++;
+	if (fused < terms) FAIL(listing.substr(0, 2000).c_str());
+	PASS();
+}
+
+static void test_vm_nesting_limit() {
+	BEGIN_TEST("VM: nesting past its limit is an error, not a crash");
+	std::string chain = "int a = 1", ifs, ends;
+	for (unsigned i = 0; i < Vm_backend::MAX_DEPTH; i++)
+		chain += " + 1";
+	for (unsigned i = 0; i <= Vm_backend::MAX_DEPTH; i++) {
+		ifs += "if a {\n";
+		ends += "}\n";
+	}
+	bool ran;
+	std::string out = run_program<Vm_backend>(chain + "\n", &ran);
+	if (!ran || out != "a=" + std::to_string(Vm_backend::MAX_DEPTH + 1) + "\n") FAIL(out.c_str());
+	out = run_program<Vm_backend>(chain + " + 1\n", &ran);
+	if (ran || out.find("Expression nesting exceeds the VM's limit") == std::string::npos)
+		FAIL(out.c_str());
+	out = run_program<Vm_backend>("int a = 1\n" + ifs + ends, &ran);
+	if (ran || out.find("Block nesting exceeds the VM's limit") == std::string::npos)
+		FAIL(out.c_str());
+	PASS();
+}
+
+// ==== C BACKEND TESTS ====
+
+/*
+ * Translate content to C, or return "" if it did not parse cleanly, with
+ * its diagnostics added to diagnostics if given.
+ */
+static std::string emit_program(const std::string& content, std::string* diagnostics = NULL) {
+	std::string path = write_temp(content);
+	Diagnostic_buffer buffer;
+	Diagnostic_buffer* outer = Diagnostic_buffer::capture(&buffer);
+	std::string out;
+	{
+		C_backend* be = new C_backend;
+		Parser parser(path, be);
+		parser.parse();
+		if (buffer.diagnostics().empty())
+			out = be->emit();
+	}
+	Diagnostic_buffer::capture(outer);
+
+	for (auto d = buffer.diagnostics().begin(); diagnostics && d != buffer.diagnostics().end(); ++d)
+		*diagnostics += d->message + "\n";
+	return out;
+}
+
+/*
+ * Build content natively through the system C compiler and run it.
+ * Returns what it printed, as run_program() lists the variables, and
+ * sets status to its exit status, or -1 if it did not build.
+ */
+static std::string run_native(const std::string& content, int* status) {
+	const char* source = "rin_test_parser_tmp.c";
+	const char* binary = "./rin_test_parser_tmp.bin";
+	std::ofstream(source, std::ios::trunc) << emit_program(content);
+
+	*status = -1;
+	std::string out;
+	std::string build = std::string("cc -std=c99 -O2 -o ") + binary + " " + source + " -lm";
+	if (system(build.c_str()) == 0) {
+		FILE* pipe = popen((std::string(binary) + " 2>/dev/null").c_str(), "r");
+		char line[256];
+		while (fgets(line, sizeof(line), pipe)) {
+			std::string text(line);
+			size_t eq = text.find(" = ");
+			out += (eq == std::string::npos) ? text : text.replace(eq, 3, "=");
+		}
+		int raw = pclose(pipe);
+		*status = WIFEXITED(raw) ? WEXITSTATUS(raw) : -1;
+	}
+	std::remove(source);
+	std::remove(binary);
+	return out;
+}
+
+static void test_c_backend_types() {
+	BEGIN_TEST("C backend: variables get the C type of what they hold");
+	std::string c = emit_program(
+		"int s = 0\nfloat x = 1.0\nvar m = 1\nvar k = 2\n"
+		"fn half(v) {\n\tx = v / 2.0\n}\n"
+		"for int i = 0; i < 10; i++ {\n\ts += i * 2\n\thalf(x)\n\tm = m + x\n}\n");
+	const char* decls[] = { "static int64_t g_s;", "static double g_x;", "static rin_value g_m;",
+				"static int64_t g_k;", "int64_t fn_half(double v)", "int main(void)" };
+	for (size_t i = 0; i < sizeof(decls) / sizeof(decls[0]); i++) {
+		if (c.find(decls[i]) == std::string::npos) FAIL(decls[i]);
+	}
+	if (c.find("rin_mul(g_i, 2)") == std::string::npos) FAIL("integer multiply not wrapped");
+	PASS();
+}
+
+static void test_c_backend_locations() {
+	BEGIN_TEST("C backend: runtime errors are located as the interpreter locates them");
+	std::string c = emit_program("int d = 0\nint q = 1 / d\n");
+	if (c.find(":1:11\")") == std::string::npos) FAIL(c.c_str());
+	PASS();
+}
+
+static void test_c_backend_nesting_limit() {
+	BEGIN_TEST("C backend: nesting past its limit is an error, not a crash");
+	std::string chain = "float a = 0.5", ifs, ends;
+	for (unsigned i = 0; i < C_backend::MAX_DEPTH; i++)
+		chain += " + 1";
+	for (unsigned i = 0; i <= C_backend::MAX_DEPTH; i++) {
+		ifs += "if a {\n";
+		ends += "}\n";
+	}
+	std::string errors;
+	std::string c = emit_program(chain + "\n", &errors);
+	if (c.find("static double g_a;") == std::string::npos) FAIL(errors.c_str());
+	c = emit_program(chain + " + 1\n", &errors);
+	if (!c.empty() || errors.find("Expression nesting exceeds the C backend's limit") == std::string::npos)
+		FAIL(errors.c_str());
+	c = emit_program("int a = 1\n" + ifs + ends, &errors);
+	if (!c.empty() || errors.find("Block nesting exceeds the C backend's limit") == std::string::npos)
+		FAIL(errors.c_str());
+	PASS();
+}
+
+static const char* NATIVE_PROGRAMS[] = {
+	// Locals named as C keywords, macros and prelude names keep out of their way.
+	"int r = 0\nfn f(double, stdout, rin_add, NAN) {\n\tint int64_t = double * stdout\n"
+	"\tr = int64_t + rin_add - NAN\n}\nf(3, 4, 5, 6)\n",
+	"var s = 0\nint n = 0\nfn sign(k) {\n\tn++\n\tif k < 0 {\n\t\ts = -1\n\t\treturn\n"
+	"\t} else if k > 0 {\n\t\ts = s + 1.5\n\t\treturn 7\n\t}\n\ts = s * 2\n}\n"
+	"sign(-4)\nsign(0)\nsign(4)\nsign(0)\n",
+	"int m = -9223372036854775807 - 1\nint n = m - 1\nint q = m / -1\nint r = m % -1\n"
+	"int l = 1 << 65\nfloat inf = 1.0 / 0.0\nfloat ninf = -inf\nfloat tiny = 0.1 + 0.2\n",
+	// A declaration holds integer 0 until it is assigned, whatever the variable's type.
+	"float x\nint q = 7 / (x + 2)\nx = 1.5\nfloat z = z + 1.5\nfloat y = 2.5\n",
+};
+
+static void test_c_backend_matches_interpreter() {
+	BEGIN_TEST("C backend: native builds run as the interpreter does");
+	if (system("cc --version >/dev/null 2>&1") != 0) {
+		printf("(no C compiler) ");
+		PASS();
+		return;
+	}
+
+	size_t vm = sizeof(VM_PROGRAMS) / sizeof(VM_PROGRAMS[0]);
+	size_t jit = sizeof(JIT_PROGRAMS) / sizeof(JIT_PROGRAMS[0]);
+	size_t native = sizeof(NATIVE_PROGRAMS) / sizeof(NATIVE_PROGRAMS[0]);
+	for (size_t i = 0; i < vm + jit + native; i++) {
+		const char* program = (i < vm) ? VM_PROGRAMS[i] :
+			(i < vm + jit) ? JIT_PROGRAMS[i - vm] : NATIVE_PROGRAMS[i - vm - jit];
+
+		// A program stopped by an error prints nothing.
+		bool ran;
+		int status;
+		std::string expected = run_program<Interp_backend>(program, &ran);
+		std::string got = run_native(program, &status);
+		if (status != (ran ? 0 : 1) || (ran && got != expected))
+			FAIL((std::string(program) + "--\n" + expected + "--\n" + got).c_str());
+	}
+	PASS();
+}
+
+// ==== LITERAL VALUE TESTS ====
+
+// Literals built outside a parser live here until the tests exit.
+static Arena literal_arena;
+
+static Float_expression* float_literal(const char* text) {
+	Location loc;
+	return static_cast<Float_expression*>
+		(Expression::make_float(&literal_arena, Source_span(text, strlen(text)), loc));
+}
+
+static Integer_expression* int_literal(const char* text) {
+	Location loc;
+	return static_cast<Integer_expression*>
+		(Expression::make_integer(&literal_arena, Source_span(text, strlen(text)), loc));
+}
+
+static void test_float_literal_native() {
+	BEGIN_TEST("Float literals held exactly use a double");
+	const char* texts[] = { "1.5", "1.5f", "12f", "10.0f", "0.25", "0.0" };
+	double values[]     = {  1.5,   1.5,    12.0,  10.0,    0.25,   0.0  };
+	for (int i = 0; i < 6; i++) {
+		Float_expression* e = float_literal(texts[i]);
+		bool ok = e->is_native() && e->native_value() == values[i];
+		if (!ok) FAIL(texts[i]);
+	}
+	PASS();
+}
+
+static void test_float_literal_mpfr_fallback() {
+	BEGIN_TEST("Inexact float literals fall back to mpfr");
+	const char* texts[] = { "0.1", "3.14f", "9007199254740993.0" };
+	for (int i = 0; i < 3; i++) {
+		Float_expression* e = float_literal(texts[i]);
+		bool ok = !e->is_native();
+		if (ok) {
+			mpfr_t want;
+			std::string digits(texts[i]);
+			if (digits.back() == 'f') digits.pop_back();
+			mpfr_init_set_str(want, digits.c_str(), 10, MPFR_RNDN);
+			ok = mpfr_cmp(*e->value(), want) == 0;
+			mpfr_clear(want);
+		}
+		if (!ok) FAIL(texts[i]);
+	}
+	PASS();
+}
+
+static void test_integer_literal_native() {
+	BEGIN_TEST("Integer literals fitting int64_t stay native");
+	Integer_expression* a = int_literal("42");
+	Integer_expression* b = int_literal("0x7fffffffffffffff");
+	Integer_expression* c = int_literal("9223372036854775808");
+	Integer_expression* d = int_literal("0xFF");
+	bool ok = a->is_native() && a->native_value() == 42
+		&& b->is_native() && b->native_value() == INT64_MAX
+		&& !c->is_native() && mpfr_cmp_d(*c->value(), 9223372036854775808.0) == 0
+		&& d->is_native() && d->native_value() == 255;
+	if (!ok) FAIL("native/mpfr split mismatch");
+	PASS();
+}
+
+// ==== SYMBOL TESTS ====
+
+static void test_scope_lookup_by_symbol() {
+	BEGIN_TEST("Nested scopes resolve interned symbols");
+	Arena arena;
+	Scope outer(&arena);
+	Scope inner(&arena, &outer);
+	Symbol x = intern("x");
+	Symbol y = intern(std::string("y"));
+	Named_object* ox = outer.define_obj(x, Location());
+	Named_object* iy = inner.define_obj(y, Location());
+	if (intern("x", 1) != x || x == y) FAIL("interning is not stable");
+	if (inner.lookup(x) != ox || inner.lookup(y) != iy)
+		FAIL("inner scope lookup mismatch");
+	inner.leave();
+	if (outer.lookup(y) != NULL) FAIL("outer scope sees inner symbol");
+	if (ox->identifier() != "x" || ox->symbol() != x)
+		FAIL("named object lost its identifier");
+	PASS();
+}
+
+static void test_deep_scopes_unwind() {
+	BEGIN_TEST("Leaving deep scopes restores outer bindings");
+	Test_backend be;
+	Symbol sym[64];
+	for (int i = 0; i < 64; i++)
+		sym[i] = intern("depth_" + std::to_string(i));
+
+	Named_object* root = be.current_scope()->define_obj(sym[0], Location());
+	for (int i = 1; i < 64; i++) {
+		be.enter_scope();
+		be.current_scope()->define_obj(sym[i], Location());
+	}
+	if (be.current_scope()->lookup(sym[0]) != root) FAIL("outer binding lost");
+	if (be.current_scope()->lookup(sym[63]) == NULL) FAIL("inner binding lost");
+
+	for (int i = 63; i > 0; i--) {
+		be.leave_scope();
+		if (be.current_scope()->lookup(sym[i]) != NULL)
+			FAIL("binding survived its scope");
+	}
+	if (be.current_scope()->lookup(sym[0]) != root) FAIL("root binding lost");
+	PASS();
+}
+
+// ==== ARENA TESTS ====
+
+static int arena_destroyed = 0;
+
+struct Arena_probe {
+	~Arena_probe() { arena_destroyed++; }
+	double value = 0;
+};
+
+static void test_arena_alignment_and_clear() {
+	BEGIN_TEST("Arena aligns objects and runs destructors on clear");
+	Arena arena;
+	arena_destroyed = 0;
+	for (int i = 0; i < 10000; i++) {
+		arena.allocate(1, 1);
+		Arena_probe* p = arena.make<Arena_probe>();
+		if ((uintptr_t)p % alignof(Arena_probe) != 0) FAIL("misaligned object");
+	}
+	void* big = arena.allocate(256 * 1024, 16);
+	if ((uintptr_t)big % 16 != 0) FAIL("misaligned large block");
+	if (arena.bytes_allocated() < 256 * 1024) FAIL("bytes not counted");
+	arena.clear();
+	if (arena_destroyed != 10000) FAIL("destructors not run");
+	if (arena.bytes_allocated() != 0) FAIL("clear kept bytes");
+	PASS();
+}
+
+static void test_arena_holds_parse_tree() {
+	BEGIN_TEST("Parse trees live in the backend arena");
+	std::string path = write_temp("float a = 0.1 + 2\nfloat b = a * 3.14\n");
+	Test_backend* be = new Test_backend;
+	size_t before = be->arena()->bytes_allocated();
+	Parser parser(path, be);
+	parser.parse();
+	if (be->had_error()) FAIL("parse error");
+	if (be->arena()->bytes_allocated() <= before) FAIL("nothing allocated in arena");
+	PASS();
+}
+
 // ==== ENTRY POINT ====
 
 typedef void (*TestFn)();
@@ -790,6 +2025,44 @@ int main() {
 		test_mixed_int_and_float, test_semicolons_multiple_on_line,
 		test_crlf_with_functions, test_crlf_with_else_if,
 		test_nested_function_scopes, test_expression_many_operators,
+		test_expression_precedence_shape, test_expression_long_chain,
+		test_expression_missing_operands, test_malformed_expression_errors,
+		test_flat_ast_post_order, test_flat_ast_built_by_parser,
+		test_flat_ast_lvalue_error,
+		// Nesting
+		test_deep_nesting, test_nesting_limit, test_stray_close_brace,
+		// Parallel functions
+		test_parallel_functions_in_order, test_parallel_functions_diagnostics,
+		test_parallel_functions_errors,
+		test_parallel_functions_counts,
+		// Compilation contexts
+		test_context_warning_level, test_concurrent_compilations,
+		// Null backend
+		test_null_backend_diagnostics, test_null_backend_sentinels,
+		// Pipelined scanning
+		test_pipelined_parse,
+		test_token_cache_parse,
+		// Interpreter
+		test_interp_arithmetic, test_interp_loops, test_interp_recursion,
+		test_interp_runtime_errors,
+		test_interp_stray_break,
+		test_interp_nesting_limit,
+		test_interp_enclosing_locals,
+		test_interp_stack_budget,
+		// Bytecode VM
+		test_vm_matches_interpreter, test_vm_typed_instructions, test_vm_deep_calls,
+		test_vm_superinstructions, test_vm_jit_matches_interpreter,
+		test_vm_jit_compiles_hot_loops, test_vm_long_expressions, test_vm_nesting_limit,
+		// C backend
+		test_c_backend_types, test_c_backend_locations, test_c_backend_nesting_limit,
+		test_c_backend_matches_interpreter,
+		// Literal values
+		test_float_literal_native, test_float_literal_mpfr_fallback,
+		test_integer_literal_native,
+		// Symbols
+		test_scope_lookup_by_symbol, test_deep_scopes_unwind,
+		// Arena
+		test_arena_alignment_and_clear, test_arena_holds_parse_tree,
 	};
 
 	int count = sizeof(tests) / sizeof(tests[0]);
@@ -2,9 +2,16 @@
 #include <backend.hpp>
 #include <scanner.hpp>
 #include <diagnostic.hpp>
+#include <simd.hpp>
+#include <token-cache.hpp>
 #include <fstream>
 #include <cstdlib>
 #include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 class Bexpression {};
 class Bstatement  {};
@@ -448,6 +455,33 @@ static void test_peek_nth() {
 	PASS();
 }
 
+static void test_peek_ref_is_stable() {
+	BEGIN_TEST("peek_token reference survives further lookahead");
+	Scanner sc(write_temp("a b c d e f g"));
+	const Token& first = sc.peek_token();
+	const Token& last = sc.peek_nth_token(Scanner::LOOKAHEAD_CAPACITY - 2);
+	if (&first != &sc.peek_nth_token(0)) FAIL("peek returned a different slot");
+	if (first.string() != "a") FAIL("first token overwritten");
+	if (last.string() != "g") FAIL("expected g at the far end");
+	PASS();
+}
+
+static void test_lookahead_ring_wraps() {
+	BEGIN_TEST("Lookahead ring wraps in source order");
+	Scanner sc(write_temp("a b c d e f g h i j k l"));
+	std::string seen;
+	for (int i = 0; i < 12; i++) {
+		sc.peek_nth_token(3);
+		Token t = sc.next_token();
+		EXPECT_CLS(t, TOKEN_IDENT);
+		seen += t.string();
+	}
+	if (seen != "abcdefghijkl") FAIL("tokens out of order");
+	const Token& eof = sc.peek_nth_token(2);
+	EXPECT_CLS(eof, TOKEN_EOF);
+	PASS();
+}
+
 // ---- MULTI-TOKEN SEQUENCE TESTS ----
 
 static void test_full_var_decl_tokens() {
@@ -689,6 +723,579 @@ static void test_classification_as_string() {
 	PASS();
 }
 
+// ---- LEXEME CLASSIFICATION TESTS ----
+
+static void test_classify_predicates() {
+	BEGIN_TEST("Lexeme predicates: int/hex/float/ident");
+	if (!Scanner::is_int_literal("0") || !Scanner::is_int_literal("0042"))
+		FAIL("int literal rejected");
+	if (Scanner::is_int_literal("42f") || Scanner::is_int_literal("4 2"))
+		FAIL("non-int accepted as int");
+	if (!Scanner::is_hex_literal("0xFf09") || Scanner::is_hex_literal("0x"))
+		FAIL("hex literal misclassified");
+	if (Scanner::is_hex_literal("0X1F") || Scanner::is_hex_literal("00x1"))
+		FAIL("malformed hex accepted");
+	if (!Scanner::is_float_literal("1.5") || !Scanner::is_float_literal("1.5f")
+	    || !Scanner::is_float_literal("12f"))
+		FAIL("float literal rejected");
+	if (Scanner::is_float_literal("1.") || Scanner::is_float_literal("1.f")
+	    || Scanner::is_float_literal(".5") || Scanner::is_float_literal("1.5ff"))
+		FAIL("malformed float accepted");
+	if (!Scanner::is_valid_identifier("a_1") || !Scanner::is_valid_identifier("xF"))
+		FAIL("identifier rejected");
+	if (Scanner::is_valid_identifier("_a") || Scanner::is_valid_identifier("1a")
+	    || Scanner::is_valid_identifier("a.b") || Scanner::is_valid_identifier(""))
+		FAIL("malformed identifier accepted");
+	PASS();
+}
+
+static void test_classify_string_char_predicates() {
+	BEGIN_TEST("Lexeme predicates: string/char literal");
+	if (!Scanner::is_string_literal("\"hello world\"") || !Scanner::is_string_literal("\"\""))
+		FAIL("string literal rejected");
+	if (Scanner::is_string_literal("\"a+b\"") || Scanner::is_string_literal("\""))
+		FAIL("malformed string accepted");
+	if (!Scanner::is_char_literal("'a'") || Scanner::is_char_literal("'ab'")
+	    || Scanner::is_char_literal("'+'"))
+		FAIL("char literal misclassified");
+	PASS();
+}
+
+static void test_malformed_literals_invalid() {
+	BEGIN_TEST("Malformed literals: 0x 1. 12ff a$b -> INVALID");
+	Scanner sc(write_temp("0x 1. 12ff a$b"));
+	for (int i = 0; i < 4; i++) {
+		Token t = sc.next_token();
+		EXPECT_CLS(t, TOKEN_INVALID);
+	}
+	Token t = sc.next_token();
+	EXPECT_CLS(t, TOKEN_EOF);
+	PASS();
+}
+
+static void test_word_ends_at_operator() {
+	BEGIN_TEST("Literal ends at operator: 0x1F+2.5f;");
+	Scanner sc(write_temp("0x1F+2.5f;"));
+	Token t1 = sc.next_token();
+	EXPECT_CLS(t1, TOKEN_INTEGER);
+	if (t1.string() != "0x1F") FAIL("hex text mismatch");
+	Token t2 = sc.next_token(); EXPECT_OP(t2, OPER_ADD);
+	Token t3 = sc.next_token();
+	EXPECT_CLS(t3, TOKEN_FLOAT);
+	if (t3.string() != "2.5f") FAIL("float text mismatch");
+	Token t4 = sc.next_token(); EXPECT_OP(t4, OPER_SEMICOLON);
+	PASS();
+}
+
+static void test_rid_lookup_table() {
+	BEGIN_TEST("rid_lookup: every keyword, near misses");
+	const char* words[] = {
+		"float", "int", "bool", "string", "var", "for", "if", "else",
+		"while", "true", "false", "fn", "return", "break", "continue",
+		"switch"
+	};
+	for (const char* w : words) {
+		RID rid = rid_lookup(w, strlen(w));
+		if (rid == RID_INVALID) FAIL("keyword not found");
+		if (rid_as_string(rid) != std::string(w) + " keyword")
+			FAIL("keyword maps to wrong RID");
+	}
+	const char* misses[] = { "", "f", "flat", "floats", "If", "continues", "fi", "whale" };
+	for (const char* w : misses)
+		if (rid_lookup(w, strlen(w)) != RID_INVALID) FAIL("non-keyword found");
+	PASS();
+}
+
+static void test_op_lookup_table() {
+	BEGIN_TEST("op_lookup: 1/2-char operators, near misses");
+	if (op_lookup("<<", 2) != OPER_LSHIFT || op_lookup("<", 1) != OPER_LSS)
+		FAIL("shift/less lookup");
+	if (op_lookup("/=", 2) != OPER_QUO_ASSIGN || op_lookup(",", 1) != OPER_COMMA)
+		FAIL("assign/comma lookup");
+	if (op_lookup("<>", 2) != OPER_ILLEGAL || op_lookup("//", 2) != OPER_ILLEGAL
+	    || op_lookup("=<", 2) != OPER_ILLEGAL || op_lookup(".", 1) != OPER_ILLEGAL
+	    || op_lookup("<<=", 3) != OPER_ILLEGAL || op_lookup("", 0) != OPER_ILLEGAL)
+		FAIL("non-operator found");
+	for (int c = 0; c < 256; c++) {
+		char ch = (char)c;
+		RIN_OPERATOR op = op_lookup(&ch, 1);
+		if (op != OPER_ILLEGAL && operator_name(op) != std::string("'") + ch + "' operator")
+			FAIL("single-char operator maps to wrong name");
+	}
+	PASS();
+}
+
+// ---- TOKEN REPRESENTATION TESTS ----
+
+static void test_token_text_is_view() {
+	BEGIN_TEST("Token text is a view into the source buffer");
+	File* f = new File(write_temp("float abc = 12"));
+	Scanner sc(f);
+	sc.next_token();
+	Token t = sc.next_token();
+	EXPECT_CLS(t, TOKEN_IDENT);
+	if (t.text().data() != f->begin() + 6 || t.text().size() != 3)
+		FAIL("identifier text does not point into the buffer");
+	if (t.offset() != 6 || t.length() != 3 || t.file() != f->id())
+		FAIL("offset/length/file mismatch");
+	if (t.identifier() != "abc") FAIL("identifier mismatch");
+	PASS();
+}
+
+static void test_token_location_from_span() {
+	BEGIN_TEST("Token location is resolved after the token");
+	std::string path = write_temp("x\n  yy + 42");
+	Scanner sc(path);
+	sc.next_token(); // x
+	Token eol = sc.next_token();
+	EXPECT_CLS(eol, TOKEN_EOL);
+	if (eol.location().line() != 1 || eol.location().column() != 0)
+		FAIL("EOL location mismatch");
+	Token t = sc.next_token();
+	Location loc = t.location();
+	if (loc.filename() != path) FAIL("filename mismatch");
+	if (loc.line() != 1 || loc.column() != 4 || loc.offset != 6)
+		FAIL("identifier location mismatch");
+	sc.next_token(); // +
+	Token n = sc.next_token();
+	EXPECT_CLS(n, TOKEN_INTEGER);
+	if (n.string() != "42") FAIL("integer text mismatch");
+	PASS();
+}
+
+static void test_token_copies_are_independent() {
+	BEGIN_TEST("Copied and reassigned tokens keep their values");
+	Scanner sc(write_temp("1.5 0x10 name"));
+	Token a = sc.next_token();
+	Token b = sc.next_token();
+	Token c = a;
+	a = sc.next_token();
+	EXPECT_CLS(c, TOKEN_FLOAT);
+	if (c.string() != "1.5") FAIL("float copy mismatch");
+	EXPECT_CLS(b, TOKEN_INTEGER);
+	if (b.string() != "0x10") FAIL("hex text mismatch");
+	if (a.identifier() != "name") FAIL("reassigned identifier mismatch");
+	PASS();
+}
+
+static void test_identifiers_are_interned() {
+	BEGIN_TEST("Equal identifiers share one interned symbol");
+	Symbol first, again, other;
+	{
+		Scanner sc(write_temp("alpha beta alpha"));
+		first = sc.next_token().symbol();
+		other = sc.next_token().symbol();
+		again = sc.next_token().symbol();
+	}
+	if (first == NO_SYMBOL || first != again) FAIL("same name, different symbol");
+	if (first == other) FAIL("different names share a symbol");
+	if (symbol_name(first) != "alpha") FAIL("name outlives its file");
+	PASS();
+}
+
+// ---- SOURCE BUFFER TESTS ----
+
+static void test_regular_file_is_mapped() {
+	BEGIN_TEST("Regular file source is memory-mapped");
+	File f(write_temp("float x"));
+	if (!f.is_open()) FAIL("file not open");
+	if (!f.is_mapped()) FAIL("expected mmap'd buffer");
+	if (f.end() - f.begin() != 7) FAIL("buffer size mismatch");
+	if (memcmp(f.begin(), "float x", 7) != 0) FAIL("buffer content mismatch");
+	PASS();
+}
+
+static void test_missing_file_not_open() {
+	BEGIN_TEST("Missing file source is not open");
+	Scanner sc("rin_sc_test_does_not_exist.rin");
+	if (sc.has_next()) FAIL("missing file should have no tokens");
+	PASS();
+}
+
+static void test_oversized_file_not_open() {
+	BEGIN_TEST("Source over 4 GiB is reported and not opened");
+	std::string path = "rin_sc_test_oversized.rin";
+	std::remove(path.c_str());
+	// A sparse file takes no space on disk.
+	int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) FAIL("cannot create file");
+	bool sized = ftruncate(fd, (off_t)UINT32_MAX + 2) == 0;
+	close(fd);
+
+	Diagnostic_buffer buffer;
+	Diagnostic_buffer* outer = Diagnostic_buffer::capture(&buffer);
+	File f(path);
+	Diagnostic_buffer::capture(outer);
+	std::remove(path.c_str());
+
+	if (!sized) FAIL("cannot size file");
+	if (f.is_open()) FAIL("oversized file opened");
+	if (buffer.diagnostics().size() != 1
+	    || buffer.diagnostics()[0].message.find("too large") == std::string::npos)
+		FAIL("oversized file not reported");
+	PASS();
+}
+
+static void fifo_timeout(int) {}
+
+static void test_fifo_source_fallback() {
+	BEGIN_TEST("FIFO source falls back to stream read");
+	std::string path = "rin_sc_test_fifo.rin";
+	std::remove(path.c_str());
+	if (mkfifo(path.c_str(), 0600) != 0) FAIL("mkfifo failed");
+
+	// The writer blocks opening its end until the File opens the read end
+	// exactly once; either side gives up after a few seconds.
+	pid_t writer = fork();
+	if (writer == 0) {
+		alarm(5);
+		int fd = open(path.c_str(), O_WRONLY);
+		if (fd < 0) _exit(1);
+		const char text[] = "x + 42\n";
+		bool ok = write(fd, text, sizeof(text) - 1) == (ssize_t) (sizeof(text) - 1);
+		close(fd);
+		_exit(ok ? 0 : 1);
+	}
+
+	struct sigaction timeout, saved;
+	memset(&timeout, 0, sizeof(timeout));
+	timeout.sa_handler = fifo_timeout;
+	sigaction(SIGALRM, &timeout, &saved);
+	alarm(5);
+	File* f = new File(path);
+	alarm(0);
+	sigaction(SIGALRM, &saved, NULL);
+
+	int status = 0;
+	waitpid(writer, &status, 0);
+	std::remove(path.c_str());
+
+	if (!f->is_open()) { delete f; FAIL("timed out opening the FIFO"); }
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) { delete f; FAIL("FIFO writer failed"); }
+	bool mapped = f->is_mapped();
+	Scanner sc(f);
+	Token t1 = sc.next_token();
+	Token t2 = sc.next_token();
+	Token t3 = sc.next_token();
+
+	if (mapped) FAIL("FIFO should not be mapped");
+	EXPECT_CLS(t1, TOKEN_IDENT);
+	EXPECT_OP(t2, OPER_ADD);
+	EXPECT_CLS(t3, TOKEN_INTEGER);
+	PASS();
+}
+
+static void test_comment_keeps_location() {
+	BEGIN_TEST("Block comment spanning lines updates location");
+	Scanner sc(write_temp("/* a\nb\n */ x"));
+	Token t = sc.next_token();
+	EXPECT_CLS(t, TOKEN_IDENT);
+	if (t.location().line() != 2 || t.location().column() != 5)
+		FAIL("location mismatch after comment");
+	PASS();
+}
+
+static void test_line_table_long_lines() {
+	BEGIN_TEST("Line table resolves lines longer than a SIMD block");
+	std::string src = "aaaaaaaaaaaaaaa\nbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbb\n\nc";
+	Scanner sc(write_temp(src));
+	Token a = sc.next_token();
+	sc.next_token(); // EOL
+	Token b = sc.next_token();
+	sc.next_token(); // EOL
+	sc.next_token(); // EOL
+	Token c = sc.next_token();
+	if (a.location().line() != 0 || a.location().column() != 15)
+		FAIL("first line mismatch");
+	if (b.location().line() != 1 || b.location().column() != 35)
+		FAIL("second line mismatch");
+	if (c.location().line() != 3 || c.location().column() != 1)
+		FAIL("last line mismatch");
+	PASS();
+}
+
+static void test_location_outlives_file() {
+	BEGIN_TEST("Location still resolves after its file is closed, while pinned");
+	std::string path = write_temp("x\n y");
+	Location loc;
+	Source_pin* pin;
+	{
+		Scanner sc(path);
+		sc.next_token(); // x
+		sc.next_token(); // EOL
+		loc = sc.next_token().location();
+		pin = new Source_pin(loc.source);
+	}
+	if (sizeof(Location) != 8) FAIL("Location is not 8 bytes");
+	if (loc.filename() != path) FAIL("filename lost after close");
+	if (loc.line() != 1 || loc.column() != 2)
+		FAIL("line/column lost after close");
+
+	// The last user frees the line table; the filename stays.
+	delete pin;
+	if (loc.filename() != path) FAIL("filename lost after unpin");
+	if (loc.line() != -1 || loc.column() != -1) FAIL("line table kept after unpin");
+	if (File::unknown_location().line() != -1) FAIL("unknown line mismatch");
+	PASS();
+}
+
+// ---- SIMD SCANNING TESTS ----
+
+static const Scan_isa all_isas[] = { SCAN_SCALAR, SCAN_SSE2, SCAN_AVX2 };
+
+static void test_simd_scans_agree() {
+	BEGIN_TEST("Every scan variant finds the same bytes as scalar");
+	Scan_isa original = scan_isa();
+	const char alphabet[] = " \t*/\nab";
+	unsigned seed = 12345;
+	for (int round = 0; round < 200; round++) {
+		std::string buf;
+		int len = round % 97;
+		for (int i = 0; i < len; i++) {
+			seed = seed * 1103515245 + 12345;
+			// Favour long runs of one byte, like indentation and comments.
+			char c = alphabet[(seed >> 16) % 7];
+			buf.append(1 + (seed >> 8) % 24, c);
+		}
+		const char* b = buf.data();
+		const char* e = b + buf.size();
+
+		scan_select_isa(SCAN_SCALAR);
+		const char* blanks = scan_blanks(b, e);
+		const char* nl = scan_byte(b, e, '\n');
+		const char* close = scan_block_comment_end(b, e);
+		std::vector<uint32_t> lines;
+		scan_line_starts(b, buf.size(), lines);
+
+		for (Scan_isa isa : all_isas) {
+			if (!scan_select_isa(isa))
+				continue;
+			std::vector<uint32_t> got;
+			scan_line_starts(b, buf.size(), got);
+			if (scan_blanks(b, e) != blanks || scan_byte(b, e, '\n') != nl ||
+			    scan_block_comment_end(b, e) != close || got != lines) {
+				scan_select_isa(original);
+				FAIL("variant disagrees with scalar");
+			}
+		}
+	}
+	scan_select_isa(original);
+	PASS();
+}
+
+static void test_simd_tokens_agree() {
+	BEGIN_TEST("Scanner yields identical tokens with every scan variant");
+	std::string path = write_temp(
+		"/* header header header header header header header\n"
+		" * header header header header header header ** / *\n"
+		" */\n"
+		"\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\tx\n"
+		"                                                  y = 1 // trailing trailing trailing\n"
+		"/**/z/*unterminated comment that runs to the end of the file");
+	Scan_isa original = scan_isa();
+
+	scan_select_isa(SCAN_SCALAR);
+	std::vector<std::string> want;
+	{
+		Scanner sc(path);
+		while (sc.has_next()) {
+			Token t = sc.next_token();
+			Location l = t.location();
+			want.push_back(t.string() + "@" + std::to_string(l.line()) +
+				       ":" + std::to_string(l.column()));
+		}
+	}
+
+	for (Scan_isa isa : all_isas) {
+		if (!scan_select_isa(isa))
+			continue;
+		std::vector<std::string> got;
+		Scanner sc(path);
+		while (sc.has_next()) {
+			Token t = sc.next_token();
+			Location l = t.location();
+			got.push_back(t.string() + "@" + std::to_string(l.line()) +
+				      ":" + std::to_string(l.column()));
+		}
+		if (got != want) {
+			scan_select_isa(original);
+			FAIL("token stream differs between variants");
+		}
+	}
+	scan_select_isa(original);
+	if (want.size() < 6) FAIL("too few tokens scanned");
+	PASS();
+}
+
+// ---- PIPELINED SCANNING TESTS ----
+
+// Enough source to fill the pipeline's queue several times over.
+static std::string pipelined_source() {
+	std::string src;
+	for (int i = 0; i < 3000; i++) {
+		src += "x" + std::to_string(i) + " = (y + 2.5f) * 0x1F // note\n";
+		if (i % 500 == 7)
+			src += "if 1abc { ]\n/* { */\n";
+	}
+	return src + "z = (1";
+}
+
+/*
+ * Read the whole source, peeking and skipping lines along the way. With
+ * stop_after, the pipeline is stopped after that many tokens; with cache,
+ * tokens are replayed from it.
+ */
+static std::string read_all(const std::string& path, bool pipelined, int stop_after = -1,
+			    Token_cache* cache = NULL) {
+	Diagnostic_buffer buffer;
+	Diagnostic_buffer* outer = Diagnostic_buffer::capture(&buffer);
+	std::string out;
+	{
+		Scanner sc(path, cache);
+		if (pipelined)
+			sc.start_pipeline();
+		for (int n = 0; sc.has_next(); n++) {
+			if (n == stop_after)
+				sc.stop_pipeline();
+			if (n % 37 == 5)
+				out += "?" + sc.peek_nth_token(3).string();
+			if (n % 101 == 9) {
+				sc.skip_line();
+				out += "|";
+				continue;
+			}
+			Token t = sc.next_token();
+			out += " " + t.string() + "@" + std::to_string(t.location().offset)
+				+ ":" + std::to_string(t.location().line());
+		}
+		sc.consume_errors();
+		out += " #" + std::to_string(sc.tokens_scanned());
+	}
+	Diagnostic_buffer::capture(outer);
+	for (auto d = buffer.diagnostics().begin(); d != buffer.diagnostics().end(); ++d)
+		out += "\n" + std::to_string(d->location.offset) + ": " + d->message;
+	return out;
+}
+
+static void test_pipelined_tokens_agree() {
+	BEGIN_TEST("Pipelined scanner yields the same tokens and errors");
+	std::string path = write_temp(pipelined_source());
+	std::string want = read_all(path, false);
+	if (want.find("Unknown keyword 1abc") == std::string::npos) FAIL("no scan error");
+	if (want.find("Unmatched parenthesis") == std::string::npos) FAIL("no pair error");
+	for (int i = 0; i < 3; i++) {
+		if (read_all(path, true) != want) FAIL("pipelined scan differs");
+	}
+	PASS();
+}
+
+static void test_pipelined_stop_resumes() {
+	BEGIN_TEST("Stopping the pipeline resumes at the next token");
+	std::string path = write_temp(pipelined_source());
+	std::string want = read_all(path, false);
+	if (read_all(path, true, 0) != want) FAIL("stopped at once");
+	if (read_all(path, true, 1234) != want) FAIL("stopped midway");
+	if (read_all(path, true, 1 << 30) != want) FAIL("never stopped");
+	PASS();
+}
+
+// ---- TOKEN CACHE TESTS ----
+
+static const char* CACHE_DIR = "rin_sc_cache";
+
+// The entry cache holds for the source at path.
+static std::string cache_entry(const Token_cache& cache, const std::string& path) {
+	File f(path);
+	return cache.path(Token_cache::hash(f.begin(), f.end() - f.begin()));
+}
+
+static bool cache_hit(const Token_cache& cache, const std::string& path) {
+	File f(path);
+	size_t size = f.end() - f.begin();
+	Cached_tokens* tokens = cache.find(Token_cache::hash(f.begin(), size), size);
+	delete tokens;
+	return tokens != NULL;
+}
+
+static void test_token_cache_replays() {
+	BEGIN_TEST("Token cache replays the lexed tokens and errors");
+	mkdir(CACHE_DIR, 0755);
+	Token_cache cache(CACHE_DIR);
+	std::string path = write_temp(pipelined_source());
+	std::string want = read_all(path, false);
+	std::remove(cache_entry(cache, path).c_str());
+
+	if (read_all(path, false, -1, &cache) != want) FAIL("stored scan differs");
+	if (!cache_hit(cache, path)) FAIL("entry not stored");
+	if (read_all(path, false, -1, &cache) != want) FAIL("replayed scan differs");
+	if (read_all(path, true, -1, &cache) != want) FAIL("replay with pipeline differs");
+
+	// Skipping over replayed tokens lands where skipping the source does.
+	{
+		Scanner lexed(path);
+		Scanner replayed(path, &cache);
+		if (!replayed.is_replaying()) FAIL("not replaying");
+		lexed.peek_nth_token(2);
+		replayed.peek_nth_token(2);
+		lexed.skip_to(5000);
+		replayed.skip_to(5000);
+		while (lexed.has_next()) {
+			Token a = lexed.next_token();
+			Token b = replayed.next_token();
+			if (a.string() != b.string() || a.offset() != b.offset()) FAIL("skip differs");
+		}
+		if (replayed.has_next()) FAIL("replay runs long");
+		if (lexed.tokens_scanned() != replayed.tokens_scanned()) FAIL("count differs");
+	}
+	std::remove(cache_entry(cache, path).c_str());
+	PASS();
+}
+
+static void test_token_cache_invalidates() {
+	BEGIN_TEST("Token cache misses on new content, version or damage");
+	mkdir(CACHE_DIR, 0755);
+	Token_cache cache(CACHE_DIR);
+	std::string path = write_temp("x = 1\ny = x + 2\n");
+	read_all(path, false, -1, &cache);
+	std::string old_entry = cache_entry(cache, path);
+
+	// An edited source has an entry of its own.
+	{
+		std::ofstream out(path, std::ios::trunc | std::ios::binary);
+		out << "x = 1\nif y { z = 3 }\n";
+	}
+	if (cache_hit(cache, path)) FAIL("edited source hit");
+	std::string want = read_all(path, false);
+	if (read_all(path, false, -1, &cache) != want) FAIL("edited source differs");
+	if (!cache_hit(cache, path)) FAIL("edited source not stored");
+	std::string entry = cache_entry(cache, path);
+	if (entry == old_entry) FAIL("same entry for both");
+
+	// A byte changed in the header's version, then in the tokens.
+	const long where[] = { 8, -3 };
+	for (long at : where) {
+		{
+			std::fstream f(entry, std::ios::in | std::ios::out | std::ios::binary);
+			f.seekg(at, (at < 0) ? std::ios::end : std::ios::beg);
+			char c = f.get();
+			f.seekp(at, (at < 0) ? std::ios::end : std::ios::beg);
+			f.put(c ^ 0x5a);
+		}
+		if (cache_hit(cache, path)) FAIL("damaged entry hit");
+		if (read_all(path, false, -1, &cache) != want) FAIL("damaged entry used");
+		if (!cache_hit(cache, path)) FAIL("damaged entry not rewritten");
+	}
+
+	// Without a writable directory, sources are still scanned.
+	Token_cache missing("rin_sc_no_such_dir");
+	if (read_all(path, false, -1, &missing) != want) FAIL("unwritable cache differs");
+
+	std::remove(old_entry.c_str());
+	std::remove(entry.c_str());
+	rmdir(CACHE_DIR);
+	PASS();
+}
+
 // ---- ENTRY POINT ----
 
 typedef void (*TestFn)();
@@ -739,6 +1346,7 @@ int main() {
 		test_eol_token, test_eof_at_end, test_tabs_and_spaces, test_crlf_handling,
 		// Peek / lookahead
 		test_peek_does_not_consume, test_peek_nth,
+		test_peek_ref_is_stable, test_lookahead_ring_wraps,
 		// Multi-token sequences
 		test_full_var_decl_tokens, test_expression_tokens, test_function_decl_tokens,
 		test_is_semicolon,
@@ -751,6 +1359,23 @@ int main() {
 		test_nested_comment, test_integer_dot_method,
 		test_consume_errors_unmatched_paren, test_multiple_peek_same_token,
 		test_has_next_after_eof, test_classification_as_string,
+		// Lexeme classification
+		test_classify_predicates, test_classify_string_char_predicates,
+		test_malformed_literals_invalid, test_word_ends_at_operator,
+		test_rid_lookup_table, test_op_lookup_table,
+		// Token representation
+		test_token_text_is_view, test_token_location_from_span,
+		test_token_copies_are_independent, test_identifiers_are_interned,
+		// Source buffer
+		test_regular_file_is_mapped, test_missing_file_not_open, test_oversized_file_not_open,
+		test_fifo_source_fallback, test_comment_keeps_location,
+		test_line_table_long_lines, test_location_outlives_file,
+		// SIMD scanning
+		test_simd_scans_agree, test_simd_tokens_agree,
+		// Pipelined scanning
+		test_pipelined_tokens_agree, test_pipelined_stop_resumes,
+		// Token cache
+		test_token_cache_replays, test_token_cache_invalidates,
 	};
 
 	int count = sizeof(tests) / sizeof(tests[0]);
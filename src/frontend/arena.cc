@@ -0,0 +1,50 @@
+// arena.cc - Bump-pointer allocation for compilation-lifetime objects
+#include "arena.hpp"
+
+void* Arena::allocate(size_t size, size_t align)
+{
+        uintptr_t p = ((uintptr_t)this->cursor + align - 1) & ~(uintptr_t)(align - 1);
+        if (this->cursor == NULL || p + size > (uintptr_t)this->limit) {
+                size_t block_size = size + align;
+                if (block_size < BLOCK_SIZE)
+                        block_size = BLOCK_SIZE;
+                char* block = new char[block_size];
+                this->blocks.push_back(block);
+                this->cursor = block;
+                this->limit = block + block_size;
+                p = ((uintptr_t)block + align - 1) & ~(uintptr_t)(align - 1);
+        }
+
+        this->cursor = (char*)(p + size);
+        this->allocated += size;
+        return (void*)p;
+}
+
+void Arena::clear()
+{
+        for (auto itr = this->finalizers.rbegin(); itr != this->finalizers.rend(); ++itr)
+                itr->destroy(itr->obj);
+        this->finalizers.clear();
+
+        for (auto itr = this->blocks.begin(); itr != this->blocks.end(); ++itr)
+                delete[] *itr;
+        this->blocks.clear();
+
+        this->cursor = NULL;
+        this->limit = NULL;
+        this->allocated = 0;
+}
+
+void Arena::adopt(Arena* other)
+{
+        this->blocks.insert(this->blocks.end(), other->blocks.begin(), other->blocks.end());
+        this->finalizers.insert(this->finalizers.end(),
+                                other->finalizers.begin(), other->finalizers.end());
+        this->allocated += other->allocated;
+
+        other->blocks.clear();
+        other->finalizers.clear();
+        other->cursor = NULL;
+        other->limit = NULL;
+        other->allocated = 0;
+}
@@ -0,0 +1,75 @@
+// arena.hpp - Bump-pointer allocation for compilation-lifetime objects
+#ifndef RIN_ARENA_HPP
+#define RIN_ARENA_HPP
+
+#include <rin-system.hpp>
+
+/*
+ * An arena hands out memory from large blocks by bumping a pointer, and
+ * releases all of it at once when it is cleared or destroyed. Objects made
+ * in an arena are never deleted individually: AST nodes, scopes and named
+ * objects all live until the end of the compilation that owns the arena.
+ *
+ * Objects whose type is not trivially destructible (mpfr-holding literals,
+ * nodes holding a std::string or std::vector) have their destructor
+ * registered by make(); those destructors run, newest first, on clear().
+ */
+class Arena
+{
+public:
+        Arena() {}
+        ~Arena()
+        { this->clear(); }
+
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        // Return size bytes aligned to align, which must be a power of two.
+        void* allocate(size_t size, size_t align);
+
+        // Construct a T in the arena.
+        template<typename T, typename... Args>
+        T* make(Args&&... args)
+        {
+                void* mem = this->allocate(sizeof(T), alignof(T));
+                T* obj = ::new (mem) T(std::forward<Args>(args)...);
+                if (!std::is_trivially_destructible<T>::value)
+                        this->finalizers.push_back(Finalizer{ &Arena::destroy<T>, obj });
+                return obj;
+        }
+
+        // Run registered destructors and release every block.
+        void clear();
+
+        /*
+         * Take over every block and object of other, which is left empty.
+         * Adopted objects are destroyed as if they had just been made here.
+         */
+        void adopt(Arena* other);
+
+        // Bytes handed out since the arena was created or last cleared.
+        size_t bytes_allocated() const
+        { return this->allocated; }
+
+private:
+        struct Finalizer {
+                void (*destroy)(void*);
+                void* obj;
+        };
+
+        template<typename T>
+        static void destroy(void* obj)
+        { static_cast<T*>(obj)->~T(); }
+
+        // Blocks are at least this large; bigger requests get their own.
+        static const size_t BLOCK_SIZE = 64 * 1024;
+
+        std::vector<char*> blocks;
+        char* cursor = NULL;
+        char* limit = NULL;
+        size_t allocated = 0;
+
+        std::vector<Finalizer> finalizers;
+};
+
+#endif /* RIN_ARENA_HPP */
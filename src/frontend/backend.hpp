@@ -4,16 +4,19 @@
 
 /*
  * Memory Ownership Model:
- * - AST nodes (Expression, Statement) are allocated via factory methods (make_*)
- * - Compound nodes own their children and delete them in destructors
+ * - AST nodes (Expression, Statement), Scopes and Named_objects are made in
+ *   the Backend's Arena and live until the Backend is destroyed; they are
+ *   never deleted individually
  * - Backend types (Bexpression, Bstatement, Bvariable) are allocated by Backend
  *   methods and deleted by the scope or by callers
- * - Scopes own their Named_objects and Bstatements
- * - Future: consider std::unique_ptr for clearer ownership semantics (C++14)
+ * - Scopes own their Bstatements
  */
 
 #include <rin-system.hpp>
+#include "arena.hpp"
+#include "context.hpp"
 #include "operators.hpp"
+#include "symbols.hpp"
 
 #define RIN_ASSERT(EXPR)  BE_ASSERT(EXPR)
 #define RIN_UNREACHABLE() BE_UNREACHABLE()
@@ -21,6 +24,7 @@
 class Bexpression;
 class Bstatement;
 class Bvariable;
+class Flat_ast;
 
 /*
  * Implements deleting a statement. Otherwise, deleting an incomplete type
@@ -28,27 +32,73 @@ class Bvariable;
  */
 extern void delete_stmt(Bstatement* stmt);
 
-// A location represents a position in a file.
+/*
+ * A location represents a position in a file: the id its source was
+ * registered under (see File) and a byte offset into that source. Line,
+ * column and filename are not stored; they are resolved from the source's
+ * line table only when asked for, typically when a diagnostic is emitted.
+ * A source id of 0 refers to no file.
+ */
 struct Location {
-        int offset = 0;
-        int line = 0;
-        int column = 0;
-        std::string filename;
+        uint32_t source = 0;
+        uint32_t offset = 0;
+
+        // Zero-based line and column, or -1 for an unknown location.
+        int line() const;
+        int column() const;
+
+        const std::string& filename() const;
 };
 
+static_assert(sizeof(Location) == 8, "Location should stay two words");
+
 inline bool operator==(const Location& lhs, const Location& rhs)
 {
-        if (lhs.offset != rhs.offset)
-                return false;
-        if (lhs.line != rhs.line)
-                return false;
-        if (lhs.column != rhs.column)
-                return false;
-        if (lhs.filename != rhs.filename)
-                return false;
-        return true;
+        return lhs.source == rhs.source && lhs.offset == rhs.offset;
 }
 
+/*
+ * A read-only view of characters in a source buffer. This is a minimal
+ * stand-in for std::string_view, which is not available in C++14.
+ */
+class Source_span
+{
+public:
+        Source_span() {}
+        Source_span(const char* data, size_t size) : _data(data), _size(size) {}
+
+        const char* data() const
+        { return this->_data; }
+
+        size_t size() const
+        { return this->_size; }
+
+        bool empty() const
+        { return this->_size == 0; }
+
+        const char* begin() const
+        { return this->_data; }
+
+        const char* end() const
+        { return this->_data + this->_size; }
+
+        std::string str() const
+        { return std::string(this->_data, this->_size); }
+
+        bool operator==(const Source_span& other) const
+        {
+                return this->_size == other._size
+                        && std::equal(this->begin(), this->end(), other.begin());
+        }
+
+        bool operator!=(const Source_span& other) const
+        { return !(*this == other); }
+
+private:
+        const char* _data = NULL;
+        size_t _size = 0;
+};
+
 // Diagnostics.hpp
 extern void rin_error_at(const Location&, const char* fmt, ...);
 
@@ -56,18 +106,21 @@ extern void rin_error_at(const Location&, const char* fmt, ...);
 class Named_object
 {
 public:
-        Named_object(const std::string& ident, const Location& loc)
-                : _identifier(ident), _location(loc)
+        Named_object(Symbol sym, const Location& loc)
+                : _symbol(sym), _location(loc)
         {}
 
+        Symbol symbol() const
+        { return this->_symbol; }
+
         const std::string& identifier() const
-        { return this->_identifier; }
+        { return symbol_name(this->_symbol); }
 
         Location location() const
         { return this->_location; }
 
 private:
-        std::string _identifier;
+        Symbol      _symbol;
         Location    _location;
 };
 
@@ -76,6 +129,11 @@ private:
  * implemented, scopes can only be linear and nested (meaning no
  * two un-nested scopes can exist in parallel). Keeps track of
  * a series of statements and of variable definitions.
+ *
+ * A scope and all of its descendants share one Symbol_table, owned by
+ * the outermost scope, so names resolve in constant time however deep
+ * the nesting is. Definitions made in a scope stay visible until
+ * leave() unwinds them.
  */
 class Scope
 {
@@ -83,51 +141,53 @@ public:
         /*
          * Create a new scope that branches off of parent. Statements in
          * scope can reference variables defined by their ancestors.
-         * If parent is NULL, then the scope is the supercontext.
+         * If parent is NULL, then the scope is the supercontext. Named
+         * objects defined in the scope are made in arena.
          */
-        explicit Scope(Scope* parent = NULL)
-                : _parent(parent)
+        explicit Scope(Arena* arena, Scope* parent = NULL)
+                : _arena(arena), _parent(parent),
+                  _symbols((parent) ? parent->_symbols : new Symbol_table),
+                  _symbols_mark(_symbols->mark())
         {}
 
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
         ~Scope()
         {
-                // Delete all defined named objects
-                if (!this->ident_map.empty()) {
-                        for (auto itr = this->ident_map.begin(); itr != this->ident_map.end(); ++itr)
-                                delete itr->second;
-                }
-
                 if (!this->_statements.empty()) {
                         for (auto itr = this->_statements.begin(); itr != this->_statements.end(); ++itr)
                                 delete_stmt(*itr);
                 }
+
+                if (this->_parent == NULL)
+                        delete this->_symbols;
         }
 
         // List of statements contained within the scope.
         typedef std::vector<Bstatement*> Statement_list;
 
-        // Map of variables within the scope.
-        typedef std::unordered_map<std::string, Named_object*> Var_map;
+        // Variables defined within the scope, in order of definition.
+        typedef std::vector<Named_object*> Var_map;
 
         // Returns the scope's parent.
         Scope* parent()
         { return this->_parent; }
 
-        // Lookup a defined Named_object by its string. Returns NULL.
-        Named_object* lookup(const std::string& ident)
+        /*
+         * Lookup a defined Named_object by its symbol. Returns NULL.
+         * Resolves against every scope that has not been left yet, so
+         * this should be asked of the current scope.
+         */
+        Named_object* lookup(Symbol sym)
         {
-                auto itr = this->ident_map.find(ident);
-                if (itr != this->ident_map.end())
-                        return itr->second;
-                if (this->parent())
-                        return this->parent()->lookup(ident);
-                return NULL;
+                return this->_symbols->lookup(sym);
         }
 
-        // Test whether an identifier string has been defined.
-        bool is_defined(const std::string& ident)
+        // Test whether a symbol has been defined.
+        bool is_defined(Symbol sym)
         {
-                return (this->lookup(ident) != NULL);
+                return (this->lookup(sym) != NULL);
         }
 
         /*
@@ -135,23 +195,54 @@ public:
          * As long as statements are evaluated sequentially, then there is
          * no risk of a statement referencing an undefined object.
          */
-        Named_object* define_obj(const std::string& ident, const Location& loc)
+        Named_object* define_obj(Symbol sym, const Location& loc)
         {
-                if (this->is_defined(ident)) {
-                        rin_error_at(loc, "Redefinition of '%s'", ident.c_str());
+                if (this->is_defined(sym)) {
+                        rin_error_at(loc, "Redefinition of '%s'",
+                                     symbol_name(sym).c_str());
                         return NULL;
                 }
 
-                Named_object* obj = new Named_object(ident, loc);
-                this->ident_map[ident] = obj;
+                Named_object* obj = this->_arena->make<Named_object>(sym, loc);
+                this->_variables.push_back(obj);
+                this->_symbols->bind(sym, obj);
                 return obj;
         }
 
+        /*
+         * Make obj, which another backend defined, resolve in this scope
+         * without defining it here.
+         */
+        void import_obj(Named_object* obj)
+        { this->_symbols->bind(obj->symbol(), obj); }
+
+        /*
+         * Move the definitions and statements of other, the supercontext
+         * of a backend that is done with them, to the end of this one's.
+         */
+        void adopt(Scope* other)
+        {
+                for (auto itr = other->_variables.begin(); itr != other->_variables.end(); ++itr) {
+                        this->_variables.push_back(*itr);
+                        this->_symbols->bind((*itr)->symbol(), *itr);
+                }
+                this->_statements.insert(this->_statements.end(), other->_statements.begin(),
+                                         other->_statements.end());
+                other->_variables.clear();
+                other->_statements.clear();
+        }
+
         // Undefine an object.
-        void undefine_obj(const std::string* ident)
+        void undefine_obj(Symbol sym)
         {
-                RIN_ASSERT(ident);
-                this->ident_map[*ident] = NULL;
+                RIN_ASSERT(sym != NO_SYMBOL);
+                this->_symbols->bind(sym, NULL);
+        }
+
+        // Drop the scope's definitions from name resolution.
+        void leave()
+        {
+                this->_symbols->unwind(this->_symbols_mark);
         }
 
         // Return the number of statements.
@@ -164,7 +255,7 @@ public:
 
         // Return all variables.
         Var_map* variables()
-        { return &this->ident_map; }
+        { return &this->_variables; }
 
         // Inserts a statement into the statement list
         void push_statement(Bstatement* state)
@@ -189,8 +280,11 @@ public:
         }
 
 private:
+        Arena* _arena;
         Scope* _parent;
-        Var_map ident_map;
+        Symbol_table* _symbols;
+        size_t _symbols_mark;
+        Var_map _variables;
         Statement_list _statements;
 };
 
@@ -199,23 +293,49 @@ class Backend
 public:
         Backend()
         {
-                this->_supercontext = new Scope(NULL);
+                this->_supercontext = this->_arena.make<Scope>(&this->_arena);
                 this->_current_scope = this->_supercontext;
         }
 
         Backend(const Backend&) = delete;
         Backend& operator=(const Backend&) = delete;
 
-        virtual ~Backend()
-        {
-                if (this->_current_scope == this->_supercontext) {
-                        delete this->_current_scope;
-                        return;
-                }
+        // Scopes and AST nodes are released along with the arena.
+        virtual ~Backend() {}
 
-                delete this->_supercontext;
-                delete this->_current_scope;
-        }
+        // Return the arena AST nodes and scopes are made in.
+        Arena* arena()
+        { return &this->_arena; }
+
+        // Return the flat AST compound expressions are lowered through.
+        Flat_ast* flat_ast();
+
+        // Return the context the backend compiles in; its own by default.
+        Compilation_context* context()
+        { return this->_context; }
+
+        /*
+         * Compile in context, which must outlive the backend, or in the
+         * backend's own context if it is NULL.
+         */
+        void set_context(Compilation_context* context)
+        { this->_context = (context) ? context : &this->_own_context; }
+
+        /*
+         * Return a new, empty backend of the same kind to lower a top-level
+         * function on another thread, or NULL if every statement must be
+         * lowered by this backend, in order. See Parser::set_jobs().
+         */
+        virtual Backend* fork()
+        { return NULL; }
+
+        /*
+         * Take over what a fork made once it is done with. The parser moves
+         * the fork's top-level statements into this supercontext first, and
+         * deletes the fork after. Overrides must call this.
+         */
+        virtual void join(Backend* fork)
+        { this->_arena.adopt(&fork->_arena); }
 
         // Return the supercontext.
         Scope* supercontext()
@@ -231,7 +351,8 @@ public:
          */
         virtual Scope* enter_scope()
         {
-                this->_current_scope = new Scope(this->_current_scope);
+                this->_current_scope =
+                        this->_arena.make<Scope>(&this->_arena, this->_current_scope);
                 return this->_current_scope;
         }
 
@@ -241,12 +362,16 @@ public:
          */
         virtual Scope* leave_scope()
         {
+                this->_current_scope->leave();
                 this->_current_scope = this->_current_scope->parent();
                 return this->_current_scope;
         }
 
-        // Push a statement to the current scope
-        void push_statement(Bstatement* statement)
+        /*
+         * Push a statement to the current scope. Backends that keep their
+         * statements elsewhere, or not at all, override this.
+         */
+        virtual void push_statement(Bstatement* statement)
         {
                 RIN_ASSERT(this->_current_scope);
                 this->_current_scope->push_statement(statement);
@@ -290,6 +415,32 @@ public:
         // Return an expression which is a reference to an integer.
         virtual Bexpression* integer_expression(const mpfr_t* val, const Location&) = 0;
 
+        /*
+         * Fast paths for literals that a double or an int64_t holds exactly.
+         * By default these build an mpfr and defer to the functions above;
+         * backends that can build native constants directly override them.
+         */
+        virtual Bexpression* native_float_expression(double val, const Location& loc)
+        {
+                mpfr_t tmp;
+                mpfr_init_set_d(tmp, val, MPFR_RNDN);
+                Bexpression* ret = this->float_expression(&tmp, loc);
+                mpfr_clear(tmp);
+                return ret;
+        }
+
+        virtual Bexpression* native_integer_expression(int64_t val, const Location& loc)
+        {
+                mpfr_t tmp;
+                if (val >= LONG_MIN && val <= LONG_MAX)
+                        mpfr_init_set_si(tmp, val, MPFR_RNDN);
+                else
+                        mpfr_init_set_str(tmp, std::to_string(val).c_str(), 10, MPFR_RNDN);
+                Bexpression* ret = this->integer_expression(&tmp, loc);
+                mpfr_clear(tmp);
+                return ret;
+        }
+
         // Return a reference to a conditional expression
         virtual Bexpression* conditional_expression(Bexpression* cond, const Location&) = 0;
 
@@ -368,8 +519,15 @@ public:
         virtual Bstatement* continue_statement(const Location&) = 0;
 
 private:
+        Compilation_context  _own_context;
+        Compilation_context* _context = &_own_context;
+
+        Arena  _arena;
         Scope* _supercontext;
         Scope* _current_scope;
+
+        // Made in the arena on first use.
+        Flat_ast* _flat = NULL;
 };
 
 #endif // RIN_BACKEND_HPP
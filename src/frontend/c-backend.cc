@@ -0,0 +1,1678 @@
+// c-backend.cc - A backend that translates programs to C99 source
+#include "c-backend.hpp"
+#include "file.hpp"
+
+#include <algorithm>
+
+// What is known of a value before the program runs, and so its C type.
+enum C_type : uint8_t {
+        CTYPE_NONE,     // nothing yet
+        CTYPE_INT,      // int64_t
+        CTYPE_FLOAT,    // double
+        CTYPE_VALUE     // either, as a rin_value
+};
+
+static C_type widen(C_type a, C_type b)
+{
+        if (a == b || b == CTYPE_NONE)
+                return a;
+        return (a == CTYPE_NONE) ? b : CTYPE_VALUE;
+}
+
+/*
+ * A variable is a global of the C program, unless owner is a function, in
+ * which case it is a local of the C function.
+ */
+struct C_variable {
+        C_variable(Named_object* obj, Scope* scope) : obj(obj), scope(scope) {}
+
+        // NULL for a function's result.
+        Named_object* obj;
+
+        // The scope the variable was first seen in.
+        Scope* scope;
+
+        // The index of the function it belongs to, or 0 for a global.
+        uint32_t owner = 0;
+        C_type type = CTYPE_NONE;
+
+        // Its identifier in the C program.
+        std::string name;
+};
+
+/*
+ * The emitter writes nodes by recursion, so each records how deeply it
+ * nests, as in the interpreter. The backend reports code nested deeper
+ * than C_backend::MAX_DEPTH as it is built.
+ */
+struct C_expression {
+        enum Kind : uint8_t {
+                EXPR_CONSTANT,
+                EXPR_VARIABLE,
+                EXPR_UNARY,
+                EXPR_BINARY,
+                EXPR_CALL,
+                EXPR_INVALID
+        };
+
+        C_expression(Kind kind, const Location& loc, uint32_t depth = 0)
+                : kind(kind), location(loc), depth(depth)
+        {}
+
+        Kind kind;
+        Location location;
+        uint32_t depth;
+
+        // Worked out by infer_types(), operands first.
+        C_type type = CTYPE_NONE;
+};
+
+struct C_constant : C_expression {
+        C_constant(Interp_value value, const Location& loc)
+                : C_expression(EXPR_CONSTANT, loc), value(value)
+        {}
+
+        Interp_value value;
+};
+
+struct C_reference : C_expression {
+        C_reference(C_variable* var, const Location& loc)
+                : C_expression(EXPR_VARIABLE, loc), var(var)
+        {}
+
+        C_variable* var;
+};
+
+// A unary operation has no right operand.
+struct C_operation : C_expression {
+        C_operation(RIN_OPERATOR op, C_expression* left, C_expression* right,
+                    const Location& loc)
+                : C_expression((right) ? EXPR_BINARY : EXPR_UNARY, loc,
+                               (right) ? std::max(left->depth, right->depth) + 1
+                                       : left->depth + 1),
+                  op(op), left(left), right(right)
+        {}
+
+        RIN_OPERATOR op;
+        C_expression* left;
+        C_expression* right;
+};
+
+struct C_call : C_expression {
+        C_call(const std::string& name, const Location& loc)
+                : C_expression(EXPR_CALL, loc), name(name)
+        {}
+
+        std::string name;
+        std::vector<C_expression*> args;
+
+        // Resolved once the program is parsed; NULL if there is none to call.
+        C_function* function = NULL;
+};
+
+struct C_statement {
+        enum Kind : uint8_t {
+                STMT_DECLARE,
+                STMT_ASSIGN,
+                STMT_STEP,
+                STMT_EXPRESSION,
+                STMT_IF,
+                STMT_FOR,
+                STMT_COMPOUND,
+                STMT_RETURN,
+                STMT_BREAK,
+                STMT_CONTINUE,
+                STMT_NOTHING,
+                STMT_INVALID
+        };
+
+        C_statement(Kind kind, const Location& loc, uint32_t depth = 0)
+                : kind(kind), location(loc), depth(depth)
+        {}
+
+        Kind kind;
+        Location location;
+        uint32_t depth;
+};
+
+// Declarations, assignments and steps of a variable.
+struct C_store : C_statement {
+        C_store(Kind kind, C_variable* var, C_expression* value, int step,
+                const Location& loc)
+                : C_statement(kind, loc, (value) ? value->depth : 0),
+                  var(var), value(value), step(step)
+        {}
+
+        C_variable* var;
+        C_expression* value;
+        int step;
+};
+
+// Expression statements and returns.
+struct C_evaluate : C_statement {
+        C_evaluate(Kind kind, C_expression* expr, const Location& loc)
+                : C_statement(kind, loc, (expr) ? expr->depth : 0), expr(expr)
+        {}
+
+        C_expression* expr;
+};
+
+// If statements and loops. A loop's condition may be missing.
+struct C_branch : C_statement {
+        C_branch(Kind kind, C_expression* cond, const Location& loc)
+                : C_statement(kind, loc, (cond) ? cond->depth : 0), cond(cond)
+        {}
+
+        C_expression* cond;
+        std::vector<C_statement*> then_block;
+        std::vector<C_statement*> else_block;
+
+        // A loop's induction and increment, either of which may be missing.
+        C_statement* ind = NULL;
+        C_statement* inc = NULL;
+};
+
+struct C_compound : C_statement {
+        C_compound(C_statement* first, C_statement* second, const Location& loc)
+                : C_statement(STMT_COMPOUND, loc, std::max(first->depth, second->depth)),
+                  first(first), second(second)
+        {}
+
+        C_statement* first;
+        C_statement* second;
+};
+
+/*
+ * A function, or the program's top level, which is function 0. Parameters
+ * come first among its variables, in order.
+ */
+struct C_function {
+        std::string name;
+        Location location;
+
+        std::vector<C_variable*> params;
+        std::vector<C_variable*> locals;
+        std::vector<C_statement*> body;
+
+        // What the function returns; its type is the C function's.
+        C_variable result{ NULL, NULL };
+
+        // Its identifier in the C program.
+        std::string c_name;
+};
+
+/*
+ * The backend types are incomplete in the frontend, so nodes are handed
+ * to the parser, and back, through casts.
+ */
+static Bexpression* bexpression(C_expression* expr)
+{ return reinterpret_cast<Bexpression*>(expr); }
+
+static C_expression* node(Bexpression* expr)
+{ return reinterpret_cast<C_expression*>(expr); }
+
+static Bstatement* bstatement(C_statement* stmt)
+{ return reinterpret_cast<Bstatement*>(stmt); }
+
+static C_statement* node(Bstatement* stmt)
+{ return reinterpret_cast<C_statement*>(stmt); }
+
+static Bvariable* bvariable(C_variable* var)
+{ return reinterpret_cast<Bvariable*>(var); }
+
+static C_variable* node(Bvariable* var)
+{ return reinterpret_cast<C_variable*>(var); }
+
+// The depth of the deepest statement of list, or at least depth.
+static uint32_t deepest(const std::vector<C_statement*>& list, uint32_t depth)
+{
+        for (auto itr = list.begin(); itr != list.end(); ++itr)
+                depth = std::max(depth, (*itr)->depth);
+        return depth;
+}
+
+// Report s if it is the first node on its path nested deeper than emit() can walk.
+static C_statement* check_depth(C_statement* s)
+{
+        if (s->depth == C_backend::MAX_DEPTH + 1)
+                rin_error_at(s->location, "Block nesting exceeds the C backend's limit of %u",
+                             C_backend::MAX_DEPTH);
+        return s;
+}
+
+static bool is_comparison(RIN_OPERATOR op)
+{
+        return op == OPER_EQL || op == OPER_NEQ || op == OPER_LSS
+                || op == OPER_GTR || op == OPER_LEQ || op == OPER_GEQ;
+}
+
+static bool is_arithmetic(RIN_OPERATOR op)
+{
+        return op == OPER_ADD || op == OPER_SUB || op == OPER_MUL
+                || op == OPER_QUO || op == OPER_REM;
+}
+
+/*
+ * The type an expression's value may have, given its variables' and calls'
+ * types, and the types last worked out for its operands.
+ */
+static C_type type_of(const C_expression* e)
+{
+        switch (e->kind) {
+        case C_expression::EXPR_CONSTANT:
+                return (static_cast<const C_constant*>(e)->value.is_float()) ?
+                        CTYPE_FLOAT : CTYPE_INT;
+        case C_expression::EXPR_VARIABLE:
+                return static_cast<const C_reference*>(e)->var->type;
+        case C_expression::EXPR_UNARY: {
+                const C_operation* n = static_cast<const C_operation*>(e);
+                return (n->op == OPER_NEG) ? n->left->type : CTYPE_INT;
+        }
+        case C_expression::EXPR_BINARY: {
+                const C_operation* n = static_cast<const C_operation*>(e);
+                if (!is_arithmetic(n->op))
+                        return CTYPE_INT;
+
+                C_type a = n->left->type;
+                C_type b = n->right->type;
+                if (a == CTYPE_NONE || b == CTYPE_NONE)
+                        return CTYPE_NONE;
+                if (a == CTYPE_VALUE || b == CTYPE_VALUE)
+                        return CTYPE_VALUE;
+                return (a == CTYPE_INT && b == CTYPE_INT) ? CTYPE_INT : CTYPE_FLOAT;
+        }
+        case C_expression::EXPR_CALL: {
+                const C_function* fn = static_cast<const C_call*>(e)->function;
+                return (fn) ? fn->result.type : CTYPE_INT;
+        }
+        default:
+                // What fails returns an integer, for the C compiler's sake.
+                return CTYPE_INT;
+        }
+}
+
+// Whether running body always ends in a return.
+static bool ends_in_return(const std::vector<C_statement*>& body)
+{
+        if (body.empty())
+                return false;
+
+        const C_statement* last = body.back();
+        if (last->kind == C_statement::STMT_RETURN)
+                return true;
+        if (last->kind != C_statement::STMT_IF)
+                return false;
+        const C_branch* branch = static_cast<const C_branch*>(last);
+        return ends_in_return(branch->then_block) && ends_in_return(branch->else_block);
+}
+
+// Every return statement of body, bar those of functions declared in it.
+static void find_returns(const std::vector<C_statement*>& body, std::vector<C_evaluate*>* returns)
+{
+        for (auto itr = body.begin(); itr != body.end(); ++itr) {
+                switch ((*itr)->kind) {
+                case C_statement::STMT_RETURN:
+                        returns->push_back(static_cast<C_evaluate*>(*itr));
+                        break;
+                case C_statement::STMT_IF:
+                case C_statement::STMT_FOR:
+                        find_returns(static_cast<C_branch*>(*itr)->then_block, returns);
+                        find_returns(static_cast<C_branch*>(*itr)->else_block, returns);
+                        break;
+                default:
+                        break;
+                }
+        }
+}
+
+// Whether e reads var.
+static bool mentions(const C_expression* e, const C_variable* var)
+{
+        switch (e->kind) {
+        case C_expression::EXPR_VARIABLE:
+                return static_cast<const C_reference*>(e)->var == var;
+        case C_expression::EXPR_UNARY:
+        case C_expression::EXPR_BINARY: {
+                const C_operation* n = static_cast<const C_operation*>(e);
+                return mentions(n->left, var) || (n->right && mentions(n->right, var));
+        }
+        case C_expression::EXPR_CALL: {
+                // A call may read any global.
+                return var->owner == 0 || std::any_of(
+                        static_cast<const C_call*>(e)->args.begin(), static_cast<const C_call*>(e)->args.end(),
+                        [var](const C_expression* arg) { return mentions(arg, var); });
+        }
+        default:
+                return false;
+        }
+}
+
+/*
+ * Whether a declaration has nothing to do but zero a variable the next
+ * statement assigns without reading, as the declaration of an initialized
+ * variable does, so only the assignment need be written.
+ */
+static bool folds_into(const C_statement* decl, const C_statement* next)
+{
+        if (decl->kind != C_statement::STMT_DECLARE || next->kind != C_statement::STMT_ASSIGN)
+                return false;
+
+        const C_store* d = static_cast<const C_store*>(decl);
+        const C_store* a = static_cast<const C_store*>(next);
+        return d->var == a->var && !mentions(a->value, a->var);
+}
+
+static void find_zeroes(const C_statement* s, const C_statement* next,
+                        std::vector<const C_store*>* zeroes);
+
+/*
+ * Every declaration of body, its loop headers and the blocks nested in it,
+ * whose integer zero may be read: all but those that fold into the next.
+ */
+static void find_zeroes(const std::vector<C_statement*>& body, std::vector<const C_store*>* zeroes)
+{
+        for (size_t i = 0; i < body.size(); i++)
+                find_zeroes(body[i], (i + 1 < body.size()) ? body[i + 1] : NULL, zeroes);
+}
+
+static void find_zeroes(const C_statement* s, const C_statement* next,
+                        std::vector<const C_store*>* zeroes)
+{
+        switch (s->kind) {
+        case C_statement::STMT_DECLARE:
+                if (!next || !folds_into(s, next))
+                        zeroes->push_back(static_cast<const C_store*>(s));
+                return;
+        case C_statement::STMT_COMPOUND: {
+                const C_compound* c = static_cast<const C_compound*>(s);
+                find_zeroes(c->first, c->second, zeroes);
+                find_zeroes(c->second, NULL, zeroes);
+                return;
+        }
+        case C_statement::STMT_IF:
+        case C_statement::STMT_FOR: {
+                const C_branch* b = static_cast<const C_branch*>(s);
+                if (b->ind)
+                        find_zeroes(b->ind, NULL, zeroes);
+                if (b->inc)
+                        find_zeroes(b->inc, NULL, zeroes);
+                find_zeroes(b->then_block, zeroes);
+                find_zeroes(b->else_block, zeroes);
+                return;
+        }
+        default:
+                return;
+        }
+}
+
+// --- Emitting ---
+
+/*
+ * What every program starts with: the tagged value of variables of both
+ * types, and the operations C leaves undefined, or cannot check, done as
+ * the interpreter does them.
+ */
+static const char C_PRELUDE[] = R"(#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* A variable assigned both integers and floats. */
+typedef struct {
+	int is_float;
+	union {
+		int64_t i;
+		double f;
+	} as;
+} rin_value;
+
+static inline int64_t rin_fail(const char* where, const char* message)
+{
+	fflush(stdout);
+	fprintf(stderr, "%s: error: %s\n", where, message);
+	exit(1);
+}
+
+/* Integer arithmetic wraps, as it does in two's complement hardware. */
+static inline int64_t rin_add(int64_t a, int64_t b) { return (int64_t)((uint64_t)a + (uint64_t)b); }
+static inline int64_t rin_sub(int64_t a, int64_t b) { return (int64_t)((uint64_t)a - (uint64_t)b); }
+static inline int64_t rin_mul(int64_t a, int64_t b) { return (int64_t)((uint64_t)a * (uint64_t)b); }
+static inline int64_t rin_neg(int64_t a) { return (int64_t)(0 - (uint64_t)a); }
+
+/* INT64_MIN / -1 overflows; it wraps to INT64_MIN. */
+static inline int64_t rin_quo(int64_t a, int64_t b, const char* where)
+{
+	if (b == 0)
+		return rin_fail(where, "Division by zero");
+	return (b == -1) ? rin_neg(a) : a / b;
+}
+
+static inline int64_t rin_rem(int64_t a, int64_t b, const char* where)
+{
+	if (b == 0)
+		return rin_fail(where, "Division by zero");
+	return (b == -1) ? 0 : a % b;
+}
+
+/* Shift counts are taken modulo 64. */
+static inline int64_t rin_lshift(int64_t a, int64_t b) { return (int64_t)((uint64_t)a << (b & 63)); }
+static inline int64_t rin_rshift(int64_t a, int64_t b) { return a >> (b & 63); }
+
+static inline double rin_rem_float(double a, double b) { return fmod(a, b); }
+
+static inline rin_value rin_int(int64_t i)
+{
+	rin_value v;
+	v.is_float = 0;
+	v.as.i = i;
+	return v;
+}
+
+static inline rin_value rin_float(double f)
+{
+	rin_value v;
+	v.is_float = 1;
+	v.as.f = f;
+	return v;
+}
+
+static inline double rin_as_float(rin_value v) { return (v.is_float) ? v.as.f : (double)v.as.i; }
+static inline int rin_truth(rin_value v) { return (v.is_float) ? v.as.f != 0 : v.as.i != 0; }
+
+static inline rin_value rin_neg_value(rin_value v)
+{
+	return (v.is_float) ? rin_float(-v.as.f) : rin_int(rin_neg(v.as.i));
+}
+
+static inline rin_value rin_step_value(rin_value v, int step)
+{
+	return (v.is_float) ? rin_float(v.as.f + step) : rin_int(rin_add(v.as.i, step));
+}
+
+)";
+
+// The checked operations on rin_values, which need the operators' names.
+static const char C_VALUE_OPERATIONS[] = R"(
+static inline int64_t rin_bnot_value(rin_value v, const char* where)
+{
+	if (v.is_float)
+		return rin_fail(where, RIN_BNOT_FLOAT);
+	return ~v.as.i;
+}
+
+static inline rin_value rin_binary(enum rin_operator op, rin_value a, rin_value b, const char* where)
+{
+	char message[64];
+	double x, y;
+	if (!a.is_float && !b.is_float) {
+		int64_t i = a.as.i, j = b.as.i;
+		switch (op) {
+		case RIN_ADD: return rin_int(rin_add(i, j));
+		case RIN_SUB: return rin_int(rin_sub(i, j));
+		case RIN_MUL: return rin_int(rin_mul(i, j));
+		case RIN_QUO: return rin_int(rin_quo(i, j, where));
+		case RIN_REM: return rin_int(rin_rem(i, j, where));
+		case RIN_EQL: return rin_int(i == j);
+		case RIN_NEQ: return rin_int(i != j);
+		case RIN_LSS: return rin_int(i < j);
+		case RIN_GTR: return rin_int(i > j);
+		case RIN_LEQ: return rin_int(i <= j);
+		case RIN_GEQ: return rin_int(i >= j);
+		case RIN_BAND: return rin_int(i & j);
+		case RIN_BOR: return rin_int(i | j);
+		case RIN_BXOR: return rin_int(i ^ j);
+		case RIN_LSHIFT: return rin_int(rin_lshift(i, j));
+		case RIN_RSHIFT: return rin_int(rin_rshift(i, j));
+		}
+	}
+
+	x = rin_as_float(a);
+	y = rin_as_float(b);
+	switch (op) {
+	case RIN_ADD: return rin_float(x + y);
+	case RIN_SUB: return rin_float(x - y);
+	case RIN_MUL: return rin_float(x * y);
+	case RIN_QUO: return rin_float(x / y);
+	case RIN_REM: return rin_float(rin_rem_float(x, y));
+	case RIN_EQL: return rin_int(x == y);
+	case RIN_NEQ: return rin_int(x != y);
+	case RIN_LSS: return rin_int(x < y);
+	case RIN_GTR: return rin_int(x > y);
+	case RIN_LEQ: return rin_int(x <= y);
+	case RIN_GEQ: return rin_int(x >= y);
+	default:
+		sprintf(message, "Operands of %s must be integers", rin_operator_names[op]);
+		return rin_int(rin_fail(where, message));
+	}
+}
+
+static inline void rin_print_value(const char* name, rin_value v)
+{
+	if (v.is_float)
+		printf("%s = %g\n", name, v.as.f);
+	else
+		printf("%s = %lld\n", name, (long long)v.as.i);
+}
+)";
+
+// What programs with functions need to keep calls as shallow as the interpreter does.
+static const char C_CALL_DEPTH[] = R"(
+/* Calls in progress, which may not go deeper than the interpreter's. */
+static unsigned rin_depth;
+
+/* Checked before a call's arguments are evaluated; the callee counts itself. */
+static inline void rin_call(const char* where)
+{
+	if (rin_depth >= RIN_MAX_CALL_DEPTH)
+		rin_fail(where, RIN_TOO_DEEP);
+}
+
+static inline int64_t rin_leave_int(int64_t v) { rin_depth--; return v; }
+static inline double rin_leave_float(double v) { rin_depth--; return v; }
+static inline rin_value rin_leave_value(rin_value v) { rin_depth--; return v; }
+)";
+
+// The operators rin_binary() takes, as the prelude's enum names them and as C spells them.
+static const struct C_operator {
+        RIN_OPERATOR op;
+        const char* name;
+        const char* symbol;
+} C_OPERATORS[] = {
+        { OPER_ADD, "RIN_ADD", "+" },   { OPER_SUB, "RIN_SUB", "-" },
+        { OPER_MUL, "RIN_MUL", "*" },   { OPER_QUO, "RIN_QUO", "/" },
+        { OPER_REM, "RIN_REM", "%" },   { OPER_EQL, "RIN_EQL", "==" },
+        { OPER_NEQ, "RIN_NEQ", "!=" },  { OPER_LSS, "RIN_LSS", "<" },
+        { OPER_GTR, "RIN_GTR", ">" },   { OPER_LEQ, "RIN_LEQ", "<=" },
+        { OPER_GEQ, "RIN_GEQ", ">=" },  { OPER_BAND, "RIN_BAND", "&" },
+        { OPER_BOR, "RIN_BOR", "|" },   { OPER_BXOR, "RIN_BXOR", "^" },
+        { OPER_LSHIFT, "RIN_LSHIFT", "<<" }, { OPER_RSHIFT, "RIN_RSHIFT", ">>" }
+};
+
+static const C_operator& c_operator(RIN_OPERATOR op)
+{
+        for (size_t i = 0; i < sizeof(C_OPERATORS) / sizeof(C_OPERATORS[0]); i++) {
+                if (C_OPERATORS[i].op == op)
+                        return C_OPERATORS[i];
+        }
+        RIN_UNREACHABLE();
+}
+
+// text as a C string literal.
+static std::string c_string(const std::string& text)
+{
+        std::string out = "\"";
+        for (auto c = text.begin(); c != text.end(); ++c) {
+                if (*c == '"' || *c == '\\')
+                        out += '\\';
+                if (*c == '\n')
+                        out += "\\n";
+                else
+                        out += *c;
+        }
+        return out + "\"";
+}
+
+static std::string c_type_name(C_type type)
+{
+        switch (type) {
+        case CTYPE_FLOAT: return "double";
+        case CTYPE_VALUE: return "rin_value";
+        default:          return "int64_t";
+        }
+}
+
+// Type suffixes of the prelude's functions.
+static std::string c_type_suffix(C_type type)
+{
+        switch (type) {
+        case CTYPE_FLOAT: return "float";
+        case CTYPE_VALUE: return "value";
+        default:          return "int";
+        }
+}
+
+static std::string c_int(int64_t i)
+{
+        if (i == INT64_MIN)
+                return "INT64_MIN";
+        std::string digits = std::to_string(i);
+        return (i < 0) ? "(" + digits + ")" : digits;
+}
+
+// The shortest literal that reads back as f, which always reads as a double.
+static std::string c_float(double f)
+{
+        if (std::isnan(f))
+                return "NAN";
+        if (std::isinf(f))
+                return (f < 0) ? "(-HUGE_VAL)" : "HUGE_VAL";
+
+        char buf[32];
+        for (int digits = 15; digits <= 17; digits++) {
+                snprintf(buf, sizeof(buf), "%.*g", digits, f);
+                if (strtod(buf, NULL) == f)
+                        break;
+        }
+
+        std::string text(buf);
+        if (text.find_first_of(".e") == std::string::npos)
+                text += ".0";
+        return (f < 0 || (f == 0 && std::signbit(f))) ? "(" + text + ")" : text;
+}
+
+/*
+ * Whether text is wrapped in one pair of parentheses of its own, which
+ * only hold a comma expression if they are a call's.
+ */
+static bool parenthesized(const std::string& text)
+{
+        if (text.size() < 2 || text.front() != '(' || text.back() != ')')
+                return false;
+
+        int depth = 0;
+        bool quoted = false;
+        for (size_t i = 0; i < text.size(); i++) {
+                char c = text[i];
+                if (quoted) {
+                        if (c == '\\')
+                                i++;
+                        else if (c == '"')
+                                quoted = false;
+                } else if (c == '"') {
+                        quoted = true;
+                } else if (c == '(') {
+                        depth++;
+                } else if (c == ')' && --depth == 0) {
+                        return i == text.size() - 1;
+                } else if (c == ',' && depth == 1) {
+                        return false;
+                }
+        }
+        return false;
+}
+
+// text without the parentheses around it, where nothing binds to it.
+static std::string bare(const std::string& text)
+{
+        return (parenthesized(text)) ? text.substr(1, text.size() - 2) : text;
+}
+
+/*
+ * Whether a local could not be called name in C: a keyword, a macro or
+ * type of the headers the prelude includes, or a name of the prelude's
+ * or of a global or function.
+ */
+static bool is_reserved(const std::string& name)
+{
+        static const char* const reserved[] = {
+                "auto", "break", "case", "char", "const", "continue", "default", "do",
+                "double", "else", "enum", "extern", "float", "for", "goto", "if",
+                "inline", "int", "long", "register", "restrict", "return", "short",
+                "signed", "sizeof", "static", "struct", "switch", "typedef", "union",
+                "unsigned", "void", "volatile", "while", "errno", "stdin", "stdout",
+                "stderr", "math_errhandling"
+        };
+        for (size_t i = 0; i < sizeof(reserved) / sizeof(reserved[0]); i++) {
+                if (name == reserved[i])
+                        return true;
+        }
+
+        // Macros are in capitals, and types end in _t.
+        if (name.find_first_of("abcdefghijklmnopqrstuvwxyz") == std::string::npos)
+                return true;
+        if (name.size() > 2 && name.compare(name.size() - 2, 2, "_t") == 0)
+                return true;
+        return name.compare(0, 4, "rin_") == 0 || name.compare(0, 2, "g_") == 0
+                || name.compare(0, 3, "fn_") == 0;
+}
+
+// Hands out C identifiers, none of them twice.
+class C_names
+{
+public:
+        std::string take(const std::string& name)
+        {
+                std::string taken = name;
+                for (unsigned n = 2; !this->_taken.emplace(taken, true).second; n++)
+                        taken = name + "_" + std::to_string(n);
+                return taken;
+        }
+
+private:
+        std::unordered_map<std::string, bool> _taken;
+};
+
+// Writes the C program for a parsed one, a function at a time.
+class C_emitter
+{
+public:
+        C_emitter(const std::vector<C_function*>& functions, const std::vector<C_variable*>& variables,
+                  const Scope::Var_map* printed)
+                : _functions(functions), _variables(variables), _printed(printed)
+        {}
+
+        std::string emit()
+        {
+                this->name_everything();
+                this->prelude();
+
+                bool globals = false;
+                for (auto var = this->_variables.begin(); var != this->_variables.end(); ++var) {
+                        if ((*var)->owner != 0)
+                                continue;
+                        if (!globals)
+                                this->_out += "/* Top-level variables. */\n";
+                        globals = true;
+                        this->_out += "static " + c_type_name((*var)->type) + " " + (*var)->name + ";\n";
+                }
+                if (globals)
+                        this->_out += "\n";
+
+                for (size_t i = 1; i < this->_functions.size(); i++)
+                        this->_out += this->signature(this->_functions[i]) + ";\n";
+                if (this->_functions.size() > 1)
+                        this->_out += "\n";
+
+                for (size_t i = 1; i < this->_functions.size(); i++)
+                        this->function(this->_functions[i]);
+                this->top_level();
+                return this->_out;
+        }
+
+private:
+        const std::vector<C_function*>& _functions;
+        const std::vector<C_variable*>& _variables;
+        const Scope::Var_map* _printed;
+
+        std::string _out;
+        unsigned _indent = 0;
+
+        // What is being written, and how many loops deep.
+        const C_function* _fn = NULL;
+        uint32_t _index = 0;
+        unsigned _loops = 0;
+
+        // Whether the top level returns, and so jumps to where it ends.
+        bool _top_returns = false;
+
+        void name_everything()
+        {
+                C_names globals;
+                for (auto var = this->_variables.begin(); var != this->_variables.end(); ++var) {
+                        if ((*var)->owner == 0)
+                                (*var)->name = globals.take("g_" + (*var)->obj->identifier());
+                }
+                for (size_t i = 1; i < this->_functions.size(); i++) {
+                        C_function* fn = this->_functions[i];
+                        fn->c_name = globals.take("fn_" + fn->name);
+
+                        C_names locals;
+                        for (auto var = fn->params.begin(); var != fn->params.end(); ++var)
+                                this->name_local(*var, &locals);
+                        for (auto var = fn->locals.begin(); var != fn->locals.end(); ++var)
+                                this->name_local(*var, &locals);
+                }
+        }
+
+        static void name_local(C_variable* var, C_names* names)
+        {
+                const std::string& identifier = var->obj->identifier();
+                var->name = names->take((is_reserved(identifier)) ? "v_" + identifier : identifier);
+        }
+
+        void prelude()
+        {
+                this->_out += "/* Translated from Rinto by its C backend. */\n";
+                this->_out += C_PRELUDE;
+
+                this->_out += "enum rin_operator {\n\t";
+                for (size_t i = 0; i < sizeof(C_OPERATORS) / sizeof(C_OPERATORS[0]); i++)
+                        this->_out += std::string((i) ? ", " : "") + C_OPERATORS[i].name;
+                this->_out += "\n};\n\nstatic const char* const rin_operator_names[] = {\n\t";
+                for (size_t i = 0; i < sizeof(C_OPERATORS) / sizeof(C_OPERATORS[0]); i++)
+                        this->_out += ((i) ? ", " : "") + c_string(operator_name(C_OPERATORS[i].op));
+                this->_out += "\n};\n\n";
+
+                this->_out += "#define RIN_BNOT_FLOAT " + c_string("Operand of "
+                        + operator_name(OPER_BNOT) + " must be an integer") + "\n";
+                this->_out += C_VALUE_OPERATIONS;
+                if (this->_functions.size() > 1) {
+                        this->_out += "\n#define RIN_MAX_CALL_DEPTH "
+                                + std::to_string(Interp_backend::MAX_CALL_DEPTH) + "\n";
+                        this->_out += "#define RIN_TOO_DEEP " + c_string("Call depth exceeds the limit of "
+                                + std::to_string(Interp_backend::MAX_CALL_DEPTH)) + "\n";
+                        this->_out += C_CALL_DEPTH;
+                }
+                this->_out += "\n";
+        }
+
+        std::string signature(const C_function* fn)
+        {
+                std::string params;
+                for (auto var = fn->params.begin(); var != fn->params.end(); ++var) {
+                        if (!params.empty())
+                                params += ", ";
+                        params += c_type_name((*var)->type) + " " + (*var)->name;
+                }
+                return c_type_name(fn->result.type) + " " + fn->c_name
+                        + "(" + ((params.empty()) ? "void" : params) + ")";
+        }
+
+        void function(const C_function* fn)
+        {
+                this->_fn = fn;
+                this->_index = std::find(this->_functions.begin(), this->_functions.end(), fn)
+                        - this->_functions.begin();
+
+                this->_out += this->signature(fn) + "\n{\n";
+                this->_indent = 1;
+                for (auto var = fn->locals.begin(); var != fn->locals.end(); ++var)
+                        this->line(c_type_name((*var)->type) + " " + (*var)->name + " = "
+                                   + this->zero((*var)->type) + ";");
+                if (!fn->locals.empty())
+                        this->_out += "\n";
+
+                this->line("rin_depth++;");
+                this->block(fn->body);
+                if (!ends_in_return(fn->body))
+                        this->line(this->leave(this->zero(fn->result.type)));
+                this->_out += "}\n\n";
+        }
+
+        void top_level()
+        {
+                this->_fn = this->_functions[0];
+                this->_index = 0;
+
+                this->_out += "int main(void)\n{\n";
+                this->_indent = 1;
+                this->block(this->_fn->body);
+                if (this->_top_returns)
+                        this->_out += "done:\n";
+
+                // The top-level variables, as the debug parser's --run prints them.
+                for (auto obj = this->_printed->begin(); obj != this->_printed->end(); ++obj) {
+                        const C_variable* var = this->global(*obj);
+                        std::string name = c_string((*obj)->identifier());
+                        if (!var || var->type == CTYPE_INT) {
+                                this->line("printf(\"%s = %lld\\n\", " + name + ", (long long)"
+                                           + ((var) ? var->name : "0") + ");");
+                        } else if (var->type == CTYPE_FLOAT) {
+                                this->line("printf(\"%s = %g\\n\", " + name + ", " + var->name + ");");
+                        } else {
+                                this->line("rin_print_value(" + name + ", " + var->name + ");");
+                        }
+                }
+                this->line("return 0;");
+                this->_out += "}\n";
+        }
+
+        const C_variable* global(const Named_object* obj) const
+        {
+                for (auto var = this->_variables.begin(); var != this->_variables.end(); ++var) {
+                        if ((*var)->obj == obj)
+                                return ((*var)->owner == 0) ? *var : NULL;
+                }
+                return NULL;
+        }
+
+        void line(const std::string& text)
+        {
+                this->_out.append(this->_indent, '\t');
+                this->_out += text + "\n";
+        }
+
+        // A location, as a C string for runtime errors, counted from 0 as the frontend's are.
+        static std::string where(const Location& loc)
+        {
+                std::string text = loc.filename();
+                if (loc.line() >= 0)
+                        text += ":" + std::to_string(loc.line()) + ":" + std::to_string(loc.column());
+                return c_string(text);
+        }
+
+        // An expression of type that stops the program with message.
+        std::string fail(C_type type, const Location& loc, const std::string& message)
+        {
+                std::string call = "rin_fail(" + this->where(loc) + ", " + c_string(message) + ")";
+                return (type == CTYPE_VALUE) ? "rin_int(" + call + ")" : call;
+        }
+
+        static std::string zero(C_type type)
+        {
+                switch (type) {
+                case CTYPE_FLOAT: return "0.0";
+                case CTYPE_VALUE: return "rin_int(0)";
+                default:          return "0";
+                }
+        }
+
+        // A return from the current function of code, or the end of the program.
+        std::string leave(const std::string& code)
+        {
+                return "return rin_leave_" + c_type_suffix(this->_fn->result.type)
+                        + "(" + bare(code) + ");";
+        }
+
+        // code, of type from, as type to, which is at least as wide.
+        static std::string convert(const std::string& code, C_type from, C_type to)
+        {
+                if (from == to || from == CTYPE_NONE)
+                        return code;
+                if (to == CTYPE_VALUE)
+                        return ((from == CTYPE_FLOAT) ? "rin_float(" : "rin_int(") + bare(code) + ")";
+                if (to == CTYPE_FLOAT)
+                        return (from == CTYPE_VALUE) ? "rin_as_float(" + bare(code) + ")"
+                                : "(double)" + code;
+                return (from == CTYPE_VALUE) ? code + ".as.i" : "(int64_t)" + code;
+        }
+
+        std::string value_as(const C_expression* e, C_type type)
+        { return convert(this->value(e), e->type, type); }
+
+        // e as a C condition, which C tests against zero as Rinto does.
+        std::string condition(const C_expression* e)
+        {
+                std::string code = this->value(e);
+                return (e->type == CTYPE_VALUE) ? "rin_truth(" + bare(code) + ")" : code;
+        }
+
+        /*
+         * Whether var is a variable of the code being written: a global, or
+         * a local of the current function.
+         */
+        bool in_reach(const C_variable* var) const
+        { return var->owner == 0 || var->owner == this->_index; }
+
+        std::string out_of_reach(const C_variable* var, const Location& loc)
+        {
+                return this->fail(var->type, loc, "'" + var->obj->identifier()
+                                  + "' belongs to an enclosing function");
+        }
+
+        // e, in its own type.
+        std::string value(const C_expression* e)
+        {
+                switch (e->kind) {
+                case C_expression::EXPR_CONSTANT: {
+                        const Interp_value& v = static_cast<const C_constant*>(e)->value;
+                        return (v.is_float()) ? c_float(v.f) : c_int(v.i);
+                }
+                case C_expression::EXPR_VARIABLE: {
+                        const C_variable* var = static_cast<const C_reference*>(e)->var;
+                        return (this->in_reach(var)) ? var->name : this->out_of_reach(var, e->location);
+                }
+                case C_expression::EXPR_UNARY:
+                        return this->unary(static_cast<const C_operation*>(e));
+                case C_expression::EXPR_BINARY:
+                        return this->binary(static_cast<const C_operation*>(e));
+                case C_expression::EXPR_CALL:
+                        return this->call(static_cast<const C_call*>(e));
+                default:
+                        return this->fail(CTYPE_INT, e->location, "Cannot run an invalid expression");
+                }
+        }
+
+        std::string unary(const C_operation* e)
+        {
+                // Negative constants are written as they are.
+                if (e->op == OPER_NEG && e->left->kind == C_expression::EXPR_CONSTANT) {
+                        const Interp_value& v = static_cast<const C_constant*>(e->left)->value;
+                        if (v.is_float())
+                                return c_float(-v.f);
+                        if (v.i != INT64_MIN)
+                                return c_int(-v.i);
+                }
+
+                C_type type = e->left->type;
+                std::string a = this->value(e->left);
+                if (e->op == OPER_NOT)
+                        return "(!" + this->condition(e->left) + ")";
+
+                if (e->op == OPER_NEG) {
+                        if (type == CTYPE_FLOAT)
+                                return "(-" + a + ")";
+                        return ((type == CTYPE_VALUE) ? "rin_neg_value(" : "rin_neg(") + bare(a) + ")";
+                }
+
+                if (type == CTYPE_INT)
+                        return "(~" + a + ")";
+                if (type == CTYPE_VALUE)
+                        return "rin_bnot_value(" + bare(a) + ", " + this->where(e->location) + ")";
+                return "((void)" + a + ", " + this->fail(CTYPE_INT, e->location, "Operand of "
+                        + operator_name(OPER_BNOT) + " must be an integer") + ")";
+        }
+
+        std::string binary(const C_operation* e)
+        {
+                // && and || only evaluate their right operand if they need it.
+                if (e->op == OPER_LAND || e->op == OPER_LOR) {
+                        return "(" + this->condition(e->left) + ((e->op == OPER_LAND) ? " && " : " || ")
+                                + this->condition(e->right) + ")";
+                }
+
+                C_type ta = e->left->type;
+                C_type tb = e->right->type;
+                std::string where = this->where(e->location);
+
+                if (ta == CTYPE_VALUE || tb == CTYPE_VALUE) {
+                        std::string code = std::string("rin_binary(") + c_operator(e->op).name + ", "
+                                + bare(this->value_as(e->left, CTYPE_VALUE)) + ", "
+                                + bare(this->value_as(e->right, CTYPE_VALUE)) + ", " + where + ")";
+                        return (is_arithmetic(e->op)) ? code : code + ".as.i";
+                }
+
+                if (ta != CTYPE_FLOAT && tb != CTYPE_FLOAT) {
+                        std::string a = this->value(e->left);
+                        std::string b = this->value(e->right);
+                        switch (e->op) {
+                        case OPER_ADD:    return "rin_add(" + bare(a) + ", " + bare(b) + ")";
+                        case OPER_SUB:    return "rin_sub(" + bare(a) + ", " + bare(b) + ")";
+                        case OPER_MUL:    return "rin_mul(" + bare(a) + ", " + bare(b) + ")";
+                        case OPER_QUO:    return "rin_quo(" + bare(a) + ", " + bare(b) + ", " + where + ")";
+                        case OPER_REM:    return "rin_rem(" + bare(a) + ", " + bare(b) + ", " + where + ")";
+                        case OPER_LSHIFT: return "rin_lshift(" + bare(a) + ", " + bare(b) + ")";
+                        case OPER_RSHIFT: return "rin_rshift(" + bare(a) + ", " + bare(b) + ")";
+                        default:          return "(" + a + " " + c_operator(e->op).symbol + " " + b + ")";
+                        }
+                }
+
+                // Mixed operands are widened, as they would be at run time.
+                std::string a = this->value_as(e->left, CTYPE_FLOAT);
+                std::string b = this->value_as(e->right, CTYPE_FLOAT);
+                if (e->op == OPER_REM)
+                        return "rin_rem_float(" + bare(a) + ", " + bare(b) + ")";
+                if (is_arithmetic(e->op) || is_comparison(e->op))
+                        return "(" + a + " " + c_operator(e->op).symbol + " " + b + ")";
+                return "((void)" + a + ", (void)" + b + ", " + this->fail(CTYPE_INT, e->location,
+                        "Operands of " + operator_name(e->op) + " must be integers") + ")";
+        }
+
+        std::string call(const C_call* e)
+        {
+                const C_function* fn = e->function;
+                if (!fn) {
+                        auto found = std::find_if(this->_functions.begin() + 1, this->_functions.end(),
+                                                  [e](const C_function* f) { return f->name == e->name; });
+                        if (found == this->_functions.end())
+                                return this->fail(CTYPE_INT, e->location,
+                                                  "Call to undeclared function '" + e->name + "'");
+                        return this->fail(CTYPE_INT, e->location, "Function '" + e->name + "' takes "
+                                          + std::to_string((*found)->params.size()) + " arguments, but "
+                                          + std::to_string(e->args.size()) + " were given");
+                }
+
+                std::string args;
+                for (size_t i = 0; i < e->args.size(); i++) {
+                        if (i)
+                                args += ", ";
+                        args += bare(this->value_as(e->args[i], fn->params[i]->type));
+                }
+                return "(rin_call(" + this->where(e->location) + "), " + fn->c_name + "(" + args + "))";
+        }
+
+        void block(const std::vector<C_statement*>& body)
+        {
+                for (size_t i = 0; i < body.size(); i++) {
+                        if (i + 1 < body.size() && folds_into(body[i], body[i + 1]))
+                                continue;
+                        this->statement(body[i]);
+                }
+        }
+
+        /*
+         * A declaration, assignment, step or expression as a C expression,
+         * as a for loop's header needs it.
+         */
+        std::string simple(const C_statement* s)
+        {
+                switch (s->kind) {
+                case C_statement::STMT_DECLARE:
+                case C_statement::STMT_ASSIGN:
+                case C_statement::STMT_STEP:
+                        return this->store(static_cast<const C_store*>(s));
+                case C_statement::STMT_EXPRESSION:
+                        return bare(this->value(static_cast<const C_evaluate*>(s)->expr));
+                case C_statement::STMT_COMPOUND: {
+                        const C_compound* c = static_cast<const C_compound*>(s);
+                        if (folds_into(c->first, c->second))
+                                return this->simple(c->second);
+                        return this->simple(c->first) + ", " + this->simple(c->second);
+                }
+                default:
+                        return bare(this->fail(CTYPE_INT, s->location, "Cannot run an invalid statement"));
+                }
+        }
+
+        std::string store(const C_store* s)
+        {
+                C_variable* var = s->var;
+                if (!this->in_reach(var))
+                        return bare(this->out_of_reach(var, s->location));
+
+                // A declaration zeroes the variable to integer 0, which its type holds.
+                if (s->kind == C_statement::STMT_DECLARE)
+                        return var->name + " = " + this->zero(var->type);
+                if (s->kind == C_statement::STMT_ASSIGN)
+                        return var->name + " = " + bare(this->value_as(s->value, var->type));
+
+                std::string step = std::to_string(s->step);
+                if (var->type == CTYPE_FLOAT)
+                        return var->name + ((s->step < 0) ? " -= " : " += ") + std::to_string(std::abs(s->step));
+                if (var->type == CTYPE_VALUE)
+                        return var->name + " = rin_step_value(" + var->name + ", " + step + ")";
+                return var->name + " = rin_add(" + var->name + ", " + step + ")";
+        }
+
+        void statement(const C_statement* s)
+        {
+                switch (s->kind) {
+                case C_statement::STMT_DECLARE:
+                case C_statement::STMT_ASSIGN:
+                case C_statement::STMT_STEP:
+                        this->line(this->simple(s) + ";");
+                        return;
+                case C_statement::STMT_EXPRESSION: {
+                        const C_expression* expr = static_cast<const C_evaluate*>(s)->expr;
+                        std::string code = this->value(expr);
+                        if (expr->kind == C_expression::EXPR_CALL)
+                                this->line(code + ";");
+                        else
+                                this->line("(void)" + code + ";");
+                        return;
+                }
+                case C_statement::STMT_IF:
+                        this->if_statement(static_cast<const C_branch*>(s), false);
+                        return;
+                case C_statement::STMT_FOR:
+                        this->for_statement(static_cast<const C_branch*>(s));
+                        return;
+                case C_statement::STMT_COMPOUND: {
+                        const C_compound* c = static_cast<const C_compound*>(s);
+                        if (!folds_into(c->first, c->second))
+                                this->statement(c->first);
+                        this->statement(c->second);
+                        return;
+                }
+                case C_statement::STMT_RETURN:
+                        this->return_statement(static_cast<const C_evaluate*>(s));
+                        return;
+                case C_statement::STMT_BREAK:
+                case C_statement::STMT_CONTINUE:
+                        if (this->_loops > 0) {
+                                this->line((s->kind == C_statement::STMT_BREAK) ? "break;" : "continue;");
+                        } else if (this->_index == 0) {
+                                this->line(this->fail(CTYPE_INT, s->location,
+                                                      "Left a loop outside of any loop") + ";");
+                        } else {
+                                this->line(this->fail(CTYPE_INT, s->location, "Function '"
+                                                      + this->_fn->name + "' left a loop it is not in") + ";");
+                        }
+                        return;
+                case C_statement::STMT_NOTHING:
+                        return;
+                default:
+                        this->line(this->fail(CTYPE_INT, s->location, "Cannot run an invalid statement") + ";");
+                        return;
+                }
+        }
+
+        // An else block of a lone if statement continues an else-if chain.
+        void if_statement(const C_branch* s, bool chained)
+        {
+                std::string head = "if (" + bare(this->condition(s->cond)) + ") {";
+                if (chained) {
+                        this->_indent--;
+                        this->line("} else " + head);
+                        this->_indent++;
+                } else {
+                        this->line(head);
+                        this->_indent++;
+                }
+                this->block(s->then_block);
+
+                if (s->else_block.size() == 1 && s->else_block[0]->kind == C_statement::STMT_IF) {
+                        this->if_statement(static_cast<const C_branch*>(s->else_block[0]), true);
+                        return;
+                }
+                if (!s->else_block.empty()) {
+                        this->_indent--;
+                        this->line("} else {");
+                        this->_indent++;
+                        this->block(s->else_block);
+                }
+                this->_indent--;
+                this->line("}");
+        }
+
+        // A continue runs the increment, as the last clause of a C for loop does.
+        void for_statement(const C_branch* s)
+        {
+                std::string cond = (s->cond) ? bare(this->condition(s->cond)) : "";
+                if (!s->ind && !s->inc) {
+                        this->line((s->cond) ? "while (" + cond + ") {" : "for (;;) {");
+                } else {
+                        std::string ind = (s->ind) ? this->simple(s->ind) : "";
+                        std::string inc = (s->inc) ? this->simple(s->inc) : "";
+                        this->line("for (" + ind + "; " + cond + "; " + inc + ") {");
+                }
+
+                this->_indent++;
+                this->_loops++;
+                this->block(s->then_block);
+                this->_loops--;
+                this->_indent--;
+                this->line("}");
+        }
+
+        void return_statement(const C_evaluate* s)
+        {
+                if (this->_index != 0) {
+                        C_type type = this->_fn->result.type;
+                        this->line(this->leave((s->expr) ? this->value_as(s->expr, type) : this->zero(type)));
+                        return;
+                }
+
+                // The top level's result is not printed, but is still worked out.
+                if (s->expr)
+                        this->line("(void)" + this->value(s->expr) + ";");
+                this->_top_returns = true;
+                this->line("goto done;");
+        }
+};
+
+// Work out the type of every expression, each made after its operands.
+static void settle_types(const std::vector<C_expression*>& expressions)
+{
+        for (auto e = expressions.begin(); e != expressions.end(); ++e)
+                (*e)->type = type_of(*e);
+}
+
+void C_backend::infer_types()
+{
+        std::vector<std::pair<C_variable*, C_expression*> > sites(this->_assignments);
+
+        // Arguments are assigned to the parameters they are passed to.
+        for (auto call = this->_calls.begin(); call != this->_calls.end(); ++call) {
+                auto found = this->_function_index.find((*call)->name);
+                if (found == this->_function_index.end()
+                    || found->second->params.size() != (*call)->args.size())
+                        continue;
+
+                C_function* fn = found->second;
+                (*call)->function = fn;
+                for (size_t i = 0; i < fn->params.size(); i++)
+                        sites.push_back(std::make_pair(fn->params[i], (*call)->args[i]));
+        }
+
+        // A function returns what its return statements do, or 0 if it can end without one.
+        for (size_t i = 1; i < this->_functions.size(); i++) {
+                C_function* fn = this->_functions[i];
+                std::vector<C_evaluate*> returns;
+                find_returns(fn->body, &returns);
+                for (auto ret = returns.begin(); ret != returns.end(); ++ret) {
+                        if ((*ret)->expr)
+                                sites.push_back(std::make_pair(&fn->result, (*ret)->expr));
+                        else
+                                fn->result.type = CTYPE_INT;
+                }
+                if (!ends_in_return(fn->body))
+                        fn->result.type = widen(fn->result.type, CTYPE_INT);
+        }
+
+        // A declaration whose zero may be read assigns the integer zero.
+        std::vector<const C_store*> zeroes;
+        for (auto fn = this->_functions.begin(); fn != this->_functions.end(); ++fn)
+                find_zeroes((*fn)->body, &zeroes);
+        for (auto decl = zeroes.begin(); decl != zeroes.end(); ++decl)
+                (*decl)->var->type = widen((*decl)->var->type, CTYPE_INT);
+
+        /*
+         * Types only ever widen, so this settles within a few passes. A
+         * variable nothing has been assigned to holds the integer zero.
+         */
+        for (int settle = 0; settle < 2; settle++) {
+                bool changed = true;
+                while (changed) {
+                        changed = false;
+                        settle_types(this->_expressions);
+                        for (auto site = sites.begin(); site != sites.end(); ++site) {
+                                C_type type = widen(site->first->type, site->second->type);
+                                if (type != site->first->type) {
+                                        site->first->type = type;
+                                        changed = true;
+                                }
+                        }
+                }
+
+                for (auto var = this->_made.begin(); var != this->_made.end(); ++var) {
+                        if ((*var)->type == CTYPE_NONE)
+                                (*var)->type = CTYPE_INT;
+                }
+                for (auto fn = this->_functions.begin(); fn != this->_functions.end(); ++fn) {
+                        if ((*fn)->result.type == CTYPE_NONE)
+                                (*fn)->result.type = CTYPE_INT;
+                }
+        }
+        settle_types(this->_expressions);
+}
+
+std::string C_backend::emit()
+{
+        C_function* top = this->_functions[0];
+        Statement_list rest = this->take_statements(this->supercontext());
+        top->body.insert(top->body.end(), rest.begin(), rest.end());
+        this->infer_types();
+
+        C_emitter emitter(this->_functions, this->_made, this->supercontext()->variables());
+        return emitter.emit();
+}
+
+// --- Building ---
+
+C_backend::C_backend()
+{
+        // The top level is function 0.
+        C_function* top = this->arena()->make<C_function>();
+        top->name = "<top level>";
+        top->location = File::unknown_location();
+        this->_functions.push_back(top);
+}
+
+Scope* C_backend::enter_scope()
+{
+        Scope* scope = Backend::enter_scope();
+        this->_scope_marks[scope] = this->_made.size();
+        return scope;
+}
+
+void C_backend::push_statement(Bstatement* statement)
+{
+        if (statement)
+                this->_statements[this->current_scope()].push_back(node(statement));
+}
+
+C_backend::Statement_list C_backend::take_statements(Scope* scope)
+{
+        Statement_list list;
+        auto itr = this->_statements.find(scope);
+        if (scope && itr != this->_statements.end()) {
+                list.swap(itr->second);
+                this->_statements.erase(itr);
+        }
+        return list;
+}
+
+C_variable* C_backend::variable_in(Named_object* obj, Scope* scope)
+{
+        auto itr = this->_variables.find(obj);
+        if (itr != this->_variables.end())
+                return itr->second;
+
+        C_variable* var = this->arena()->make<C_variable>(obj, scope);
+        this->_variables[obj] = var;
+        this->_made.push_back(var);
+        return var;
+}
+
+Bvariable* C_backend::variable(Named_object* obj)
+{
+        RIN_ASSERT(obj);
+        return bvariable(this->variable_in(obj, this->current_scope()));
+}
+
+Bexpression* C_backend::made(C_expression* e)
+{
+        if (e->depth == MAX_DEPTH + 1)
+                rin_error_at(e->location, "Expression nesting exceeds the C backend's limit of %u",
+                             MAX_DEPTH);
+        this->_expressions.push_back(e);
+        return bexpression(e);
+}
+
+Bexpression* C_backend::invalid_expression()
+{
+        return this->made(this->arena()->make<C_expression>(C_expression::EXPR_INVALID,
+                                                            File::unknown_location()));
+}
+
+Bexpression* C_backend::unary_expression
+(RIN_OPERATOR op, Bexpression* expr, const Location& loc)
+{
+        RIN_ASSERT(expr);
+
+        // The variable itself, which inc_statement() and dec_statement() step.
+        if (op == OPER_INC || op == OPER_DEC)
+                return expr;
+
+        RIN_ASSERT(op == OPER_NOT || op == OPER_NEG || op == OPER_BNOT);
+        return this->made(this->arena()->make<C_operation>(op, node(expr), nullptr, loc));
+}
+
+Bexpression* C_backend::binary_expression
+(RIN_OPERATOR op, Bexpression* left, Bexpression* right, const Location& loc)
+{
+        RIN_ASSERT(left && right);
+        RIN_ASSERT(is_arithmetic(op) || is_comparison(op) || op == OPER_LAND || op == OPER_LOR
+                   || op == OPER_BAND || op == OPER_BOR || op == OPER_BXOR
+                   || op == OPER_LSHIFT || op == OPER_RSHIFT);
+        return this->made(this->arena()->make<C_operation>(op, node(left), node(right), loc));
+}
+
+Bexpression* C_backend::var_reference(Bvariable* var, const Location& loc)
+{
+        RIN_ASSERT(var);
+        return this->made(this->arena()->make<C_reference>(node(var), loc));
+}
+
+Bexpression* C_backend::float_expression(const mpfr_t* val, const Location& loc)
+{
+        RIN_ASSERT(val);
+        return this->native_float_expression(mpfr_get_d(*val, MPFR_RNDN), loc);
+}
+
+Bexpression* C_backend::integer_expression(const mpfr_t* val, const Location& loc)
+{
+        RIN_ASSERT(val);
+        return this->native_integer_expression(mpfr_get_si(*val, MPFR_RNDN), loc);
+}
+
+Bexpression* C_backend::native_float_expression(double val, const Location& loc)
+{
+        return this->made(this->arena()->make<C_constant>(Interp_value::of_float(val), loc));
+}
+
+Bexpression* C_backend::native_integer_expression(int64_t val, const Location& loc)
+{
+        return this->made(this->arena()->make<C_constant>(Interp_value::of_int(val), loc));
+}
+
+Bexpression* C_backend::call_expression
+(const std::string& name, const std::vector<Bexpression*>& args, const Location& loc)
+{
+        C_call* call = this->arena()->make<C_call>(name, loc);
+        for (auto itr = args.begin(); itr != args.end(); ++itr) {
+                call->args.push_back(node(*itr));
+                call->depth = std::max(call->depth, node(*itr)->depth + 1);
+        }
+        this->_calls.push_back(call);
+        return this->made(call);
+}
+
+Bstatement* C_backend::invalid_statement()
+{
+        return bstatement(this->arena()->make<C_statement>(C_statement::STMT_INVALID,
+                                                           File::unknown_location()));
+}
+
+Bstatement* C_backend::var_dec_statement(Bvariable* var)
+{
+        RIN_ASSERT(var);
+        C_variable* v = node(var);
+        return bstatement(this->arena()->make<C_store>(C_statement::STMT_DECLARE, v, nullptr, 0,
+                                                       v->obj->location()));
+}
+
+Bstatement* C_backend::assignment_statement
+(Bexpression* lhs, Bexpression* rhs, const Location& loc)
+{
+        RIN_ASSERT(lhs && rhs);
+        if (node(lhs)->kind != C_expression::EXPR_VARIABLE)
+                return this->invalid_statement();
+
+        C_variable* var = static_cast<C_reference*>(node(lhs))->var;
+        this->_assignments.push_back(std::make_pair(var, node(rhs)));
+        return bstatement(this->arena()->make<C_store>(C_statement::STMT_ASSIGN, var, node(rhs),
+                                                       0, loc));
+}
+
+Bstatement* C_backend::inc_statement(Bexpression* expr, const Location& loc)
+{
+        RIN_ASSERT(expr);
+        if (node(expr)->kind != C_expression::EXPR_VARIABLE)
+                return this->invalid_statement();
+
+        C_variable* var = static_cast<C_reference*>(node(expr))->var;
+        return bstatement(this->arena()->make<C_store>(C_statement::STMT_STEP, var, nullptr,
+                                                       1, loc));
+}
+
+Bstatement* C_backend::dec_statement(Bexpression* expr, const Location& loc)
+{
+        RIN_ASSERT(expr);
+        if (node(expr)->kind != C_expression::EXPR_VARIABLE)
+                return this->invalid_statement();
+
+        C_variable* var = static_cast<C_reference*>(node(expr))->var;
+        return bstatement(this->arena()->make<C_store>(C_statement::STMT_STEP, var, nullptr,
+                                                       -1, loc));
+}
+
+Bstatement* C_backend::if_statement
+(Bexpression* cond, Scope* then, Scope* else_block, const Location& loc)
+{
+        RIN_ASSERT(cond);
+        RIN_ASSERT(then);
+
+        C_branch* stmt = this->arena()->make<C_branch>(C_statement::STMT_IF, node(cond), loc);
+        stmt->then_block = this->take_statements(then);
+        stmt->else_block = this->take_statements(else_block);
+        stmt->depth = deepest(stmt->else_block, deepest(stmt->then_block, stmt->depth) + 1);
+        return bstatement(check_depth(stmt));
+}
+
+Bstatement* C_backend::for_statement
+(Bstatement* ind, Bstatement* cond, Bstatement* inc, Scope* then_block, const Location& loc)
+{
+        // The condition comes wrapped in an expression statement.
+        C_expression* cond_expr = NULL;
+        if (cond) {
+                if (node(cond)->kind != C_statement::STMT_EXPRESSION)
+                        return this->invalid_statement();
+                cond_expr = static_cast<C_evaluate*>(node(cond))->expr;
+        }
+
+        C_branch* stmt = this->arena()->make<C_branch>(C_statement::STMT_FOR, cond_expr, loc);
+        stmt->ind = (ind) ? node(ind) : NULL;
+        stmt->inc = (inc) ? node(inc) : NULL;
+        stmt->then_block = this->take_statements(then_block);
+        if (stmt->ind)
+                stmt->depth = std::max(stmt->depth, stmt->ind->depth);
+        if (stmt->inc)
+                stmt->depth = std::max(stmt->depth, stmt->inc->depth);
+        stmt->depth = deepest(stmt->then_block, stmt->depth) + 1;
+        return bstatement(check_depth(stmt));
+}
+
+Bstatement* C_backend::expression_statement(Bexpression* expr, const Location& loc)
+{
+        RIN_ASSERT(expr);
+        return bstatement(this->arena()->make<C_evaluate>(C_statement::STMT_EXPRESSION,
+                                                          node(expr), loc));
+}
+
+Bstatement* C_backend::compound_statement
+(Bstatement* first, Bstatement* second, const Location& loc)
+{
+        RIN_ASSERT(first && second);
+        return bstatement(this->arena()->make<C_compound>(node(first), node(second), loc));
+}
+
+Bstatement* C_backend::return_statement(Bexpression* expr, const Location& loc)
+{
+        C_expression* value = (expr) ? node(expr) : NULL;
+        return bstatement(this->arena()->make<C_evaluate>(C_statement::STMT_RETURN, value, loc));
+}
+
+// Whether scope is inner, or nested in it.
+static bool is_within(Scope* scope, Scope* inner)
+{
+        for (; scope; scope = scope->parent()) {
+                if (scope == inner)
+                        return true;
+        }
+        return false;
+}
+
+Bstatement* C_backend::function_statement
+(const std::string& name, const std::vector<std::string>& params,
+ Scope* body, const Location& loc)
+{
+        RIN_ASSERT(body);
+        if (this->_function_index.count(name)) {
+                rin_error_at(loc, "Redefinition of function '%s'", name.c_str());
+                return this->invalid_statement();
+        }
+
+        uint32_t index = this->_functions.size();
+        C_function* fn = this->arena()->make<C_function>();
+        fn->name = name;
+        fn->location = loc;
+
+        // Parameters are the body's first objects, in order.
+        Scope::Var_map* objects = body->variables();
+        for (auto param = params.begin(); param != params.end(); ++param) {
+                Symbol sym = intern(*param);
+                C_variable* var = NULL;
+                for (auto obj = objects->begin(); obj != objects->end(); ++obj) {
+                        if ((*obj)->symbol() == sym) {
+                                var = this->variable_in(*obj, body);
+                                break;
+                        }
+                }
+
+                // A parameter the body never names still takes its argument.
+                if (!var) {
+                        var = this->arena()->make<C_variable>(
+                                this->arena()->make<Named_object>(sym, loc), body);
+                        this->_made.push_back(var);
+                }
+                var->owner = index;
+                fn->params.push_back(var);
+        }
+
+        /*
+         * Every other variable first seen within the body is a local, bar
+         * those of functions nested in it, which have claimed theirs.
+         */
+        auto mark = this->_scope_marks.find(body);
+        size_t first = (mark != this->_scope_marks.end()) ? mark->second : 0;
+        for (size_t i = first; i < this->_made.size(); i++) {
+                C_variable* var = this->_made[i];
+                if (var->owner != 0 || !is_within(var->scope, body))
+                        continue;
+                var->owner = index;
+                fn->locals.push_back(var);
+        }
+
+        this->_function_index[name] = fn;
+        this->_functions.push_back(fn);
+        fn->body = this->take_statements(body);
+        return bstatement(this->arena()->make<C_statement>(C_statement::STMT_NOTHING, loc));
+}
+
+Bstatement* C_backend::break_statement(const Location& loc)
+{ return bstatement(this->arena()->make<C_statement>(C_statement::STMT_BREAK, loc)); }
+
+Bstatement* C_backend::continue_statement(const Location& loc)
+{ return bstatement(this->arena()->make<C_statement>(C_statement::STMT_CONTINUE, loc)); }
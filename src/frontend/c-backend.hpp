@@ -0,0 +1,153 @@
+// c-backend.hpp - A backend that translates programs to C99 source
+#ifndef RIN_C_BACKEND_HPP
+#define RIN_C_BACKEND_HPP
+
+#include "backend.hpp"
+#include "interp-backend.hpp"
+
+// Built by the backend and translated by emit(); see c-backend.cc.
+struct C_expression;
+struct C_statement;
+struct C_variable;
+struct C_function;
+struct C_call;
+
+/*
+ * The C backend translates a whole program to one C99 translation unit,
+ * which any C compiler can build into a native executable, so a program
+ * can be run natively without a GCC tree to build rin1 in. The callbacks
+ * build a small tree, as the VM's do; once the whole program has been
+ * parsed, emit() infers a type for every variable and function result,
+ * and writes the C.
+ *
+ * Values behave as in Vm_backend. A variable only ever assigned integers
+ * is an int64_t, one only assigned doubles a double, and one assigned
+ * both a rin_value, a tagged union checked as it is used. Arithmetic that
+ * C leaves undefined, such as a signed overflow or a shift by 64, goes
+ * through small inline functions that wrap as the interpreter does, and
+ * runtime errors are reported at the location they come from.
+ *
+ * Every function becomes a C function, and the top level becomes main(),
+ * which prints the top-level variables when it is done, as the debug
+ * parser's --run does. Calls deeper than the interpreter allows stop the
+ * program with the same error.
+ */
+class C_backend : public Backend
+{
+public:
+        C_backend();
+
+        /*
+         * Return the program as C source. A program should only be
+         * translated if it parsed without errors.
+         */
+        std::string emit();
+
+        // Deepest nesting of operations, or of blocks, emit() accepts.
+        static const unsigned MAX_DEPTH = 1 << 10;
+
+        // Scopes and statements
+
+        Scope* enter_scope() override;
+        void push_statement(Bstatement* statement) override;
+
+        // Variables
+
+        Bvariable* variable(Named_object* obj) override;
+
+        // Expressions
+
+        Bexpression* invalid_expression() override;
+
+        Bexpression* unary_expression
+        (RIN_OPERATOR op, Bexpression* expr, const Location& loc) override;
+
+        Bexpression* binary_expression
+        (RIN_OPERATOR op, Bexpression* left, Bexpression* right, const Location& loc) override;
+
+        Bexpression* var_reference(Bvariable* var, const Location& loc) override;
+
+        Bexpression* float_expression(const mpfr_t* val, const Location& loc) override;
+        Bexpression* integer_expression(const mpfr_t* val, const Location& loc) override;
+        Bexpression* native_float_expression(double val, const Location& loc) override;
+        Bexpression* native_integer_expression(int64_t val, const Location& loc) override;
+
+        // A condition is the value of its expression.
+        Bexpression* conditional_expression(Bexpression* cond, const Location&) override
+        { return cond; }
+
+        Bexpression* call_expression
+        (const std::string& name, const std::vector<Bexpression*>& args,
+         const Location& loc) override;
+
+        // Statements
+
+        Bstatement* invalid_statement() override;
+
+        Bstatement* var_dec_statement(Bvariable* var) override;
+
+        Bstatement* assignment_statement
+        (Bexpression* lhs, Bexpression* rhs, const Location& loc) override;
+
+        Bstatement* inc_statement(Bexpression* expr, const Location& loc) override;
+        Bstatement* dec_statement(Bexpression* expr, const Location& loc) override;
+
+        Bstatement* if_statement
+        (Bexpression* cond, Scope* then, Scope* else_block, const Location& loc) override;
+
+        Bstatement* for_statement
+        (Bstatement* ind, Bstatement* cond, Bstatement* inc,
+         Scope* then_block, const Location& loc) override;
+
+        Bstatement* expression_statement(Bexpression* expr, const Location& loc) override;
+
+        Bstatement* compound_statement
+        (Bstatement* first, Bstatement* second, const Location& loc) override;
+
+        Bstatement* return_statement(Bexpression* expr, const Location& loc) override;
+
+        Bstatement* function_statement
+        (const std::string& name, const std::vector<std::string>& params,
+         Scope* body, const Location& loc) override;
+
+        Bstatement* break_statement(const Location& loc) override;
+        Bstatement* continue_statement(const Location& loc) override;
+
+private:
+        typedef std::vector<C_statement*> Statement_list;
+
+        // The statements pushed to each scope, taken by the statement it is the body of.
+        std::unordered_map<Scope*, Statement_list> _statements;
+
+        // Take the statements pushed to scope, which may be NULL.
+        Statement_list take_statements(Scope* scope);
+
+        // Every variable, by its object, and in the order they were made.
+        std::unordered_map<Named_object*, C_variable*> _variables;
+        std::vector<C_variable*> _made;
+
+        // For each scope, how many variables had been made when it was entered.
+        std::unordered_map<Scope*, size_t> _scope_marks;
+
+        // Return the variable for obj, made in scope if it is new.
+        C_variable* variable_in(Named_object* obj, Scope* scope);
+
+        // What variables are assigned, and every call, for type inference.
+        std::vector<std::pair<C_variable*, C_expression*> > _assignments;
+        std::vector<C_call*> _calls;
+
+        // Every expression, each after its operands, which infer_types() types in turn.
+        std::vector<C_expression*> _expressions;
+
+        // Keep e, and report it if it nests deeper than emit() can walk.
+        Bexpression* made(C_expression* e);
+
+        // Resolve every call, and give every variable and result a type.
+        void infer_types();
+
+        // The top level, then the functions in the order declared, and the functions by name.
+        std::vector<C_function*> _functions;
+        std::unordered_map<std::string, C_function*> _function_index;
+};
+
+#endif // RIN_C_BACKEND_HPP
@@ -0,0 +1,27 @@
+// context.cc - Settings and state of one compilation
+#include "context.hpp"
+#include "diagnostic.hpp"
+
+// The context entered on the calling thread, if any.
+static thread_local Compilation_context* __current_context__ = NULL;
+
+Compilation_context::Compilation_context()
+{
+        rin_be_get_quotechars(&this->_open_quote, &this->_close_quote);
+}
+
+Compilation_context* Compilation_context::current()
+{
+        if (__current_context__)
+                return __current_context__;
+
+        static Compilation_context default_context;
+        return &default_context;
+}
+
+Compilation_context* Compilation_context::enter(Compilation_context* context)
+{
+        Compilation_context* previous = __current_context__;
+        __current_context__ = context;
+        return previous;
+}
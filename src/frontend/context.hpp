@@ -0,0 +1,60 @@
+// context.hpp - Settings and state of one compilation
+#ifndef RIN_CONTEXT_HPP
+#define RIN_CONTEXT_HPP
+
+#include <rin-system.hpp>
+
+/*
+ * A compilation context holds what belongs to one compilation rather than
+ * to the process: the warning level, and the quote characters diagnostics
+ * are formatted with. Every Backend compiles in a context, and the Parser
+ * and Scanner working for it report through the same one, so independent
+ * compilations may run on different threads of one process.
+ *
+ * Diagnostics are issued through free functions (see diagnostic.hpp),
+ * which use the context current on the calling thread. Parser::parse()
+ * makes its backend's context current for as long as it runs; outside of
+ * a parse, a default context is used.
+ *
+ * A context must not be changed while a parse uses it. The threads that
+ * parse one file share its context (see Parser::set_jobs()).
+ */
+class Compilation_context
+{
+public:
+        Compilation_context();
+
+        Compilation_context(const Compilation_context&) = delete;
+        Compilation_context& operator=(const Compilation_context&) = delete;
+
+        // Only warnings with opt <= warning_level() are reported. Default is 0.
+        int warning_level() const
+        { return this->_warning_level; }
+
+        void set_warning_level(int level)
+        { this->_warning_level = level; }
+
+        // The quote characters the back end formats diagnostics with.
+        const char* open_quote() const
+        { return this->_open_quote; }
+
+        const char* close_quote() const
+        { return this->_close_quote; }
+
+        // Return the calling thread's current context.
+        static Compilation_context* current();
+
+        /*
+         * Make context current on the calling thread, or the default
+         * context if it is NULL. Returns what was entered before, which
+         * may be NULL.
+         */
+        static Compilation_context* enter(Compilation_context* context);
+
+private:
+        int _warning_level = 0;
+        const char* _open_quote = NULL;
+        const char* _close_quote = NULL;
+};
+
+#endif // RIN_CONTEXT_HPP
@@ -126,24 +126,49 @@ static std::string expand_message(const char* fmt, va_list ap)
 
 #pragma GCC diagnostic pop
 
-// Warning level: only warnings with opt <= rin_warning_level are emitted.
-int rin_warning_level = 0;
+const char* rin_open_quote()
+{ return Compilation_context::current()->open_quote(); }
+
+const char* rin_close_quote()
+{ return Compilation_context::current()->close_quote(); }
 
-static const char* cached_open_quote  = NULL;
-static const char* cached_close_quote = NULL;
+// The calling thread's capture, if any.
+static thread_local Diagnostic_buffer* __capture__ = NULL;
 
-const char* rin_open_quote()
+Diagnostic_buffer* Diagnostic_buffer::capture(Diagnostic_buffer* buffer)
 {
-        if (cached_open_quote == NULL)
-                rin_be_get_quotechars(&cached_open_quote, &cached_close_quote);
-        return cached_open_quote;
+        Diagnostic_buffer* previous = __capture__;
+        __capture__ = buffer;
+        return previous;
 }
 
-const char* rin_close_quote()
+void Diagnostic_buffer::issue
+(Diagnostic_kind kind, int opt, const Location& loc, const std::string& message)
+{
+        if (__capture__) {
+                __capture__->_diagnostics.push_back(Diagnostic{ kind, opt, loc, message, Source_pin(loc.source) });
+                return;
+        }
+
+        switch (kind) {
+        case DIAGNOSTIC_ERROR:
+                rin_be_error_at(loc, message);
+                break;
+        case DIAGNOSTIC_WARNING:
+                rin_be_warning_at(loc, opt, message);
+                break;
+        case DIAGNOSTIC_INFORM:
+                rin_be_inform(loc, message);
+                break;
+        }
+}
+
+void Diagnostic_buffer::replay()
 {
-        if (cached_close_quote == NULL)
-                rin_be_get_quotechars(&cached_open_quote, &cached_close_quote);
-        return cached_close_quote;
+        std::vector<Diagnostic> held;
+        held.swap(this->_diagnostics);
+        for (auto itr = held.begin(); itr != held.end(); ++itr)
+                issue(itr->kind, itr->opt, itr->location, itr->message);
 }
 
 void rin_error_at(const Location& loc, const char* fmt, ...)
@@ -151,19 +176,21 @@ void rin_error_at(const Location& loc, const char* fmt, ...)
         va_list ap;
 
         va_start(ap, fmt);
-        rin_be_error_at(loc, expand_message(fmt, ap));
+        Diagnostic_buffer::issue(Diagnostic_buffer::DIAGNOSTIC_ERROR, 0, loc,
+                                 expand_message(fmt, ap));
         va_end(ap);
 }
 
 void rin_warning_at(const Location& loc, int opt, const char* fmt, ...)
 {
-        if (opt > rin_warning_level)
+        if (opt > Compilation_context::current()->warning_level())
                 return;
 
         va_list ap;
 
         va_start(ap, fmt);
-        rin_be_warning_at(loc, opt, expand_message(fmt, ap));
+        Diagnostic_buffer::issue(Diagnostic_buffer::DIAGNOSTIC_WARNING, opt, loc,
+                                 expand_message(fmt, ap));
         va_end(ap);
 }
 
@@ -181,7 +208,8 @@ void rin_inform(const Location& loc, const char* fmt, ...)
         va_list ap;
 
         va_start(ap, fmt);
-        rin_be_inform(loc, expand_message(fmt, ap));
+        Diagnostic_buffer::issue(Diagnostic_buffer::DIAGNOSTIC_INFORM, 0, loc,
+                                 expand_message(fmt, ap));
         va_end(ap);
 }
 
@@ -200,6 +228,5 @@ void rin_debug(const Location& loc, const char* fmt, ...)
         }
         std::string rval = std::string(mbuf);
         free(mbuf);
-        rin_be_inform(loc, rval);
-}
-
+        Diagnostic_buffer::issue(Diagnostic_buffer::DIAGNOSTIC_INFORM, 0, loc, rval);
+}
\ No newline at end of file
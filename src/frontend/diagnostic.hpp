@@ -35,6 +35,7 @@
 #define RIN_DIAGNOSTICS_HPP
 
 #include "backend.hpp"
+#include "context.hpp"
 #include "file.hpp"
 
 #include <cstdarg>
@@ -75,6 +76,8 @@
  *
  * All other format specifiers are as defined by 'sprintf'. The final resulting
  * message is then sent to the back end via rin_be_error_at/rin_be_warning_at.
+ * Warnings above the warning level of the calling thread's compilation
+ * context are dropped (see context.hpp).
  */
 extern void rin_error_at(const Location&, const char* fmt, ...)
         RIN_ATTRIBUTE_GCC_DIAG(2,3);
@@ -114,10 +117,52 @@ extern void rin_be_inform(const Location&, const std::string& infomsg);
 extern void rin_be_get_quotechars(const char** open_quote, const char** close_quote);
 
 /*
- * Warning level controls which warnings are reported.
- * Only warnings with opt <= rin_warning_level are emitted.
- * Default is 0 (report only level-0 warnings).
+ * A diagnostic buffer holds the errors, warnings and notes issued on a
+ * thread while it is that thread's capture, instead of passing them to the
+ * back end, so that work done on several threads can report in a fixed
+ * order. Fatal errors are never held.
  */
-extern int rin_warning_level;
+class Diagnostic_buffer
+{
+public:
+        enum Diagnostic_kind {
+                DIAGNOSTIC_ERROR,
+                DIAGNOSTIC_WARNING,
+                DIAGNOSTIC_INFORM
+        };
+
+        struct Diagnostic {
+                Diagnostic_kind kind;
+                int opt;
+                Location location;
+                std::string message;
+
+                // Keeps location resolvable after its File is closed.
+                Source_pin pin;
+        };
+
+        /*
+         * Hold the calling thread's diagnostics in buffer from now on, or
+         * pass them to the back end again if buffer is NULL. Returns the
+         * capture that was replaced.
+         */
+        static Diagnostic_buffer* capture(Diagnostic_buffer* buffer);
+
+        // Issue a formatted diagnostic through the calling thread's capture.
+        static void issue(Diagnostic_kind kind, int opt, const Location& loc,
+                          const std::string& message);
+
+        /*
+         * Issue the held diagnostics again, in order, through the calling
+         * thread's capture, and empty the buffer.
+         */
+        void replay();
+
+        const std::vector<Diagnostic>& diagnostics() const
+        { return this->_diagnostics; }
+
+private:
+        std::vector<Diagnostic> _diagnostics;
+};
 
 #endif // RIN_DIAGNOSTICS_HPP
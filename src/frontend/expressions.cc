@@ -1,108 +1,62 @@
 // expressions.cc - Expression factory methods and backend code generation
 #include "expressions.hpp"
+#include "flat.hpp"
 
-Expression* Expression::make_invalid(const Location& loc)
-{ return new Invalid_expression(loc); }
+Expression* Expression::make_invalid(Arena* arena, const Location& loc)
+{ return arena->make<Invalid_expression>(loc); }
 
 Expression* Expression::make_unary
-(RIN_OPERATOR op, Expression* expr, const Location& loc)
-{ return new Unary_expression(op, expr, loc); }
+(Arena* arena, RIN_OPERATOR op, Expression* expr, const Location& loc)
+{ return arena->make<Unary_expression>(op, expr, loc); }
 
 Expression* Expression::make_binary
-(RIN_OPERATOR op, Expression* left, Expression* right, const Location& loc)
-{ return new Binary_expression(op, left, right, loc); }
+(Arena* arena, RIN_OPERATOR op, Expression* left, Expression* right, const Location& loc)
+{ return arena->make<Binary_expression>(op, left, right, loc); }
 
-Expression* Expression::make_var_reference(Named_object* var, const Location& loc)
-{ return new Var_expression(var, loc); }
+Expression* Expression::make_var_reference(Arena* arena, Named_object* var, const Location& loc)
+{ return arena->make<Var_expression>(var, loc); }
 
-Expression* Expression::make_conditional(Expression* cond, const Location& loc)
-{ return new Conditional_expression(cond, loc); }
+Expression* Expression::make_conditional(Arena* arena, Expression* cond, const Location& loc)
+{ return arena->make<Conditional_expression>(cond, loc); }
 
-Expression* Expression::make_float(const mpfr_t* val, const Location& loc)
-{ return new Float_expression(val, loc); }
+Expression* Expression::make_float(Arena* arena, Source_span text, const Location& loc)
+{ return arena->make<Float_expression>(text, loc); }
 
-Expression* Expression::make_integer(const mpfr_t* val, const Location& loc)
-{ return new Integer_expression(val, loc); }
+Expression* Expression::make_integer(Arena* arena, Source_span text, const Location& loc)
+{ return arena->make<Integer_expression>(text, loc); }
 
 Expression* Expression::make_call
-(const std::string& name, std::vector<Expression*>& args, const Location& loc)
-{ return new Call_expression(name, args, loc); }
+(Arena* arena, const std::string& name, std::vector<Expression*>& args, const Location& loc)
+{ return arena->make<Call_expression>(name, args, loc); }
 
 // Invalid_expression implementation:
 
 Bexpression* Invalid_expression::do_get_backend(Backend* backend)
 { RIN_UNREACHABLE(); }
 
-// Unary_expression implementation:
-
-Bexpression* Unary_expression::do_get_backend(Backend* backend)
+/*
+ * Compound expressions are lowered from the backend's flat AST in a single
+ * loop. Trees the parser did not lay out there are flattened first.
+ */
+static Bexpression* lower_flat(Expression* expr, Backend* backend)
 {
         RIN_ASSERT(backend);
+        Flat_ast* flat = backend->flat_ast();
+        uint32_t root = expr->flat_node();
+        if (!flat->contains(root))
+                root = flat->flatten(expr);
+        return flat->lower(root, backend);
+}
 
-        RIN_ASSERT(this->op() == OPER_INC || this->op() == OPER_DEC
-                   || this->op() == OPER_NOT || this->op() == OPER_NEG
-                   || this->op() == OPER_BNOT);
-
-        /*
-         * Increment and decrement require an lvalue (variable reference).
-         * NOT, NEG, and BNOT can operate on any expression.
-         */
-        if (this->op() != OPER_NOT && this->op() != OPER_NEG &&
-            this->op() != OPER_BNOT &&
-            this->operand()->classification() != Expression::EXPRESSION_VAR_REFERENCE) {
-                rin_error_at(this->location(), "lvalue required as increment/decrement operand");
-                return backend->invalid_expression();
-        }
-
-        Bexpression* expr = this->operand()->get_backend(backend);
-        RIN_ASSERT(expr);
+// Unary_expression implementation:
 
-        return backend->unary_expression
-                (this->op(), expr, this->location());
-}
+Bexpression* Unary_expression::do_get_backend(Backend* backend)
+{ return lower_flat(this, backend); }
 
 // Binary_expression implementation:
 
-Binary_expression::~Binary_expression()
-{
-        delete _left;
-        delete _right;
-}
-
 Bexpression* Binary_expression::do_get_backend(Backend* backend)
-{
-        RIN_ASSERT(backend);
-        RIN_ASSERT(this->left() != NULL && this->right() != NULL);
-
-        /*
-         * See operators.cc. If the precedence of the operator
-         * is less than or equal to -1 then it cant be used
-         * in a binary expression.
-         */
-        RIN_ASSERT(OPERATOR_PRECEDENCE[this->op()] > -1);
-
-        /*
-         * Binary expressions can only be formed from float, integer, unary,
-         * binary, or var reference children.
-         */
-        Expression_classification left_c = this->left()->classification();
-        RIN_ASSERT(left_c == EXPRESSION_FLOAT || left_c == EXPRESSION_INTEGER ||
-                   left_c == EXPRESSION_BINARY ||
-                   left_c == EXPRESSION_UNARY || left_c == EXPRESSION_VAR_REFERENCE);
-
-        Expression_classification right_c = this->right()->classification();
-        RIN_ASSERT(right_c == EXPRESSION_FLOAT || right_c == EXPRESSION_INTEGER ||
-                   right_c == EXPRESSION_BINARY ||
-                   right_c == EXPRESSION_UNARY || right_c == EXPRESSION_VAR_REFERENCE);
-
-        // Create backend expressions
-        Bexpression* bleft = this->left()->get_backend(backend);
-        Bexpression* bright = this->right()->get_backend(backend);
-        RIN_ASSERT(bleft != NULL && bright != NULL);
-
-        return backend->binary_expression(this->op(), bleft,
-                bright, this->location());
-}
+{ return lower_flat(this, backend); }
 
 // Var_expression implementation:
 
@@ -120,59 +74,140 @@ Bexpression* Var_expression::do_get_backend(Backend* backend) {
 // Conditional_expression implementation:
 
 Bexpression* Conditional_expression::do_get_backend(Backend* backend)
+{ return lower_flat(this, backend); }
+
+// Float_expression implementation
+
+/*
+ * Parse a float literal ([0-9]+(.[0-9]+)?f?) into a double, if the double
+ * holds its value exactly. The literal is m / 10^k for an integer m and k
+ * fractional digits, which is exact iff 5^k divides m and m / 5^k fits in
+ * a 53-bit significand; the result is then (m / 5^k) * 2^-k.
+ */
+static bool parse_exact_double(Source_span text, double* out)
 {
-        RIN_ASSERT(backend);
-        RIN_ASSERT(this->condition());
+        const char* p = text.begin();
+        const char* end = text.end();
+        if (p < end && end[-1] == 'f')
+                end--;
+
+        const char* dot = std::find(p, end, '.');
+        const char* frac_end = end;
+        if (dot != end) {
+                while (frac_end > dot + 1 && frac_end[-1] == '0')
+                        frac_end--;
+        }
+
+        uint64_t m = 0;
+        int k = 0;
+        for (; p < frac_end; p++) {
+                if (p == dot)
+                        continue;
+                unsigned digit = *p - '0';
+                if (m > (UINT64_MAX - digit) / 10)
+                        return false;
+                m = m * 10 + digit;
+                if (p > dot && dot != end)
+                        k++;
+        }
 
-        // Must be of type float, integer, binary, unary, or var reference.
-        Expression_classification cls = this->condition()->classification();
-        RIN_ASSERT(cls == EXPRESSION_FLOAT || cls == EXPRESSION_INTEGER ||
-                   cls == EXPRESSION_BINARY ||
-                   cls == EXPRESSION_UNARY || cls == EXPRESSION_VAR_REFERENCE);
+        // 5^27 is the largest power of five that fits in 64 bits.
+        if (k > 27)
+                return false;
 
-        // Build backend expression.
-        Bexpression* cond = this->condition()->get_backend(backend);
-        RIN_ASSERT(cond);
+        uint64_t pow5 = 1;
+        for (int i = 0; i < k; i++)
+                pow5 *= 5;
+        if (m % pow5 != 0)
+                return false;
 
-        // Create backend conditional expression
-        return backend->conditional_expression(cond, this->location());
+        uint64_t q = m / pow5;
+        if (q >= (uint64_t)1 << 53)
+                return false;
+
+        *out = ldexp((double)q, -k);
+        return true;
 }
 
-// Float_expression implementation
+Float_expression::Float_expression(Source_span text, const Location& loc)
+        : Expression(EXPRESSION_FLOAT, loc), _native(0)
+{
+        this->_is_native = parse_exact_double(text, &this->_native);
+        if (this->_is_native)
+                return;
+
+        // The 'f' suffix is not part of the number.
+        std::string str = text.str();
+        if (!str.empty() && str.back() == 'f')
+                str.pop_back();
+        mpfr_init_set_str(this->_val, str.c_str(), 10, MPFR_RNDN);
+}
 
 Bexpression* Float_expression::do_get_backend(Backend* backend)
 {
         RIN_ASSERT(backend);
 
+        if (this->_is_native)
+                return backend->native_float_expression(this->_native, this->location());
+
         /*
          * Float expression implementation must copy this->value()
-         * otherwise it will be deleted once this expression is
-         * deallocated.
+         * otherwise it will be cleared once the arena holding this
+         * expression is.
          */
         return backend->float_expression(this->value(), this->location());
 }
 
 // Integer_expression implementation
 
-Bexpression* Integer_expression::do_get_backend(Backend* backend)
+// Parse a decimal or 0x-prefixed hex literal that fits in an int64_t.
+static bool parse_int64(Source_span text, int64_t* out)
 {
-        RIN_ASSERT(backend);
-        return backend->integer_expression(this->value(), this->location());
+        const char* p = text.begin();
+        const char* end = text.end();
+        unsigned base = 10;
+        if (end - p > 2 && p[0] == '0' && p[1] == 'x') {
+                base = 16;
+                p += 2;
+        }
+
+        uint64_t val = 0;
+        for (; p < end; p++) {
+                unsigned digit;
+                if (*p >= '0' && *p <= '9')
+                        digit = *p - '0';
+                else if (*p >= 'a' && *p <= 'f')
+                        digit = *p - 'a' + 10;
+                else
+                        digit = *p - 'A' + 10;
+
+                if (val > (uint64_t)(INT64_MAX - digit) / base)
+                        return false;
+                val = val * base + digit;
+        }
+
+        *out = val;
+        return true;
 }
 
-// Call_expression implementation
+Integer_expression::Integer_expression(Source_span text, const Location& loc)
+        : Expression(EXPRESSION_INTEGER, loc), _native(0)
+{
+        this->_is_native = parse_int64(text, &this->_native);
+        if (!this->_is_native)
+                mpfr_init_set_str(this->_val, text.str().c_str(), 0, MPFR_RNDN);
+}
 
-Bexpression* Call_expression::do_get_backend(Backend* backend)
+Bexpression* Integer_expression::do_get_backend(Backend* backend)
 {
         RIN_ASSERT(backend);
 
-        // Build backend expressions for each argument.
-        std::vector<Bexpression*> bargs;
-        for (auto itr = _args.begin(); itr != _args.end(); ++itr) {
-                Bexpression* barg = (*itr)->get_backend(backend);
-                bargs.push_back(barg);
-        }
-
-        return backend->call_expression(this->name(), bargs, this->location());
+        if (this->_is_native)
+                return backend->native_integer_expression(this->_native, this->location());
+        return backend->integer_expression(this->value(), this->location());
 }
 
+// Call_expression implementation
+
+Bexpression* Call_expression::do_get_backend(Backend* backend)
+{ return lower_flat(this, backend); }
@@ -13,7 +13,7 @@ class Integer_expression;
 class Call_expression;
 
 // operators.cc
-extern int OPERATOR_PRECEDENCE[];
+extern const int OPERATOR_PRECEDENCE[];
 
 // An expression is a statement's constituent
 class Expression
@@ -31,7 +31,11 @@ public:
                 : _classification(cl), _location(loc)
         {}
 
-        virtual ~Expression() {}
+        // Flat node of an expression that is not in the flat AST.
+        static const uint32_t NO_FLAT_NODE = UINT32_MAX;
+
+        // Expressions live in an Arena and are never deleted one by one.
+        void operator delete(void*) = delete;
 
         // Return the expression's classification
         Expression_classification classification() const
@@ -48,32 +52,41 @@ public:
         Location location() const
         { return this->_location; }
 
+        // Return the expression's node in the backend's flat AST (see flat.hpp).
+        uint32_t flat_node() const
+        { return this->_flat_node; }
+
+        void set_flat_node(uint32_t node)
+        { this->_flat_node = node; }
+
+        // Expression factories construct their expression in arena.
+
         // Make an invalid expression
-        static Expression* make_invalid(const Location& loc);
+        static Expression* make_invalid(Arena* arena, const Location& loc);
 
         // Make unary expression
         static Expression* make_unary
-        (RIN_OPERATOR op, Expression* expr, const Location& loc);
+        (Arena* arena, RIN_OPERATOR op, Expression* expr, const Location& loc);
 
         // Make binary expression
         static Expression* make_binary
-        (RIN_OPERATOR op, Expression* left, Expression* right, const Location& loc);
+        (Arena* arena, RIN_OPERATOR op, Expression* left, Expression* right, const Location& loc);
 
         // Make variable reference
-        static Expression* make_var_reference(Named_object* var, const Location& loc);
+        static Expression* make_var_reference(Arena* arena, Named_object* var, const Location& loc);
 
-        // Make float expression
-        static Expression* make_float(const mpfr_t* val, const Location& loc);
+        // Make float expression from the literal's source text
+        static Expression* make_float(Arena* arena, Source_span text, const Location& loc);
 
-        // Make integer expression
-        static Expression* make_integer(const mpfr_t* val, const Location& loc);
+        // Make integer expression from the literal's source text
+        static Expression* make_integer(Arena* arena, Source_span text, const Location& loc);
 
         // make conditional expression
-        static Expression* make_conditional(Expression* cond, const Location& loc);
+        static Expression* make_conditional(Arena* arena, Expression* cond, const Location& loc);
 
         // Make a function call expression
         static Expression* make_call
-        (const std::string& name, std::vector<Expression*>& args, const Location& loc);
+        (Arena* arena, const std::string& name, std::vector<Expression*>& args, const Location& loc);
 
         // Converts the expression to a unary expression type
         Unary_expression* unary_expression()
@@ -112,6 +125,7 @@ protected:
 
 private:
         Expression_classification _classification;
+        uint32_t                  _flat_node = NO_FLAT_NODE;
         Location                  _location;
 
         // Convert an expression to the specified type
@@ -158,9 +172,6 @@ public:
                   _op(op), _expr(expr)
         { RIN_ASSERT(expr); }
 
-        ~Unary_expression() override
-        { delete this->_expr; }
-
         // Return the operand
         Expression* operand() const
         { return this->_expr; }
@@ -190,8 +201,6 @@ public:
                   _op(op), _left(left), _right(right)
         {}
 
-        ~Binary_expression() override;
-
         // Return the operator
         RIN_OPERATOR op()
         { return this->_op; }
@@ -222,8 +231,6 @@ public:
                   _variable(variable)
         {}
 
-        ~Var_expression() override {}
-
         // Return the variable
         Named_object* named_object() const
         { return this->_variable; }
@@ -244,9 +251,6 @@ public:
                   _cond(cond)
         {}
 
-        ~Conditional_expression() override
-        { delete this->_cond;}
-
         // Return the condition
         Expression* condition()
         { return this->_cond; }
@@ -258,61 +262,95 @@ private:
         Expression* _cond;
 };
 
-// A float expression, i.e: 3.01 or 3f
+/*
+ * A float expression, i.e: 3.01 or 3f. Literals whose value a double holds
+ * exactly are kept as a double; anything else is parsed into an mpfr.
+ */
 class Float_expression : public Expression
 {
 public:
-        Float_expression(const mpfr_t* val, const Location& loc)
-                : Expression(EXPRESSION_FLOAT, loc)
+        Float_expression(Source_span text, const Location& loc);
+
+        ~Float_expression()
         {
-                RIN_ASSERT(val);
-                mpfr_init_set(this->_val, *val, MPFR_RNDN);
+                if (!this->_is_native)
+                        mpfr_clear(this->_val);
         }
 
-        ~Float_expression() override
-        { mpfr_clear(_val); }
-
         // Whether the current value is equivalent to zero.
         bool is_zero_value() const
         {
+                if (this->_is_native)
+                        return this->_native == 0;
                 return mpfr_zero_p(this->_val) != 0
                         && mpfr_signbit(this->_val) == 0;
         }
 
+        // Whether the value is held as a double rather than an mpfr.
+        bool is_native() const
+        { return this->_is_native; }
+
+        double native_value() const
+        {
+                RIN_ASSERT(this->_is_native);
+                return this->_native;
+        }
+
         // Return a pointer to the mpfr_t float value.
         mpfr_t* value()
-        { return &_val; }
+        {
+                RIN_ASSERT(!this->_is_native);
+                return &_val;
+        }
 
 protected:
         Bexpression* do_get_backend(Backend* backend) override;
 
 private:
+        bool   _is_native;
+        double _native;
         mpfr_t _val;
 };
 
-// An integer expression, i.e: 42
+/*
+ * An integer expression, i.e: 42 or 0x2A. Literals that fit in an int64_t
+ * are kept native; larger ones are parsed into an mpfr.
+ */
 class Integer_expression : public Expression
 {
 public:
-        Integer_expression(const mpfr_t* val, const Location& loc)
-                : Expression(EXPRESSION_INTEGER, loc)
+        Integer_expression(Source_span text, const Location& loc);
+
+        ~Integer_expression()
         {
-                RIN_ASSERT(val);
-                mpfr_init_set(this->_val, *val, MPFR_RNDN);
+                if (!this->_is_native)
+                        mpfr_clear(this->_val);
         }
 
-        ~Integer_expression() override
-        { mpfr_clear(_val); }
+        // Whether the value is held as an int64_t rather than an mpfr.
+        bool is_native() const
+        { return this->_is_native; }
+
+        int64_t native_value() const
+        {
+                RIN_ASSERT(this->_is_native);
+                return this->_native;
+        }
 
         // Return a pointer to the mpfr_t integer value.
         mpfr_t* value()
-        { return &_val; }
+        {
+                RIN_ASSERT(!this->_is_native);
+                return &_val;
+        }
 
 protected:
         Bexpression* do_get_backend(Backend* backend) override;
 
 private:
-        mpfr_t _val;
+        bool    _is_native;
+        int64_t _native;
+        mpfr_t  _val;
 };
 
 // A function call expression, i.e: myFunc(a, b)
@@ -325,12 +363,6 @@ public:
                   _name(name), _args(args)
         {}
 
-        ~Call_expression() override
-        {
-                for (auto itr = _args.begin(); itr != _args.end(); ++itr)
-                        delete *itr;
-        }
-
         // Return the function name
         const std::string& name() const
         { return this->_name; }
@@ -1,53 +1,324 @@
 // file.cc - File reading, character streaming, and location management
 #include "file.hpp"
+#include "diagnostic.hpp"
+#include "simd.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Every source opened so far, indexed by id. Slot 0 is never used so that
+ * an id of 0 can stand for "no source". Ids are never reused: a record
+ * keeps its filename after its File is closed, and its line table while
+ * anything still resolves locations into it. A deque keeps references to
+ * records stable as it grows.
+ */
+struct Source_record {
+        // The open File, or NULL once it has been closed.
+        const File* file = NULL;
+        std::string filename;
+
+        // Offset of the first character of every line, in ascending order.
+        std::vector<uint32_t> line_starts;
+
+        // The File, its open views and the pins on it; the table is freed at 0.
+        unsigned users = 0;
+};
+
+static std::deque<Source_record> __source_registry__(1);
+
+// Guards the registry; files may be opened by compilations on other threads.
+static std::mutex __source_registry_lock__;
+
+// The offset File::unknown_location() uses to mark itself.
+static const uint32_t UNKNOWN_OFFSET = UINT32_MAX;
+
+static const std::string __no_filename__ = "";
+static const std::string __unknown_filename__ = "unknown";
+
+// The record of id, or NULL. The registry must be locked.
+static Source_record* find_record(uint32_t id)
+{
+        if (id == 0 || id >= __source_registry__.size())
+                return NULL;
+        return &__source_registry__[id];
+}
+
+// Count a user of id's line table. The registry must be locked.
+static void retain(uint32_t id)
+{
+        Source_record* record = find_record(id);
+        if (record)
+                record->users++;
+}
+
+// Stop counting a user of id's line table, freeing it after the last.
+static void release(uint32_t id)
+{
+        Source_record* record = find_record(id);
+        if (record && record->users > 0 && --record->users == 0)
+                std::vector<uint32_t>().swap(record->line_starts);
+}
+
+static const Source_record* source_record(uint32_t id)
+{
+        std::lock_guard<std::mutex> lock(__source_registry_lock__);
+        return find_record(id);
+}
+
+const File* File::lookup(uint32_t id)
+{
+        const Source_record* record = source_record(id);
+        return record ? record->file : NULL;
+}
+
+/*
+ * The line of record's source that offset is on, counted from 0, or -1
+ * once the line table has been freed. The registry must be locked.
+ */
+static int line_of(const Source_record* record, uint32_t offset)
+{
+        const std::vector<uint32_t>& starts = record->line_starts;
+        return std::upper_bound(starts.begin(), starts.end(), offset) - starts.begin() - 1;
+}
+
+int Location::line() const
+{
+        std::lock_guard<std::mutex> lock(__source_registry_lock__);
+        const Source_record* record = find_record(this->source);
+        if (record == NULL)
+                return (this->offset == UNKNOWN_OFFSET) ? -1 : 0;
+        return line_of(record, this->offset);
+}
+
+int Location::column() const
+{
+        std::lock_guard<std::mutex> lock(__source_registry_lock__);
+        const Source_record* record = find_record(this->source);
+        if (record == NULL)
+                return (this->offset == UNKNOWN_OFFSET) ? -1 : 0;
+
+        int line = line_of(record, this->offset);
+        return (line < 0) ? -1 : this->offset - record->line_starts[line];
+}
+
+const std::string& Location::filename() const
+{
+        const Source_record* record = source_record(this->source);
+        if (record == NULL)
+                return (this->offset == UNKNOWN_OFFSET) ? __unknown_filename__
+                                                        : __no_filename__;
+        return record->filename;
+}
 
 void File::open(const std::string& path)
 {
-        if (this->buffer.is_open())
-                this->buffer.close();
+        this->load(path);
+        this->publish();
+}
 
-        this->buffer.open(path, std::ifstream::in | std::ifstream::binary);
-        this->is_finished = false;
+void File::load(const std::string& path)
+{
+        this->close();
+        this->path = path;
+
+#ifndef _WIN32
+        // Open the source once: a FIFO must not be opened a second time to
+        // read it, or what its writer sent to the first open is lost.
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+                return;
+
+        if (!this->map_source(fd))
+                this->read_stream(fd);
+        ::close(fd);
+#else
+        this->read_stream(path);
+#endif
 
-        this->loc.filename = path;
-        this->loc.offset   = 0;
-        this->loc.line     = 0;
-        this->loc.column   = 0;
+        // Locations hold 32-bit offsets into their source.
+        if (this->opened && this->size > UINT32_MAX) {
+                rin_error_at(File::unknown_location(), "Source %s is too large: sources are limited to 4 GiB",
+                             path.c_str());
+                this->close();
+        }
 }
 
-void File::reset()
+void File::publish(std::vector<uint32_t>* line_starts)
 {
-        this->is_finished = false;
-        this->buffer.seekg(0, std::ios::beg);
+        RIN_ASSERT(this->_id == 0 && !this->view);
+
+        std::vector<uint32_t> computed;
+        if (!line_starts) {
+                scan_line_starts(this->data, this->size, computed);
+                line_starts = &computed;
+        }
+
+        std::lock_guard<std::mutex> lock(__source_registry_lock__);
+        RIN_ASSERT(__source_registry__.size() <= UINT32_MAX);
+        __source_registry__.emplace_back();
+        Source_record& record = __source_registry__.back();
+        record.file = this;
+        record.filename = this->path;
+        record.line_starts.swap(*line_starts);
+        record.users = 1;
+
+        this->_id = __source_registry__.size() - 1;
 }
 
-int File::get_char()
+void File::open_view(const File& whole, uint32_t begin, uint32_t end)
 {
-        if (this->is_finished || !this->buffer.is_open())
-                return EOF;
+        this->close();
+        RIN_ASSERT(whole.opened);
+        RIN_ASSERT(begin <= end && end <= whole.size);
+
+        this->path   = whole.path;
+        this->data   = whole.data;
+        this->size   = end;
+        this->pos    = begin;
+        this->start  = begin;
+        this->opened = true;
+        this->view   = true;
+        this->_id    = whole._id;
+
+        std::lock_guard<std::mutex> lock(__source_registry_lock__);
+        retain(this->_id);
+}
+
+#ifndef _WIN32
+bool File::map_source(int fd)
+{
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+                return false;
+
+        // Empty files cannot be mapped, but they are still valid sources.
+        if (st.st_size == 0) {
+                this->opened = true;
+                return true;
+        }
+
+        void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+                return false;
+
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        this->data   = static_cast<const char*>(map);
+        this->size   = st.st_size;
+        this->mapped = true;
+        this->opened = true;
+        return true;
+}
 
-        if (this->buffer.peek() == EOF) {
-                this->is_finished = true;
-                return EOF;
+void File::read_stream(int fd)
+{
+        char chunk[1 << 16];
+        for (;;) {
+                ssize_t got = ::read(fd, chunk, sizeof(chunk));
+                if (got < 0 && errno == EINTR)
+                        continue;
+                if (got < 0)
+                        return;
+                if (got == 0)
+                        break;
+                this->stream_buffer.insert(this->stream_buffer.end(), chunk, chunk + got);
         }
 
-        int ch = this->buffer.get();
-        this->loc.offset++;
-        this->loc.column++;
-        if (ch == '\n') {
-                this->loc.column = 0;
-                this->loc.line++;
+        this->data   = this->stream_buffer.data();
+        this->size   = this->stream_buffer.size();
+        this->opened = true;
+}
+#else
+void File::read_stream(const std::string& path)
+{
+        std::ifstream stream(path, std::ifstream::in | std::ifstream::binary);
+        if (!stream.is_open())
+                return;
+
+        this->stream_buffer.assign(std::istreambuf_iterator<char>(stream),
+                                   std::istreambuf_iterator<char>());
+        this->data   = this->stream_buffer.data();
+        this->size   = this->stream_buffer.size();
+        this->opened = true;
+}
+#endif
+
+void File::close()
+{
+        if (this->_id != 0) {
+                std::lock_guard<std::mutex> lock(__source_registry_lock__);
+                if (!this->view)
+                        __source_registry__[this->_id].file = NULL;
+                release(this->_id);
         }
+        this->_id = 0;
 
-        return ch;
+#ifndef _WIN32
+        if (this->mapped)
+                munmap(const_cast<char*>(this->data), this->size);
+#endif
+        this->stream_buffer.clear();
+        this->data = NULL;
+        this->size = 0;
+        this->pos  = 0;
+        this->opened = false;
+        this->mapped = false;
+        this->is_finished = false;
+        this->view = false;
+        this->start = 0;
+}
+
+void File::reset()
+{
+        this->is_finished = false;
+        this->pos = this->start;
+}
+
+void File::seek(const char* p)
+{
+        RIN_ASSERT(p >= this->cursor() && p <= this->end());
+        this->pos = p - this->data;
+}
+
+void File::rewind(const char* p)
+{
+        RIN_ASSERT(p >= this->data + this->start && p <= this->end());
+        this->pos = p - this->data;
+        this->is_finished = false;
 }
 
 Location File::unknown_location()
 {
         Location loc;
-        loc.filename = "unknown";
-        loc.offset   = -1;
-        loc.line     = -1;
-        loc.column   = -1;
+        loc.offset = UNKNOWN_OFFSET;
         return loc;
 }
+
+Source_pin::Source_pin(uint32_t id) : _id(id)
+{
+        std::lock_guard<std::mutex> lock(__source_registry_lock__);
+        retain(this->_id);
+}
+
+Source_pin& Source_pin::operator=(const Source_pin& other)
+{
+        std::lock_guard<std::mutex> lock(__source_registry_lock__);
+        retain(other._id);
+        release(this->_id);
+        this->_id = other._id;
+        return *this;
+}
+
+Source_pin::~Source_pin()
+{
+        std::lock_guard<std::mutex> lock(__source_registry_lock__);
+        release(this->_id);
+}
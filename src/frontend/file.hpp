@@ -9,42 +9,185 @@
 #define EOF (-1)
 #endif /* EOF */
 
+/*
+ * A File exposes a whole source as one contiguous, read-only buffer.
+ * Regular files are memory-mapped; anything that cannot be mapped
+ * (pipes, FIFOs, character devices) is read from the same descriptor
+ * into an owned buffer instead. Either way the scanner can walk the source
+ * with a plain pointer via begin(), cursor() and end().
+ *
+ * On open(), a File is registered under a numeric id so that tokens and
+ * locations can refer to their source without holding a pointer or a copy
+ * of the filename. The source's text is only reachable while the File is
+ * open. Its filename outlives close(), and its line table lasts until the
+ * File, every view of it and every Source_pin on it are gone: a diagnostic
+ * held for later pins the source its location is in.
+ */
 class File
 {
 public:
         File(){}
         explicit File(const std::string& path) : path(path) {open(path);};
-        ~File() {if (buffer.is_open()) buffer.close();}
+        ~File() { this->close(); }
+
+        File(const File&) = delete;
+        File& operator=(const File&) = delete;
 
         // set source to path
         void open(const std::string& path);
 
+        /*
+         * open() in two steps: load() makes the source's text readable, and
+         * publish() then registers it under an id with its line table. The
+         * table is computed unless it is given, e.g. by a token cache (see
+         * token-cache.hpp), in which case it is moved out of line_starts.
+         */
+        void load(const std::string& path);
+        void publish(std::vector<uint32_t>* line_starts = NULL);
+
+        /*
+         * Read [begin, end) of an open file without copying it. The view
+         * shares the whole file's buffer and id, so its locations are those
+         * of the whole file; it must be closed before the whole file is.
+         */
+        void open_view(const File& whole, uint32_t begin, uint32_t end);
+
+        // Release the source buffer.
+        void close();
+
         bool is_open()
-        { return this->buffer.is_open(); }
+        { return this->opened; }
 
         bool has_next()
         { return (!this->is_finished && this->is_open()); }
 
+        // Whether the source buffer is memory-mapped.
+        bool is_mapped() const
+        { return this->mapped; }
+
+        // The location of the read cursor.
         Location get_loc() const
-        { return this->loc; }
+        {
+                Location loc;
+                loc.source = this->_id;
+                loc.offset = this->pos;
+                return loc;
+        }
 
         // restart reading file
         void reset();
 
         // return next char (-1 if EOF)
-        int get_char();
+        int get_char()
+        {
+                if (this->is_finished || !this->opened)
+                        return EOF;
+
+                if (this->pos >= this->size) {
+                        this->is_finished = true;
+                        return EOF;
+                }
+
+                return (unsigned char)this->data[this->pos++];
+        }
 
         // return next char without affecting buffer (-1 if EOF)
-        int peek()
-        { return this->buffer.peek(); }
+        int peek() const
+        {
+                if (this->pos >= this->size)
+                        return EOF;
+                return (unsigned char)this->data[this->pos];
+        }
+
+        // Return the bounds of the source buffer and the read cursor.
+        const char* begin() const
+        { return this->data; }
+
+        const char* end() const
+        { return this->data + this->size; }
+
+        const char* cursor() const
+        { return this->data + this->pos; }
+
+        /*
+         * Move the read cursor forward to p, which must lie between
+         * cursor() and end().
+         */
+        void seek(const char* p);
+
+        // Move the read cursor to p, before or after it, and read on from there.
+        void rewind(const char* p);
+
+        // Move the read cursor to the end, as if every character was read.
+        void finish()
+        {
+                this->pos = this->size;
+                this->is_finished = true;
+        }
+
+        // Id this file is registered under, or 0 if closed.
+        uint32_t id() const
+        { return this->_id; }
+
+        const std::string& filename() const
+        { return this->path; }
+
+        // Return the open file registered under id, or NULL.
+        static const File* lookup(uint32_t id);
+
+        // Return the text in [offset, offset + length) of the source.
+        Source_span span(uint32_t offset, uint32_t length) const
+        {
+                RIN_ASSERT(offset + length <= this->size);
+                return Source_span(this->data + offset, length);
+        }
 
         static Location unknown_location();
 
 private:
+#ifndef _WIN32
+        // Memory-map the regular file open on fd. Returns false if it cannot be mapped.
+        bool map_source(int fd);
+
+        // Read a non-mappable source from fd to its end into the owned buffer.
+        void read_stream(int fd);
+#else
+        // Read the source into the owned buffer.
+        void read_stream(const std::string& path);
+#endif
+
         std::string path = "";
-        std::ifstream buffer;
+        const char* data = NULL;
+        size_t size = 0;
+        size_t pos = 0;
+        bool opened = false;
+        bool mapped = false;
         bool is_finished = false;
-        Location loc;
+        uint32_t _id = 0;
+
+        // Set by open_view(): the buffer and id belong to another File.
+        bool view = false;
+        size_t start = 0;
+
+        // Fallback storage when the source is not memory-mapped.
+        std::vector<char> stream_buffer;
+};
+
+/*
+ * Keeps the line table of a source, so that locations in it still resolve
+ * once its File is closed, for as long as the pin lives.
+ */
+class Source_pin
+{
+public:
+        Source_pin() {}
+        explicit Source_pin(uint32_t id);
+        Source_pin(const Source_pin& other) : Source_pin(other._id) {}
+        Source_pin& operator=(const Source_pin& other);
+        ~Source_pin();
+
+private:
+        uint32_t _id = 0;
 };
 
 #endif /* RIN_FILE_H */
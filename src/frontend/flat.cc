@@ -0,0 +1,301 @@
+// flat.cc - Flat, index-based expression storage for lowering
+#include "flat.hpp"
+#include "expressions.hpp"
+
+Flat_ast* Backend::flat_ast()
+{
+        if (!this->_flat)
+                this->_flat = this->_arena.make<Flat_ast>();
+        return this->_flat;
+}
+
+// Whether expr increments or decrements something that is not a variable.
+static bool is_not_lvalue(Expression* expr)
+{
+        Unary_expression* unary = expr->unary_expression();
+        if (!unary || (unary->op() != OPER_INC && unary->op() != OPER_DEC))
+                return false;
+        return unary->operand()->classification() != Expression::EXPRESSION_VAR_REFERENCE;
+}
+
+// Whether expr may be an operand of a binary or conditional expression.
+static bool is_operand(Expression* expr)
+{
+        switch (expr->classification()) {
+        case Expression::EXPRESSION_FLOAT:
+        case Expression::EXPRESSION_INTEGER:
+        case Expression::EXPRESSION_BINARY:
+        case Expression::EXPRESSION_UNARY:
+        case Expression::EXPRESSION_VAR_REFERENCE:
+                return true;
+        default:
+                return false;
+        }
+}
+
+Expression* Flat_ast::child(Expression* expr, uint32_t n)
+{
+        switch (expr->classification()) {
+        case Expression::EXPRESSION_UNARY:
+                // An invalid operand is reported without being lowered.
+                if (n > 0 || is_not_lvalue(expr))
+                        return NULL;
+                return expr->unary_expression()->operand();
+
+        case Expression::EXPRESSION_BINARY:
+                if (n == 0)
+                        return expr->binary_expression()->left();
+                if (n == 1)
+                        return expr->binary_expression()->right();
+                return NULL;
+
+        case Expression::EXPRESSION_CONDITIONAL:
+                return (n == 0) ? expr->conditional_expression()->condition() : NULL;
+
+        case Expression::EXPRESSION_CALL: {
+                const std::vector<Expression*>& args = expr->call_expression()->args();
+                return (n < args.size()) ? args[n] : NULL;
+        }
+
+        default:
+                return NULL;
+        }
+}
+
+void Flat_ast::push(Expression* expr, uint32_t first)
+{
+        RIN_ASSERT(this->end() < NO_CHILD);
+
+        Node_kind kind;
+        uint8_t oper = OPER_ILLEGAL;
+        uint32_t literal = 0;
+
+        switch (expr->classification()) {
+        case Expression::EXPRESSION_VAR_REFERENCE:
+                kind = NODE_VAR;
+                literal = this->_objects.size();
+                this->_objects.push_back(expr->var_expression()->named_object());
+                break;
+
+        case Expression::EXPRESSION_FLOAT: {
+                Float_expression* flt = expr->float_expression();
+                Literal lit;
+                lit.is_native = flt->is_native();
+                lit.f = lit.is_native ? flt->native_value() : 0;
+                lit.big = lit.is_native ? NULL : flt->value();
+
+                kind = NODE_FLOAT;
+                literal = this->_literals.size();
+                this->_literals.push_back(lit);
+                break;
+        }
+
+        case Expression::EXPRESSION_INTEGER: {
+                Integer_expression* integer = expr->integer_expression();
+                Literal lit;
+                lit.is_native = integer->is_native();
+                lit.i = lit.is_native ? integer->native_value() : 0;
+                lit.big = lit.is_native ? NULL : integer->value();
+
+                kind = NODE_INTEGER;
+                literal = this->_literals.size();
+                this->_literals.push_back(lit);
+                break;
+        }
+
+        case Expression::EXPRESSION_UNARY: {
+                RIN_OPERATOR op = expr->unary_expression()->op();
+                RIN_ASSERT(op == OPER_INC || op == OPER_DEC || op == OPER_NOT
+                           || op == OPER_NEG || op == OPER_BNOT);
+
+                kind = is_not_lvalue(expr) ? NODE_NOT_LVALUE : NODE_UNARY;
+                oper = op;
+                break;
+        }
+
+        case Expression::EXPRESSION_BINARY: {
+                /*
+                 * See operators.cc. If the precedence of the operator
+                 * is less than or equal to -1 then it cant be used
+                 * in a binary expression.
+                 */
+                Binary_expression* binary = expr->binary_expression();
+                RIN_ASSERT(OPERATOR_PRECEDENCE[binary->op()] > -1);
+                RIN_ASSERT(binary->left() != NULL && binary->right() != NULL);
+
+                /*
+                 * Binary expressions can only be formed from float, integer,
+                 * unary, binary, or var reference children.
+                 */
+                RIN_ASSERT(is_operand(binary->left()) && is_operand(binary->right()));
+
+                kind = NODE_BINARY;
+                oper = binary->op();
+                break;
+        }
+
+        case Expression::EXPRESSION_CONDITIONAL:
+                RIN_ASSERT(is_operand(expr->conditional_expression()->condition()));
+                kind = NODE_CONDITIONAL;
+                break;
+
+        case Expression::EXPRESSION_CALL: {
+                Call_expression* call = expr->call_expression();
+                kind = NODE_CALL;
+                literal = this->_calls.size();
+                this->_calls.push_back(Call{ &call->name(), (uint32_t)call->args().size() });
+                break;
+        }
+
+        default:
+                RIN_UNREACHABLE();
+        }
+
+        // Neighbouring nodes often share a location.
+        if (this->_locations.empty() || !(this->_locations.back() == expr->location()))
+                this->_locations.push_back(expr->location());
+
+        expr->set_flat_node(this->end());
+        this->_kind.push_back(kind);
+        this->_oper.push_back(oper);
+        this->_first_child.push_back(first);
+        this->_location.push_back(this->_locations.size() - 1);
+        this->_literal.push_back(literal);
+}
+
+void Flat_ast::append(Expression* expr)
+{
+        if (is_not_lvalue(expr))
+                return;
+
+        // Each child must be flat and start right after the one before it.
+        uint32_t first = NO_CHILD;
+        uint32_t next = this->end();
+        for (uint32_t n = 0; Expression* arg = child(expr, n); n++) {
+                uint32_t node = arg->flat_node();
+                if (!this->contains(node))
+                        return;
+                if (n == 0)
+                        first = next = this->start(node);
+                if (this->start(node) != next)
+                        return;
+                next = node + 1;
+        }
+        if (next != this->end())
+                return;
+
+        this->push(expr, first);
+}
+
+uint32_t Flat_ast::flatten(Expression* root)
+{
+        // Walk the tree depth first, appending each node after its children.
+        this->_frames.clear();
+        this->_frames.push_back(Frame{ root, 0, NO_CHILD });
+        while (!this->_frames.empty()) {
+                Frame& top = this->_frames.back();
+                Expression* next = child(top.expr, top.next);
+                if (next) {
+                        if (top.next == 0)
+                                top.first = this->end();
+                        top.next++;
+                        this->_frames.push_back(Frame{ next, 0, NO_CHILD });
+                        continue;
+                }
+
+                this->push(top.expr, top.first);
+                this->_frames.pop_back();
+        }
+        return this->end() - 1;
+}
+
+void Flat_ast::clear()
+{
+        this->_base = this->end();
+
+        this->_kind.clear();
+        this->_oper.clear();
+        this->_first_child.clear();
+        this->_location.clear();
+        this->_literal.clear();
+
+        this->_locations.clear();
+        this->_objects.clear();
+        this->_literals.clear();
+        this->_calls.clear();
+}
+
+Bexpression* Flat_ast::lower(uint32_t root, Backend* backend)
+{
+        RIN_ASSERT(backend);
+        RIN_ASSERT(this->contains(root));
+
+        std::vector<Bexpression*>& values = this->_values;
+        values.clear();
+
+        // Walk the columns directly; i is the node's position in them.
+        uint32_t last = this->at(root);
+        for (uint32_t i = this->at(this->start(root)); i <= last; i++) {
+                const Location& loc = this->_locations[this->_location[i]];
+                RIN_OPERATOR op = (RIN_OPERATOR)this->_oper[i];
+
+                switch ((Node_kind)this->_kind[i]) {
+                case NODE_VAR: {
+                        Bvariable* var = backend->variable(this->_objects[this->_literal[i]]);
+                        values.push_back(backend->var_reference(var, loc));
+                        break;
+                }
+
+                case NODE_FLOAT: {
+                        const Literal& lit = this->_literals[this->_literal[i]];
+                        values.push_back(lit.is_native
+                                ? backend->native_float_expression(lit.f, loc)
+                                : backend->float_expression(lit.big, loc));
+                        break;
+                }
+
+                case NODE_INTEGER: {
+                        const Literal& lit = this->_literals[this->_literal[i]];
+                        values.push_back(lit.is_native
+                                ? backend->native_integer_expression(lit.i, loc)
+                                : backend->integer_expression(lit.big, loc));
+                        break;
+                }
+
+                case NODE_NOT_LVALUE:
+                        rin_error_at(loc, "lvalue required as increment/decrement operand");
+                        values.push_back(backend->invalid_expression());
+                        break;
+
+                case NODE_UNARY:
+                        values.back() = backend->unary_expression
+                                (op, values.back(), loc);
+                        break;
+
+                case NODE_BINARY: {
+                        Bexpression* right = values.back();
+                        values.pop_back();
+                        values.back() = backend->binary_expression
+                                (op, values.back(), right, loc);
+                        break;
+                }
+
+                case NODE_CONDITIONAL:
+                        values.back() = backend->conditional_expression(values.back(), loc);
+                        break;
+
+                case NODE_CALL: {
+                        const Call& call = this->_calls[this->_literal[i]];
+                        RIN_ASSERT(values.size() >= call.argc);
+
+                        std::vector<Bexpression*> args(values.end() - call.argc, values.end());
+                        values.resize(values.size() - call.argc);
+                        values.push_back(backend->call_expression(*call.name, args, loc));
+                        break;
+                }
+                }
+        }
+
+        RIN_ASSERT(values.size() == 1);
+        return values.back();
+}
@@ -0,0 +1,162 @@
+// flat.hpp - Flat, index-based expression storage for lowering
+#ifndef RIN_FLAT_HPP
+#define RIN_FLAT_HPP
+
+#include "backend.hpp"
+
+class Expression;
+
+/*
+ * A flat AST holds expression trees as parallel arrays, one entry per
+ * node, in post-order: every node comes after all of its children, and
+ * the subtree of a node is the contiguous range that ends at the node.
+ * Lowering a tree is then a single loop over that range which keeps the
+ * lowered operands on a stack, with no pointer chasing and no virtual
+ * dispatch.
+ *
+ * The parser builds expressions bottom-up, which is post-order, so it
+ * appends each node as it makes it and the flat form of an expression is
+ * complete by the time the expression is. Trees assembled any other way
+ * are flattened when they are first lowered. Each Backend owns one flat
+ * AST for its compilation (see Backend::flat_ast()).
+ *
+ * Nodes are numbered from 0 for the whole compilation, but only those
+ * since the last clear() are held, so that the arrays stay small and hot
+ * in cache. An expression whose node was dropped is flattened again if it
+ * is ever lowered again.
+ */
+class Flat_ast
+{
+public:
+        enum Node_kind : uint8_t {
+                NODE_VAR,         NODE_FLOAT,       NODE_INTEGER,
+                NODE_UNARY,       NODE_BINARY,      NODE_CONDITIONAL,
+                NODE_CALL,
+
+                // An increment or decrement of something other than a variable.
+                NODE_NOT_LVALUE
+        };
+
+        // First-child index of a node without children.
+        static const uint32_t NO_CHILD = UINT32_MAX;
+
+        Flat_ast() {}
+
+        Flat_ast(const Flat_ast&) = delete;
+        Flat_ast& operator=(const Flat_ast&) = delete;
+
+        /*
+         * Append expr, whose children must be the most recently appended
+         * subtrees, in order. If they are not, expr is left out and will be
+         * flattened when it is lowered.
+         */
+        void append(Expression* expr);
+
+        // Append the whole tree rooted at root and return the root's node.
+        uint32_t flatten(Expression* root);
+
+        // Lower the subtree ending at root to backend.
+        Bexpression* lower(uint32_t root, Backend* backend);
+
+        // Drop every node held. Numbering carries on from where it was.
+        void clear();
+
+        // Number of nodes held.
+        uint32_t size() const
+        { return this->_kind.size(); }
+
+        // Return the number the next node will get.
+        uint32_t end() const
+        { return this->_base + this->size(); }
+
+        // Whether node is held.
+        bool contains(uint32_t node) const
+        { return node >= this->_base && node < this->end(); }
+
+        Node_kind kind(uint32_t node) const
+        { return (Node_kind)this->_kind[this->at(node)]; }
+
+        RIN_OPERATOR op(uint32_t node) const
+        { return (RIN_OPERATOR)this->_oper[this->at(node)]; }
+
+        /*
+         * Return the index of the first node of the node's first child, or
+         * NO_CHILD. That is also where the node's own subtree starts. A
+         * binary node's left operand is the subtree starting there and its
+         * right operand is the subtree ending just before the node.
+         */
+        uint32_t first_child(uint32_t node) const
+        { return this->_first_child[this->at(node)]; }
+
+        // Return the index of the first node in the node's subtree.
+        uint32_t start(uint32_t node) const
+        {
+                uint32_t first = this->first_child(node);
+                return (first == NO_CHILD) ? node : first;
+        }
+
+        const Location& location(uint32_t node) const
+        { return this->_locations[this->_location[this->at(node)]]; }
+
+private:
+        // A float or integer literal.
+        struct Literal {
+                bool is_native;
+                union {
+                        double  f;
+                        int64_t i;
+                };
+                const mpfr_t* big;
+        };
+
+        struct Call {
+                const std::string* name;
+                uint32_t argc;
+        };
+
+        // A node being flattened whose children are not all appended yet.
+        struct Frame {
+                Expression* expr;
+                uint32_t next;
+                uint32_t first;
+        };
+
+        // Return the n-th child of expr to lower, or NULL.
+        static Expression* child(Expression* expr, uint32_t n);
+
+        // Append expr, whose first child starts at first.
+        void push(Expression* expr, uint32_t first);
+
+        // Return where node is held in the columns.
+        uint32_t at(uint32_t node) const
+        {
+                RIN_ASSERT(this->contains(node));
+                return node - this->_base;
+        }
+
+        // Number of the first node held.
+        uint32_t _base = 0;
+
+        // Node columns
+        std::vector<uint8_t>  _kind;
+        std::vector<uint8_t>  _oper;
+        std::vector<uint32_t> _first_child;
+        std::vector<uint32_t> _location;
+
+        // Index into the pool for the node's kind, if it has one.
+        std::vector<uint32_t> _literal;
+
+        // Pools
+        std::vector<Location>      _locations;
+        std::vector<Named_object*> _objects;
+        std::vector<Literal>       _literals;
+        std::vector<Call>          _calls;
+
+        // Scratch for flatten() and lower()
+        std::vector<Frame>        _frames;
+        std::vector<Bexpression*> _values;
+};
+
+static_assert(OPER_COMMA <= UINT8_MAX, "operators must fit the operator column");
+
+#endif // RIN_FLAT_HPP
@@ -0,0 +1,1074 @@
+// interp-backend.cc - A backend that runs programs by walking closure trees
+#include "interp-backend.hpp"
+#include "file.hpp"
+
+#include <algorithm>
+
+// How a statement left off: go on with the next, or leave a loop or call.
+enum Interp_flow {
+        FLOW_NEXT,
+        FLOW_BREAK,
+        FLOW_CONTINUE,
+        FLOW_RETURN,
+        FLOW_ERROR
+};
+
+typedef Interp_value (*Interp_eval)(const Interp_expression*, Interp_state*);
+typedef Interp_flow  (*Interp_exec)(const Interp_statement*, Interp_state*);
+
+/*
+ * Nodes are run by recursion, so each records how deeply it nests: the
+ * levels of operations, or of blocks, below and including it. The backend
+ * reports code nested deeper than Interp_backend::MAX_DEPTH as it is built.
+ */
+struct Interp_expression {
+        Interp_expression(Interp_eval eval, const Location& loc, uint32_t depth = 0)
+                : eval(eval), location(loc), depth(depth)
+        {}
+
+        Interp_value operator()(Interp_state* state) const
+        { return this->eval(this, state); }
+
+        Interp_eval eval;
+        Location location;
+        uint32_t depth;
+};
+
+struct Interp_statement {
+        Interp_statement(Interp_exec exec, const Location& loc, uint32_t depth = 0)
+                : exec(exec), location(loc), depth(depth)
+        {}
+
+        Interp_flow operator()(Interp_state* state) const
+        { return this->exec(this, state); }
+
+        Interp_exec exec;
+        Location location;
+        uint32_t depth;
+};
+
+/*
+ * A variable lives in value, unless it belongs to a function, in which case
+ * it lives in slot of the frame of the function's current call.
+ */
+struct Interp_variable {
+        Interp_variable(Named_object* obj, Scope* scope) : obj(obj), scope(scope) {}
+
+        Named_object* obj;
+
+        // The scope the variable was first seen in.
+        Scope* scope;
+
+        bool local = false;
+        uint32_t slot = 0;
+        Interp_value value;
+
+        // The function whose frame holds it, for a local.
+        Interp_function* owner = NULL;
+};
+
+struct Interp_function {
+        std::string name;
+        Location location;
+
+        // Parameters take the first slots of the frame.
+        uint32_t params = 0;
+        uint32_t frame_size = 0;
+        std::vector<Interp_statement*> body;
+
+        // The nesting of its body, charged to the stack on every call.
+        uint32_t depth = 0;
+};
+
+// The state of a run: the frames of the calls in progress.
+struct Interp_state {
+        explicit Interp_state(Interp_backend* backend) : backend(backend) {}
+
+        Interp_backend* backend;
+
+        // Slots of every frame; the current frame starts at frame.
+        std::vector<Interp_value> stack;
+        size_t frame = 0;
+        unsigned depth = 0;
+
+        // The nesting of the bodies of the calls in progress; see MAX_STACK_DEPTH.
+        unsigned stack_depth = 0;
+
+        // Set by a return statement, and by a runtime error.
+        Interp_value returned;
+        bool failed = false;
+
+        // The break or continue statement that last left a loop.
+        const Interp_statement* left = NULL;
+
+        Interp_value& slot(const Interp_variable* var)
+        { return (var->local) ? this->stack[this->frame + var->slot] : const_cast<Interp_variable*>(var)->value; }
+
+        // A runtime error was reported; unwind to run().
+        Interp_value fail()
+        {
+                this->failed = true;
+                return Interp_value();
+        }
+};
+
+/*
+ * The backend types are incomplete in the frontend, so nodes are handed
+ * to the parser, and back, through casts.
+ */
+static Bexpression* bexpression(Interp_expression* expr)
+{ return reinterpret_cast<Bexpression*>(expr); }
+
+static Interp_expression* node(Bexpression* expr)
+{ return reinterpret_cast<Interp_expression*>(expr); }
+
+static Bstatement* bstatement(Interp_statement* stmt)
+{ return reinterpret_cast<Bstatement*>(stmt); }
+
+static Interp_statement* node(Bstatement* stmt)
+{ return reinterpret_cast<Interp_statement*>(stmt); }
+
+static Bvariable* bvariable(Interp_variable* var)
+{ return reinterpret_cast<Bvariable*>(var); }
+
+static Interp_variable* node(Bvariable* var)
+{ return reinterpret_cast<Interp_variable*>(var); }
+
+static Interp_flow exec_list(const std::vector<Interp_statement*>& list, Interp_state* state)
+{
+        for (auto itr = list.begin(); itr != list.end(); ++itr) {
+                Interp_flow flow = (**itr)(state);
+                if (flow != FLOW_NEXT)
+                        return flow;
+        }
+        return FLOW_NEXT;
+}
+
+// The depth of the deepest statement of list, or at least depth.
+static uint32_t deepest(const std::vector<Interp_statement*>& list, uint32_t depth)
+{
+        for (auto itr = list.begin(); itr != list.end(); ++itr)
+                depth = std::max(depth, (*itr)->depth);
+        return depth;
+}
+
+// Report e if it is the first node on its path nested deeper than run() can walk.
+static Interp_expression* check_depth(Interp_expression* e)
+{
+        if (e->depth == Interp_backend::MAX_DEPTH + 1)
+                rin_error_at(e->location, "Expression nesting exceeds the interpreter's limit of %u",
+                             Interp_backend::MAX_DEPTH);
+        return e;
+}
+
+static Interp_statement* check_depth(Interp_statement* s)
+{
+        if (s->depth == Interp_backend::MAX_DEPTH + 1)
+                rin_error_at(s->location, "Block nesting exceeds the interpreter's limit of %u",
+                             Interp_backend::MAX_DEPTH);
+        return s;
+}
+
+std::string Interp_value::str() const
+{
+        char buf[32];
+        if (this->is_float())
+                snprintf(buf, sizeof(buf), "%g", this->f);
+        else
+                snprintf(buf, sizeof(buf), "%lld", (long long)this->i);
+        return buf;
+}
+
+// --- Expressions ---
+
+struct Constant_node : Interp_expression {
+        Constant_node(Interp_value value, const Location& loc)
+                : Interp_expression(eval, loc), value(value)
+        {}
+
+        static Interp_value eval(const Interp_expression* e, Interp_state*)
+        { return static_cast<const Constant_node*>(e)->value; }
+
+        Interp_value value;
+};
+
+struct Var_node : Interp_expression {
+        Var_node(Interp_variable* var, const Location& loc)
+                : Interp_expression(eval, loc), var(var)
+        {}
+
+        static Interp_value eval(const Interp_expression* e, Interp_state* state)
+        { return state->slot(static_cast<const Var_node*>(e)->var); }
+
+        // What a reference to a local of an enclosing function evaluates to instead.
+        static Interp_value enclosing(const Interp_expression* e, Interp_state* state)
+        {
+                rin_error_at(e->location, "'%s' belongs to an enclosing function",
+                             static_cast<const Var_node*>(e)->var->obj->identifier().c_str());
+                return state->fail();
+        }
+
+        Interp_variable* var;
+};
+
+// Only built for code with errors, which should not be run.
+struct Invalid_node : Interp_expression {
+        Invalid_node() : Interp_expression(eval, File::unknown_location()) {}
+
+        static Interp_value eval(const Interp_expression* e, Interp_state* state)
+        {
+                rin_error_at(e->location, "Cannot run an invalid expression");
+                return state->fail();
+        }
+};
+
+struct Unary_node : Interp_expression {
+        Unary_node(Interp_eval eval, Interp_expression* operand, const Location& loc)
+                : Interp_expression(eval, loc, operand->depth + 1), operand(operand)
+        {}
+
+        Interp_expression* operand;
+};
+
+static Interp_value eval_not(const Interp_expression* e, Interp_state* state)
+{
+        const Unary_node* n = static_cast<const Unary_node*>(e);
+        Interp_value v = (*n->operand)(state);
+        if (state->failed)
+                return Interp_value();
+        return Interp_value::of_int(!v.truth());
+}
+
+static Interp_value eval_neg(const Interp_expression* e, Interp_state* state)
+{
+        const Unary_node* n = static_cast<const Unary_node*>(e);
+        Interp_value v = (*n->operand)(state);
+        if (state->failed)
+                return Interp_value();
+        if (v.is_float())
+                return Interp_value::of_float(-v.f);
+        return Interp_value::of_int((int64_t)(0 - (uint64_t)v.i));
+}
+
+static Interp_value eval_bnot(const Interp_expression* e, Interp_state* state)
+{
+        const Unary_node* n = static_cast<const Unary_node*>(e);
+        Interp_value v = (*n->operand)(state);
+        if (state->failed)
+                return Interp_value();
+        if (v.is_float()) {
+                rin_error_at(e->location, "Operand of %s must be an integer",
+                             operator_name(OPER_BNOT).c_str());
+                return state->fail();
+        }
+        return Interp_value::of_int(~v.i);
+}
+
+struct Binary_node : Interp_expression {
+        Binary_node(Interp_eval eval, Interp_expression* left, Interp_expression* right,
+                    const Location& loc)
+                : Interp_expression(eval, loc, std::max(left->depth, right->depth) + 1),
+                  left(left), right(right)
+        {}
+
+        Interp_expression* left;
+        Interp_expression* right;
+};
+
+// Integer arithmetic wraps, as it does in two's complement hardware.
+template<RIN_OPERATOR OP>
+static Interp_value int_op(int64_t a, int64_t b, const Interp_expression* e, Interp_state* state)
+{
+        switch (OP) {
+        case OPER_ADD: return Interp_value::of_int((int64_t)((uint64_t)a + (uint64_t)b));
+        case OPER_SUB: return Interp_value::of_int((int64_t)((uint64_t)a - (uint64_t)b));
+        case OPER_MUL: return Interp_value::of_int((int64_t)((uint64_t)a * (uint64_t)b));
+        case OPER_QUO:
+        case OPER_REM:
+                if (b == 0) {
+                        rin_error_at(e->location, "Division by zero");
+                        return state->fail();
+                }
+                // INT64_MIN / -1 overflows; it wraps to INT64_MIN.
+                if (b == -1)
+                        return Interp_value::of_int((OP == OPER_QUO) ? (int64_t)(0 - (uint64_t)a) : 0);
+                return Interp_value::of_int((OP == OPER_QUO) ? a / b : a % b);
+        case OPER_EQL: return Interp_value::of_int(a == b);
+        case OPER_NEQ: return Interp_value::of_int(a != b);
+        case OPER_LSS: return Interp_value::of_int(a < b);
+        case OPER_GTR: return Interp_value::of_int(a > b);
+        case OPER_LEQ: return Interp_value::of_int(a <= b);
+        case OPER_GEQ: return Interp_value::of_int(a >= b);
+        case OPER_BAND: return Interp_value::of_int(a & b);
+        case OPER_BOR: return Interp_value::of_int(a | b);
+        case OPER_BXOR: return Interp_value::of_int(a ^ b);
+
+        // Shift counts are taken modulo 64.
+        case OPER_LSHIFT: return Interp_value::of_int((int64_t)((uint64_t)a << (b & 63)));
+        case OPER_RSHIFT: return Interp_value::of_int(a >> (b & 63));
+        default:
+                RIN_UNREACHABLE();
+        }
+}
+
+template<RIN_OPERATOR OP>
+static Interp_value float_op(double a, double b, const Interp_expression* e, Interp_state* state)
+{
+        switch (OP) {
+        case OPER_ADD: return Interp_value::of_float(a + b);
+        case OPER_SUB: return Interp_value::of_float(a - b);
+        case OPER_MUL: return Interp_value::of_float(a * b);
+        case OPER_QUO: return Interp_value::of_float(a / b);
+        case OPER_REM: return Interp_value::of_float(fmod(a, b));
+        case OPER_EQL: return Interp_value::of_int(a == b);
+        case OPER_NEQ: return Interp_value::of_int(a != b);
+        case OPER_LSS: return Interp_value::of_int(a < b);
+        case OPER_GTR: return Interp_value::of_int(a > b);
+        case OPER_LEQ: return Interp_value::of_int(a <= b);
+        case OPER_GEQ: return Interp_value::of_int(a >= b);
+        default:
+                rin_error_at(e->location, "Operands of %s must be integers",
+                             operator_name(OP).c_str());
+                return state->fail();
+        }
+}
+
+template<RIN_OPERATOR OP>
+static Interp_value eval_binary(const Interp_expression* e, Interp_state* state)
+{
+        const Binary_node* n = static_cast<const Binary_node*>(e);
+        Interp_value a = (*n->left)(state);
+        if (state->failed)
+                return Interp_value();
+        Interp_value b = (*n->right)(state);
+        if (state->failed)
+                return Interp_value();
+        if (!a.is_float() && !b.is_float())
+                return int_op<OP>(a.i, b.i, e, state);
+        return float_op<OP>(a.as_float(), b.as_float(), e, state);
+}
+
+// && and || only evaluate their right operand if they need it.
+static Interp_value eval_land(const Interp_expression* e, Interp_state* state)
+{
+        const Binary_node* n = static_cast<const Binary_node*>(e);
+        Interp_value a = (*n->left)(state);
+        if (state->failed)
+                return Interp_value();
+        if (!a.truth())
+                return Interp_value::of_int(0);
+        Interp_value b = (*n->right)(state);
+        if (state->failed)
+                return Interp_value();
+        return Interp_value::of_int(b.truth());
+}
+
+static Interp_value eval_lor(const Interp_expression* e, Interp_state* state)
+{
+        const Binary_node* n = static_cast<const Binary_node*>(e);
+        Interp_value a = (*n->left)(state);
+        if (state->failed)
+                return Interp_value();
+        if (a.truth())
+                return Interp_value::of_int(1);
+        Interp_value b = (*n->right)(state);
+        if (state->failed)
+                return Interp_value();
+        return Interp_value::of_int(b.truth());
+}
+
+static Interp_eval binary_eval(RIN_OPERATOR op)
+{
+        switch (op) {
+        case OPER_ADD:    return eval_binary<OPER_ADD>;
+        case OPER_SUB:    return eval_binary<OPER_SUB>;
+        case OPER_MUL:    return eval_binary<OPER_MUL>;
+        case OPER_QUO:    return eval_binary<OPER_QUO>;
+        case OPER_REM:    return eval_binary<OPER_REM>;
+        case OPER_EQL:    return eval_binary<OPER_EQL>;
+        case OPER_NEQ:    return eval_binary<OPER_NEQ>;
+        case OPER_LSS:    return eval_binary<OPER_LSS>;
+        case OPER_GTR:    return eval_binary<OPER_GTR>;
+        case OPER_LEQ:    return eval_binary<OPER_LEQ>;
+        case OPER_GEQ:    return eval_binary<OPER_GEQ>;
+        case OPER_BAND:   return eval_binary<OPER_BAND>;
+        case OPER_BOR:    return eval_binary<OPER_BOR>;
+        case OPER_BXOR:   return eval_binary<OPER_BXOR>;
+        case OPER_LSHIFT: return eval_binary<OPER_LSHIFT>;
+        case OPER_RSHIFT: return eval_binary<OPER_RSHIFT>;
+        case OPER_LAND:   return eval_land;
+        case OPER_LOR:    return eval_lor;
+        default:
+                return NULL;
+        }
+}
+
+// The stack a call takes besides its body's nesting, in levels of nesting.
+static const unsigned CALL_STACK_DEPTH = 4;
+
+struct Call_node : Interp_expression {
+        Call_node(const std::string& name, const std::vector<Bexpression*>& args,
+                  const Location& loc)
+                : Interp_expression(eval, loc), name(name)
+        {
+                for (auto itr = args.begin(); itr != args.end(); ++itr) {
+                        this->args.push_back(node(*itr));
+                        this->depth = std::max(this->depth, node(*itr)->depth + 1);
+                }
+        }
+
+        static Interp_value eval(const Interp_expression* e, Interp_state* state);
+
+        std::string name;
+        std::vector<Interp_expression*> args;
+
+        // Looked up by name on the first call; functions may be declared after.
+        mutable Interp_function* function = NULL;
+};
+
+Interp_value Call_node::eval(const Interp_expression* e, Interp_state* state)
+{
+        const Call_node* call = static_cast<const Call_node*>(e);
+        Interp_function* fn = call->function;
+        if (!fn) {
+                fn = state->backend->function(call->name);
+                if (!fn) {
+                        rin_error_at(e->location, "Call to undeclared function '%s'",
+                                     call->name.c_str());
+                        return state->fail();
+                }
+                call->function = fn;
+        }
+
+        if (call->args.size() != fn->params) {
+                rin_error_at(e->location, "Function '%s' takes %u arguments, but %u were given",
+                             fn->name.c_str(), fn->params, (unsigned)call->args.size());
+                return state->fail();
+        }
+
+        if (state->depth >= Interp_backend::MAX_CALL_DEPTH) {
+                rin_error_at(e->location, "Call depth exceeds the limit of %u",
+                             Interp_backend::MAX_CALL_DEPTH);
+                return state->fail();
+        }
+
+        unsigned charge = fn->depth + CALL_STACK_DEPTH;
+        if (state->stack_depth + charge > Interp_backend::MAX_STACK_DEPTH) {
+                rin_error_at(e->location, "Calls nest deeper than the interpreter's stack of %u levels",
+                             Interp_backend::MAX_STACK_DEPTH);
+                return state->fail();
+        }
+
+        // Arguments are evaluated in the caller's frame, into the callee's.
+        size_t base = state->stack.size();
+        for (auto itr = call->args.begin(); itr != call->args.end(); ++itr) {
+                Interp_value arg = (**itr)(state);
+                if (state->failed)
+                        return Interp_value();
+                state->stack.push_back(arg);
+        }
+        state->stack.resize(base + fn->frame_size);
+
+        size_t caller = state->frame;
+        state->frame = base;
+        state->depth++;
+        state->stack_depth += charge;
+        Interp_flow flow = exec_list(fn->body, state);
+        state->stack_depth -= charge;
+        state->depth--;
+        state->frame = caller;
+        state->stack.resize(base);
+
+        switch (flow) {
+        case FLOW_RETURN:
+                return state->returned;
+        case FLOW_BREAK:
+        case FLOW_CONTINUE:
+                rin_error_at(state->left->location, "Function '%s' left a loop it is not in",
+                             fn->name.c_str());
+                return state->fail();
+        case FLOW_ERROR:
+                return Interp_value();
+        default:
+                return Interp_value::of_int(0);
+        }
+}
+
+// --- Statements ---
+
+static Interp_flow exec_nothing(const Interp_statement*, Interp_state*)
+{ return FLOW_NEXT; }
+
+static Interp_flow exec_invalid(const Interp_statement* s, Interp_state* state)
+{
+        rin_error_at(s->location, "Cannot run an invalid statement");
+        state->fail();
+        return FLOW_ERROR;
+}
+
+static Interp_flow exec_break(const Interp_statement* s, Interp_state* state)
+{
+        state->left = s;
+        return FLOW_BREAK;
+}
+
+static Interp_flow exec_continue(const Interp_statement* s, Interp_state* state)
+{
+        state->left = s;
+        return FLOW_CONTINUE;
+}
+
+// Declaring a variable zeroes it, every time the declaration is run.
+struct Declare_node : Interp_statement {
+        explicit Declare_node(Interp_variable* var)
+                : Interp_statement(exec, var->obj->location()), var(var)
+        {}
+
+        static Interp_flow exec(const Interp_statement* s, Interp_state* state)
+        {
+                state->slot(static_cast<const Declare_node*>(s)->var) = Interp_value();
+                return FLOW_NEXT;
+        }
+
+        Interp_variable* var;
+};
+
+// Assignments and steps of a variable.
+struct Store_node : Interp_statement {
+        Store_node(Interp_exec exec, Interp_variable* var, const Location& loc, uint32_t depth = 0)
+                : Interp_statement(exec, loc, depth), var(var)
+        {}
+
+        // What a store to a local of an enclosing function runs instead.
+        static Interp_flow enclosing(const Interp_statement* s, Interp_state* state)
+        {
+                rin_error_at(s->location, "'%s' belongs to an enclosing function",
+                             static_cast<const Store_node*>(s)->var->obj->identifier().c_str());
+                state->fail();
+                return FLOW_ERROR;
+        }
+
+        Interp_variable* var;
+};
+
+struct Assign_node : Store_node {
+        Assign_node(Interp_variable* var, Interp_expression* rhs, const Location& loc)
+                : Store_node(exec, var, loc, rhs->depth), rhs(rhs)
+        {}
+
+        static Interp_flow exec(const Interp_statement* s, Interp_state* state)
+        {
+                const Assign_node* n = static_cast<const Assign_node*>(s);
+                Interp_value v = (*n->rhs)(state);
+                if (state->failed)
+                        return FLOW_ERROR;
+                state->slot(n->var) = v;
+                return FLOW_NEXT;
+        }
+
+        Interp_expression* rhs;
+};
+
+struct Step_node : Store_node {
+        Step_node(Interp_variable* var, int64_t step, const Location& loc)
+                : Store_node(exec, var, loc), step(step)
+        {}
+
+        static Interp_flow exec(const Interp_statement* s, Interp_state* state)
+        {
+                const Step_node* n = static_cast<const Step_node*>(s);
+                Interp_value& v = state->slot(n->var);
+                if (v.is_float())
+                        v.f += n->step;
+                else
+                        v.i = (int64_t)((uint64_t)v.i + (uint64_t)n->step);
+                return FLOW_NEXT;
+        }
+
+        int64_t step;
+};
+
+// A node that reads or writes a variable, and the function it is in, once that is known.
+struct Interp_use {
+        Interp_variable* var;
+        Interp_expression* expr;
+        Interp_statement* stmt;
+        Scope* scope;
+        Interp_function* function;
+};
+
+struct Expression_node : Interp_statement {
+        Expression_node(Interp_expression* expr, const Location& loc)
+                : Interp_statement(exec, loc, expr->depth), expr(expr)
+        {}
+
+        static Interp_flow exec(const Interp_statement* s, Interp_state* state)
+        {
+                (*static_cast<const Expression_node*>(s)->expr)(state);
+                return (state->failed) ? FLOW_ERROR : FLOW_NEXT;
+        }
+
+        Interp_expression* expr;
+};
+
+struct If_node : Interp_statement {
+        If_node(Interp_expression* cond, const Location& loc)
+                : Interp_statement(exec, loc, cond->depth), cond(cond)
+        {}
+
+        static Interp_flow exec(const Interp_statement* s, Interp_state* state)
+        {
+                const If_node* n = static_cast<const If_node*>(s);
+                bool taken = (*n->cond)(state).truth();
+                if (state->failed)
+                        return FLOW_ERROR;
+                return exec_list((taken) ? n->then_block : n->else_block, state);
+        }
+
+        Interp_expression* cond;
+        std::vector<Interp_statement*> then_block;
+        std::vector<Interp_statement*> else_block;
+};
+
+// Any part of the header may be missing; a loop with no condition runs until left.
+struct For_node : Interp_statement {
+        For_node(Interp_statement* ind, Interp_expression* cond, Interp_statement* inc,
+                 const Location& loc)
+                : Interp_statement(exec, loc), ind(ind), cond(cond), inc(inc)
+        {
+                if (ind)
+                        this->depth = std::max(this->depth, ind->depth);
+                if (cond)
+                        this->depth = std::max(this->depth, cond->depth);
+                if (inc)
+                        this->depth = std::max(this->depth, inc->depth);
+        }
+
+        static Interp_flow exec(const Interp_statement* s, Interp_state* state)
+        {
+                const For_node* n = static_cast<const For_node*>(s);
+                if (n->ind) {
+                        Interp_flow flow = (*n->ind)(state);
+                        if (flow != FLOW_NEXT)
+                                return flow;
+                }
+
+                for (;;) {
+                        if (n->cond) {
+                                bool more = (*n->cond)(state).truth();
+                                if (state->failed)
+                                        return FLOW_ERROR;
+                                if (!more)
+                                        break;
+                        }
+
+                        Interp_flow flow = exec_list(n->body, state);
+                        if (flow == FLOW_BREAK)
+                                break;
+                        if (flow == FLOW_RETURN || flow == FLOW_ERROR)
+                                return flow;
+
+                        if (n->inc) {
+                                flow = (*n->inc)(state);
+                                if (flow != FLOW_NEXT)
+                                        return flow;
+                        }
+                }
+                return FLOW_NEXT;
+        }
+
+        Interp_statement* ind;
+        Interp_expression* cond;
+        Interp_statement* inc;
+        std::vector<Interp_statement*> body;
+};
+
+struct Compound_node : Interp_statement {
+        Compound_node(Interp_statement* first, Interp_statement* second, const Location& loc)
+                : Interp_statement(exec, loc, std::max(first->depth, second->depth)),
+                  first(first), second(second)
+        {}
+
+        static Interp_flow exec(const Interp_statement* s, Interp_state* state)
+        {
+                const Compound_node* n = static_cast<const Compound_node*>(s);
+                Interp_flow flow = (*n->first)(state);
+                if (flow != FLOW_NEXT)
+                        return flow;
+                return (*n->second)(state);
+        }
+
+        Interp_statement* first;
+        Interp_statement* second;
+};
+
+struct Return_node : Interp_statement {
+        Return_node(Interp_expression* expr, const Location& loc)
+                : Interp_statement(exec, loc, (expr) ? expr->depth : 0), expr(expr)
+        {}
+
+        static Interp_flow exec(const Interp_statement* s, Interp_state* state)
+        {
+                const Return_node* n = static_cast<const Return_node*>(s);
+                state->returned = (n->expr) ? (*n->expr)(state) : Interp_value();
+                return (state->failed) ? FLOW_ERROR : FLOW_RETURN;
+        }
+
+        Interp_expression* expr;
+};
+
+// --- Interp_backend implementation ---
+
+bool Interp_backend::run()
+{
+        Interp_state state(this);
+        this->_result = Interp_value();
+
+        auto itr = this->_statements.find(this->supercontext());
+        if (itr == this->_statements.end())
+                return true;
+
+        state.stack_depth = deepest(itr->second, 0);
+        switch (exec_list(itr->second, &state)) {
+        case FLOW_RETURN:
+                this->_result = state.returned;
+                return true;
+        case FLOW_BREAK:
+        case FLOW_CONTINUE:
+                rin_error_at(state.left->location, "Left a loop outside of any loop");
+                return false;
+        case FLOW_ERROR:
+                return false;
+        default:
+                return true;
+        }
+}
+
+Interp_value Interp_backend::value(Named_object* obj) const
+{
+        auto itr = this->_variables.find(obj);
+        if (itr == this->_variables.end() || itr->second->local)
+                return Interp_value();
+        return itr->second->value;
+}
+
+Interp_function* Interp_backend::function(const std::string& name) const
+{
+        auto itr = this->_functions.find(name);
+        return (itr != this->_functions.end()) ? itr->second : NULL;
+}
+
+Scope* Interp_backend::enter_scope()
+{
+        Scope* scope = Backend::enter_scope();
+        this->_scope_marks[scope] = this->_made.size();
+        this->_use_marks[scope] = this->_uses.size();
+        return scope;
+}
+
+void Interp_backend::push_statement(Bstatement* statement)
+{
+        if (statement)
+                this->_statements[this->current_scope()].push_back(node(statement));
+}
+
+Interp_backend::Statement_list Interp_backend::take_statements(Scope* scope)
+{
+        Statement_list list;
+        auto itr = this->_statements.find(scope);
+        if (scope && itr != this->_statements.end()) {
+                list.swap(itr->second);
+                this->_statements.erase(itr);
+        }
+        return list;
+}
+
+Interp_variable* Interp_backend::variable_in(Named_object* obj, Scope* scope)
+{
+        auto itr = this->_variables.find(obj);
+        if (itr != this->_variables.end())
+                return itr->second;
+
+        Interp_variable* var = this->arena()->make<Interp_variable>(obj, scope);
+        this->_variables[obj] = var;
+        this->_made.push_back(var);
+        return var;
+}
+
+void Interp_backend::use(Interp_variable* var, Interp_expression* expr, Interp_statement* stmt)
+{
+        Interp_use* use = this->arena()->make<Interp_use>();
+        use->var = var;
+        use->expr = expr;
+        use->stmt = stmt;
+        use->scope = this->current_scope();
+        use->function = NULL;
+        this->_uses.push_back(use);
+}
+
+Bvariable* Interp_backend::variable(Named_object* obj)
+{
+        RIN_ASSERT(obj);
+        return bvariable(this->variable_in(obj, this->current_scope()));
+}
+
+Bexpression* Interp_backend::invalid_expression()
+{ return bexpression(this->arena()->make<Invalid_node>()); }
+
+Bexpression* Interp_backend::unary_expression
+(RIN_OPERATOR op, Bexpression* expr, const Location& loc)
+{
+        RIN_ASSERT(expr);
+
+        // The variable itself, which inc_statement() and dec_statement() step.
+        if (op == OPER_INC || op == OPER_DEC)
+                return expr;
+
+        Interp_eval eval;
+        if (op == OPER_NOT)
+                eval = eval_not;
+        else if (op == OPER_NEG)
+                eval = eval_neg;
+        else if (op == OPER_BNOT)
+                eval = eval_bnot;
+        else
+                RIN_UNREACHABLE();
+
+        return bexpression(check_depth(this->arena()->make<Unary_node>(eval, node(expr), loc)));
+}
+
+Bexpression* Interp_backend::binary_expression
+(RIN_OPERATOR op, Bexpression* left, Bexpression* right, const Location& loc)
+{
+        RIN_ASSERT(left && right);
+        Interp_eval eval = binary_eval(op);
+        RIN_ASSERT(eval);
+        return bexpression(check_depth(this->arena()->make<Binary_node>(eval, node(left),
+                                                                        node(right), loc)));
+}
+
+Bexpression* Interp_backend::var_reference(Bvariable* var, const Location& loc)
+{
+        RIN_ASSERT(var);
+        Var_node* ref = this->arena()->make<Var_node>(node(var), loc);
+        this->use(ref->var, ref, NULL);
+        return bexpression(ref);
+}
+
+Bexpression* Interp_backend::float_expression(const mpfr_t* val, const Location& loc)
+{
+        RIN_ASSERT(val);
+        return this->native_float_expression(mpfr_get_d(*val, MPFR_RNDN), loc);
+}
+
+Bexpression* Interp_backend::integer_expression(const mpfr_t* val, const Location& loc)
+{
+        RIN_ASSERT(val);
+        return this->native_integer_expression(mpfr_get_si(*val, MPFR_RNDN), loc);
+}
+
+Bexpression* Interp_backend::native_float_expression(double val, const Location& loc)
+{
+        return bexpression(this->arena()->make<Constant_node>(Interp_value::of_float(val), loc));
+}
+
+Bexpression* Interp_backend::native_integer_expression(int64_t val, const Location& loc)
+{
+        return bexpression(this->arena()->make<Constant_node>(Interp_value::of_int(val), loc));
+}
+
+Bexpression* Interp_backend::call_expression
+(const std::string& name, const std::vector<Bexpression*>& args, const Location& loc)
+{
+        return bexpression(check_depth(this->arena()->make<Call_node>(name, args, loc)));
+}
+
+Bstatement* Interp_backend::invalid_statement()
+{
+        return bstatement(this->arena()->make<Interp_statement>(exec_invalid,
+                                                                File::unknown_location()));
+}
+
+Bstatement* Interp_backend::var_dec_statement(Bvariable* var)
+{
+        RIN_ASSERT(var);
+        return bstatement(this->arena()->make<Declare_node>(node(var)));
+}
+
+Bstatement* Interp_backend::assignment_statement
+(Bexpression* lhs, Bexpression* rhs, const Location& loc)
+{
+        RIN_ASSERT(lhs && rhs);
+        Interp_expression* target = node(lhs);
+        if (target->eval != Var_node::eval)
+                return this->invalid_statement();
+
+        Interp_variable* var = static_cast<Var_node*>(target)->var;
+        Assign_node* stmt = this->arena()->make<Assign_node>(var, node(rhs), loc);
+        this->use(var, NULL, stmt);
+        return bstatement(stmt);
+}
+
+Bstatement* Interp_backend::inc_statement(Bexpression* expr, const Location& loc)
+{
+        RIN_ASSERT(expr);
+        Interp_expression* target = node(expr);
+        if (target->eval != Var_node::eval)
+                return this->invalid_statement();
+
+        Interp_variable* var = static_cast<Var_node*>(target)->var;
+        Step_node* stmt = this->arena()->make<Step_node>(var, 1, loc);
+        this->use(var, NULL, stmt);
+        return bstatement(stmt);
+}
+
+Bstatement* Interp_backend::dec_statement(Bexpression* expr, const Location& loc)
+{
+        RIN_ASSERT(expr);
+        Interp_expression* target = node(expr);
+        if (target->eval != Var_node::eval)
+                return this->invalid_statement();
+
+        Interp_variable* var = static_cast<Var_node*>(target)->var;
+        Step_node* stmt = this->arena()->make<Step_node>(var, -1, loc);
+        this->use(var, NULL, stmt);
+        return bstatement(stmt);
+}
+
+Bstatement* Interp_backend::if_statement
+(Bexpression* cond, Scope* then, Scope* else_block, const Location& loc)
+{
+        RIN_ASSERT(cond);
+        RIN_ASSERT(then);
+
+        If_node* stmt = this->arena()->make<If_node>(node(cond), loc);
+        stmt->then_block = this->take_statements(then);
+        stmt->else_block = this->take_statements(else_block);
+        stmt->depth = deepest(stmt->else_block, deepest(stmt->then_block, stmt->depth) + 1);
+        return bstatement(check_depth(stmt));
+}
+
+Bstatement* Interp_backend::for_statement
+(Bstatement* ind, Bstatement* cond, Bstatement* inc, Scope* then_block, const Location& loc)
+{
+        // The condition comes wrapped in an expression statement.
+        Interp_expression* cond_expr = NULL;
+        if (cond) {
+                Interp_statement* wrapped = node(cond);
+                if (wrapped->exec != Expression_node::exec)
+                        return this->invalid_statement();
+                cond_expr = static_cast<Expression_node*>(wrapped)->expr;
+        }
+
+        For_node* stmt = this->arena()->make<For_node>((ind) ? node(ind) : NULL, cond_expr,
+                                                       (inc) ? node(inc) : NULL, loc);
+        stmt->body = this->take_statements(then_block);
+        stmt->depth = deepest(stmt->body, stmt->depth) + 1;
+        return bstatement(check_depth(stmt));
+}
+
+Bstatement* Interp_backend::expression_statement(Bexpression* expr, const Location& loc)
+{
+        RIN_ASSERT(expr);
+        return bstatement(this->arena()->make<Expression_node>(node(expr), loc));
+}
+
+Bstatement* Interp_backend::compound_statement
+(Bstatement* first, Bstatement* second, const Location& loc)
+{
+        RIN_ASSERT(first && second);
+        return bstatement(this->arena()->make<Compound_node>(node(first), node(second), loc));
+}
+
+Bstatement* Interp_backend::return_statement(Bexpression* expr, const Location& loc)
+{
+        Interp_expression* value = (expr) ? node(expr) : NULL;
+        return bstatement(this->arena()->make<Return_node>(value, loc));
+}
+
+// Whether scope is inner, or nested in it.
+static bool is_within(Scope* scope, Scope* inner)
+{
+        for (; scope; scope = scope->parent()) {
+                if (scope == inner)
+                        return true;
+        }
+        return false;
+}
+
+Bstatement* Interp_backend::function_statement
+(const std::string& name, const std::vector<std::string>& params,
+ Scope* body, const Location& loc)
+{
+        RIN_ASSERT(body);
+        if (this->_functions.count(name)) {
+                rin_error_at(loc, "Redefinition of function '%s'", name.c_str());
+                return this->invalid_statement();
+        }
+
+        Interp_function* fn = this->arena()->make<Interp_function>();
+        fn->name = name;
+        fn->location = loc;
+        fn->body = this->take_statements(body);
+        fn->depth = deepest(fn->body, 0);
+
+        // Parameters are the body's first objects, in order.
+        Scope::Var_map* objects = body->variables();
+        for (auto param = params.begin(); param != params.end(); ++param) {
+                Symbol sym = intern(*param);
+                for (auto obj = objects->begin(); obj != objects->end(); ++obj) {
+                        if ((*obj)->symbol() != sym)
+                                continue;
+                        Interp_variable* var = this->variable_in(*obj, body);
+                        var->local = true;
+                        var->owner = fn;
+                        var->slot = fn->params;
+                        break;
+                }
+                fn->params++;
+        }
+        fn->frame_size = fn->params;
+
+        /*
+         * Every other variable first seen within the body is a local, bar
+         * those of functions nested in it, which have claimed theirs.
+         */
+        auto mark = this->_scope_marks.find(body);
+        size_t first = (mark != this->_scope_marks.end()) ? mark->second : 0;
+        for (size_t i = first; i < this->_made.size(); i++) {
+                Interp_variable* var = this->_made[i];
+                if (var->local || !is_within(var->scope, body))
+                        continue;
+                var->local = true;
+                var->owner = fn;
+                var->slot = fn->frame_size++;
+        }
+
+        /*
+         * The body's uses not claimed by a function nested in it are its
+         * own. Those of its locals made in a nested function would reach
+         * into the wrong frame, so they report an error instead.
+         */
+        auto use_mark = this->_use_marks.find(body);
+        size_t first_use = (use_mark != this->_use_marks.end()) ? use_mark->second : 0;
+        for (size_t i = first_use; i < this->_uses.size(); i++) {
+                Interp_use* use = this->_uses[i];
+                if (!use->function && is_within(use->scope, body))
+                        use->function = fn;
+                if (use->var->owner != fn || use->function == fn)
+                        continue;
+                if (use->expr)
+                        use->expr->eval = Var_node::enclosing;
+                else
+                        use->stmt->exec = Store_node::enclosing;
+        }
+
+        this->_functions[name] = fn;
+        return bstatement(this->arena()->make<Interp_statement>(exec_nothing, loc));
+}
+
+Bstatement* Interp_backend::break_statement(const Location& loc)
+{ return bstatement(this->arena()->make<Interp_statement>(exec_break, loc)); }
+
+Bstatement* Interp_backend::continue_statement(const Location& loc)
+{ return bstatement(this->arena()->make<Interp_statement>(exec_continue, loc)); }
@@ -0,0 +1,218 @@
+// interp-backend.hpp - A backend that runs programs by walking closure trees
+#ifndef RIN_INTERP_BACKEND_HPP
+#define RIN_INTERP_BACKEND_HPP
+
+#include "backend.hpp"
+
+// A value an interpreted program computes: an integer or a float.
+struct Interp_value
+{
+        enum Value_kind : uint8_t { VALUE_INT, VALUE_FLOAT };
+
+        Interp_value() : kind(VALUE_INT), i(0) {}
+
+        static Interp_value of_int(int64_t i)
+        {
+                Interp_value v;
+                v.i = i;
+                return v;
+        }
+
+        static Interp_value of_float(double f)
+        {
+                Interp_value v;
+                v.kind = VALUE_FLOAT;
+                v.f = f;
+                return v;
+        }
+
+        bool is_float() const
+        { return this->kind == VALUE_FLOAT; }
+
+        double as_float() const
+        { return (this->is_float()) ? this->f : (double)this->i; }
+
+        // Whether the value counts as true in a condition.
+        bool truth() const
+        { return (this->is_float()) ? this->f != 0 : this->i != 0; }
+
+        std::string str() const;
+
+        Value_kind kind;
+        union {
+                int64_t i;
+                double f;
+        };
+};
+
+// Built by the backend and run by run(); see interp-backend.cc.
+struct Interp_expression;
+struct Interp_statement;
+struct Interp_variable;
+struct Interp_function;
+struct Interp_state;
+struct Interp_use;
+
+/*
+ * The interpreter backend runs a program straight from the parser, with no
+ * compiler behind it. Every callback builds a closure node: a small object
+ * holding its operands and a pointer to the function that evaluates it,
+ * chosen when the node is built, so running the program is a walk from
+ * node to node with no dispatch on what the node is. run() then executes
+ * the supercontext's statements in order.
+ *
+ * Values are 64-bit integers or doubles, typed by what is stored in them
+ * rather than by declarations, which the backend is not told about: an
+ * operation on two integers gives an integer, and one on a float gives a
+ * float. Integer arithmetic wraps; division by zero is a runtime error.
+ *
+ * Variables at the top level, and in blocks outside of any function, live
+ * as long as the backend. The parameters and locals of a function live in
+ * a frame of its own for every call, so functions may recurse; a function
+ * sees its own locals and the top-level variables. Using the locals of a
+ * function it is nested in is a runtime error, as in the other backends.
+ *
+ * Nodes are made in the backend's arena, like the AST, and are handed to
+ * the parser under the backend types. Statements are kept by the backend
+ * rather than by their scopes, so nothing it builds is ever deleted.
+ */
+class Interp_backend : public Backend
+{
+public:
+        Interp_backend() {}
+
+        /*
+         * Run the supercontext's statements, in order, until they are done
+         * or one of them returns. Returns false if the program stopped on a
+         * runtime error, which is reported. A program should only be run
+         * if it parsed without errors.
+         */
+        bool run();
+
+        // Deepest function call run() allows before stopping with an error.
+        static const unsigned MAX_CALL_DEPTH = 1 << 12;
+
+        // Deepest nesting of operations, or of blocks, the backend accepts.
+        static const unsigned MAX_DEPTH = 1 << 13;
+
+        /*
+         * Nodes run by recursion, so the native stack a run takes grows
+         * with the nesting of every body in the calls in progress. Each
+         * call is charged its body's nesting, and a few levels for the
+         * call itself; run() stops with an error past this many.
+         */
+        static const unsigned MAX_STACK_DEPTH = 1 << 15;
+
+        // The value of a variable at the top level, once the program has run.
+        Interp_value value(Named_object* obj) const;
+
+        // The value returned by a top-level return statement, or 0.
+        const Interp_value& result() const
+        { return this->_result; }
+
+        // Return the function declared as name, or NULL.
+        Interp_function* function(const std::string& name) const;
+
+        // Scopes and statements
+
+        Scope* enter_scope() override;
+        void push_statement(Bstatement* statement) override;
+
+        // Variables
+
+        Bvariable* variable(Named_object* obj) override;
+
+        // Expressions
+
+        Bexpression* invalid_expression() override;
+
+        Bexpression* unary_expression
+        (RIN_OPERATOR op, Bexpression* expr, const Location& loc) override;
+
+        Bexpression* binary_expression
+        (RIN_OPERATOR op, Bexpression* left, Bexpression* right, const Location& loc) override;
+
+        Bexpression* var_reference(Bvariable* var, const Location& loc) override;
+
+        Bexpression* float_expression(const mpfr_t* val, const Location& loc) override;
+        Bexpression* integer_expression(const mpfr_t* val, const Location& loc) override;
+        Bexpression* native_float_expression(double val, const Location& loc) override;
+        Bexpression* native_integer_expression(int64_t val, const Location& loc) override;
+
+        // A condition is the value of its expression.
+        Bexpression* conditional_expression(Bexpression* cond, const Location&) override
+        { return cond; }
+
+        Bexpression* call_expression
+        (const std::string& name, const std::vector<Bexpression*>& args,
+         const Location& loc) override;
+
+        // Statements
+
+        Bstatement* invalid_statement() override;
+
+        Bstatement* var_dec_statement(Bvariable* var) override;
+
+        Bstatement* assignment_statement
+        (Bexpression* lhs, Bexpression* rhs, const Location& loc) override;
+
+        Bstatement* inc_statement(Bexpression* expr, const Location& loc) override;
+        Bstatement* dec_statement(Bexpression* expr, const Location& loc) override;
+
+        Bstatement* if_statement
+        (Bexpression* cond, Scope* then, Scope* else_block, const Location& loc) override;
+
+        Bstatement* for_statement
+        (Bstatement* ind, Bstatement* cond, Bstatement* inc,
+         Scope* then_block, const Location& loc) override;
+
+        Bstatement* expression_statement(Bexpression* expr, const Location& loc) override;
+
+        Bstatement* compound_statement
+        (Bstatement* first, Bstatement* second, const Location& loc) override;
+
+        Bstatement* return_statement(Bexpression* expr, const Location& loc) override;
+
+        Bstatement* function_statement
+        (const std::string& name, const std::vector<std::string>& params,
+         Scope* body, const Location& loc) override;
+
+        Bstatement* break_statement(const Location& loc) override;
+        Bstatement* continue_statement(const Location& loc) override;
+
+private:
+        typedef std::vector<Interp_statement*> Statement_list;
+
+        // The statements pushed to each scope, taken by the statement it is the body of.
+        std::unordered_map<Scope*, Statement_list> _statements;
+
+        // Take the statements pushed to scope, which may be NULL.
+        Statement_list take_statements(Scope* scope);
+
+        // Every variable, by its object, and in the order they were made.
+        std::unordered_map<Named_object*, Interp_variable*> _variables;
+        std::vector<Interp_variable*> _made;
+
+        // For each scope, how many variables had been made when it was entered.
+        std::unordered_map<Scope*, size_t> _scope_marks;
+
+        // Return the variable for obj, made in scope if it is new.
+        Interp_variable* variable_in(Named_object* obj, Scope* scope);
+
+        /*
+         * Every node that reads or writes a variable, in the order made,
+         * and for each scope how many had been made when it was entered.
+         * A function claims those its body made, once it is declared.
+         */
+        std::vector<Interp_use*> _uses;
+        std::unordered_map<Scope*, size_t> _use_marks;
+
+        // Note that node, made in the current scope, uses var.
+        void use(Interp_variable* var, Interp_expression* expr, Interp_statement* stmt);
+
+        std::unordered_map<std::string, Interp_function*> _functions;
+
+        Interp_value _result;
+};
+
+#endif // RIN_INTERP_BACKEND_HPP
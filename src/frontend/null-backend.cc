@@ -0,0 +1,19 @@
+// null-backend.cc - A backend that builds nothing, for syntax-only checks
+#include "null-backend.hpp"
+
+/*
+ * The backend types are incomplete in the frontend, so the sentinels are
+ * plain words whose addresses are handed out under those types.
+ */
+static uintptr_t __null_expression__;
+static uintptr_t __null_statement__;
+static uintptr_t __null_variable__;
+
+Bexpression* Null_backend::null_expression()
+{ return reinterpret_cast<Bexpression*>(&__null_expression__); }
+
+Bstatement* Null_backend::null_statement()
+{ return reinterpret_cast<Bstatement*>(&__null_statement__); }
+
+Bvariable* Null_backend::null_variable()
+{ return reinterpret_cast<Bvariable*>(&__null_variable__); }
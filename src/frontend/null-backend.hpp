@@ -0,0 +1,122 @@
+// null-backend.hpp - A backend that builds nothing, for syntax-only checks
+#ifndef RIN_NULL_BACKEND_HPP
+#define RIN_NULL_BACKEND_HPP
+
+#include "backend.hpp"
+
+/*
+ * The null backend checks a file without compiling it. The parser still
+ * scans, parses and lowers every statement, so every diagnostic is still
+ * issued, but each backend callback just returns one of three shared
+ * sentinels: no backend object is allocated, and no statement is kept.
+ *
+ * The sentinels stand for a Bexpression, a Bstatement and a Bvariable but
+ * are none of them; they must never be dereferenced or deleted. A backend
+ * that may be handed them (see fork()) must only ever pass them back.
+ */
+class Null_backend : public Backend
+{
+public:
+        Null_backend() {}
+
+        // Statements are not kept, so scopes stay empty.
+        void push_statement(Bstatement*) override
+        {}
+
+        Backend* fork() override
+        { return new Null_backend; }
+
+        // Variables
+
+        Bvariable* variable(Named_object*) override
+        { return null_variable(); }
+
+        // Expressions
+
+        Bexpression* invalid_expression() override
+        { return null_expression(); }
+
+        Bexpression* unary_expression
+        (RIN_OPERATOR, Bexpression*, const Location&) override
+        { return null_expression(); }
+
+        Bexpression* binary_expression
+        (RIN_OPERATOR, Bexpression*, Bexpression*, const Location&) override
+        { return null_expression(); }
+
+        Bexpression* var_reference(Bvariable*, const Location&) override
+        { return null_expression(); }
+
+        Bexpression* float_expression(const mpfr_t*, const Location&) override
+        { return null_expression(); }
+
+        Bexpression* integer_expression(const mpfr_t*, const Location&) override
+        { return null_expression(); }
+
+        Bexpression* native_float_expression(double, const Location&) override
+        { return null_expression(); }
+
+        Bexpression* native_integer_expression(int64_t, const Location&) override
+        { return null_expression(); }
+
+        Bexpression* conditional_expression(Bexpression*, const Location&) override
+        { return null_expression(); }
+
+        Bexpression* call_expression
+        (const std::string&, const std::vector<Bexpression*>&, const Location&) override
+        { return null_expression(); }
+
+        // Statements
+
+        Bstatement* invalid_statement() override
+        { return null_statement(); }
+
+        Bstatement* var_dec_statement(Bvariable*) override
+        { return null_statement(); }
+
+        Bstatement* assignment_statement
+        (Bexpression*, Bexpression*, const Location&) override
+        { return null_statement(); }
+
+        Bstatement* inc_statement(Bexpression*, const Location&) override
+        { return null_statement(); }
+
+        Bstatement* dec_statement(Bexpression*, const Location&) override
+        { return null_statement(); }
+
+        Bstatement* if_statement
+        (Bexpression*, Scope*, Scope*, const Location&) override
+        { return null_statement(); }
+
+        Bstatement* for_statement
+        (Bstatement*, Bstatement*, Bstatement*, Scope*, const Location&) override
+        { return null_statement(); }
+
+        Bstatement* expression_statement(Bexpression*, const Location&) override
+        { return null_statement(); }
+
+        Bstatement* compound_statement
+        (Bstatement*, Bstatement*, const Location&) override
+        { return null_statement(); }
+
+        Bstatement* return_statement(Bexpression*, const Location&) override
+        { return null_statement(); }
+
+        Bstatement* function_statement
+        (const std::string&, const std::vector<std::string>&, Scope*,
+         const Location&) override
+        { return null_statement(); }
+
+        Bstatement* break_statement(const Location&) override
+        { return null_statement(); }
+
+        Bstatement* continue_statement(const Location&) override
+        { return null_statement(); }
+
+        // The sentinels every callback returns.
+        static Bexpression* null_expression();
+        static Bstatement*  null_statement();
+        static Bvariable*   null_variable();
+};
+
+#endif // RIN_NULL_BACKEND_HPP
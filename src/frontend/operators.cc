@@ -7,7 +7,7 @@
  * -1 means the operator can be parsed but takes no precedence.
  * -2 means stop parsing.
  */
-int OPERATOR_PRECEDENCE[] =
+const int OPERATOR_PRECEDENCE[] =
 {
         -2, 4, 4, 5, 5,  5,  1,  0,  6,  6,  2,  3, 3,
         -2, 6, 2, 3, 3, -1, -2, -2, -1, -2, -2, -2,
@@ -19,76 +19,91 @@ int OPERATOR_PRECEDENCE[] =
 };
 
 /*
- * The operator map enables O(1) conversion from an operator string to the
- * respective RIN_OPERATOR
+ * Every operator the scanner recognises. Operators are looked up through a
+ * perfect hash over their (at most two) characters, built at compile time
+ * from this list, so a lookup is one hash, one table load and a compare.
  */
-bool __operator_map_is_inited__ = false;
-std::unordered_map<std::string, RIN_OPERATOR> __operator_map__;
-void __init_op_map__()
-{
-        if (__operator_map_is_inited__)
-                return;
-
-        typedef std::pair<const std::string, RIN_OPERATOR> op_pair;
+struct Operator_entry {
+        char text[3];
+        RIN_OPERATOR op;
+};
 
-        __operator_map__.insert(op_pair("+", OPER_ADD));
-        __operator_map__.insert(op_pair("-", OPER_SUB));
-        __operator_map__.insert(op_pair("*", OPER_MUL));
-        __operator_map__.insert(op_pair("/", OPER_QUO));
-        __operator_map__.insert(op_pair("%", OPER_REM));
+static constexpr Operator_entry __operators__[] =
+{
+        {"+",  OPER_ADD},        {"-",  OPER_SUB},        {"*",  OPER_MUL},
+        {"/",  OPER_QUO},        {"%",  OPER_REM},
 
-        __operator_map__.insert(op_pair("&&", OPER_LAND));
-        __operator_map__.insert(op_pair("||", OPER_LOR));
-        __operator_map__.insert(op_pair("++", OPER_INC));
-        __operator_map__.insert(op_pair("--", OPER_DEC));
+        {"&&", OPER_LAND},       {"||", OPER_LOR},        {"++", OPER_INC},
+        {"--", OPER_DEC},
 
-        __operator_map__.insert(op_pair("==", OPER_EQL));
-        __operator_map__.insert(op_pair("<", OPER_LSS));
-        __operator_map__.insert(op_pair(">", OPER_GTR));
-        __operator_map__.insert(op_pair("=", OPER_ASSIGN));
-        __operator_map__.insert(op_pair("!", OPER_NOT));
+        {"==", OPER_EQL},        {"<",  OPER_LSS},        {">",  OPER_GTR},
+        {"=",  OPER_ASSIGN},     {"!",  OPER_NOT},
 
-        __operator_map__.insert(op_pair("!=", OPER_NEQ));
-        __operator_map__.insert(op_pair("<=", OPER_LEQ));
-        __operator_map__.insert(op_pair(">=", OPER_GEQ));
+        {"!=", OPER_NEQ},        {"<=", OPER_LEQ},        {">=", OPER_GEQ},
 
         // Left-hand-side operators
-        __operator_map__.insert(op_pair("(", OPER_LPAREN));
-        __operator_map__.insert(op_pair("[", OPER_LBRACK));
-        __operator_map__.insert(op_pair("{", OPER_LBRACE));
+        {"(",  OPER_LPAREN},     {"[",  OPER_LBRACK},     {"{",  OPER_LBRACE},
 
         // Right-hand-side operators
-        __operator_map__.insert(op_pair(")", OPER_RPAREN));
-        __operator_map__.insert(op_pair("]", OPER_RBRACK));
-        __operator_map__.insert(op_pair("}", OPER_RBRACE));
+        {")",  OPER_RPAREN},     {"]",  OPER_RBRACK},     {"}",  OPER_RBRACE},
 
         // Semicolon
-        __operator_map__.insert(op_pair(";", OPER_SEMICOLON));
+        {";",  OPER_SEMICOLON},
 
         // Compound assignment operators
-        __operator_map__.insert(op_pair("+=", OPER_ADD_ASSIGN));
-        __operator_map__.insert(op_pair("-=", OPER_SUB_ASSIGN));
-        __operator_map__.insert(op_pair("*=", OPER_MUL_ASSIGN));
-        __operator_map__.insert(op_pair("/=", OPER_QUO_ASSIGN));
+        {"+=", OPER_ADD_ASSIGN}, {"-=", OPER_SUB_ASSIGN},
+        {"*=", OPER_MUL_ASSIGN}, {"/=", OPER_QUO_ASSIGN},
 
         // Bitwise operators
-        __operator_map__.insert(op_pair("&", OPER_BAND));
-        __operator_map__.insert(op_pair("|", OPER_BOR));
-        __operator_map__.insert(op_pair("^", OPER_BXOR));
-        __operator_map__.insert(op_pair("~", OPER_BNOT));
-        __operator_map__.insert(op_pair("<<", OPER_LSHIFT));
-        __operator_map__.insert(op_pair(">>", OPER_RSHIFT));
+        {"&",  OPER_BAND},       {"|",  OPER_BOR},        {"^",  OPER_BXOR},
+        {"~",  OPER_BNOT},       {"<<", OPER_LSHIFT},     {">>", OPER_RSHIFT},
 
         // Ternary operators
-        __operator_map__.insert(op_pair("?", OPER_TERNARY));
-        __operator_map__.insert(op_pair(":", OPER_COLON));
+        {"?",  OPER_TERNARY},    {":",  OPER_COLON},
 
         // Comma
-        __operator_map__.insert(op_pair(",", OPER_COMMA));
+        {",",  OPER_COMMA}
+};
+
+static constexpr unsigned __operator_count__ =
+        sizeof(__operators__) / sizeof(__operators__[0]);
+
+// Hash parameters, found by search; the static_assert below rejects collisions.
+static constexpr unsigned __op_hash_size__ = 74;
 
-        __operator_map_is_inited__ = true;
+static constexpr unsigned op_hash(const char* str, size_t len)
+{
+        return (2 * (unsigned char)str[0]
+                + 15 * (len > 1 ? (unsigned char)str[1] : 0)) % __op_hash_size__;
+}
+
+static constexpr size_t op_length(const Operator_entry& entry)
+{
+        return (entry.text[1] != '\0') ? 2 : 1;
 }
 
+struct Operator_table {
+        signed char slot[__op_hash_size__];
+        bool perfect;
+
+        constexpr Operator_table() : slot(), perfect(true)
+        {
+                for (unsigned i = 0; i < __op_hash_size__; i++)
+                        slot[i] = -1;
+
+                for (unsigned i = 0; i < __operator_count__; i++) {
+                        const Operator_entry& entry = __operators__[i];
+                        unsigned h = op_hash(entry.text, op_length(entry));
+                        if (slot[h] != -1)
+                                perfect = false;
+                        slot[h] = i;
+                }
+        }
+};
+
+static constexpr Operator_table __operator_table__;
+static_assert(__operator_table__.perfect, "operator hash is not perfect");
+
 bool is_paired_symbol(RIN_OPERATOR symbol)
 {
         if (symbol >= OPER_LPAREN && symbol <= OPER_RBRACE)
@@ -114,35 +129,40 @@ RIN_OPERATOR get_symbol_pair(RIN_OPERATOR symbol)
         return OPER_ILLEGAL;
 }
 
-bool is_rin_operator(char c)
+RIN_OPERATOR op_lookup(const char* str, size_t len)
 {
-        __init_op_map__();
-        std::string op(1, c);
-        return is_rin_operator(op);
+        if (len == 0 || len > 2)
+                return OPER_ILLEGAL;
+
+        int i = __operator_table__.slot[op_hash(str, len)];
+        if (i < 0)
+                return OPER_ILLEGAL;
+
+        const Operator_entry& entry = __operators__[i];
+        if (op_length(entry) != len || entry.text[0] != str[0]
+            || (len == 2 && entry.text[1] != str[1]))
+                return OPER_ILLEGAL;
+
+        return entry.op;
 }
 
-bool is_rin_operator(const std::string& str)
+RIN_OPERATOR op_lookup(const std::string& str)
 {
-        __init_op_map__();
-        auto itr = __operator_map__.find(str);
-        return (itr != __operator_map__.end() && itr->second != OPER_ILLEGAL);
+        return op_lookup(str.data(), str.size());
 }
 
-RIN_OPERATOR op_lookup(const std::string& str)
+bool is_rin_operator(char c)
 {
-        __init_op_map__();
-        auto itr = __operator_map__.find(str);
-        if (itr != __operator_map__.end())
-                return itr->second;
-        return OPER_ILLEGAL;
+        return op_lookup(&c, 1) != OPER_ILLEGAL;
+}
+
+bool is_rin_operator(const std::string& str)
+{
+        return op_lookup(str.data(), str.size()) != OPER_ILLEGAL;
 }
 
 std::string operator_name(RIN_OPERATOR op)
 {
-        /*
-         * Crude approach but searching for a key by its value in
-         * __operator_map__ is still O(n).
-         */
         switch (op) {
         case OPER_ILLEGAL:   return "illegal operator";
         case OPER_ADD:       return "'+' operator";
@@ -20,6 +20,9 @@ enum RIN_OPERATOR {
         OPER_COMMA
 };
 
+// Operator precedences, indexed by RIN_OPERATOR (see operators.cc).
+extern const int OPERATOR_PRECEDENCE[];
+
 /*
  * Returns whether this is a paired symbol.
  * ex. pairs: ( -> ), [ -> ], { -> }
@@ -34,6 +37,7 @@ bool is_righthand_op(RIN_OPERATOR symbol);
 RIN_OPERATOR get_symbol_pair(RIN_OPERATOR symbol);
 
 // Converts a string into an operator, or returns OPER_ILLEGAL
+RIN_OPERATOR op_lookup(const char* str, size_t len);
 RIN_OPERATOR op_lookup(const std::string& str);
 
 // Returns true if RIN operator
@@ -1,5 +1,7 @@
 // parser.cc - Recursive descent parser and AST construction
 #include "parser.hpp"
+#include "flat.hpp"
+#include "simd.hpp"
 
 Parser::Parser(Scanner* scanner, Backend* backend)
 {
@@ -22,21 +24,452 @@ Parser::~Parser()
         delete this->_backend;
 }
 
-void Parser::parse(bool is_supercontext)
+unsigned Parser::default_jobs()
 {
+        unsigned n = std::thread::hardware_concurrency();
+        return (n > 0) ? n : 1;
+}
+
+// --- Top-level functions ---
+
+// The source text [begin, end) of a top-level function declaration.
+struct Function_span {
+        uint32_t begin;
+        uint32_t end;
+};
+
+static bool is_name_start(char c)
+{ return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+
+static bool is_name_char(char c)
+{ return is_name_start(c) || (c >= '0' && c <= '9') || c == '_'; }
+
+static const char* skip_blanks(const char* p, const char* end)
+{
+        while (p < end && (*p == ' ' || *p == '\t'))
+                p++;
+        return p;
+}
+
+// Step over an identifier at p. Returns where it ends, or NULL.
+static const char* match_name(const char* p, const char* end)
+{
+        if (p == end || !is_name_start(*p))
+                return NULL;
+
+        const char* start = p;
+        while (p < end && is_name_char(*p))
+                p++;
+        return (rid_lookup(start, p - start) == RID_INVALID) ? p : NULL;
+}
+
+/*
+ * Match the rest of a function header after 'fn', in the plain form
+ * 'fn name(a, b) {' on one line, and return the '{'. Anything else,
+ * comments included, returns NULL and is left to the sequential parse.
+ */
+static const char* match_function_header(const char* p, const char* end)
+{
+        if (p == end || (*p != ' ' && *p != '\t'))
+                return NULL;
+
+        p = match_name(skip_blanks(p, end), end);
+        if (!p)
+                return NULL;
+
+        p = skip_blanks(p, end);
+        if (p == end || *p != '(')
+                return NULL;
+
+        p = skip_blanks(p + 1, end);
+        if (p < end && *p != ')') {
+                for (;;) {
+                        p = match_name(p, end);
+                        if (!p)
+                                return NULL;
+                        p = skip_blanks(p, end);
+                        if (p == end || *p != ',')
+                                break;
+                        p = skip_blanks(p + 1, end);
+                }
+        }
+        if (p == end || *p != ')')
+                return NULL;
+
+        p = skip_blanks(p + 1, end);
+        return (p < end && *p == '{') ? p : NULL;
+}
+
+/*
+ * Find the function declarations at the top level of a source without
+ * scanning it: braces are matched on the raw text, skipping comments,
+ * which is all the scanner does with them as well. A function runs from
+ * its 'fn' to the '}' that closes its body.
+ */
+static std::vector<Function_span> find_functions(const char* data, const char* end)
+{
+        std::vector<Function_span> spans;
+        const char* fn = NULL;
+        unsigned depth = 0;
+
+        const char* p = data;
+        while (p < end) {
+                char c = *p;
+                if (c == '/' && p + 1 < end && p[1] == '/') {
+                        const char* nl = scan_byte(p + 2, end, '\n');
+                        p = (nl < end) ? nl + 1 : end;
+                        continue;
+                }
+                if (c == '/' && p + 1 < end && p[1] == '*') {
+                        const char* close = scan_block_comment_end(p + 2, end);
+                        p = (close < end) ? close + 2 : end;
+                        continue;
+                }
+
+                if (c == '{') {
+                        depth++;
+                } else if (c == '}' && depth > 0) {
+                        if (--depth == 0 && fn) {
+                                spans.push_back(Function_span{ (uint32_t)(fn - data),
+                                                               (uint32_t)(p + 1 - data) });
+                                fn = NULL;
+                        }
+                } else if (depth == 0 && c == 'f' && p + 1 < end && p[1] == 'n'
+                           && (p == data || p[-1] == ' ' || p[-1] == '\t'
+                               || p[-1] == '\r' || p[-1] == '\n'
+                               || Scanner::is_operator(p[-1]))) {
+                        const char* lbrace = match_function_header(p + 2, end);
+                        if (lbrace) {
+                                fn = p;
+                                depth = 1;
+                                p = lbrace + 1;
+                                continue;
+                        }
+                }
+                p++;
+        }
+        return spans;
+}
+
+/*
+ * Top-level functions parsed on worker threads. parse() hands each one
+ * found by find_functions() to a worker when it reaches it and skips its
+ * text. The worker parses the function alone, with a parser and a fork of
+ * the backend of its own, whose supercontext sees the variables defined so
+ * far. merge() then puts the functions' statements and diagnostics back
+ * where a sequential parse has them. Diagnostics this thread issues after
+ * a function are held until then, too.
+ */
+class Parser::Function_jobs
+{
+public:
+        /*
+         * Start parsing functions for parser, or return NULL if its
+         * backend does not fork or there are none to parse.
+         */
+        static Function_jobs* start(Parser* parser);
+
+        ~Function_jobs();
+
+        /*
+         * Hand the function declared by the 'fn' token tok to a worker and
+         * skip it, if it is one that was found. Returns whether it was.
+         */
+        bool dispatch(const Token& tok);
+
+        // Wait for the workers and merge what they parsed into the parser.
+        void merge();
+
+        /*
+         * Whether every function merged parsed without errors. A function
+         * with errors may end where a sequential parse would not have
+         * resynchronised, so only then is the parse as if sequential.
+         */
+        bool clean() const
+        { return this->_clean; }
+
+private:
+        struct Job {
+                Function_span span;
+
+                // Parses the function into a fork of the backend it owns.
+                Parser* parser;
+
+                // Variables defined before the function, in order.
+                std::vector<Named_object*> globals;
+
+                // Number of top-level statements before the function.
+                size_t index;
+
+                Diagnostic_buffer diagnostics;
+
+                // This thread's diagnostics until the next function.
+                Diagnostic_buffer after;
+        };
+
+        Function_jobs(Parser* parser, Backend* fork, std::vector<Function_span>& spans);
+
+        // Parse functions until merge() is called.
+        void work();
+
+        Parser* _parser;
+        std::vector<Function_span> _spans;
+        size_t _next_span = 0;
+
+        // A fork made by start() and not used yet.
+        Backend* _fork;
+
+        std::vector<std::unique_ptr<Job>> _jobs;
+        bool _clean = true;
+
+        // The capture that held this thread's diagnostics before the first job.
+        Diagnostic_buffer* _outer = NULL;
+
+        // Guards _jobs, _next_job and _closed.
+        std::mutex _lock;
+        std::condition_variable _ready;
+        size_t _next_job = 0;
+        bool _closed = false;
+
+        std::vector<std::thread> _workers;
+};
+
+Parser::Function_jobs::Function_jobs
+(Parser* parser, Backend* fork, std::vector<Function_span>& spans)
+        : _parser(parser), _fork(fork)
+{
+        this->_spans.swap(spans);
+}
+
+Parser::Function_jobs* Parser::Function_jobs::start(Parser* parser)
+{
+        File* src = parser->_scanner->source();
+        if (!src || !src->is_open())
+                return NULL;
+
+        std::vector<Function_span> spans = find_functions(src->begin(), src->end());
+        if (spans.empty())
+                return NULL;
+
+        Backend* fork = parser->_backend->fork();
+        if (!fork)
+                return NULL;
+        return new Function_jobs(parser, fork, spans);
+}
+
+Parser::Function_jobs::~Function_jobs()
+{
+        if (!this->_closed)
+                this->merge();
+        delete this->_fork;
+}
+
+bool Parser::Function_jobs::dispatch(const Token& tok)
+{
+        while (this->_next_span < this->_spans.size()
+               && this->_spans[this->_next_span].begin < tok.offset())
+                this->_next_span++;
+        if (this->_next_span == this->_spans.size()
+            || this->_spans[this->_next_span].begin != tok.offset())
+                return false;
+
+        Job* job = new Job;
+        job->span = this->_spans[this->_next_span++];
+
+        Backend* fork = this->_fork ? this->_fork : this->_parser->_backend->fork();
+        this->_fork = NULL;
+        RIN_ASSERT(fork);
+
+        File* view = new File;
+        view->open_view(*this->_parser->_scanner->source(), job->span.begin, job->span.end);
+        fork->set_context(this->_parser->_backend->context());
+        job->parser = new Parser(new Scanner(view), fork);
+        job->parser->set_jobs(1);
+        job->parser->set_max_nesting(this->_parser->max_nesting());
+
+        Scope* supercontext = this->_parser->_backend->supercontext();
+        job->globals = *supercontext->variables();
+        job->index = supercontext->size();
+
+        // Hold what this thread reports from here on until merge().
+        Diagnostic_buffer* previous = Diagnostic_buffer::capture(&job->after);
+        if (this->_jobs.empty())
+                this->_outer = previous;
+
+        {
+                std::lock_guard<std::mutex> lock(this->_lock);
+                this->_jobs.emplace_back(job);
+        }
+        this->_ready.notify_one();
+
+        // One worker per job, up to one less than the parser may use.
+        if (this->_workers.size() + 1 < this->_parser->_jobs
+            && this->_workers.size() < this->_jobs.size())
+                this->_workers.emplace_back(&Function_jobs::work, this);
+
+        this->_parser->_scanner->skip_to(job->span.end);
+        return true;
+}
+
+void Parser::Function_jobs::work()
+{
+        for (;;) {
+                Job* job;
+                {
+                        std::unique_lock<std::mutex> lock(this->_lock);
+                        this->_ready.wait(lock, [this] {
+                                return this->_closed || this->_next_job < this->_jobs.size();
+                        });
+                        if (this->_next_job == this->_jobs.size())
+                                return;
+                        job = this->_jobs[this->_next_job++].get();
+                }
+
+                Diagnostic_buffer::capture(&job->diagnostics);
+                Backend* fork = job->parser->backend();
+                for (auto itr = job->globals.begin(); itr != job->globals.end(); ++itr)
+                        fork->supercontext()->import_obj(*itr);
+                job->parser->parse();
+                Diagnostic_buffer::capture(NULL);
+        }
+}
+
+void Parser::Function_jobs::merge()
+{
+        {
+                std::lock_guard<std::mutex> lock(this->_lock);
+                this->_closed = true;
+        }
+        this->_ready.notify_all();
+        for (auto itr = this->_workers.begin(); itr != this->_workers.end(); ++itr)
+                itr->join();
+        this->_workers.clear();
+
+        if (this->_jobs.empty())
+                return;
+        Diagnostic_buffer::capture(this->_outer);
+
+        Backend* backend = this->_parser->_backend;
+        Scope::Statement_list* statements = backend->supercontext()->statements();
+        Scope::Statement_list merged;
+        size_t next = 0;
+
+        for (auto itr = this->_jobs.begin(); itr != this->_jobs.end(); ++itr) {
+                Job* job = itr->get();
+                while (next < job->index)
+                        merged.push_back((*statements)[next++]);
+
+                Backend* fork = job->parser->backend();
+                Scope::Statement_list* made = fork->supercontext()->statements();
+                merged.insert(merged.end(), made->begin(), made->end());
+                made->clear();
+
+                const std::vector<Diagnostic_buffer::Diagnostic>& held = job->diagnostics.diagnostics();
+                for (auto diag = held.begin(); diag != held.end(); ++diag) {
+                        if (diag->kind == Diagnostic_buffer::DIAGNOSTIC_ERROR)
+                                this->_clean = false;
+                }
+                job->diagnostics.replay();
+                job->after.replay();
+
+                this->_parser->_statements += job->parser->statement_count();
+                this->_parser->_job_tokens += job->parser->token_count();
+
+                backend->join(fork);
+                delete job->parser;
+        }
+        while (next < statements->size())
+                merged.push_back((*statements)[next++]);
+
+        statements->swap(merged);
+        this->_jobs.clear();
+}
+
+void Parser::parse()
+{
+        // Report in the backend's context until the parse is done.
+        Compilation_context* outer = Compilation_context::enter(this->_backend->context());
+
+        if (this->_jobs <= 1 || !this->parse_in_parallel())
+                this->parse_statements(NULL);
+
+        Compilation_context::enter(outer);
+}
+
+bool Parser::parse_in_parallel()
+{
+        /*
+         * This thread parses into a fork too, with its diagnostics held, so
+         * that what it did can be dropped if a function had errors.
+         */
+        Backend* backend = this->_backend;
+        Backend* shadow = backend->fork();
+        if (!shadow)
+                return false;
+        shadow->set_context(backend->context());
+        this->_backend = shadow;
+
+        std::unique_ptr<Function_jobs> functions(Function_jobs::start(this));
+        if (!functions) {
+                this->_backend = backend;
+                delete shadow;
+                return false;
+        }
+
+        Diagnostic_buffer held;
+        Diagnostic_buffer* previous = Diagnostic_buffer::capture(&held);
+        this->parse_statements(functions.get());
+        bool clean = functions->clean();
+        functions.reset();
+        Diagnostic_buffer::capture(previous);
+        this->_backend = backend;
+
+        if (clean) {
+                held.replay();
+                backend->supercontext()->adopt(shadow->supercontext());
+                backend->join(shadow);
+                delete shadow;
+                return true;
+        }
+
+        // Parse the file again on this thread alone, as a sequential parse would.
+        delete shadow;
+        this->_scanner->restart();
+        this->_statements = 0;
+        this->_job_tokens = 0;
+        this->parse_statements(NULL);
+        return true;
+}
+
+void Parser::parse_statements(Function_jobs* functions)
+{
+        if (this->_pipelined)
+                this->_scanner->start_pipeline();
+
         while (this->_scanner->has_next()) {
+                // A function at the top level may go to a worker thread.
+                if (functions && this->_blocks.empty()) {
+                        const Token& peek = this->_scanner->peek_token();
+                        if (peek.classification() == Token::TOKEN_RID && peek.rid() == RID_FN
+                            && functions->dispatch(peek))
+                                continue;
+                }
+
                 /*
-                 * If not supercontext, then parse until a '}' is encountered,
-                 * which marks the end of the current scope.
+                 * A '}' ends the innermost block. Outside of any block it is
+                 * stray, and the scanner reports it as unmatched.
                  */
-                if (!is_supercontext && EXPECT_RIGHT_BRACE(this->_scanner->peek_token())) {
+                if (EXPECT_RIGHT_BRACE(this->_scanner->peek_token())) {
                         this->_scanner->next_token();
+                        if (this->_depth == 0)
+                                continue;
                         this->_backend->leave_scope();
-                        return;
+                        this->finish(this->close_block());
+                        continue;
                 }
 
                 /*
-                 * Prevents errors being issued when a non-super scope has no
+                 * Prevents errors being issued when a block has no
                  * statements, i.e for-loop with no statements.
                  */
                 if (this->_scanner->peek_token().classification() == Token::TOKEN_EOL) {
@@ -44,28 +477,160 @@ void Parser::parse(bool is_supercontext)
                         continue;
                 }
 
-                Statement* next = this->parse_next();
-                RIN_ASSERT(next != NULL);
-                if (!next->is_invalid())
-                        this->_backend->push_statement(next->get_backend(this->_backend));
-                delete next;
+                this->finish(this->parse_next());
         }
 
+        this->_scanner->stop_pipeline();
+
         // Issue Scanner errors, if any.
         this->_scanner->consume_errors();
+
+        // Finish the blocks left open at EOF with what they hold.
+        while (this->_depth > 0)
+                this->finish(this->close_block());
+
+        if (functions)
+                functions->merge();
+}
+
+Statement* Parser::open_block
+(Block::Block_kind kind, Statement* stmt, Scope* scope, const Location& loc)
+{
+        this->_blocks.push_back(Block{ kind, stmt, scope, loc });
+        if (kind == Block::BLOCK_ELSE_IF || kind == Block::BLOCK_FOR_INIT)
+                return NULL;
+
+        if (++this->_depth <= this->_max_nesting)
+                return NULL;
+
+        // Skip to the '}' that closes the block; parse() then closes it.
+        rin_error_at(loc, "Block nesting exceeds the limit of %u", this->_max_nesting);
+        unsigned open = 0;
+        while (this->_scanner->has_next()) {
+                const Token& tok = this->_scanner->peek_token();
+                if (EXPECT_RIGHT_BRACE(tok)) {
+                        if (open == 0)
+                                break;
+                        open--;
+                } else if (EXPECT_LEFT_BRACE(tok)) {
+                        open++;
+                }
+                this->_scanner->next_token();
+        }
+        return NULL;
+}
+
+Statement* Parser::close_block()
+{
+        RIN_ASSERT(this->_depth > 0);
+        Block block = this->_blocks.back();
+        this->_blocks.pop_back();
+        this->_depth--;
+
+        switch (block.kind) {
+        case Block::BLOCK_IF: {
+                If_statement* if_stmt = block.stmt->if_statement();
+
+                // Check for else / else-if
+                Token peek = this->_scanner->peek_token();
+                if (peek.classification() != Token::TOKEN_RID || peek.rid() != RID_ELSE)
+                        return if_stmt;
+                this->_scanner->next_token();
+
+                Token next = this->_scanner->peek_token();
+
+                // else if { ... }
+                if (next.classification() == Token::TOKEN_RID && next.rid() == RID_IF) {
+                        /*
+                         * Parse else-if as a nested if-statement inside an
+                         * else scope. Enter scope first so the nested
+                         * if-statement is parsed within it.
+                         */
+                        Scope* else_scope = this->_backend->enter_scope();
+                        this->open_block(Block::BLOCK_ELSE_IF, if_stmt, else_scope,
+                                         next.location());
+                        return this->parse_if_statement();
+                }
+
+                // else { ... }
+                if (EXPECT_LEFT_BRACE(next)) {
+                        this->_scanner->next_token();
+                        Scope* else_scope = this->_backend->enter_scope();
+                        return this->open_block(Block::BLOCK_ELSE, if_stmt, else_scope,
+                                                next.location());
+                }
+
+                rin_error_at(next.location(),
+                        "Expected '{' or 'if' after 'else', but received %s instead",
+                        next.string().c_str());
+                return if_stmt;
+        }
+
+        case Block::BLOCK_ELSE:
+                block.stmt->if_statement()->set_else_block(block.scope);
+                return block.stmt;
+
+        case Block::BLOCK_LOOP:
+                // Leave the scope of the loop header as well.
+                this->_backend->leave_scope();
+                block.stmt->for_statement()->add_statements(block.scope);
+                return block.stmt;
+
+        case Block::BLOCK_FUNCTION:
+                return block.stmt;
+
+        default:
+                RIN_UNREACHABLE();
+                return NULL;
+        }
+}
+
+void Parser::finish(Statement* stmt)
+{
+        // A NULL statement is pending; close_block() returns it later.
+        while (stmt) {
+                if (this->_blocks.empty() || this->_blocks.back().kind < Block::BLOCK_ELSE_IF) {
+                        if (!stmt->is_invalid()) {
+                                this->_backend->push_statement(stmt->get_backend(this->_backend));
+                                this->_statements++;
+                        }
+
+                        // A top-level statement is lowered whole; drop its flat nodes.
+                        if (this->_blocks.empty())
+                                this->_backend->flat_ast()->clear();
+                        return;
+                }
+
+                Block block = this->_blocks.back();
+                this->_blocks.pop_back();
+
+                if (block.kind == Block::BLOCK_FOR_INIT) {
+                        stmt = this->parse_for_header(stmt, block.location);
+                        continue;
+                }
+
+                // An else-if lives in the else scope of the statement before it.
+                if (!stmt->is_invalid()) {
+                        this->_backend->push_statement(stmt->get_backend(this->_backend));
+                        this->_statements++;
+                }
+                this->_backend->leave_scope();
+                block.stmt->if_statement()->set_else_block(block.scope);
+                stmt = block.stmt;
+        }
 }
 
 Statement* Parser::parse_next()
 {
         Token tk = this->_scanner->peek_token();
-        if (tk.classification() == Token::TOKEN_EOF)
-                goto is_invalid_statement;
-
-        if (tk.classification() == Token::TOKEN_EOL) {
+        while (tk.classification() == Token::TOKEN_EOL) {
                 this->_scanner->next_token();
-                return this->parse_next();
+                tk = this->_scanner->peek_token();
         }
 
+        if (tk.classification() == Token::TOKEN_EOF)
+                goto is_invalid_statement;
+
         if (tk.classification() == Token::TOKEN_RID) {
                 // Parse if statement
                 if (tk.rid() == RID_IF)
@@ -96,14 +661,14 @@ Statement* Parser::parse_next()
                 if (tk.rid() == RID_BREAK) {
                         Token brk = this->_scanner->next_token();
                         EXPECT_SEMICOLON_ERR(this->_scanner->next_token());
-                        return Statement::make_break(brk.location());
+                        return Statement::make_break(this->arena(), brk.location());
                 }
 
                 // Parse continue statement
                 if (tk.rid() == RID_CONTINUE) {
                         Token cont = this->_scanner->next_token();
                         EXPECT_SEMICOLON_ERR(this->_scanner->next_token());
-                        return Statement::make_continue(cont.location());
+                        return Statement::make_continue(this->arena(), cont.location());
                 }
 
                 // Switch statement (not yet implemented)
@@ -112,20 +677,20 @@ Statement* Parser::parse_next()
                                 "switch statements are not yet implemented");
                         this->_scanner->next_token();
                         this->_scanner->skip_line();
-                        return Statement::make_invalid(tk.location());
+                        return Statement::make_invalid(this->arena(), tk.location());
                 }
 
                 // Hanging reserved identifier
-                rin_error_at(tk.location(), "Malformed identifier %s", tk.str());
+                rin_error_at(tk.location(), "Malformed identifier %s", tk.string().c_str());
                 goto is_invalid_statement;
         }
 
         if (tk.classification() == Token::TOKEN_IDENT) {
-                Token op = this->_scanner->peek_nth_token(1);
+                const Token& op = this->_scanner->peek_nth_token(1);
                 if (op.classification() != Token::TOKEN_OPERATOR) {
                         rin_error_at(op.location(),
                                 "Expected operator after identifier, but received %s instead",
-                                op.str());
+                                op.string().c_str());
                         goto is_invalid_statement;
                 }
 
@@ -133,7 +698,7 @@ Statement* Parser::parse_next()
                 if (op.op() == OPER_LPAREN) {
                         Token ident = this->_scanner->next_token();
                         return this->parse_call_statement(
-                                *ident.identifier(), ident.location());
+                                ident.identifier(), ident.location());
                 }
 
                 // Parse increment/decrement statement
@@ -155,7 +720,7 @@ is_invalid_statement:
          * the current scope). Do not consume the right brace itself.
          */
         while (this->_scanner->has_next()) {
-                Token peek = this->_scanner->peek_token();
+                const Token& peek = this->_scanner->peek_token();
                 if (peek.classification() == Token::TOKEN_EOF ||
                     peek.classification() == Token::TOKEN_EOL)
                         break;
@@ -168,7 +733,7 @@ is_invalid_statement:
         }
         if (this->_scanner->has_next() && !EXPECT_RIGHT_BRACE(this->_scanner->peek_token()))
                 this->_scanner->next_token();
-        return Statement::make_invalid(tk.location());
+        return Statement::make_invalid(this->arena(), tk.location());
 }
 
 // --- Statements ---
@@ -192,62 +757,23 @@ Statement* Parser::parse_if_statement()
         if (!condition && !EXPECT_LEFT_BRACE(expect_lbrace)) {
                 rin_error_at(expect_lbrace.location(),
                              "If-statement expected left-brace '{' but received %s instead",
-                             expect_lbrace.str());
+                             expect_lbrace.string().c_str());
                 this->_scanner->skip_line();
-                return Statement::make_invalid(if_rid.location());
+                return Statement::make_invalid(this->arena(), if_rid.location());
         }
 
         // Error already issued by parse_conditional_expression.
         if (!condition) {
                 this->_scanner->skip_line();
-                return Statement::make_invalid(if_rid.location());
+                return Statement::make_invalid(this->arena(), if_rid.location());
         }
 
-        // Parse if-statement scope
+        // Parse if-statement scope; else / else-if follow in close_block().
         Scope* if_stmt_scope = this->_backend->enter_scope();
-        this->parse(false);
-
-        If_statement* if_stmt = new If_statement(condition, if_stmt_scope,
+        If_statement* if_stmt = this->arena()->make<If_statement>(condition, if_stmt_scope,
                 if_rid.location());
-
-        // Check for else / else-if
-        Token peek = this->_scanner->peek_token();
-        if (peek.classification() == Token::TOKEN_RID && peek.rid() == RID_ELSE) {
-                this->_scanner->next_token();
-
-                Token next = this->_scanner->peek_token();
-
-                // else if { ... }
-                if (next.classification() == Token::TOKEN_RID && next.rid() == RID_IF) {
-                        /*
-                         * Parse else-if as a nested if-statement inside an
-                         * else scope. Enter scope first so the recursive
-                         * parse_if_statement operates within it.
-                         */
-                        Scope* else_scope = this->_backend->enter_scope();
-                        Statement* else_if = this->parse_if_statement();
-                        if (!else_if->is_invalid())
-                                this->_backend->push_statement(
-                                        else_if->get_backend(this->_backend));
-                        delete else_if;
-                        this->_backend->leave_scope();
-                        if_stmt->set_else_block(else_scope);
-                }
-                // else { ... }
-                else if (EXPECT_LEFT_BRACE(next)) {
-                        this->_scanner->next_token();
-                        Scope* else_scope = this->_backend->enter_scope();
-                        this->parse(false);
-                        if_stmt->set_else_block(else_scope);
-                }
-                else {
-                        rin_error_at(next.location(),
-                                "Expected '{' or 'if' after 'else', but received %s instead",
-                                next.str());
-                }
-        }
-
-        return if_stmt;
+        return this->open_block(Block::BLOCK_IF, if_stmt, if_stmt_scope,
+                                expect_lbrace.location());
 }
 
 Statement* Parser::parse_for_statement()
@@ -261,12 +787,29 @@ Statement* Parser::parse_for_statement()
 
         // Induction statement
         Token semicolon = this->_scanner->peek_token();
-        Statement* ind_stmt = NULL;
-        if (!EXPECT_SEMICOLON(semicolon)) {
-                ind_stmt = this->parse_next();
-                if (ind_stmt->is_invalid())
-                        return ind_stmt;
-        } else this->_scanner->next_token();
+        if (EXPECT_SEMICOLON(semicolon)) {
+                this->_scanner->next_token();
+                return this->parse_for_header(NULL, for_rid.location());
+        }
+
+        /*
+         * The induction statement may open a block of its own, in which
+         * case the header is parsed once the block is closed.
+         */
+        this->open_block(Block::BLOCK_FOR_INIT, NULL, NULL, for_rid.location());
+        Statement* ind_stmt = this->parse_next();
+        if (!ind_stmt)
+                return NULL;
+        this->_blocks.pop_back();
+        return this->parse_for_header(ind_stmt, for_rid.location());
+}
+
+Statement* Parser::parse_for_header(Statement* ind_stmt, const Location& loc)
+{
+        if (ind_stmt && ind_stmt->is_invalid())
+                return ind_stmt;
+
+        Token semicolon;
 
         /*
          * If the induction statement is an if-statement or for-loop, then we
@@ -278,10 +821,9 @@ Statement* Parser::parse_for_statement()
                 if (!EXPECT_SEMICOLON(semicolon)) {
                         rin_error_at(semicolon.location(),
                                 "For-loop expected semicolon (';') after statement but received %s instead",
-                                semicolon.str());
-                        delete ind_stmt;
+                                semicolon.string().c_str());
                         this->_scanner->skip_line();
-                        return Statement::make_invalid(semicolon.location());
+                        return Statement::make_invalid(this->arena(), semicolon.location());
                 }
         }
 
@@ -293,15 +835,14 @@ Statement* Parser::parse_for_statement()
 
                 // Try and get a conditional expression
                 if (cond) {
-                        cond_stmt = Statement::make_expression(cond, cond->location());
+                        cond_stmt = Statement::make_expression(this->arena(), cond, cond->location());
                         EXPECT_SEMICOLON_ERR(this->_scanner->next_token());
                 }
 
                 // Found neither a semicolon nor a statement; Error already issued.
                 if (!cond_stmt) {
-                        delete ind_stmt;
                         this->_scanner->skip_line();
-                        return Statement::make_invalid(semicolon.location());
+                        return Statement::make_invalid(this->arena(), semicolon.location());
                 }
         } else this->_scanner->next_token();
 
@@ -315,9 +856,7 @@ Statement* Parser::parse_for_statement()
                         rin_error_at(peek_op.location(),
                                      "For-loop expected increment, decrement, or assignment statement");
                         this->_scanner->skip_line();
-                        delete ind_stmt;
-                        delete cond_stmt;
-                        return Statement::make_invalid(peek_op.location());
+                        return Statement::make_invalid(this->arena(), peek_op.location());
                 }
 
                 /*
@@ -331,34 +870,28 @@ Statement* Parser::parse_for_statement()
                     peek_op.op() == OPER_QUO_ASSIGN) {
                         incdec_stmt = this->parse_assignment_statement();
                         if (incdec_stmt->is_invalid()) {
-                                delete ind_stmt;
-                                delete cond_stmt;
                                 return incdec_stmt;
                         }
                 } else if (peek_op.op() == OPER_INC || peek_op.op() == OPER_DEC) {
                         Token ident = this->_scanner->next_token();
                         Token oper = this->_scanner->next_token();
 
-                        Named_object* obj = this->backend()->current_scope()->lookup(*ident.identifier());
+                        Named_object* obj = this->backend()->current_scope()->lookup(ident.symbol());
                         if (!obj) {
-                                rin_error_at(ident.location(), "'%s' is undefined", ident.str());
-                                delete ind_stmt;
-                                delete cond_stmt;
-                                return Statement::make_invalid(ident.location());
+                                rin_error_at(ident.location(), "'%s' is undefined", ident.string().c_str());
+                                return Statement::make_invalid(this->arena(), ident.location());
                         }
 
-                        Expression* ref = Expression::make_var_reference(obj, ident.location());
-                        Expression* unary = Expression::make_unary(oper.op(), ref, oper.location());
+                        Expression* ref = Expression::make_var_reference(this->arena(), obj, ident.location());
+                        Expression* unary = Expression::make_unary(this->arena(), oper.op(), ref, oper.location());
 
-                        incdec_stmt = (oper.op() == OPER_INC) ? Statement::make_inc(unary) :
-                                Statement::make_dec(unary);
+                        incdec_stmt = (oper.op() == OPER_INC) ? Statement::make_inc(this->arena(), unary) :
+                                Statement::make_dec(this->arena(), unary);
                 } else {
                         rin_error_at(peek_op.location(),
                                      "For-loop expected increment, decrement, or assignment statement");
                         this->_scanner->skip_line();
-                        delete ind_stmt;
-                        delete cond_stmt;
-                        return Statement::make_invalid(peek_op.location());
+                        return Statement::make_invalid(this->arena(), peek_op.location());
                 }
         }
 
@@ -371,25 +904,16 @@ Statement* Parser::parse_for_statement()
         if (!EXPECT_LEFT_BRACE(lbrace)) {
                 rin_error_at(lbrace.location(),
                              "For-loop expected left-brace '{' but received %s instead",
-                             lbrace.str());
+                             lbrace.string().c_str());
                 this->_scanner->skip_line();
-                delete ind_stmt;
-                delete cond_stmt;
-                delete incdec_stmt;
-                return Statement::make_invalid(lbrace.location());
+                return Statement::make_invalid(this->arena(), lbrace.location());
         }
 
-        // Parse statements in for-loop scope.
+        // Create for-loop statement and parse statements in its scope.
         Scope* loop_scope = this->_backend->enter_scope();
-        this->parse(false);
-        this->_backend->leave_scope();
-
-        // Create for-loop statement
-        For_statement* loop_stmt = new For_statement(ind_stmt, cond_stmt,
-                incdec_stmt, for_rid.location());
-        loop_stmt->add_statements(loop_scope);
-
-        return loop_stmt;
+        For_statement* loop_stmt = this->arena()->make<For_statement>(ind_stmt, cond_stmt,
+                incdec_stmt, loc);
+        return this->open_block(Block::BLOCK_LOOP, loop_stmt, loop_scope, lbrace.location());
 }
 
 Statement* Parser::parse_while_statement()
@@ -405,11 +929,11 @@ Statement* Parser::parse_while_statement()
         Expression* cond = this->parse_conditional_expression();
         Statement* cond_stmt = NULL;
         if (cond) {
-                cond_stmt = Statement::make_expression(cond, cond->location());
+                cond_stmt = Statement::make_expression(this->arena(), cond, cond->location());
         } else {
                 this->_scanner->skip_line();
                 this->backend()->leave_scope();
-                return Statement::make_invalid(while_rid.location());
+                return Statement::make_invalid(this->arena(), while_rid.location());
         }
 
         // Skip EOL tokens before opening brace (allows brace on next line)
@@ -421,24 +945,18 @@ Statement* Parser::parse_while_statement()
         if (!EXPECT_LEFT_BRACE(lbrace)) {
                 rin_error_at(lbrace.location(),
                              "While-loop expected left-brace '{' but received %s instead",
-                             lbrace.str());
+                             lbrace.string().c_str());
                 this->_scanner->skip_line();
-                delete cond_stmt;
                 this->backend()->leave_scope();
-                return Statement::make_invalid(lbrace.location());
+                return Statement::make_invalid(this->arena(), lbrace.location());
         }
 
-        // Parse statements in while-loop scope.
-        Scope* loop_scope = this->_backend->enter_scope();
-        this->parse(false);
-        this->_backend->leave_scope();
-
         // Reuse for-loop with NULL induction and NULL increment.
-        For_statement* loop_stmt = new For_statement(NULL, cond_stmt,
-                NULL, while_rid.location());
-        loop_stmt->add_statements(loop_scope);
-
-        return loop_stmt;
+        Scope* loop_scope = this->_backend->enter_scope();
+        Statement* none = NULL;
+        For_statement* loop_stmt = this->arena()->make<For_statement>(none, cond_stmt,
+                none, while_rid.location());
+        return this->open_block(Block::BLOCK_LOOP, loop_stmt, loop_scope, lbrace.location());
 }
 
 Statement* Parser::parse_var_dec_statement()
@@ -452,9 +970,9 @@ Statement* Parser::parse_var_dec_statement()
         if (ident.classification() != Token::TOKEN_IDENT) {
                 rin_error_at(ident.location(),
                         "Variable declaration expected identifier but received %s instead. Expected a variable name",
-                        ident.str());
+                        ident.string().c_str());
                 this->_scanner->skip_line();
-                return Statement::make_invalid(ident.location());
+                return Statement::make_invalid(this->arena(), ident.location());
         }
 
         /*
@@ -469,24 +987,24 @@ Statement* Parser::parse_var_dec_statement()
 
                 // Create var declaration
                 Named_object* obj = this->backend()->current_scope()->
-                        define_obj(*ident.identifier(), ident.location());
+                        define_obj(ident.symbol(), ident.location());
 
-                if (!obj) return Statement::make_invalid(ident.location());
-                return Statement::make_variable_declaration(obj);
+                if (!obj) return Statement::make_invalid(this->arena(), ident.location());
+                return Statement::make_variable_declaration(this->arena(), obj);
         }
 
         // Create a declaration and then parse it's assignment
         Named_object* obj = this->backend()->current_scope()->
-                define_obj(*ident.identifier(), ident.location());
+                define_obj(ident.symbol(), ident.location());
 
         // Redefinition.
-        if (!obj) return Statement::make_invalid(ident.location());
+        if (!obj) return Statement::make_invalid(this->arena(), ident.location());
 
-        Statement* declr = Statement::make_variable_declaration(obj);
+        Statement* declr = Statement::make_variable_declaration(this->arena(), obj);
         Statement* assign = this->parse_assignment_statement();
 
         // Create compound statement
-        return Statement::make_compound(declr, assign, declr->location());
+        return Statement::make_compound(this->arena(), declr, assign, declr->location());
 }
 
 Statement* Parser::parse_assignment_statement()
@@ -512,35 +1030,34 @@ Statement* Parser::parse_assignment_statement()
                 default:
                         rin_error_at(assign.location(),
                                 "Assignment statement expected '=' operator, but received %s instead. Did you mean '='?",
-                                assign.str());
+                                assign.string().c_str());
                         this->_scanner->skip_line();
-                        return Statement::make_invalid(assign.location());
+                        return Statement::make_invalid(this->arena(), assign.location());
                 }
         } else {
                 rin_error_at(assign.location(),
                         "Assignment statement expected '=' operator, but received %s instead. Did you mean '='?",
-                        assign.str());
+                        assign.string().c_str());
                 this->_scanner->skip_line();
-                return Statement::make_invalid(assign.location());
+                return Statement::make_invalid(this->arena(), assign.location());
         }
 
         // Create left-hand variable reference expression.
-        Named_object* obj = this->backend()->current_scope()->lookup(*ident.identifier());
+        Named_object* obj = this->backend()->current_scope()->lookup(ident.symbol());
         if (!obj) {
                 rin_error_at(ident.location(), "'%s' is undeclared",
-                        ident.str());
+                        ident.string().c_str());
                 this->_scanner->skip_line();
-                return Statement::make_invalid(ident.location());
+                return Statement::make_invalid(this->arena(), ident.location());
         }
 
-        Expression* lhs_ref = Expression::make_var_reference(obj, ident.location());
+        Expression* lhs_ref = Expression::make_var_reference(this->arena(), obj, ident.location());
 
         // Parse right-hand side expression.
         Expression* binary = this->parse_binary_expression();
         if (!binary) {
                 this->_scanner->skip_line();
-                delete lhs_ref;
-                return Statement::make_invalid(assign.location());
+                return Statement::make_invalid(this->arena(), assign.location());
         }
 
         /*
@@ -548,12 +1065,12 @@ Statement* Parser::parse_assignment_statement()
          * x = x op rhs. Create a second var reference for the RHS.
          */
         if (compound_op != OPER_ILLEGAL) {
-                Expression* rhs_ref = Expression::make_var_reference(obj, ident.location());
-                binary = Expression::make_binary(compound_op, rhs_ref, binary, assign.location());
+                Expression* rhs_ref = Expression::make_var_reference(this->arena(), obj, ident.location());
+                binary = Expression::make_binary(this->arena(), compound_op, rhs_ref, binary, assign.location());
         }
 
         EXPECT_SEMICOLON_ERR(this->_scanner->next_token());
-        return Statement::make_assignment(lhs_ref, binary, ident.location());
+        return Statement::make_assignment(this->arena(), lhs_ref, binary, ident.location());
 }
 
 Statement* Parser::parse_inc_dec_statement()
@@ -564,23 +1081,23 @@ Statement* Parser::parse_inc_dec_statement()
 
         // Create var reference
         Named_object* obj = this->backend()->current_scope()->
-                lookup(*ident.identifier());
+                lookup(ident.symbol());
         if (!obj) {
                 rin_error_at(ident.location(), "'%s' is undefined",
-                        ident.str());
+                        ident.string().c_str());
                 this->_scanner->skip_line();
-                return Statement::make_invalid(ident.location());
+                return Statement::make_invalid(this->arena(), ident.location());
         }
 
         Expression* var_reference = Expression::make_var_reference
-                (obj, ident.location());
+                (this->arena(), obj, ident.location());
 
         // Create unary expression
         Expression* unary = Expression::make_unary
-                (op.op(), var_reference, ident.location());
+                (this->arena(), op.op(), var_reference, ident.location());
 
-        return (op.op() == OPER_INC) ? Statement::make_inc(unary) :
-                Statement::make_dec(unary);
+        return (op.op() == OPER_INC) ? Statement::make_inc(this->arena(), unary) :
+                Statement::make_dec(this->arena(), unary);
 }
 
 Statement* Parser::parse_function_declaration()
@@ -595,11 +1112,11 @@ Statement* Parser::parse_function_declaration()
         if (name_tok.classification() != Token::TOKEN_IDENT) {
                 rin_error_at(name_tok.location(),
                         "Function declaration expected identifier but received %s instead",
-                        name_tok.str());
+                        name_tok.string().c_str());
                 this->_scanner->skip_line();
-                return Statement::make_invalid(fn_tok.location());
+                return Statement::make_invalid(this->arena(), fn_tok.location());
         }
-        std::string name = *name_tok.identifier();
+        std::string name = name_tok.identifier();
 
         // Consume '(' token.
         Token lparen = this->_scanner->next_token();
@@ -607,14 +1124,14 @@ Statement* Parser::parse_function_declaration()
             lparen.op() != OPER_LPAREN) {
                 rin_error_at(lparen.location(),
                         "Function declaration expected '(' but received %s instead",
-                        lparen.str());
+                        lparen.string().c_str());
                 this->_scanner->skip_line();
-                return Statement::make_invalid(fn_tok.location());
+                return Statement::make_invalid(this->arena(), fn_tok.location());
         }
 
         // Read comma-separated parameter identifiers until ')'.
         std::vector<std::string> params;
-        Token next = this->_scanner->peek_token();
+        const Token& next = this->_scanner->peek_token();
         if (!(next.classification() == Token::TOKEN_OPERATOR &&
               next.op() == OPER_RPAREN)) {
                 while (true) {
@@ -622,14 +1139,14 @@ Statement* Parser::parse_function_declaration()
                         if (param.classification() != Token::TOKEN_IDENT) {
                                 rin_error_at(param.location(),
                                         "Function parameter expected identifier but received %s instead",
-                                        param.str());
+                                        param.string().c_str());
                                 this->_scanner->skip_line();
-                                return Statement::make_invalid(fn_tok.location());
+                                return Statement::make_invalid(this->arena(), fn_tok.location());
                         }
-                        params.push_back(*param.identifier());
+                        params.push_back(param.identifier());
 
                         // Check for comma or closing paren.
-                        Token sep = this->_scanner->peek_token();
+                        const Token& sep = this->_scanner->peek_token();
                         if (sep.classification() == Token::TOKEN_OPERATOR &&
                             sep.op() == OPER_RPAREN)
                                 break;
@@ -640,9 +1157,9 @@ Statement* Parser::parse_function_declaration()
                             comma.op() != OPER_COMMA) {
                                 rin_error_at(comma.location(),
                                         "Expected ',' or ')' in parameter list but received %s instead",
-                                        comma.str());
+                                        comma.string().c_str());
                                 this->_scanner->skip_line();
-                                return Statement::make_invalid(fn_tok.location());
+                                return Statement::make_invalid(this->arena(), fn_tok.location());
                         }
                 }
         }
@@ -653,9 +1170,9 @@ Statement* Parser::parse_function_declaration()
             rparen.op() != OPER_RPAREN) {
                 rin_error_at(rparen.location(),
                         "Function declaration expected ')' but received %s instead",
-                        rparen.str());
+                        rparen.string().c_str());
                 this->_scanner->skip_line();
-                return Statement::make_invalid(fn_tok.location());
+                return Statement::make_invalid(this->arena(), fn_tok.location());
         }
 
         // Consume '{' token.
@@ -663,21 +1180,21 @@ Statement* Parser::parse_function_declaration()
         if (!EXPECT_LEFT_BRACE(lbrace)) {
                 rin_error_at(lbrace.location(),
                         "Function declaration expected '{' but received %s instead",
-                        lbrace.str());
+                        lbrace.string().c_str());
                 this->_scanner->skip_line();
-                return Statement::make_invalid(fn_tok.location());
+                return Statement::make_invalid(this->arena(), fn_tok.location());
         }
 
         // Enter function body scope and define parameters as named objects.
         Scope* body = this->_backend->enter_scope();
         for (auto itr = params.begin(); itr != params.end(); ++itr) {
-                body->define_obj(*itr, fn_tok.location());
+                body->define_obj(intern(*itr), fn_tok.location());
         }
 
         // Parse function body.
-        this->parse(false);
-
-        return Statement::make_function(name, params, body, fn_tok.location());
+        Statement* fn = Statement::make_function(this->arena(), name, params, body,
+                fn_tok.location());
+        return this->open_block(Block::BLOCK_FUNCTION, fn, body, lbrace.location());
 }
 
 Statement* Parser::parse_return_statement()
@@ -688,21 +1205,21 @@ Statement* Parser::parse_return_statement()
         RIN_ASSERT(ret_tok.rid() == RID_RETURN);
 
         // Check for empty return (semicolon or EOL immediately after).
-        Token next = this->_scanner->peek_token();
+        const Token& next = this->_scanner->peek_token();
         if (EXPECT_SEMICOLON(next)) {
                 this->_scanner->next_token();
-                return Statement::make_return(NULL, ret_tok.location());
+                return Statement::make_return(this->arena(), NULL, ret_tok.location());
         }
 
         // Parse the return expression.
         Expression* expr = this->parse_binary_expression();
         if (!expr) {
                 this->_scanner->skip_line();
-                return Statement::make_invalid(ret_tok.location());
+                return Statement::make_invalid(this->arena(), ret_tok.location());
         }
 
         EXPECT_SEMICOLON_ERR(this->_scanner->next_token());
-        return Statement::make_return(expr, ret_tok.location());
+        return Statement::make_return(this->arena(), expr, ret_tok.location());
 }
 
 Statement* Parser::parse_call_statement(const std::string& name, const Location& loc)
@@ -714,22 +1231,20 @@ Statement* Parser::parse_call_statement(const std::string& name, const Location&
 
         // Parse comma-separated argument expressions until ')'.
         std::vector<Expression*> args;
-        Token next = this->_scanner->peek_token();
+        const Token& next = this->_scanner->peek_token();
         if (!(next.classification() == Token::TOKEN_OPERATOR &&
               next.op() == OPER_RPAREN)) {
                 while (true) {
-                        Expression* arg = this->parse_binary_expression();
+                        // An argument ends at a comma or at the call's ')'.
+                        Expression* arg = this->parse_expression(OPER_RPAREN);
                         if (!arg) {
-                                // Clean up already-parsed args.
-                                for (auto itr = args.begin(); itr != args.end(); ++itr)
-                                        delete *itr;
                                 this->_scanner->skip_line();
-                                return Statement::make_invalid(loc);
+                                return Statement::make_invalid(this->arena(), loc);
                         }
                         args.push_back(arg);
 
                         // Check for closing paren.
-                        Token sep = this->_scanner->peek_token();
+                        const Token& sep = this->_scanner->peek_token();
                         if (sep.classification() == Token::TOKEN_OPERATOR &&
                             sep.op() == OPER_RPAREN)
                                 break;
@@ -750,628 +1265,532 @@ Statement* Parser::parse_call_statement(const std::string& name, const Location&
             rparen.op() != OPER_RPAREN) {
                 rin_error_at(rparen.location(),
                         "Function call expected ')' but received %s instead",
-                        rparen.str());
-                for (auto itr = args.begin(); itr != args.end(); ++itr)
-                        delete *itr;
+                        rparen.string().c_str());
                 this->_scanner->skip_line();
-                return Statement::make_invalid(loc);
+                return Statement::make_invalid(this->arena(), loc);
         }
 
         EXPECT_SEMICOLON_ERR(this->_scanner->next_token());
 
-        Expression* call = Expression::make_call(name, args, loc);
-        return Statement::make_expression(call, loc);
+        Expression* call = Expression::make_call(this->arena(), name, args, loc);
+        this->_backend->flat_ast()->append(call);
+        return Statement::make_expression(this->arena(), call, loc);
 }
 
 // --- Expressions ---
 
 /*
- * Represents an expression or operator in an abstract syntax tree.
- * Used in expression parsing.
+ * Pratt (precedence-climbing) expression parser. Operands and operators
+ * are read left to right in a single pass and Expression nodes are built
+ * as soon as both sides of an operator are known; OPERATOR_PRECEDENCE
+ * decides how far each right-hand side extends. All binary operators are
+ * left-associative. Prefix operators bind to the operand that follows
+ * them and postfix '++'/'--' bind tighter than any binary operator.
+ *
+ * The parser never consumes the terminal operator, a comma, or the EOL/EOF
+ * that ends a statement. After reporting an error it skips to that point,
+ * so the caller always resumes at the end of the expression.
  */
-class Expression_node
+class Expression_parser
 {
 public:
-        // The node type
-        enum node_type { INVALID_NODE, OPERATOR_NODE, VAR_NODE, FLOAT_NODE };
-
-        Expression_node(const Token& token, Backend* backend)
+        Expression_parser(Parser* parser, RIN_OPERATOR terminal)
         {
-                this->_location = token.location();
-                this->_str = token.string();
-                this->_backend = backend;
-
-                Token::Classification cls = token.classification();
-                if (cls == Token::TOKEN_IDENT) {
-                        _type = VAR_NODE;
-
-                        Named_object* obj = this->_backend->current_scope()->
-                                lookup(*token.identifier());
-
-                        if (!obj) {
-                                rin_error_at(token.location(), "'%s' is undefined", token.str());
-                                _type = INVALID_NODE;
-                                return;
-                        }
-
-                        Expression* var_ref = Expression::make_var_reference
-                                (obj, token.location());
-
-                        this->_value.expr = var_ref;
-
-                } else if (cls == Token::TOKEN_FLOAT) {
-                        _type = FLOAT_NODE;
-
-                        Expression* flt = Expression::make_float
-                                (token.float_value(), token.location());
-
-                        this->_value.expr = flt;
-
-                } else if (cls == Token::TOKEN_INTEGER) {
-                        _type = FLOAT_NODE;
-
-                        Expression* intExpr = Expression::make_integer
-                                (token.int_value(), token.location());
-
-                        this->_value.expr = intExpr;
-
-                } else if (cls == Token::TOKEN_OPERATOR) {
-                        _type = OPERATOR_NODE;
-                        this->_value.oper = token.op();
+                this->_scanner = parser->scanner();
+                this->_backend = parser->backend();
+                this->_terminal = terminal;
+                this->_max_nesting = parser->max_nesting();
+                this->_prev = this->_scanner->peek_token();
+        }
 
-                } else {
-                        rin_error_at(token.location(),
-                                "Token '%s' is not an expression, operator, or variable reference",
-                                token.str());
-                        _type = INVALID_NODE;
+        // Parse a whole expression. Returns NULL once an error is issued.
+        Expression* parse()
+        {
+                Location start_loc = this->_scanner->peek_token().location();
+                Expression* expr = this->parse_binary();
+                if (!expr && this->_missing) {
+                        rin_error_at(start_loc, "Expected expression");
+                        this->_missing = false;
                 }
+                return expr;
         }
 
-        Backend* backend()
-        { return this->_backend; }
+private:
+        /*
+         * An operator or parenthesis still waiting for its right-hand side.
+         * Nested operands are kept on this stack rather than the call
+         * stack, so nesting depth costs only memory.
+         */
+        struct Frame {
+                enum Frame_kind { FRAME_PREFIX, FRAME_BINARY, FRAME_PAREN } kind;
+                RIN_OPERATOR op;
+                Location location;
 
-        // Return the rightmost child or itself.
-        Expression_node* rightmost_child()
-        {
-                if (this->is_invalid())
-                        return NULL;
+                // Left-hand side of a binary operator.
+                Expression* left;
 
-                if (this->type() == VAR_NODE || this->type() == FLOAT_NODE)
-                        return this;
+                // Precedence to resume with once the frame is popped.
+                int min_prec;
+        };
 
-                if (this->is_unary() && this->left_child != NULL)
-                        return this->left_child->rightmost_child();
+        Scanner* _scanner;
+        Backend* _backend;
+        RIN_OPERATOR _terminal;
+        unsigned _max_nesting;
 
-                if (this->left_child != NULL && this->right_child == NULL)
-                        return this->left_child->rightmost_child();
+        // The last token consumed, or the first token before any.
+        Token _prev;
 
-                if (this->right_child != NULL)
-                        return this->right_child->rightmost_child();
+        // Innermost frame last.
+        std::vector<Frame> _frames;
 
-                return NULL;
-        }
+        // Lowest precedence the current right-hand side may take in.
+        int _min_prec = 0;
 
-        /*
-         * Expression_node does NOT own the underlying Expression*.
-         *
-         * Expressions are created during node construction (for VAR_NODE
-         * and FLOAT_NODE types) and later extracted by get_expression(),
-         * which incorporates them into the final AST tree. After
-         * get_expression() returns, the Expression* is owned by the
-         * caller (or by a parent Expression such as Binary_expression
-         * or Unary_expression).
-         *
-         * On error paths, expr_abort() is called to delete the
-         * Expression* before the node is destroyed. This two-phase
-         * cleanup avoids double-free: the destructor only deletes
-         * child nodes (left_child, right_child), never the Expression*.
-         */
-        ~Expression_node()
-        {
-                delete left_child;
-                delete right_child;
-        }
+        // Number of open parentheses.
+        int _depth = 0;
+
+        // Number of prefix and parenthesis frames.
+        unsigned _nesting = 0;
 
         /*
-         * Abort is for when expression parsing fails and we need to
-         * clean up the underlying Expression*. Only non-operator,
-         * non-invalid nodes hold an Expression* that must be freed.
-         * This must be called before deleting the node on error paths,
-         * since ~Expression_node() intentionally does NOT delete the
-         * expression (see ownership comment above).
+         * Set when an operand was expected but the expression ended. No
+         * error has been issued yet: whoever asked for the operand reports
+         * it, since only it knows which message applies.
          */
-        void expr_abort()
-        {
-                if (_type != OPERATOR_NODE && _type != INVALID_NODE)
-                        delete this->_value.expr;
-        }
-
-        Location location()
-        { return this->_location; }
-
-        bool is_invalid()
-        { return (_type == INVALID_NODE); }
+        bool _missing = false;
 
-        node_type type()
-        { return this->_type; }
+        Arena* arena()
+        { return this->_backend->arena(); }
 
-        // Returns true if the node is an operator and is unary.
-        bool is_unary()
+        // Lay a new expression out in the flat AST as well.
+        Expression* flat(Expression* expr)
         {
-                if (this->_type != OPERATOR_NODE)
-                        return false;
-                if (this->_value.oper == OPER_INC || this->_value.oper == OPER_DEC ||
-                    this->_value.oper == OPER_NOT || this->_value.oper == OPER_NEG ||
-                    this->_value.oper == OPER_BNOT)
-                        return true;
-                return false;
+                this->_backend->flat_ast()->append(expr);
+                return expr;
         }
 
-        // Return the underlying expression (if applicable)
-        Expression* expression()
+        const Token& next()
         {
-                RIN_ASSERT(_type != INVALID_NODE && _type != OPERATOR_NODE);
-                return this->_value.expr;
+                this->_prev = this->_scanner->next_token();
+                return this->_prev;
         }
 
-        // Return the underlying operator (if applicable)
-        RIN_OPERATOR oper()
+        // True if tok ends the expression where an operator could follow.
+        bool ends_expression(const Token& tok)
         {
-                RIN_ASSERT(_type == OPERATOR_NODE);
-                return this->_value.oper;
+                switch (tok.classification()) {
+                case Token::TOKEN_OPERATOR:
+                        return tok.op() == this->_terminal || tok.op() == OPER_COMMA;
+                case Token::TOKEN_EOL:
+                case Token::TOKEN_EOF:
+                        return this->_terminal == OPER_SEMICOLON;
+                default:
+                        return false;
+                }
         }
 
-        // Return the precedence of the underlying operator.
-        int precedence()
-        {
-                if (_type != OPERATOR_NODE)
-                        return -1;
-                return OPERATOR_PRECEDENCE[(int)this->_value.oper];
-        }
+        // Whether the scanner reports op once it is read, as a closing operator that closes nothing.
+        bool scanner_rejects(RIN_OPERATOR op) const
+        { return is_righthand_op(op) && !this->_scanner->expects(op); }
 
-        // Returns true if this is an operator and a close parenthesis.
-        bool is_close_paren()
+        // Skip the rest of a malformed expression, keeping the last operand skipped in last.
+        void skip_rest(Token* last = NULL)
         {
-                if (_type != OPERATOR_NODE)
-                        return false;
-                if (this->_value.oper != OPER_RPAREN)
-                        return false;
-                return true;
+                while (true) {
+                        const Token& tok = this->_scanner->peek_token();
+                        if (ends_expression(tok) || tok.classification() == Token::TOKEN_EOF)
+                                return;
+                        if (last && tok.classification() != Token::TOKEN_OPERATOR
+                            && tok.classification() != Token::TOKEN_EOL)
+                                *last = tok;
+                        this->next();
+                }
         }
 
-        // Returns true if this is an operator and an open parenthesis.
-        bool is_open_paren()
+        // Report an operator that is missing an operand.
+        Expression* missing_operand(const Location& loc, RIN_OPERATOR op)
         {
-                if (_type != OPERATOR_NODE)
-                        return false;
-                if (this->_value.oper != OPER_LPAREN)
-                        return false;
-                return true;
+                rin_error_at(loc, "Invalid type argument of %s",
+                             operator_name(op).c_str());
+                this->_missing = false;
+                this->skip_rest();
+                return NULL;
         }
 
-        // Returns the C-string pointer of the expression for debug.
-        const char* str()
-        { return this->_str.c_str(); }
+        // Push a frame whose operand comes next.
+        bool push(Frame::Frame_kind kind, RIN_OPERATOR op, const Location& loc,
+                  Expression* left = NULL)
+        {
+                if (kind != Frame::FRAME_BINARY) {
+                        if (this->_nesting == this->_max_nesting) {
+                                rin_error_at(loc, "Expression nesting exceeds the limit of %u",
+                                             this->_max_nesting);
+                                this->skip_rest();
+                                return false;
+                        }
+                        this->_nesting++;
+                }
 
-        // Adds a child to the node
-        void add_child(Expression_node* a, Expression_node* b = NULL) {
-                RIN_ASSERT(this->_type == OPERATOR_NODE);
-                if (b == NULL) RIN_ASSERT(this->is_unary());
-                left_child = a;
-                right_child = b;
+                this->_frames.push_back(Frame{ kind, op, loc, left, this->_min_prec });
+                if (kind == Frame::FRAME_PAREN) {
+                        this->_depth++;
+                        this->_min_prec = 0;
+                }
+                return true;
         }
 
-        // Recursively traverses the node to produce an expression.
-        Expression* get_expression()
+        // Pop the innermost frame, restoring the state from before it.
+        Frame pop()
         {
-                RIN_ASSERT(this->_type != INVALID_NODE);
-                if (this->_type != OPERATOR_NODE)
-                        return this->_value.expr;
-
-                RIN_ASSERT(this->left_child);
-                Expression* left_expr = left_child->get_expression();
-
-                if (this->is_unary())
-                        return Expression::make_unary
-                                (this->_value.oper, left_expr, this->_location);
-
-                RIN_ASSERT(this->right_child);
-                Expression* right_expr = right_child->get_expression();
-
-                return Expression::make_binary
-                        (this->_value.oper, left_expr, right_expr, this->_location);
+                Frame top = this->_frames.back();
+                this->_frames.pop_back();
+                this->_min_prec = top.min_prec;
+                if (top.kind == Frame::FRAME_PAREN)
+                        this->_depth--;
+                if (top.kind != Frame::FRAME_BINARY)
+                        this->_nesting--;
+                return top;
         }
 
-private:
-        // Unary nodes only take a left child
-        node_type _type;
-
-        Location _location;
-
-        Backend* _backend;
-
-        // Own str
-        std::string _str;
-
-        // Children
-        Expression_node* left_child  = NULL;
-        Expression_node* right_child = NULL;
-
         /*
-         * Value of node is either an operator, or a var_reference or float
-         * expression
+         * Unwind every frame after an operand could not be parsed. If it
+         * was missing, the innermost frame reports it.
          */
-        union {
-                RIN_OPERATOR oper;
-                Expression* expr;
-        } _value;
-};
-
-/*
- * Must return NULL if no valid expression is found. Must not consume
- * semicolon (or semicolon-equivalent) operators.
- */
-Expression* Parser::parse_binary_expression()
-{ return this->parse_expression(OPER_SEMICOLON); }
-
-/*
- * Must return NULL if no valid expression is found. Must not consume
- * '{' operators.
- */
-Expression* Parser::parse_conditional_expression(RIN_OPERATOR terminal)
-{
-        Expression* cond = this->parse_expression(terminal);
-        if (!cond) return NULL;
-        return Expression::make_conditional(cond, cond->location());
-}
-
-/*
- * Abort expression parsing. Cleans up all Expression_node objects in
- * both the operator stack and output queue. For each node, expr_abort()
- * is called first to delete any owned Expression* (non-operator,
- * non-invalid nodes), then the node itself is deleted (which recursively
- * deletes child nodes but NOT their expressions).
- */
-void __abort_expr_parse
-(std::stack<Expression_node*>& op, std::deque<Expression_node*> out)
-{
-        // Abort operator stack
-        while(!op.empty()) {
-                op.top()->expr_abort();
-                delete op.top();
-                op.pop();
-        }
-
-        // Abort output queue
-        while (!out.empty()) {
-                out.front()->expr_abort();
-                delete out.front();
-                out.pop_front();
-        }
-}
-
-// Recursively parses a child of an expression node
-Expression_node* __parse_ast_node(std::deque<Expression_node*>& output, bool& printed)
-{
-        if (output.empty()) return NULL;
-        Expression_node* child = output.back();
-        output.pop_back();
-
-        if (child->type() == Expression_node::INVALID_NODE) {
-                child->expr_abort();
-                delete child;
-                return NULL;
-        }
-
-        if (child->type() == Expression_node::VAR_NODE ||
-            child->type() == Expression_node::FLOAT_NODE)
-                return child;
+        Expression* fail()
+        {
+                while (!this->_frames.empty()) {
+                        Frame top = this->pop();
+                        if (!this->_missing)
+                                continue;
 
-        // --- Child is an operator ---
-        Expression_node* right = __parse_ast_node(output, printed);
-        if (!right) {
-                child->expr_abort();
-                delete child;
+                        if (top.kind != Frame::FRAME_PAREN) {
+                                this->missing_operand(top.location, top.op);
+                                continue;
+                        }
+                        rin_error_at(top.location, "Expected expression");
+                        this->_missing = false;
+                        this->skip_rest();
+                }
                 return NULL;
         }
 
-        if (child->is_unary()) {
-                child->add_child(right);
-                return child;
-        }
-
         /*
-         * If left most operator is missing, then that means
-         * a binary operator was used incorrectly.
+         * Consume and report a token that can never appear in an
+         * expression. Returns false, consuming nothing, for any other token.
          */
-        Expression_node* left = __parse_ast_node(output, printed);
-        if (!left) {
-                child->expr_abort();
-                if (!printed) {
-                        rin_error_at(child->location(),
-                                     "Invalid type argument of %s",
-                                     child->str());
-                        printed = true;
-                }
-                delete child;
-                return NULL;
-        }
-
-        child->add_child(left, right);
-        return child;
-}
-
-// Parses what it assumes to be an expression until terminal operator
-Expression* Parser::parse_expression(RIN_OPERATOR terminal)
-{
-        Location start_loc = this->_scanner->peek_token().location();
-
-        // Shunting yard algorithm
-        std::stack<Expression_node*> operators;
-        std::deque<Expression_node*> output;
-
-        bool resolves = false;
-        Token token = this->_scanner->peek_token();
-        Token prev_token = token;
-        while (true) {
-                Expression_node* node = NULL;
-                switch (token.classification()) {
-
+        bool reject(const Token& tok)
+        {
+                switch (tok.classification()) {
                 case Token::TOKEN_OPERATOR:
-                        if (token.op() == terminal) {
-                                resolves = true;
-                                goto exit_loop;
-                        }
-
-                        // Comma acts as expression separator (e.g. in function calls).
-                        if (token.op() == OPER_COMMA) {
-                                resolves = true;
-                                goto exit_loop;
-                        }
-
-                        if (OPERATOR_PRECEDENCE[(int)token.op()] == -2) {
-                                this->_scanner->next_token();
-                                rin_error_at(token.location(),
-                                        "Cannot use %s in expression",
-                                        token.str());
-                                __abort_expr_parse(operators, output);
-                                return NULL;
+                        if (OPERATOR_PRECEDENCE[(int)tok.op()] == -2) {
+                                bool reported = this->scanner_rejects(tok.op());
+                                this->next();
+                                if (!reported) {
+                                        rin_error_at(tok.location(),
+                                                "Cannot use %s in expression",
+                                                tok.string().c_str());
+                                }
+                                return true;
                         }
 
-                        /*
-                         * Ternary expressions (? :) are not yet fully implemented.
-                         * Issue an error if encountered.
-                         */
-                        if (token.op() == OPER_TERNARY || token.op() == OPER_COLON) {
-                                this->_scanner->next_token();
-                                rin_error_at(token.location(),
+                        // Ternary expressions (? :) are not yet fully implemented.
+                        if (tok.op() == OPER_TERNARY || tok.op() == OPER_COLON) {
+                                this->next();
+                                rin_error_at(tok.location(),
                                         "ternary expressions are not yet fully implemented");
-                                __abort_expr_parse(operators, output);
-                                return NULL;
-                        }
-
-                        /*
-                         * Bitwise NOT (~) is always unary. Treat it
-                         * the same as unary minus/negation.
-                         */
-                        if (token.op() == OPER_BNOT) {
-                                node = new Expression_node(token, this->backend());
-                                break;
-                        }
-
-                        /*
-                         * Detect unary minus: '-' is unary when it appears at the
-                         * start of an expression or after another operator (except
-                         * close paren, INC, DEC which produce values).
-                         */
-                        if (token.op() == OPER_SUB && output.empty() && operators.empty()) {
-                                Token neg_tok = Token::make_operator_token(OPER_NEG, token.location());
-                                node = new Expression_node(neg_tok, this->backend());
-                                break;
-                        }
-                        if (token.op() == OPER_SUB &&
-                            prev_token.classification() == Token::TOKEN_OPERATOR &&
-                            prev_token.op() != OPER_RPAREN &&
-                            prev_token.op() != OPER_INC &&
-                            prev_token.op() != OPER_DEC) {
-                                Token neg_tok = Token::make_operator_token(OPER_NEG, token.location());
-                                node = new Expression_node(neg_tok, this->backend());
-                                break;
+                                return true;
                         }
-
-                        // --- DOES NOT BREAK ---
-
-                case Token::TOKEN_FLOAT:
-                case Token::TOKEN_INTEGER:
-                case Token::TOKEN_IDENT:
-                        node = new Expression_node(token, this->backend());
-                        break;
-
-                case Token::TOKEN_EOL:
-
-                        /*
-                         * Since EOL counts as a semicolon, stop parsing the
-                         * expression. Unless the previous token is an operator,
-                         * in which case the expression continues onto the next
-                         * line.
-                         */
-                        if (terminal == OPER_SEMICOLON &&
-                            prev_token.classification() != Token::TOKEN_OPERATOR) {
-                                resolves = true;
-                                goto exit_loop;
-                        }
-
-                        goto next_token;
+                        return false;
 
                 case Token::TOKEN_EOF:
-
-                        /*
-                         * EOF can count as a semicolon as long as it is not
-                         * preceded by another operator (with parenthesis
-                         * being the only exception).
-                         */
-                        if (terminal == OPER_SEMICOLON &&
-                            (prev_token.classification() != Token::TOKEN_OPERATOR
-                            || OPERATOR_PRECEDENCE[prev_token.op()] == -1
-                            || prev_token.op() == OPER_INC
-                            || prev_token.op() == OPER_DEC)) {
-                                resolves = true;
-                                goto exit_loop;
-                        }
-
-                        token = this->_scanner->next_token();
-                        prev_token = token;
-                        rin_error_at(token.location(),
+                        this->next();
+                        rin_error_at(tok.location(),
                                      "Unresolved expression: reached EOF before expected %s",
-                                     operator_name(terminal).c_str());
-                        __abort_expr_parse(operators, output);
-                        return NULL;
+                                     operator_name(this->_terminal).c_str());
+                        return true;
 
                 case Token::TOKEN_STRING:
                 case Token::TOKEN_CHARACTER:
-                        token = this->_scanner->next_token();
-                        prev_token = token;
-                        rin_error_at(token.location(),
+                        this->next();
+                        rin_error_at(tok.location(),
                                      "Cannot use %s token as expression value (NOT IMPLEMENTED)",
-                                     token.classification_as_string().c_str());
-                        __abort_expr_parse(operators, output);
-                        return NULL;
+                                     tok.classification_as_string().c_str());
+                        return true;
 
                 case Token::TOKEN_RID:
-                        token = this->_scanner->next_token();
-                        prev_token = token;
-                        rin_error_at(token.location(),
+                        this->next();
+                        rin_error_at(tok.location(),
                                      "Cannot use reserved identifier '%s' in expression",
-                                     token.str());
-                        __abort_expr_parse(operators, output);
-                        return NULL;
+                                     tok.string().c_str());
+                        return true;
 
-                default:
-                        token = this->_scanner->next_token();
-                        prev_token = token;
+                case Token::TOKEN_INVALID:
+                        // Error already issued by the scanner.
+                        this->next();
+                        return true;
 
-                        // If invalid, then error already issued by scanner
-                        __abort_expr_parse(operators, output);
-                        return NULL;
+                default:
+                        return false;
                 }
+        }
 
-                if (node->is_invalid()) {
-                        // Error already issued by Expression_node constructor
-                        __abort_expr_parse(operators, output);
-                        this->_scanner->next_token();
-                        return NULL;
-                }
+        /*
+         * Parse an operand: a literal or a variable reference, after any
+         * number of prefix operators and opening parentheses, which are
+         * pushed as frames.
+         */
+        Expression* parse_operand()
+        {
+                while (true) {
+                        Token tok = this->_scanner->peek_token();
+                        switch (tok.classification()) {
+
+                        case Token::TOKEN_EOL:
+                                /*
+                                 * A statement ends at EOL unless the previous
+                                 * token is an operator, in which case the
+                                 * expression continues onto the next line.
+                                 */
+                                if (this->_terminal == OPER_SEMICOLON &&
+                                    this->_prev.classification() != Token::TOKEN_OPERATOR) {
+                                        this->_missing = true;
+                                        return NULL;
+                                }
+                                this->next();
+                                continue;
 
-                // If the token is a float or ident, add it to the output queue
-                if (node->type() == Expression_node::FLOAT_NODE ||
-                    node->type() == Expression_node::VAR_NODE) {
-                        output.push_back(node);
-                        goto next_token;
-                }
+                        case Token::TOKEN_EOF:
+                                /*
+                                 * EOF can count as a semicolon as long as it is
+                                 * not preceded by another operator (with
+                                 * parenthesis being the only exception).
+                                 */
+                                if (this->_terminal == OPER_SEMICOLON &&
+                                    (this->_prev.classification() != Token::TOKEN_OPERATOR
+                                    || OPERATOR_PRECEDENCE[this->_prev.op()] == -1
+                                    || this->_prev.op() == OPER_INC
+                                    || this->_prev.op() == OPER_DEC)) {
+                                        this->_missing = true;
+                                        return NULL;
+                                }
+                                this->reject(tok);
+                                return NULL;
 
-                //  --- Node is an operator ---
+                        case Token::TOKEN_IDENT: {
+                                this->next();
+                                Named_object* obj = this->_backend->current_scope()->
+                                        lookup(tok.symbol());
+                                if (!obj) {
+                                        rin_error_at(tok.location(), "'%s' is undefined",
+                                                     tok.string().c_str());
+                                        return NULL;
+                                }
+                                return this->flat(Expression::make_var_reference
+                                        (this->arena(), obj, tok.location()));
+                        }
 
-                // If open paren, add to stack
-                if (node->is_open_paren()) {
-                        operators.push(node);
-                        goto next_token;
-                }
+                        case Token::TOKEN_FLOAT:
+                                this->next();
+                                return this->flat(Expression::make_float
+                                        (this->arena(), tok.text(), tok.location()));
 
-                /*
-                 * If close paren, move operators into output queue
-                 * until an open parenthesis is found. If not found,
-                 * then the close parenthesis is unmatched.
-                 */
-                if (node->is_close_paren()) {
-                        while (!operators.empty() && !operators.top()->is_open_paren()) {
-                                output.push_back(operators.top());
-                                operators.pop();
-                        }
+                        case Token::TOKEN_INTEGER:
+                                this->next();
+                                return this->flat(Expression::make_integer
+                                        (this->arena(), tok.text(), tok.location()));
 
-                        // Unmatched parenthesis
-                        if (operators.empty() || !operators.top()->is_open_paren()) {
-                                rin_error_at(token.location(), "Unmatched close parenthesis");
-                                __abort_expr_parse(operators, output);
+                        case Token::TOKEN_OPERATOR:
+                                if (!this->parse_prefix(tok))
+                                        return NULL;
+                                continue;
 
-                                // Consume the parenthesis to prevent re-emitting errors.
-                                prev_token = this->_scanner->next_token();
+                        default:
+                                this->reject(tok);
                                 return NULL;
                         }
+                }
+        }
 
-                        // Pop open parenthesis
-                        operators.pop();
-                        goto next_token;
+        /*
+         * Push the prefix operator or parenthesis tok. Returns false if
+         * tok cannot start an operand.
+         */
+        bool parse_prefix(const Token& tok)
+        {
+                RIN_OPERATOR op = tok.op();
+                if (op == this->_terminal || op == OPER_COMMA) {
+                        this->_missing = true;
+                        return false;
                 }
 
-                // Pop any operators whose precedence is >= current operator
-                while(!operators.empty() && (operators.top()->precedence() >= node->precedence())) {
-                        output.push_back(operators.top());
-                        operators.pop();
+                if (this->reject(tok))
+                        return false;
+
+                if (op == OPER_LPAREN) {
+                        this->next();
+                        return this->push(Frame::FRAME_PAREN, op, tok.location());
                 }
 
-                // Add operator to stack
-                operators.push(node);
+                if (op == OPER_RPAREN) {
+                        if (this->_depth > 0) {
+                                this->_missing = true;
+                                return false;
+                        }
+                        this->next();
+                        rin_error_at(tok.location(), "Unmatched close parenthesis");
+                        return false;
+                }
 
-        next_token:
-                prev_token = this->_scanner->next_token();
-                token = this->_scanner->peek_token();
+                // A leading '-' negates; other binary operators lack a left operand.
+                if (op == OPER_SUB)
+                        op = OPER_NEG;
+                this->next();
+                if (op != OPER_NEG && op != OPER_BNOT && op != OPER_NOT &&
+                    op != OPER_INC && op != OPER_DEC) {
+                        this->missing_operand(tok.location(), op);
+                        return false;
+                }
+                return this->push(Frame::FRAME_PREFIX, op, tok.location());
         }
-exit_loop:
-        token = this->_scanner->peek_token();
-        prev_token = token;
 
         /*
-         * If it doesn't resolve, then abort parsing and return a new
-         * expression. The new expression will be deleted once the
-         * function caller (i.e parse_for_statement) realizes that the
-         * terminating operator is not there.
+         * Apply the prefix operators waiting on operand, innermost first.
+         * They bind tighter than any binary or postfix operator.
          */
-        if (!resolves) {
-                __abort_expr_parse(operators, output);
-                return NULL;
+        Expression* apply_prefixes(Expression* operand)
+        {
+                while (!this->_frames.empty() &&
+                       this->_frames.back().kind == Frame::FRAME_PREFIX) {
+                        Frame top = this->pop();
+                        operand = this->flat(Expression::make_unary
+                                (this->arena(), top.op, operand, top.location));
+                }
+                return operand;
         }
 
-        // Add any remaining operators to the output queue
-        while (!operators.empty()) {
-                output.push_back(operators.top());
-                operators.pop();
-        }
+        /*
+         * Parse operands and the operators between them. An operator binds
+         * its right-hand side for as long as the operators that follow
+         * have a precedence above its own; the pending left-hand sides are
+         * kept in frames, so long chains and deep nesting use no recursion.
+         */
+        Expression* parse_binary()
+        {
+                Expression* left = this->parse_operand();
+                if (!left)
+                        return this->fail();
+                left = this->apply_prefixes(left);
 
-        // If the expression was empty, then it'll break here.
-        if (output.empty()) {
-                rin_error_at(start_loc, "Expected expression");
-                return NULL;
-        }
+                while (true) {
+                        Token tok = this->_scanner->peek_token();
+
+                        // Whether the innermost right-hand side or parenthesis ends at tok.
+                        bool ends = this->ends_expression(tok);
+                        if (!ends) {
+                                // Before any terminal but a semicolon, line breaks are insignificant.
+                                if (tok.classification() == Token::TOKEN_EOL) {
+                                        this->next();
+                                        continue;
+                                }
+
+                                if (this->reject(tok))
+                                        return this->fail();
+
+                                if (tok.classification() != Token::TOKEN_OPERATOR ||
+                                    tok.op() == OPER_LPAREN || tok.op() == OPER_NOT ||
+                                    tok.op() == OPER_BNOT) {
+                                        // Two operands in a row, reported at the last of the run.
+                                        Token last = tok;
+                                        this->skip_rest(&last);
+                                        rin_error_at(last.location(), "Expected ';' before '%s'",
+                                                     last.text().str().c_str());
+                                        return this->fail();
+                                }
+
+                                if (tok.op() == OPER_RPAREN) {
+                                        if (this->_depth == 0) {
+                                                bool reported = this->scanner_rejects(tok.op());
+                                                this->next();
+                                                if (!reported) {
+                                                        rin_error_at(tok.location(),
+                                                                     "Unmatched close parenthesis");
+                                                }
+                                                return this->fail();
+                                        }
+                                        ends = true;
+                                } else if (OPERATOR_PRECEDENCE[(int)tok.op()] < this->_min_prec) {
+                                        ends = true;
+                                }
+                        }
 
-        // --- Create Abstract Syntax Tree ---
-        bool __found_err = false;
-        Expression_node* super_root = __parse_ast_node(output, __found_err);
-        if (!super_root) {
-                __abort_expr_parse(operators, output);
-                return NULL;
-        }
+                        if (ends) {
+                                if (this->_frames.empty())
+                                        return left;
+
+                                Frame top = this->pop();
+                                if (top.kind == Frame::FRAME_BINARY) {
+                                        left = this->flat(Expression::make_binary
+                                                (this->arena(), top.op, top.left, left,
+                                                 top.location));
+                                        continue;
+                                }
+
+                                // A parenthesized operand must end at ')'.
+                                RIN_ASSERT(top.kind == Frame::FRAME_PAREN);
+                                if (tok.classification() != Token::TOKEN_OPERATOR ||
+                                    tok.op() != OPER_RPAREN) {
+                                        this->missing_operand(top.location, OPER_LPAREN);
+                                        return this->fail();
+                                }
+                                this->next();
+                                left = this->apply_prefixes(left);
+                                continue;
+                        }
 
-        // Missing operator
-        if (!output.empty()) {
-                Expression_node* rightmost = super_root->rightmost_child();
-                rin_error_at(super_root->location(), "Expected ';' before '%s'",
-                        rightmost->str());
-                __abort_expr_parse(operators, output);
-                delete super_root;
-                return NULL;
+                        RIN_OPERATOR op = tok.op();
+                        this->next();
+
+                        if (op == OPER_INC || op == OPER_DEC) {
+                                left = this->flat(Expression::make_unary
+                                        (this->arena(), op, left, tok.location()));
+                                continue;
+                        }
+
+                        this->push(Frame::FRAME_BINARY, op, tok.location(), left);
+                        this->_min_prec = OPERATOR_PRECEDENCE[(int)op] + 1;
+
+                        left = this->parse_operand();
+                        if (!left)
+                                return this->fail();
+                        left = this->apply_prefixes(left);
+                }
         }
+};
 
-        // --- Done Parsing ---
-        Expression* binary = super_root->get_expression();
+/*
+ * Must return NULL if no valid expression is found. Must not consume
+ * semicolon (or semicolon-equivalent) operators.
+ */
+Expression* Parser::parse_binary_expression()
+{ return this->parse_expression(OPER_SEMICOLON); }
 
-        /*
-         * Delete the Expression_node tree. This recursively deletes all
-         * child nodes via ~Expression_node(), but does NOT delete the
-         * Expression* values they held — those have been incorporated
-         * into the AST by get_expression() and are now owned by the
-         * returned Expression* (e.g., as children of Binary_expression
-         * or Unary_expression nodes).
-         */
-        delete super_root;
-        return binary;
+/*
+ * Must return NULL if no valid expression is found. Must not consume
+ * '{' operators.
+ */
+Expression* Parser::parse_conditional_expression(RIN_OPERATOR terminal)
+{
+        Expression* cond = this->parse_expression(terminal);
+        if (!cond) return NULL;
+        Expression* expr = Expression::make_conditional(this->arena(), cond, cond->location());
+        this->_backend->flat_ast()->append(expr);
+        return expr;
+}
+
+// Parses what it assumes to be an expression until terminal operator
+Expression* Parser::parse_expression(RIN_OPERATOR terminal)
+{
+        Expression_parser parser(this, terminal);
+        return parser.parse();
 }
@@ -14,7 +14,7 @@
         if (!token.is_semicolon())                                                         \
                 rin_error_at(token.location(),                                             \
                         "Expected semicolon at end of statement, but received %s instead", \
-                         token.str());                                                     \
+                         token.string().c_str());                                          \
 }
 
 /*
@@ -41,7 +41,7 @@
 rin_error_at(node->location(), "Found unclosed parenthesis in expression");
 
 // operators.cc
-extern int OPERATOR_PRECEDENCE[];
+extern const int OPERATOR_PRECEDENCE[];
 
 // Parses a .RIN file into statement units
 class Parser
@@ -66,26 +66,152 @@ public:
         { return this->_backend; }
 
         /*
-         * If in a supercontext, then the parser will parse
-         * every statement in the scanner/file. If in some
-         * sub-scope, then the parser will parse until a
-         * '}' token.
+         * Parse every statement in the scanner/file. Nested blocks are
+         * kept on an explicit stack rather than the call stack, so any
+         * depth up to max_nesting() is parsed in linear time and space.
          */
-        void parse(bool is_supercontext = true);
+        void parse();
+
+        // Default limit on nested blocks, and on nested expression operands.
+        static const unsigned DEFAULT_MAX_NESTING = 1 << 16;
+
+        // Return the deepest nesting accepted before an error is issued.
+        unsigned max_nesting() const
+        { return this->_max_nesting; }
+
+        void set_max_nesting(unsigned depth)
+        { this->_max_nesting = depth; }
+
+        /*
+         * Return the number of threads parse() may use. With more than one,
+         * top-level function declarations are parsed on worker threads,
+         * each into a fork of the backend (see Backend::fork()), while this
+         * thread parses the rest of the file. Statements and diagnostics are
+         * put back in source order, as if the file was parsed by one thread.
+         * If a function has errors, the file is parsed again on one thread,
+         * since error recovery may not have ended the function where the
+         * parallel split did.
+         */
+        unsigned jobs() const
+        { return this->_jobs; }
+
+        void set_jobs(unsigned jobs)
+        { this->_jobs = (jobs > 0) ? jobs : 1; }
+
+        // One job per hardware thread.
+        static unsigned default_jobs();
+
+        /*
+         * Whether parse() lexes on a thread of its own, ahead of the parser
+         * (see Scanner::start_pipeline()). Off by default.
+         */
+        bool pipelined() const
+        { return this->_pipelined; }
+
+        void set_pipelined(bool pipelined)
+        { this->_pipelined = pipelined; }
+
+        // Number of tokens scanned by parse(), on every thread.
+        uint64_t token_count() const
+        { return this->_scanner->tokens_scanned() + this->_job_tokens; }
+
+        // Number of valid statements parse() handed to the backend.
+        size_t statement_count() const
+        { return this->_statements; }
 
 private:
+        // A statement whose block is open, or which waits on a nested statement.
+        struct Block {
+                enum Block_kind {
+                        // Closed by '}': the body of stmt, parsed into scope.
+                        BLOCK_IF,
+                        BLOCK_ELSE,
+                        BLOCK_LOOP,
+                        BLOCK_FUNCTION,
+
+                        // Closed once the nested if statement is finished.
+                        BLOCK_ELSE_IF,
+
+                        // Closed once the induction statement is finished.
+                        BLOCK_FOR_INIT
+                } kind;
+
+                Statement* stmt;
+                Scope* scope;
+                Location location;
+        };
+
         Scanner* _scanner;
         Backend* _backend;
 
-        // Parses the next statement. Returns NULL if EOF.
+        // Innermost statement last.
+        std::vector<Block> _blocks;
+
+        // Number of blocks in _blocks closed by '}'.
+        unsigned _depth = 0;
+
+        unsigned _max_nesting = DEFAULT_MAX_NESTING;
+
+        unsigned _jobs = default_jobs();
+        bool _pipelined = false;
+
+        // Statements handed to the backend, and tokens scanned by workers.
+        size_t _statements = 0;
+        uint64_t _job_tokens = 0;
+
+        // The functions being parsed on worker threads (see parser.cc).
+        class Function_jobs;
+
+        /*
+         * Parse with top-level functions on worker threads, into a fork of
+         * the backend that is joined once every function parsed cleanly;
+         * otherwise parse the file again sequentially. Returns false, having
+         * parsed nothing, if the backend does not fork or there are no
+         * functions.
+         */
+        bool parse_in_parallel();
+
+        /*
+         * Parse every statement left in the scanner, handing top-level
+         * functions to functions if it is not NULL.
+         */
+        void parse_statements(Function_jobs* functions);
+
+        // The backend's arena, which owns every node the parser makes.
+        Arena* arena()
+        { return this->_backend->arena(); }
+
+        /*
+         * Parses the next statement. Returns NULL if the statement opened
+         * a block, in which case it is finished by close_block().
+         */
         Statement* parse_next();
 
+        /*
+         * Push a block for stmt and enter its body. Always returns NULL.
+         * Bodies nested deeper than max_nesting() are reported and skipped.
+         */
+        Statement* open_block(Block::Block_kind kind, Statement* stmt,
+                              Scope* scope, const Location& loc);
+
+        /*
+         * Pop the innermost block, whose body was just left, and return
+         * the statement that is then finished, if any.
+         */
+        Statement* close_block();
+
+        // Hand a finished statement to the statement or scope it is nested in.
+        void finish(Statement* stmt);
+
         // Parses an if statement
         Statement* parse_if_statement();
 
         // Parses a for statement
         Statement* parse_for_statement();
 
+        // Parses the rest of a for statement after its induction statement
+        Statement* parse_for_header(Statement* ind_stmt, const Location& loc);
+
         // Parses a while statement
         Statement* parse_while_statement();
 
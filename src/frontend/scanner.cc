@@ -1,10 +1,138 @@
 // scanner.cc - Token scanning and lexical analysis implementation
 #include "scanner.hpp"
+#include "simd.hpp"
+#include "token-cache.hpp"
+
+#include <cctype>
+#include <cstring>
+
+/*
+ * Words (anything that is not whitespace, an operator or a comment) are
+ * classified by a small DFA while they are scanned. Every byte is first
+ * mapped to a character class through a 256-entry table, and the class
+ * then indexes the transition table for the current state. The state the
+ * DFA stops in tells the scanner what kind of literal it has read:
+ *
+ *      [0-9]+                          integer         (LS_ZERO, LS_INT)
+ *      0x[0-9a-fA-F]+                  hex integer     (LS_HEX)
+ *      [0-9]+.[0-9]+                   float           (LS_FRAC)
+ *      [0-9]+f, [0-9]+.[0-9]+f         float           (LS_FLOAT_SUFFIX)
+ *      [a-zA-Z][a-zA-Z0-9_]*           identifier/RID  (LS_IDENT)
+ */
+enum Char_class {
+        CC_OTHER,  CC_DELIM, CC_ZERO,  CC_DIGIT,      CC_HEX,
+        CC_F,      CC_X,     CC_ALPHA, CC_UNDERSCORE, CC_DOT,
+        CC_COUNT
+};
+
+enum Lex_state {
+        LS_START,  LS_ZERO,  LS_INT,          LS_HEX_PREFIX, LS_HEX,
+        LS_DOT,    LS_FRAC,  LS_FLOAT_SUFFIX, LS_IDENT,      LS_INVALID,
+        LS_COUNT
+};
+
+// Single-character operators; these end a word just like whitespace does.
+static constexpr const char __operator_chars__[] = "+-*/%&|=<>!()[]{};~^?:,";
+
+static constexpr bool is_operator_char(unsigned c)
+{
+        for (const char* op = __operator_chars__; *op; op++) {
+                if ((unsigned char)*op == c)
+                        return true;
+        }
+        return false;
+}
+
+static constexpr unsigned char char_class_of(unsigned c)
+{
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || is_operator_char(c))
+                return CC_DELIM;
+        if (c == '0')
+                return CC_ZERO;
+        if (c >= '1' && c <= '9')
+                return CC_DIGIT;
+        if (c == 'f')
+                return CC_F;
+        if (c == 'x')
+                return CC_X;
+        if ((c >= 'a' && c <= 'e') || (c >= 'A' && c <= 'F'))
+                return CC_HEX;
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+                return CC_ALPHA;
+        if (c == '_')
+                return CC_UNDERSCORE;
+        if (c == '.')
+                return CC_DOT;
+        return CC_OTHER;
+}
+
+struct Char_class_table {
+        unsigned char cls[256];
+
+        constexpr Char_class_table() : cls()
+        {
+                for (unsigned c = 0; c < 256; c++)
+                        cls[c] = char_class_of(c);
+        }
+};
+
+static constexpr Char_class_table __char_classes__;
+
+#define I LS_INVALID
+static const unsigned char __lex_transitions__[LS_COUNT][CC_COUNT] =
+{
+        /*                 OTHER DELIM ZERO      DIGIT     HEX       F                X              ALPHA     _         .      */
+        /* START        */ { I,  I,    LS_ZERO,  LS_INT,   LS_IDENT, LS_IDENT,        LS_IDENT,      LS_IDENT, I,        I       },
+        /* ZERO         */ { I,  I,    LS_INT,   LS_INT,   I,        LS_FLOAT_SUFFIX, LS_HEX_PREFIX, I,        I,        LS_DOT  },
+        /* INT          */ { I,  I,    LS_INT,   LS_INT,   I,        LS_FLOAT_SUFFIX, I,             I,        I,        LS_DOT  },
+        /* HEX_PREFIX   */ { I,  I,    LS_HEX,   LS_HEX,   LS_HEX,   LS_HEX,          I,             I,        I,        I       },
+        /* HEX          */ { I,  I,    LS_HEX,   LS_HEX,   LS_HEX,   LS_HEX,          I,             I,        I,        I       },
+        /* DOT          */ { I,  I,    LS_FRAC,  LS_FRAC,  I,        I,               I,             I,        I,        I       },
+        /* FRAC         */ { I,  I,    LS_FRAC,  LS_FRAC,  I,        LS_FLOAT_SUFFIX, I,             I,        I,        I       },
+        /* FLOAT_SUFFIX */ { I,  I,    I,        I,        I,        I,               I,             I,        I,        I       },
+        /* IDENT        */ { I,  I,    LS_IDENT, LS_IDENT, LS_IDENT, LS_IDENT,        LS_IDENT,      LS_IDENT, LS_IDENT, I       },
+        /* INVALID      */ { I,  I,    I,        I,        I,        I,               I,             I,        I,        I       },
+};
+#undef I
+
+/*
+ * Run the DFA from p until the first delimiter or end. The delimiter's
+ * position is stored in stop, and the final state is returned.
+ */
+static Lex_state lex_word(const char* p, const char* end, const char** stop)
+{
+        unsigned char state = LS_START;
+        for (; p < end; p++) {
+                unsigned char cc = __char_classes__.cls[(unsigned char)*p];
+                if (cc == CC_DELIM)
+                        break;
+                state = __lex_transitions__[state][cc];
+        }
+
+        *stop = p;
+        return (Lex_state)state;
+}
+
+// Classify a whole string; a delimiter anywhere in it makes it invalid.
+static Lex_state lex_string(const std::string& str)
+{
+        const char* end = str.data() + str.size();
+        const char* stop = NULL;
+        Lex_state state = lex_word(str.data(), end, &stop);
+        return (stop == end) ? state : LS_INVALID;
+}
+
+// Whether c matches \w: [a-zA-Z0-9_]
+static bool is_word_char(unsigned char c)
+{
+        unsigned char cc = __char_classes__.cls[c];
+        return cc >= CC_ZERO && cc <= CC_UNDERSCORE;
+}
 
 const std::string __eof_string__ = "EOF";
 const std::string __eol_string__ = "EOL";
 
-bool Token::is_semicolon()
+bool Token::is_semicolon() const
 {
         if (_classification == TOKEN_EOL
             || _classification == TOKEN_EOF)
@@ -19,115 +147,119 @@ bool Token::is_semicolon()
         return false;
 }
 
-void Token::clear()
+Token::Token(Classification c, const Location& end, uint32_t length)
+        : _offset(end.offset - length), _length(length), _payload(0),
+          _file(end.source), _classification(c)
+{}
+
+Location Token::location() const
 {
-        if (this->_classification == TOKEN_FLOAT
-            || this->_classification == TOKEN_INTEGER)
-                mpfr_clear(this->value.float_value);
+        Location loc;
+        loc.source = this->_file;
+        loc.offset = this->_offset + this->_length;
+        return loc;
 }
 
-Token::Token(const Token& tok)
+Source_span Token::text() const
 {
-        if (tok._classification == TOKEN_INTEGER
-            || tok._classification == TOKEN_FLOAT) {
-                mpfr_init_set(this->value.float_value, tok.value.float_value, MPFR_RNDN);
-        } else if (tok._classification == TOKEN_IDENT)
-                this->value.id_name = new std::string(*tok.value.id_name);
-        else if (tok._classification == TOKEN_OPERATOR)
-                this->value.op_value = tok.value.op_value;
-        else if (tok._classification == TOKEN_RID)
-                this->value.rid = tok.value.rid;
+        const File* file = File::lookup(this->_file);
+        if (!file)
+                return Source_span();
+        return file->span(this->_offset, this->_length);
+}
 
-        this->_location.filename = tok._location.filename;
-        this->_location.offset   = tok._location.offset;
-        this->_location.line     = tok._location.line;
-        this->_location.column   = tok._location.column;
-        this->_classification    = tok._classification;
-        this->token_string       = tok.token_string;
+std::string Token::string() const
+{
+        switch (this->classification()) {
+        case TOKEN_EOF:
+                return __eof_string__;
+        case TOKEN_EOL:
+                return __eol_string__;
+        case TOKEN_RID:
+                return rid_as_string(this->rid());
+        case TOKEN_OPERATOR:
+                return operator_name(this->op());
+        default:
+                return this->text().str();
+        }
 }
 
-Token Token::make_invalid_token(const std::string& str, const Location& loc)
+Token Token::make_invalid_token(const Location& loc, uint32_t length)
 {
-        Token tok(TOKEN_INVALID, str, loc);
-        return tok;
+        return Token(TOKEN_INVALID, loc, length);
 }
 
 Token Token::make_eof_token(const Location& loc)
 {
-        Token tok(TOKEN_EOF, __eof_string__, loc);
-        return tok;
+        return Token(TOKEN_EOF, loc, 0);
 }
 
 Token Token::make_eol_token(const Location& loc)
 {
-        Token tok(TOKEN_EOL, __eol_string__, loc);
-        return tok;
+        // The newline itself is the last character before loc.
+        return Token(TOKEN_EOL, loc, (loc.offset > 0) ? 1 : 0);
 }
 
-Token Token::make_rid_token(RID rid, const Location& loc)
+Token Token::make_rid_token(RID rid, const Location& loc, uint32_t length)
 {
-        Token tok(TOKEN_RID, rid_as_string(rid), loc);
-        tok.value.rid = rid;
+        Token tok(TOKEN_RID, loc, length);
+        tok._payload = rid;
         return tok;
 }
 
-Token Token::make_ident_token
-(const std::string& val, const Location& loc)
+Token Token::make_ident_token(Symbol sym, const Location& loc, uint32_t length)
 {
-        Token tok(TOKEN_IDENT, val, loc);
-        tok.value.id_name = &tok.token_string;
+        Token tok(TOKEN_IDENT, loc, length);
+        tok._payload = sym;
         return tok;
 }
 
-Token Token::make_operator_token(RIN_OPERATOR op, const Location& loc)
+Token Token::make_operator_token(RIN_OPERATOR op, const Location& loc, uint32_t length)
 {
-        Token tok(TOKEN_OPERATOR, operator_name(op), loc);
-        tok.value.op_value = op;
+        Token tok(TOKEN_OPERATOR, loc, length);
+        tok._payload = op;
         return tok;
 }
 
-Token Token::make_float_token(const std::string& str, const Location& loc)
+Token Token::make_operator_token(RIN_OPERATOR op, const Token& from)
 {
-        Token tok(TOKEN_FLOAT, str, loc);
-        mpfr_init_set_str(tok.value.float_value, str.c_str(), 10, MPFR_RNDN);
+        Token tok = from;
+        tok._classification = TOKEN_OPERATOR;
+        tok._payload = op;
         return tok;
 }
 
-Token Token::make_integer_token(const std::string& str, const Location& loc)
+Token Token::make_float_token(const Location& loc, uint32_t length)
 {
-        Token tok(TOKEN_INTEGER, str, loc);
-        mpfr_init_set_str(tok.value.float_value, str.c_str(), 0, MPFR_RNDN);
-        return tok;
+        return Token(TOKEN_FLOAT, loc, length);
 }
 
-RID Token::rid() const
+Token Token::make_integer_token(const Location& loc, uint32_t length)
 {
-        RIN_ASSERT(this->_classification == TOKEN_RID);
-        return this->value.rid;
+        return Token(TOKEN_INTEGER, loc, length);
 }
 
-const std::string* Token::identifier() const
+RID Token::rid() const
 {
-        RIN_ASSERT(this->_classification == TOKEN_IDENT);
-        return this->value.id_name;
+        RIN_ASSERT(this->_classification == TOKEN_RID);
+        return (RID)this->_payload;
 }
 
-RIN_OPERATOR Token::op() const
+Symbol Token::symbol() const
 {
-        RIN_ASSERT(this->_classification == TOKEN_OPERATOR);
-        return this->value.op_value;
+        RIN_ASSERT(this->_classification == TOKEN_IDENT);
+        return (Symbol)this->_payload;
 }
 
-const mpfr_t* Token::float_value() const
+const std::string& Token::identifier() const
 {
-        RIN_ASSERT(this->_classification == TOKEN_FLOAT);
-        return &this->value.float_value;
+        return symbol_name(this->symbol());
 }
 
-const mpfr_t* Token::int_value() const
+RIN_OPERATOR Token::op() const
 {
-        RIN_ASSERT(this->_classification == TOKEN_INTEGER);
-        return &this->value.float_value;
+        RIN_ASSERT(this->_classification == TOKEN_OPERATOR);
+        return (RIN_OPERATOR)this->_payload;
 }
 
 std::string rid_as_string(RID rid)
@@ -174,7 +306,7 @@ std::string rid_as_string(RID rid)
 
 std::string Token::classification_as_string() const
 {
-        switch (this->_classification) {
+        switch (this->classification()) {
         case TOKEN_INVALID:
                 return "invalid token";
         case TOKEN_EOF:
@@ -182,13 +314,13 @@ std::string Token::classification_as_string() const
         case TOKEN_EOL:
                 return "EOL";
         case TOKEN_RID:
-                return rid_as_string(value.rid);
+                return rid_as_string(this->rid());
         case TOKEN_IDENT:
                 return "identifier";
         case TOKEN_STRING:
                 return "string literal";
         case TOKEN_OPERATOR:
-                return operator_name(value.op_value);
+                return operator_name(this->op());
         case TOKEN_CHARACTER:
                 return "character literal";
         case TOKEN_INTEGER:
@@ -203,7 +335,7 @@ std::string Token::classification_as_string() const
 void Scanner::skip_line()
 {
         while (this->has_next()) {
-                Token token = this->scan_token();
+                Token token = this->read_token();
                 this->acknowledge(token);
                 Token::Classification cls = token.classification();
                 if (cls == Token::TOKEN_EOF || cls == Token::TOKEN_EOL)
@@ -211,6 +343,59 @@ void Scanner::skip_line()
         }
 }
 
+Scanner::Scanner(const std::string& path, Token_cache* cache)
+{
+        this->src = new File;
+        this->src->load(path);
+        if (!cache || !this->src->is_open()) {
+                this->src->publish();
+                return;
+        }
+
+        size_t size = this->src->end() - this->src->begin();
+        uint64_t hash = Token_cache::hash(this->src->begin(), size);
+        this->replay = cache->find(hash, size);
+        if (!this->replay) {
+                std::vector<uint32_t> line_starts;
+                scan_line_starts(this->src->begin(), size, line_starts);
+
+                Token_cache::Encoder tokens;
+                while (this->src->has_next())
+                        tokens.add(this->lex_token());
+                this->src->reset();
+                this->line_count = 0;
+
+                this->replay = cache->store(hash, size, std::move(line_starts), &tokens);
+        }
+        this->src->publish(this->replay->line_starts());
+}
+
+Scanner::~Scanner()
+{
+        this->stop_pipeline();
+        delete this->replay;
+        delete this->src;
+}
+
+void Scanner::skip_to(uint32_t offset)
+{
+        RIN_ASSERT(this->src);
+        for (unsigned i = 0; i < this->lookahead_count; i++) {
+                unsigned n = (this->lookahead_head + i) % LOOKAHEAD_CAPACITY;
+                if (this->lookahead[n].classification() != Token::TOKEN_EOF)
+                        this->scanned--;
+        }
+        this->lookahead_head = 0;
+        this->lookahead_count = 0;
+
+        // The lexer thread is ahead; its tokens up to offset are dropped as read.
+        if (this->pipeline) {
+                this->skip_before = offset;
+                return;
+        }
+        this->src->seek(this->src->begin() + offset);
+}
+
 void Scanner::acknowledge(const Token& tok)
 {
         if (tok.classification() != Token::TOKEN_OPERATOR)
@@ -249,14 +434,11 @@ int Scanner::skip_whitespace()
         if (src == NULL)
                 return 0;
 
-        int chars = 0;
-
         // Do not skip newlines, they are a token
-        while (src->peek() == ' ' || src->peek() == '\t') {
-                src->get_char();
-                chars++;
-        }
+        const char* p = scan_blanks(src->cursor(), src->end());
 
+        int chars = p - src->cursor();
+        src->seek(p);
         return chars;
 }
 
@@ -269,28 +451,22 @@ int Scanner::skip_comment()
         if (!is_multiline && !is_oneline)
                 return 0;
 
-        int chars = 0;
-        char last_char = src->get_char();
-        while (is_oneline && last_char != '\n') {
-                last_char = src->get_char();
-                if (last_char == -1)
-                        return chars;
-                chars++;
+        // Step over the second character of the comment opener.
+        const char* start = src->cursor();
+        const char* p = start + 1;
+        const char* end = src->end();
+
+        if (is_oneline) {
+                // The newline belongs to the comment.
+                const char* nl = scan_byte(p, end, '\n');
+                p = (nl < end) ? nl + 1 : end;
+        } else {
+                const char* close = scan_block_comment_end(p, end);
+                p = (close < end) ? close + 2 : end;
         }
 
-        while (is_multiline) {
-                last_char = src->get_char();
-                if (last_char == -1)
-                        return chars;
-                if (last_char == '*' && src->peek() == '/') {
-                        src->get_char();
-                        chars += 2;
-                        break;
-                }
-                chars++;
-        }
-
-        return chars;
+        src->seek(p);
+        return p - start;
 }
 
 Location Scanner::location()
@@ -302,7 +478,210 @@ Location Scanner::location()
         return src->get_loc();
 }
 
+// --- Pipelined scanning ---
+
+/*
+ * The lexer thread of a pipelined scanner. It runs scan_token() over the
+ * rest of the source and hands the tokens to the scanner's own thread
+ * through a fixed ring with one producer and one consumer, so neither
+ * side takes a lock. Scanning a token moves the source cursor and nothing
+ * else, and the cursor belongs to the lexer thread while it runs.
+ *
+ * Each side keeps a copy of the other's index and reloads it only when
+ * the ring looks full or empty. A side that must wait yields its CPU.
+ */
+class Scanner::Pipeline
+{
+public:
+        explicit Pipeline(Scanner* scanner)
+                : _scanner(scanner)
+        { this->_thread = std::thread(&Pipeline::lex, this); }
+
+        ~Pipeline()
+        { this->stop(); }
+
+        Pipeline(const Pipeline&) = delete;
+        Pipeline& operator=(const Pipeline&) = delete;
+
+        // Wait for the next token. False once the source is exhausted.
+        bool has_next();
+
+        // The next token, which has_next() must have found.
+        const Token& front()
+        { return this->_ring[this->_head.load(std::memory_order_relaxed) & MASK]; }
+
+        Token pop()
+        {
+                size_t head = this->_head.load(std::memory_order_relaxed);
+                Token tok = this->_ring[head & MASK];
+                this->_head.store(head + 1, std::memory_order_release);
+                return tok;
+        }
+
+        // Stop the lexer thread and wait for it.
+        void stop();
+
+        // Whether tokens are queued; the first of them starts at *offset.
+        bool unread(uint32_t* offset);
+
+private:
+        // Tokens held at once; a power of two.
+        static const size_t CAPACITY = 4096;
+        static const size_t MASK = CAPACITY - 1;
+
+        void lex();
+
+        Scanner* _scanner;
+        Token _ring[CAPACITY];
+
+        // Read by the consumer; _tail_seen is its copy of _tail.
+        std::atomic<size_t> _head{0};
+        size_t _tail_seen = 0;
+        char _pad[64];
+
+        // Written by the producer; _head_seen is its copy of _head.
+        std::atomic<size_t> _tail{0};
+        size_t _head_seen = 0;
+
+        std::atomic<bool> _done{false};
+        std::atomic<bool> _stop{false};
+        std::thread _thread;
+};
+
+void Scanner::Pipeline::lex()
+{
+        File* src = this->_scanner->src;
+        size_t tail = this->_tail.load(std::memory_order_relaxed);
+
+        while (src->has_next() && !this->_stop.load(std::memory_order_relaxed)) {
+                Token tok = this->_scanner->scan_token();
+                while (tail - this->_head_seen == CAPACITY) {
+                        this->_head_seen = this->_head.load(std::memory_order_acquire);
+                        if (tail - this->_head_seen < CAPACITY)
+                                break;
+                        if (this->_stop.load(std::memory_order_relaxed))
+                                goto done;
+                        std::this_thread::yield();
+                }
+                this->_ring[tail & MASK] = tok;
+                this->_tail.store(++tail, std::memory_order_release);
+        }
+
+done:
+        this->_done.store(true, std::memory_order_release);
+}
+
+bool Scanner::Pipeline::has_next()
+{
+        size_t head = this->_head.load(std::memory_order_relaxed);
+        if (head != this->_tail_seen)
+                return true;
+
+        for (;;) {
+                // Load done first: the tail after it holds every token.
+                bool done = this->_done.load(std::memory_order_acquire);
+                this->_tail_seen = this->_tail.load(std::memory_order_acquire);
+                if (head != this->_tail_seen)
+                        return true;
+                if (done)
+                        return false;
+                std::this_thread::yield();
+        }
+}
+
+void Scanner::Pipeline::stop()
+{
+        if (!this->_thread.joinable())
+                return;
+        this->_stop.store(true, std::memory_order_relaxed);
+        this->_thread.join();
+        this->_tail_seen = this->_tail.load(std::memory_order_relaxed);
+}
+
+bool Scanner::Pipeline::unread(uint32_t* offset)
+{
+        size_t head = this->_head.load(std::memory_order_relaxed);
+        if (head == this->_tail.load(std::memory_order_acquire))
+                return false;
+        *offset = this->_ring[head & MASK].offset();
+        return true;
+}
+
+void Scanner::start_pipeline()
+{
+        if (this->pipeline || this->replay || !this->src || !this->src->has_next())
+                return;
+        this->pipeline = new Pipeline(this);
+}
+
+void Scanner::stop_pipeline()
+{
+        if (!this->pipeline)
+                return;
+        this->pipeline->stop();
+
+        // Lex the queued tokens again, from the first one not skipped over.
+        uint32_t offset;
+        bool unread = this->pipeline->unread(&offset);
+        delete this->pipeline;
+        this->pipeline = NULL;
+
+        const char* resume = (unread) ? this->src->begin() + offset : this->src->cursor();
+        if (resume < this->src->begin() + this->skip_before)
+                resume = this->src->begin() + this->skip_before;
+        if (resume != this->src->cursor())
+                this->src->rewind(resume);
+        this->skip_before = 0;
+}
+
+bool Scanner::source_has_next()
+{
+        if (!this->pipeline)
+                return this->src->has_next();
+
+        while (this->pipeline->has_next()) {
+                const Token& next = this->pipeline->front();
+                if (next.offset() >= this->skip_before)
+                        return true;
+
+                // A token that runs past the skip is lexed again from there.
+                if (next.offset() + next.length() > this->skip_before) {
+                        this->stop_pipeline();
+                        this->start_pipeline();
+                        if (!this->pipeline)
+                                return this->src->has_next();
+                        continue;
+                }
+                this->pipeline->pop();
+        }
+        return false;
+}
+
 Token Scanner::scan_token()
+{
+        if (!this->replay)
+                return this->lex_token();
+
+        // The source cursor follows the replayed tokens, and skip_to() moves it.
+        const char* cursor = this->src->cursor();
+        Token tok;
+        do {
+                if (!this->replay->has_next())
+                        return this->make_eof_token();
+                tok = this->replay->next(*this->src);
+        } while (this->src->begin() + tok.offset() < cursor);
+
+        if (tok.classification() == Token::TOKEN_EOF)
+                this->src->finish();
+        else
+                this->src->seek(this->src->begin() + tok.offset() + tok.length());
+
+        if (tok.classification() == Token::TOKEN_EOL)
+                this->line_count++;
+        return tok;
+}
+
+Token Scanner::lex_token()
 {
         RIN_ASSERT(src);
 
@@ -314,7 +693,7 @@ Token Scanner::scan_token()
 
         // Skip carriage return (handle CRLF line endings).
         if (ch == '\r')
-                return scan_token();
+                return lex_token();
 
         if (ch == '\n') {
                 line_count++;
@@ -322,77 +701,79 @@ Token Scanner::scan_token()
         }
 
         if (ch == '/' && this->skip_comment())
-                return scan_token();
+                return lex_token();
 
         // At this point, we have non-whitespace char
-        std::string tokenStr(1, ch);
-
-        /* Gather multi-char operator */
-        while (is_operator(tokenStr) || (src->peek() != -1 && is_operator(tokenStr + (char)src->peek()))) {
-                if (src->peek() != -1 && is_operator(tokenStr + (char)src->peek())) {
-                        int ch2 = src->get_char();
-                        if (ch2 == '/' && (src->peek() == '/' || src->peek() == '*')) {
-                                skip_comment();
-                                goto assemble_oper;
-                        }
-                        tokenStr += (int)ch2;
-                        continue;
-                }
-
-        assemble_oper:
-                RIN_OPERATOR oper = op_lookup(tokenStr);
-                Token have = Scanner::make_operator(oper);
-                if (is_paired_symbol(oper))
-                        expect_match(have, get_symbol_pair(oper));
+        const char* start = src->cursor() - 1;
 
-                return have;
-        }
-
-        // Gather non-operator word
-        while (!is_whitespace(src->peek()) && !is_operator((char)src->peek())
-               && src->peek() != '\n' && src->peek() != '\r')
-                tokenStr += (char)src->get_char();
-
-        // Gather float.
-        if (is_int_literal(tokenStr) && src->peek() == '.') {
-                tokenStr += (char)src->get_char();
-                std::string literal(1, src->peek());
-                while (is_int_literal(literal) || literal[0] == 'f') {
-                        char next = (char)src->get_char();
-                        tokenStr += next;
-                        if (next == 'f')
-                                break;
-                        literal[0] = src->peek();
-                }
+        // Gather operator, preferring the two-character form.
+        RIN_OPERATOR oper = OPER_ILLEGAL;
+        if (src->peek() != EOF) {
+                oper = op_lookup(start, 2);
+                if (oper != OPER_ILLEGAL)
+                        src->get_char();
         }
-
-        // Hex literal: starts with 0x or 0X
-        if (is_hex_literal(tokenStr)) {
-                Token tok = Token::make_integer_token(tokenStr, Scanner::location());
-                return tok;
+        if (oper == OPER_ILLEGAL)
+                oper = op_lookup(start, 1);
+
+        if (oper != OPER_ILLEGAL)
+                return Scanner::make_operator(oper, src->cursor() - start);
+
+        // Gather and classify the non-operator word in a single pass.
+        const char* word_end = start;
+        Lex_state state = lex_word(start, src->end(), &word_end);
+        src->seek(word_end);
+
+        uint32_t length = word_end - start;
+        Source_span text(start, length);
+        Location loc = Scanner::location();
+
+        switch (state) {
+        case LS_ZERO:
+        case LS_INT:
+        case LS_HEX:
+                return Token::make_integer_token(loc, length);
+        case LS_FRAC:
+        case LS_FLOAT_SUFFIX:
+                return Token::make_float_token(loc, length);
+        case LS_IDENT: {
+                RID rid = rid_lookup(start, length);
+                if (rid != RID_INVALID)
+                        return Token::make_rid_token(rid, loc, length);
+                return Token::make_ident_token(intern(start, length), loc, length);
         }
-
-        // Integer literal: digits only, next char is not '.' or 'f'
-        if (is_int_literal(tokenStr) && src->peek() != '.' && src->peek() != 'f') {
-                Token tok = Token::make_integer_token(tokenStr, Scanner::location());
-                return tok;
+        default:
+                break;
         }
 
-        if (is_float_literal(tokenStr)) {
-                Token tok = Token::make_float_token(tokenStr, Scanner::location());
-                return tok;
-        }
+        // Reported by read_token().
+        return make_invalid_token(length);
+}
 
-        if (is_rid(tokenStr)) {
-                RID rid = rid_lookup(tokenStr);
-                return Token::make_rid_token(rid, Scanner::location());
+Token Scanner::read_token()
+{
+        // Asking the pipeline for a token may stop it (see source_has_next()).
+        Token tok;
+        if (this->pipeline && !this->source_has_next())
+                tok = this->make_eof_token();
+        else if (this->pipeline)
+                tok = this->pipeline->pop();
+        else
+                tok = this->scan_token();
+
+        this->count_token(tok);
+        switch (tok.classification()) {
+        case Token::TOKEN_OPERATOR:
+                if (is_paired_symbol(tok.op()))
+                        this->expect_match(tok, get_symbol_pair(tok.op()));
+                break;
+        case Token::TOKEN_INVALID:
+                rin_error_at(tok.location(), "Unknown keyword %s", tok.text().str().c_str());
+                break;
+        default:
+                break;
         }
-
-        if (is_valid_identifier(tokenStr))
-                return Token::make_ident_token(tokenStr, Scanner::location());
-
-        rin_error_at(location(), "Unknown keyword %s", tokenStr.c_str());
-        return make_invalid_token(tokenStr);
+        return tok;
 }
 
 bool Scanner::is_whitespace(int c)
@@ -404,17 +785,18 @@ bool Scanner::is_whitespace(int c)
 
 Token Scanner::next_token()
 {
-        if (!buffer.empty()) {
-                Token tok = buffer.front();
-                buffer.pop_front();
+        if (this->lookahead_count > 0) {
+                Token tok = std::move(this->lookahead[this->lookahead_head]);
+                this->lookahead_head = (this->lookahead_head + 1) % LOOKAHEAD_CAPACITY;
+                this->lookahead_count--;
                 this->acknowledge(tok);
                 return tok;
         }
 
         RIN_ASSERT(this->src);
 
-        if (this->src->has_next()) {
-                Token tok = scan_token();
+        if (this->source_has_next()) {
+                Token tok = this->read_token();
                 acknowledge(tok);
                 return tok;
         }
@@ -422,98 +804,118 @@ Token Scanner::next_token()
         return make_eof_token();
 }
 
-Token Scanner::peek_token()
+const Token& Scanner::peek_token()
 {
-        if (!buffer.empty())
-                return buffer.front();
-
-        RIN_ASSERT(this->src);
-
-        if (src->has_next()) {
-                Token tok = scan_token();
-                buffer.emplace_back(tok);
-                return tok;
-        }
-
-        return make_eof_token();
+        return this->peek_nth_token(0);
 }
 
-Token Scanner::peek_nth_token(unsigned int n)
+const Token& Scanner::peek_nth_token(unsigned int n)
 {
+        RIN_ASSERT(n < LOOKAHEAD_CAPACITY);
+
+        if (n < this->lookahead_count)
+                return this->lookahead[(this->lookahead_head + n) % LOOKAHEAD_CAPACITY];
+
         RIN_ASSERT(this->src);
 
-        while (src->has_next() && buffer.size() <= n)
-                buffer.emplace_back(scan_token());
+        while (this->source_has_next() && this->lookahead_count <= n) {
+                unsigned tail = (this->lookahead_head + this->lookahead_count)
+                        % LOOKAHEAD_CAPACITY;
+                this->lookahead[tail] = this->read_token();
+                this->lookahead_count++;
+        }
 
-        if (buffer.size() > n)
-                return buffer[n];
+        if (n < this->lookahead_count)
+                return this->lookahead[(this->lookahead_head + n) % LOOKAHEAD_CAPACITY];
 
-        return make_eof_token();
+        this->eof_token = make_eof_token();
+        return this->eof_token;
 }
 
 void Scanner::reset()
 {
+        this->stop_pipeline();
+        delete this->replay;
+        this->replay = NULL;
         delete src;
 
         while(this->expect_matches.size() > 0)
                 this->expect_matches.pop();
 
         this->line_count = 0;
-        this->buffer.clear();
+        this->scanned = 0;
+        this->skip_before = 0;
+        this->lookahead_head = 0;
+        this->lookahead_count = 0;
+}
+
+void Scanner::restart()
+{
+        this->stop_pipeline();
+        if (this->replay)
+                this->replay->rewind();
+        if (this->src)
+                this->src->reset();
+
+        while (this->expect_matches.size() > 0)
+                this->expect_matches.pop();
+
+        this->line_count = 0;
+        this->scanned = 0;
+        this->skip_before = 0;
+        this->lookahead_head = 0;
+        this->lookahead_count = 0;
 }
 
 bool Scanner::has_next()
 {
-        if (!this->buffer.empty())
+        if (this->lookahead_count > 0)
                 return true;
         if (!this->src)
                 return false;
-        if (this->src->has_next())
-                return true;
-        return false;
+        return this->source_has_next();
 }
 
 bool Scanner::is_valid_identifier(const std::string& ident)
 {
-        if (std::regex_match(ident.begin(), ident.end(), std::regex(R"(([a-z]|[A-Z])(\w+|))")))
-                return true;
-        return false;
+        return lex_string(ident) == LS_IDENT;
 }
 
 bool Scanner::is_hex_literal(const std::string& literal)
 {
-        if(std::regex_match(literal.begin(), literal.end(), std::regex(R"(0x[ABCDEFabcdef0123456789]+)")))
-                return true;
-        return false;
+        return lex_string(literal) == LS_HEX;
 }
 
 bool Scanner::is_string_literal(const std::string& literal)
 {
-        if (std::regex_match(literal.begin(), literal.end(), std::regex(R"(\"(\w|\s|)+\")")))
-                return true;
-        return false;
+        size_t len = literal.size();
+        if (len < 2 || literal[0] != '"' || literal[len - 1] != '"')
+                return false;
+
+        for (size_t i = 1; i < len - 1; i++) {
+                unsigned char c = literal[i];
+                if (!is_word_char(c) && !isspace(c))
+                        return false;
+        }
+        return true;
 }
 
 bool Scanner::is_char_literal(const std::string& literal)
 {
-        if (std::regex_match(literal.begin(), literal.end(), std::regex(R"(\'\w\')")))
-                return true;
-        return false;
+        return literal.size() == 3 && literal[0] == '\''
+                && is_word_char(literal[1]) && literal[2] == '\'';
 }
 
 bool Scanner::is_int_literal(const std::string& literal)
 {
-        if (std::regex_match(literal.begin(), literal.end(), std::regex(R"(\d+)")))
-                return true;
-        return false;
+        Lex_state state = lex_string(literal);
+        return state == LS_ZERO || state == LS_INT;
 }
 
 bool Scanner::is_float_literal(const std::string& literal)
 {
-        if (std::regex_match(literal.begin(), literal.end(), std::regex(R"(\d+\.\d+)")) ||
-            std::regex_match(literal.begin(), literal.end(), std::regex(R"((\d+f|\d+\.\d+f))")))
-                return true;
-        return false;
+        Lex_state state = lex_string(literal);
+        return state == LS_FRAC || state == LS_FLOAT_SUFFIX;
 }
 
 bool Scanner::is_rid(const std::string& value)
@@ -550,40 +952,79 @@ bool Scanner::consume_errors()
         return true;
 }
 
+/*
+ * Reserved identifiers are found through a perfect hash over their first
+ * and last characters and their length. The table is built at compile
+ * time from __keywords__; the static_assert below rejects collisions.
+ */
+struct Keyword_entry {
+        const char* text;
+        size_t len;
+        RID rid;
+};
+
+static constexpr Keyword_entry __keywords__[] =
+{
+        {"float",    5, RID_FLOAT},    {"int",      3, RID_INT},
+        {"bool",     4, RID_BOOL},     {"string",   6, RID_STRING},
+        {"var",      3, RID_VAR},      {"for",      3, RID_FOR},
+        {"if",       2, RID_IF},       {"else",     4, RID_ELSE},
+        {"while",    5, RID_WHILE},    {"true",     4, RID_TRUE},
+        {"false",    5, RID_FALSE},    {"fn",       2, RID_FN},
+        {"return",   6, RID_RETURN},   {"break",    5, RID_BREAK},
+        {"continue", 8, RID_CONTINUE}, {"switch",   6, RID_SWITCH}
+};
+
+static constexpr unsigned __keyword_count__ =
+        sizeof(__keywords__) / sizeof(__keywords__[0]);
+
+static constexpr unsigned __rid_hash_size__ = 22;
+
+static constexpr unsigned rid_hash(const char* str, size_t len)
+{
+        return (3 * (unsigned char)str[0] + 9 * (unsigned char)str[len - 1]
+                + len) % __rid_hash_size__;
+}
+
+struct Keyword_table {
+        signed char slot[__rid_hash_size__];
+        bool perfect;
+
+        constexpr Keyword_table() : slot(), perfect(true)
+        {
+                for (unsigned i = 0; i < __rid_hash_size__; i++)
+                        slot[i] = -1;
+
+                for (unsigned i = 0; i < __keyword_count__; i++) {
+                        const Keyword_entry& entry = __keywords__[i];
+                        unsigned h = rid_hash(entry.text, entry.len);
+                        if (slot[h] != -1)
+                                perfect = false;
+                        slot[h] = i;
+                }
+        }
+};
+
+static constexpr Keyword_table __keyword_table__;
+static_assert(__keyword_table__.perfect, "keyword hash is not perfect");
+
+RID rid_lookup(const char* val, size_t len)
+{
+        if (len < 2 || len > 8)
+                return RID_INVALID;
+
+        int i = __keyword_table__.slot[rid_hash(val, len)];
+        if (i < 0)
+                return RID_INVALID;
+
+        const Keyword_entry& entry = __keywords__[i];
+        if (entry.len != len || memcmp(entry.text, val, len) != 0)
+                return RID_INVALID;
+
+        return entry.rid;
+}
+
 RID rid_lookup(const std::string& val)
 {
-        if (val == "float")
-                return RID_FLOAT;
-        if (val == "if")
-                return RID_IF;
-        if (val == "for")
-                return RID_FOR;
-        if (val == "else")
-                return RID_ELSE;
-        if (val == "while")
-                return RID_WHILE;
-        if (val == "fn")
-                return RID_FN;
-        if (val == "return")
-                return RID_RETURN;
-        if (val == "break")
-                return RID_BREAK;
-        if (val == "continue")
-                return RID_CONTINUE;
-        if (val == "switch")
-                return RID_SWITCH;
-        if (val == "int")
-                return RID_INT;
-        if (val == "bool")
-                return RID_BOOL;
-        if (val == "true")
-                return RID_TRUE;
-        if (val == "false")
-                return RID_FALSE;
-        if (val == "string")
-                return RID_STRING;
-        if (val == "var")
-                return RID_VAR;
-
-        return RID_INVALID;
+        return rid_lookup(val.data(), val.size());
 }
@@ -6,6 +6,9 @@
 #include "diagnostic.hpp"
 #include "file.hpp"
 
+class Token_cache;
+class Cached_tokens;
+
 // Reserved identifiers
 enum RID {
 	RID_INVALID, RID_FLOAT, RID_INT, RID_BOOL, RID_STRING, RID_VAR,
@@ -17,14 +20,33 @@ enum RID {
 };
 
 // Lookup an RID by string name
+RID rid_lookup(const char* val, size_t len);
 RID rid_lookup(const std::string& val);
 
 // Return an RID as a string
 std::string rid_as_string(RID rid);
 
+/*
+ * A token is a small, trivially copyable value. Rather than owning its
+ * text, it records where it sits in its source: the id of the File it was
+ * scanned from, and the offset and length of its text there. Its text is
+ * resolved through the file on demand, so it is only available while the
+ * file is open; its location stays valid after the file is closed.
+ */
 class Token
 {
 public:
+        // An invalid token with no source.
+        Token()
+                : _offset(0), _length(0), _payload(0), _file(0),
+                  _classification(TOKEN_INVALID)
+        {}
+
+        Token(const Token&) = default;
+        Token(Token&&) noexcept = default;
+        Token& operator=(const Token&) = default;
+        Token& operator=(Token&&) noexcept = default;
+
         // Token Types
         enum Classification {
                 TOKEN_INVALID,  TOKEN_EOF,       TOKEN_EOL,
@@ -33,75 +55,87 @@ public:
                 TOKEN_FLOAT
         };
 
-        Token(const Token& tok);
-
-        ~Token() { this->clear(); }
-
         Classification classification() const
-        { return _classification; }
+        { return (Classification)this->_classification; }
 
-        Location location() const
-        { return this->_location; }
+        // The location just past the end of the token.
+        Location location() const;
 
         // Return the token's classification as a string. For debugging.
         std::string classification_as_string() const;
 
-        // Return the token as a string
-        const char* str() const
-        { return this->token_string.c_str(); }
+        /*
+         * Return the token as a string: the source text for identifiers,
+         * literals and invalid tokens, and a name for everything else.
+         */
+        std::string string() const;
+
+        // The token's text in its source buffer.
+        Source_span text() const;
+
+        uint32_t file() const
+        { return this->_file; }
 
-        std::string string() const
-        { return this->token_string; }
+        uint32_t offset() const
+        { return this->_offset; }
+
+        uint32_t length() const
+        { return this->_length; }
 
         // Custom Token Type constructors
         static Token make_invalid_token
-        (const std::string& str, const Location& loc);
+        (const Location& loc, uint32_t length);
 
         static Token make_eof_token(const Location& loc);
         static Token make_eol_token(const Location& loc);
-        static Token make_rid_token(RID rid, const Location& loc);
-        static Token make_operator_token(RIN_OPERATOR op, const Location& loc);
-        static Token make_float_token(const std::string& str, const Location& loc);
-        static Token make_integer_token(const std::string& str, const Location& loc);
-
-        // Make an identifier token
-        static Token make_ident_token(const std::string& name, const Location& loc);
+        static Token make_rid_token
+        (RID rid, const Location& loc, uint32_t length);
+        static Token make_operator_token
+        (RIN_OPERATOR op, const Location& loc, uint32_t length);
+        static Token make_float_token
+        (const Location& loc, uint32_t length);
+        static Token make_integer_token
+        (const Location& loc, uint32_t length);
+
+        // Make an operator token covering the same source as tok.
+        static Token make_operator_token(RIN_OPERATOR op, const Token& tok);
+
+        // Make an identifier token for an interned symbol
+        static Token make_ident_token
+        (Symbol sym, const Location& loc, uint32_t length);
 
         // True if Token is EOL or semicolon operator
-        bool is_semicolon();
+        bool is_semicolon() const;
 
         /*
-         * Return token values. Throws invalid argument error if not of
-         * specified type
+         * Return token values. Asserts that the token is of the
+         * specified type. Numeric literals are left unparsed; their
+         * value is read from text() when an expression is built.
          */
         RID rid() const;
-        const std::string* identifier() const;
+        Symbol symbol() const;
+        const std::string& identifier() const;
         RIN_OPERATOR op() const;
-        const mpfr_t* float_value() const;
-        const mpfr_t* int_value() const;
 
 private:
         // Private constructor: called by make_x_token functions
-        Token(Classification c, const std::string& str, const Location& l)
-                : _classification(c), _location(l), token_string(str)
-                { value.op_value = OPER_ILLEGAL; }
-
-        // Clears dynamically allocated mpfr/mpz, resets attributes to defaults
-        void clear();
-
-        // Token value - varies depending on classification.
-        union {
-                RID           rid;
-                mpfr_t        float_value;
-                RIN_OPERATOR  op_value;
-                std::string*  id_name;
-        } value;
-
-        Classification _classification;
-        Location       _location;
-        std::string    token_string;
+        Token(Classification c, const Location& end, uint32_t length);
+
+        // Position in the source: the token's text is [offset, offset + length).
+        uint32_t _offset;
+        uint32_t _length;
+
+        // RID, RIN_OPERATOR or Symbol.
+        uint32_t _payload;
+
+        uint32_t _file;
+        uint8_t  _classification;
 };
 
+static_assert(sizeof(Token) <= 20, "Token should stay a small value type");
+static_assert(std::is_trivially_copyable<Token>::value,
+              "Token should be trivially copyable");
+
 /*
  * An expect match structure helps validate whether paired operators are left unmatched.
  * It also stores a location to pinpoint the source of the error. If an open parenthesis
@@ -123,31 +157,92 @@ public:
         Scanner(const Scanner&) = delete;
         Scanner& operator=(const Scanner&) = delete;
 
-        ~Scanner()
-        { delete this->src; }
+        ~Scanner();
 
         // Instantiate a scanner directly from a file.
         explicit Scanner(const std::string& path)
         { this->src = new File(path); }
 
-        // Read tokens from the scanner source.
+        /*
+         * Scan the file at path, replaying its tokens from cache if it holds
+         * them rather than lexing it (see token-cache.hpp). If it does not,
+         * the file is lexed once and stored first. The cache is only used
+         * while the scanner is constructed, and may be NULL.
+         */
+        Scanner(const std::string& path, Token_cache* cache);
+
+        // Whether tokens are replayed from a token cache.
+        bool is_replaying() const
+        { return this->replay != NULL; }
+
+        /*
+         * Read tokens from the scanner source. Peeked tokens are held in a
+         * fixed-size lookahead ring; the returned reference stays valid
+         * until LOOKAHEAD_CAPACITY more tokens have been scanned after it
+         * is consumed, so copy a token that must outlive a sub-parse.
+         */
         Token next_token();
-        Token peek_token();
-        Token peek_nth_token(unsigned int n);
+        const Token& peek_token();
+        const Token& peek_nth_token(unsigned int n);
         bool has_next();
 
+        // The number of tokens that may be peeked ahead at once.
+        static const unsigned LOOKAHEAD_CAPACITY = 8;
+
         // Read until semicolon or EOL - in case of malformed statement
         void skip_line();
 
+        /*
+         * Drop the peeked tokens and carry on scanning at offset, past the
+         * cursor. The dropped tokens must not open a pair (see expect_match).
+         */
+        void skip_to(uint32_t offset);
+
+        // Return the file being scanned, or NULL.
+        File* source()
+        { return this->src; }
+
+        /*
+         * Lex the rest of the source on a thread of its own, ahead of the
+         * token functions above, which then read from a queue between the
+         * two threads. Tokens, and the errors scanning them reports, come
+         * out the same and in the same order as without. Replayed tokens
+         * are not worth a thread, so a replaying scanner is not pipelined.
+         */
+        void start_pipeline();
+
+        // Stop lexing ahead; the source is read on from the first unread token.
+        void stop_pipeline();
+
+        bool is_pipelined() const
+        { return this->pipeline != NULL; }
+
+        /*
+         * Number of tokens scanned so far, less those dropped by skip_to().
+         * The end of the source is not counted.
+         */
+        uint64_t tokens_scanned() const
+        { return this->scanned; }
+
         // Reset the scanner's attributes, restarts scanner.
         void reset();
 
+        // Scan the source again from its start, as if none of it was read.
+        void restart();
+
         /*
          * Receive errors from unmatched expectations. Once received, expect_matches is emptied,
          * so this is best called when the scanner reaches EOF. Returns true if errors were pushed.
          */
         bool consume_errors();
 
+        /*
+         * Whether op would close the innermost pair left open. Any other closing
+         * operator is reported as unexpected once it is read.
+         */
+        bool expects(RIN_OPERATOR op) const
+        { return !this->expect_matches.empty() && this->expect_matches.top().want == op; }
+
         static bool is_operator(const std::string& op)
         { return is_rin_operator(op); }
 
@@ -198,11 +293,11 @@ protected:
         Location location();
 
         // Utility functions.
-        Token make_operator(RIN_OPERATOR op)
-        { return Token::make_operator_token(op, Scanner::location()); }
+        Token make_operator(RIN_OPERATOR op, uint32_t length)
+        { return Token::make_operator_token(op, Scanner::location(), length); }
 
-        Token make_invalid_token(const std::string& val)
-        { return Token::make_invalid_token(val, Scanner::location()); }
+        Token make_invalid_token(uint32_t length)
+        { return Token::make_invalid_token(Scanner::location(), length); }
 
         Token make_eof_token()
         { return Token::make_eof_token(Scanner::location()); }
@@ -210,12 +305,53 @@ protected:
         Token make_eol_token()
         { return Token::make_eol_token(Scanner::location()); }
 
-        // Scan the source, lex it, and return the next token.
+        /*
+         * Return the next token of the source, replayed from the token
+         * cache or lexed. This only moves the source cursor; what the token
+         * implies for the scanner is done when it is read (see read_token()).
+         */
         Token scan_token();
 
+        // Lex the source and return the next token.
+        Token lex_token();
+
+        // Count tok in tokens_scanned().
+        void count_token(const Token& tok)
+        {
+                if (tok.classification() != Token::TOKEN_EOF)
+                        this->scanned++;
+        }
+
 private:
+        // The lexer thread of a pipelined scanner and its queue (see scanner.cc).
+        class Pipeline;
+
+        // Whether the source, or the pipeline's queue, holds another token.
+        bool source_has_next();
+
+        /*
+         * Take the next token from the source or the pipeline's queue, and
+         * do what scanning it implies: count it, expect the pair of an
+         * opening operator, and report an unknown word.
+         */
+        Token read_token();
+
         File* src = nullptr;
-        std::deque<Token> buffer;
+        Pipeline* pipeline = nullptr;
+
+        // The cached tokens being replayed, if any.
+        Cached_tokens* replay = nullptr;
+
+        // Queued tokens before this offset were skipped over (see skip_to()).
+        uint32_t skip_before = 0;
+
+        // Lookahead ring: [head, head + count) are scanned but not consumed.
+        Token lookahead[LOOKAHEAD_CAPACITY];
+        unsigned lookahead_head = 0;
+        unsigned lookahead_count = 0;
+
+        // Returned by reference when peeking past the end of the source.
+        Token eof_token;
 
         /*
          * The expect_matches stack keeps track of all ExpectMatch expectations. If it
@@ -224,6 +360,7 @@ private:
          */
         std::stack<ExpectMatch> expect_matches;
         int line_count = 0;
+        uint64_t scanned = 0;
 };
 
 #endif // RIN_SCANNER_HPP
@@ -0,0 +1,259 @@
+// simd.cc - Vectorized byte scanning with runtime dispatch
+#include "simd.hpp"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define RIN_SCAN_X86 1
+#endif
+
+// ---- Scalar ----
+
+static const char* blanks_scalar(const char* p, const char* end)
+{
+        while (p < end && (*p == ' ' || *p == '\t'))
+                p++;
+        return p;
+}
+
+static const char* byte_scalar(const char* p, const char* end, char c)
+{
+        const char* hit = (const char*)memchr(p, c, end - p);
+        return (hit) ? hit : end;
+}
+
+static const char* comment_end_scalar(const char* p, const char* end)
+{
+        while (p < end) {
+                const char* star = (const char*)memchr(p, '*', end - p);
+                if (!star || star + 1 >= end)
+                        return end;
+                if (star[1] == '/')
+                        return star;
+                p = star + 1;
+        }
+        return end;
+}
+
+// Append line starts for the newlines in data[i, size).
+static void line_starts_scalar(const char* data, size_t i, size_t size,
+                               std::vector<uint32_t>& starts)
+{
+        for (; i < size; i++) {
+                if (data[i] == '\n')
+                        starts.push_back(i + 1);
+        }
+}
+
+#ifdef RIN_SCAN_X86
+
+// ---- SSE2 ----
+
+__attribute__((target("sse2")))
+static const char* blanks_sse2(const char* p, const char* end)
+{
+        const __m128i space = _mm_set1_epi8(' ');
+        const __m128i tab = _mm_set1_epi8('\t');
+        for (; end - p >= 16; p += 16) {
+                __m128i block = _mm_loadu_si128((const __m128i*)p);
+                __m128i blank = _mm_or_si128(_mm_cmpeq_epi8(block, space),
+                                             _mm_cmpeq_epi8(block, tab));
+                unsigned mask = ~_mm_movemask_epi8(blank) & 0xffff;
+                if (mask != 0)
+                        return p + __builtin_ctz(mask);
+        }
+        return blanks_scalar(p, end);
+}
+
+__attribute__((target("sse2")))
+static const char* byte_sse2(const char* p, const char* end, char c)
+{
+        const __m128i needle = _mm_set1_epi8(c);
+        for (; end - p >= 16; p += 16) {
+                __m128i block = _mm_loadu_si128((const __m128i*)p);
+                unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+                if (mask != 0)
+                        return p + __builtin_ctz(mask);
+        }
+        return byte_scalar(p, end, c);
+}
+
+__attribute__((target("sse2")))
+static const char* comment_end_sse2(const char* p, const char* end)
+{
+        // Compare each byte with '*' and its successor with '/'.
+        const __m128i star = _mm_set1_epi8('*');
+        const __m128i slash = _mm_set1_epi8('/');
+        for (; end - p >= 17; p += 16) {
+                __m128i first = _mm_loadu_si128((const __m128i*)p);
+                __m128i second = _mm_loadu_si128((const __m128i*)(p + 1));
+                __m128i close = _mm_and_si128(_mm_cmpeq_epi8(first, star),
+                                              _mm_cmpeq_epi8(second, slash));
+                unsigned mask = _mm_movemask_epi8(close);
+                if (mask != 0)
+                        return p + __builtin_ctz(mask);
+        }
+        return comment_end_scalar(p, end);
+}
+
+__attribute__((target("sse2")))
+static void line_starts_sse2(const char* data, size_t i, size_t size,
+                             std::vector<uint32_t>& starts)
+{
+        const __m128i newline = _mm_set1_epi8('\n');
+        for (; i + 16 <= size; i += 16) {
+                __m128i block = _mm_loadu_si128((const __m128i*)(data + i));
+                unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+                for (; mask != 0; mask &= mask - 1)
+                        starts.push_back(i + __builtin_ctz(mask) + 1);
+        }
+        line_starts_scalar(data, i, size, starts);
+}
+
+// ---- AVX2 ----
+
+__attribute__((target("avx2")))
+static const char* blanks_avx2(const char* p, const char* end)
+{
+        const __m256i space = _mm256_set1_epi8(' ');
+        const __m256i tab = _mm256_set1_epi8('\t');
+        for (; end - p >= 32; p += 32) {
+                __m256i block = _mm256_loadu_si256((const __m256i*)p);
+                __m256i blank = _mm256_or_si256(_mm256_cmpeq_epi8(block, space),
+                                                _mm256_cmpeq_epi8(block, tab));
+                unsigned mask = ~(unsigned)_mm256_movemask_epi8(blank);
+                if (mask != 0)
+                        return p + __builtin_ctz(mask);
+        }
+        return blanks_sse2(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char* byte_avx2(const char* p, const char* end, char c)
+{
+        const __m256i needle = _mm256_set1_epi8(c);
+        for (; end - p >= 32; p += 32) {
+                __m256i block = _mm256_loadu_si256((const __m256i*)p);
+                unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle));
+                if (mask != 0)
+                        return p + __builtin_ctz(mask);
+        }
+        return byte_sse2(p, end, c);
+}
+
+__attribute__((target("avx2")))
+static const char* comment_end_avx2(const char* p, const char* end)
+{
+        const __m256i star = _mm256_set1_epi8('*');
+        const __m256i slash = _mm256_set1_epi8('/');
+        for (; end - p >= 33; p += 32) {
+                __m256i first = _mm256_loadu_si256((const __m256i*)p);
+                __m256i second = _mm256_loadu_si256((const __m256i*)(p + 1));
+                __m256i close = _mm256_and_si256(_mm256_cmpeq_epi8(first, star),
+                                                 _mm256_cmpeq_epi8(second, slash));
+                unsigned mask = _mm256_movemask_epi8(close);
+                if (mask != 0)
+                        return p + __builtin_ctz(mask);
+        }
+        return comment_end_sse2(p, end);
+}
+
+__attribute__((target("avx2")))
+static void line_starts_avx2(const char* data, size_t i, size_t size,
+                             std::vector<uint32_t>& starts)
+{
+        const __m256i newline = _mm256_set1_epi8('\n');
+        for (; i + 32 <= size; i += 32) {
+                __m256i block = _mm256_loadu_si256((const __m256i*)(data + i));
+                unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline));
+                for (; mask != 0; mask &= mask - 1)
+                        starts.push_back(i + __builtin_ctz(mask) + 1);
+        }
+        line_starts_sse2(data, i, size, starts);
+}
+
+#endif /* RIN_SCAN_X86 */
+
+// ---- Dispatch ----
+
+struct Scan_kernels {
+        Scan_isa isa;
+        const char* (*blanks)(const char*, const char*);
+        const char* (*byte)(const char*, const char*, char);
+        const char* (*comment_end)(const char*, const char*);
+        void (*line_starts)(const char*, size_t, size_t, std::vector<uint32_t>&);
+};
+
+static const Scan_kernels __scan_kernels__[] = {
+        { SCAN_SCALAR, blanks_scalar, byte_scalar,
+          comment_end_scalar, line_starts_scalar },
+#ifdef RIN_SCAN_X86
+        { SCAN_SSE2, blanks_sse2, byte_sse2,
+          comment_end_sse2, line_starts_sse2 },
+        { SCAN_AVX2, blanks_avx2, byte_avx2,
+          comment_end_avx2, line_starts_avx2 },
+#endif
+};
+
+static bool isa_supported(Scan_isa isa)
+{
+        switch (isa) {
+        case SCAN_SCALAR:
+                return true;
+#ifdef RIN_SCAN_X86
+        case SCAN_SSE2:
+                __builtin_cpu_init();
+                return __builtin_cpu_supports("sse2");
+        case SCAN_AVX2:
+                __builtin_cpu_init();
+                return __builtin_cpu_supports("avx2");
+#endif
+        default:
+                return false;
+        }
+}
+
+static const Scan_kernels* best_kernels()
+{
+        // Kernels are listed from narrowest to widest; scalar always works.
+        size_t count = sizeof(__scan_kernels__) / sizeof(__scan_kernels__[0]);
+        for (size_t i = count - 1; i > 0; i--) {
+                if (isa_supported(__scan_kernels__[i].isa))
+                        return &__scan_kernels__[i];
+        }
+        return &__scan_kernels__[0];
+}
+
+// Selected during static initialization, before any source is opened.
+static const Scan_kernels* __kernels__ = best_kernels();
+
+const char* scan_blanks(const char* p, const char* end)
+{ return __kernels__->blanks(p, end); }
+
+const char* scan_byte(const char* p, const char* end, char c)
+{ return __kernels__->byte(p, end, c); }
+
+const char* scan_block_comment_end(const char* p, const char* end)
+{ return __kernels__->comment_end(p, end); }
+
+void scan_line_starts(const char* data, size_t size,
+                      std::vector<uint32_t>& starts)
+{
+        starts.assign(1, 0);
+        __kernels__->line_starts(data, 0, size, starts);
+}
+
+Scan_isa scan_isa()
+{ return __kernels__->isa; }
+
+bool scan_select_isa(Scan_isa isa)
+{
+        if (!isa_supported(isa))
+                return false;
+
+        for (const Scan_kernels& kernels : __scan_kernels__) {
+                if (kernels.isa == isa) {
+                        __kernels__ = &kernels;
+                        return true;
+                }
+        }
+        return false;
+}
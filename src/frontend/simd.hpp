@@ -0,0 +1,45 @@
+// simd.hpp - Vectorized byte scanning over source buffers
+#ifndef RIN_SIMD_HPP
+#define RIN_SIMD_HPP
+
+#include <rin-system.hpp>
+
+/*
+ * Searches over a raw source buffer for the runs the scanner skips:
+ * blanks, the rest of a line comment and the body of a block comment,
+ * plus the newline scan that builds a file's line table.
+ *
+ * On x86-64 each search has SSE2 and AVX2 variants next to the portable
+ * scalar one. The widest variant the running CPU supports is selected once
+ * at startup; every variant returns exactly the same result.
+ */
+
+enum Scan_isa {
+        SCAN_SCALAR,
+        SCAN_SSE2,
+        SCAN_AVX2
+};
+
+// Return the first byte in [p, end) that is not a space or a tab, or end.
+const char* scan_blanks(const char* p, const char* end);
+
+// Return the first c in [p, end), or end.
+const char* scan_byte(const char* p, const char* end, char c);
+
+// Return the '*' of the first "*/" in [p, end), or end.
+const char* scan_block_comment_end(const char* p, const char* end);
+
+// Set starts to 0 followed by the offset just past every newline in data.
+void scan_line_starts(const char* data, size_t size,
+                      std::vector<uint32_t>& starts);
+
+// The variant in use.
+Scan_isa scan_isa();
+
+/*
+ * Switch to another variant, for testing. Returns false, leaving the
+ * selection unchanged, if the CPU does not support it. Not thread-safe.
+ */
+bool scan_select_isa(Scan_isa isa);
+
+#endif /* RIN_SIMD_HPP */
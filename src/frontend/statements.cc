@@ -1,59 +1,53 @@
 // statements.cc - Statement factory methods and backend code generation
 #include "statements.hpp"
 
-Statement* Statement::make_invalid(const Location& loc)
-{ return new Invalid_statement(loc); }
+Statement* Statement::make_invalid(Arena* arena, const Location& loc)
+{ return arena->make<Invalid_statement>(loc); }
 
-Statement* Statement::make_variable_declaration(Named_object* var)
-{ return new Variable_declaration_statement(var); }
+Statement* Statement::make_variable_declaration(Arena* arena, Named_object* var)
+{ return arena->make<Variable_declaration_statement>(var); }
 
 Statement* Statement::make_assignment
-(Expression* lhs, Expression* rhs, const Location& loc)
-{ return new Assignment_statement(lhs, rhs, loc); }
+(Arena* arena, Expression* lhs, Expression* rhs, const Location& loc)
+{ return arena->make<Assignment_statement>(lhs, rhs, loc); }
 
-Statement* Statement::make_inc(Expression* expr)
-{ return new Inc_dec_statement(expr, true); }
+Statement* Statement::make_inc(Arena* arena, Expression* expr)
+{ return arena->make<Inc_dec_statement>(expr, true); }
 
-Statement* Statement::make_dec(Expression* expr)
-{ return new Inc_dec_statement(expr, false); }
+Statement* Statement::make_dec(Arena* arena, Expression* expr)
+{ return arena->make<Inc_dec_statement>(expr, false); }
 
 Statement* Statement::make_if
-(Expression* cond, Scope* then_block, const Location& loc)
-{ return new If_statement(cond, then_block, loc); }
+(Arena* arena, Expression* cond, Scope* then_block, const Location& loc)
+{ return arena->make<If_statement>(cond, then_block, loc); }
 
 Statement* Statement::make_for
-(Statement* ind, Statement* cond, Statement* inc, const Location& loc)
-{ return new For_statement(ind, cond, inc, loc); }
+(Arena* arena, Statement* ind, Statement* cond, Statement* inc, const Location& loc)
+{ return arena->make<For_statement>(ind, cond, inc, loc); }
 
-Statement* Statement::make_expression(Expression* expr, const Location& loc)
-{ return new Expression_statement(expr, loc); }
+Statement* Statement::make_expression(Arena* arena, Expression* expr, const Location& loc)
+{ return arena->make<Expression_statement>(expr, loc); }
 
 Statement* Statement::make_compound
-(Statement* first, Statement* second, const Location& loc)
-{ return new Compound_statement(first, second, loc); }
+(Arena* arena, Statement* first, Statement* second, const Location& loc)
+{ return arena->make<Compound_statement>(first, second, loc); }
 
-Statement* Statement::make_return(Expression* expr, const Location& loc)
-{ return new Return_statement(expr, loc); }
+Statement* Statement::make_return(Arena* arena, Expression* expr, const Location& loc)
+{ return arena->make<Return_statement>(expr, loc); }
 
-Statement* Statement::make_break(const Location& loc)
-{ return new Break_statement(loc); }
+Statement* Statement::make_break(Arena* arena, const Location& loc)
+{ return arena->make<Break_statement>(loc); }
 
-Statement* Statement::make_continue(const Location& loc)
-{ return new Continue_statement(loc); }
+Statement* Statement::make_continue(Arena* arena, const Location& loc)
+{ return arena->make<Continue_statement>(loc); }
 
 Statement* Statement::make_function
-(const std::string& name, const std::vector<std::string>& params,
+(Arena* arena, const std::string& name, const std::vector<std::string>& params,
  Scope* body, const Location& loc)
-{ return new Function_declaration_statement(name, params, body, loc); }
+{ return arena->make<Function_declaration_statement>(name, params, body, loc); }
 
 // Assignment_statement implementation
 
-Assignment_statement::~Assignment_statement()
-{
-        delete this->_lhs;
-        delete this->_rhs;
-}
-
 Bstatement* Assignment_statement::do_get_backend(Backend* backend)
 {
         RIN_ASSERT(backend);
@@ -103,12 +97,6 @@ Bstatement* Variable_declaration_statement::do_get_backend(Backend* backend)
 
 // If_statement implementation
 
-If_statement::~If_statement()
-{
-        delete this->_cond;
-        delete this->_else_block;
-}
-
 Bstatement* If_statement::do_get_backend(Backend* backend)
 {
         RIN_ASSERT(backend);
@@ -130,18 +118,6 @@ Bstatement* If_statement::do_get_backend(Backend* backend)
 
 // For_statement implementation
 
-For_statement::~For_statement()
-{
-        delete this->_ind;
-        delete this->_cond;
-        delete this->_inc;
-
-        // _statements is owned by For_statement, set via add_statements().
-        // The Scope* is not managed by Backend's scope stack after
-        // leave_scope() is called in parse_for_statement/parse_while_statement.
-        delete this->_statements;
-}
-
 Bstatement* For_statement::do_get_backend(Backend* backend)
 {
         RIN_ASSERT(backend);
@@ -194,12 +170,6 @@ Bstatement* Expression_statement::do_get_backend(Backend* backend)
 
 // Compound_statement implementation
 
-Compound_statement::~Compound_statement()
-{
-        delete _first;
-        delete _second;
-}
-
 Bstatement* Compound_statement::do_get_backend(Backend* backend)
 {
         RIN_ASSERT(backend);
@@ -36,7 +36,8 @@ public:
                 : _classification(cl), _location(loc)
         {}
 
-        virtual ~Statement() {}
+        // Statements live in an Arena and are never deleted one by one.
+        void operator delete(void*) = delete;
 
         // Get the statement's classification
         Statement_classification classification() const
@@ -58,47 +59,49 @@ public:
         bool is_invalid() const
         { return (this->_classification == STATEMENT_INVALID); }
 
+        // Statement factories construct their statement in arena.
+
         // Make an invalid statement which resolves to a compiler error
-        static Statement* make_invalid(const Location& loc);
+        static Statement* make_invalid(Arena* arena, const Location& loc);
 
         // Make a variable declaration statement
-        static Statement* make_variable_declaration(Named_object* var);
+        static Statement* make_variable_declaration(Arena* arena, Named_object* var);
 
         // Make an assignment statement
         static Statement* make_assignment
-        (Expression* lhs, Expression* rhs, const Location& loc);
+        (Arena* arena, Expression* lhs, Expression* rhs, const Location& loc);
 
         // Increment/decrement statements
-        static Statement* make_inc(Expression* expr);
-        static Statement* make_dec(Expression* expr);
+        static Statement* make_inc(Arena* arena, Expression* expr);
+        static Statement* make_dec(Arena* arena, Expression* expr);
 
         // If statement that calls then_block if cond resolves to true
         static Statement* make_if
-        (Expression* cond, Scope* then_block, const Location& loc);
+        (Arena* arena, Expression* cond, Scope* then_block, const Location& loc);
 
         // Make a for statement
         static Statement* make_for
-        (Statement* ind, Statement* cond, Statement* inc, const Location& loc);
+        (Arena* arena, Statement* ind, Statement* cond, Statement* inc, const Location& loc);
 
         // Make an expression statement
-        static Statement* make_expression(Expression* expr, const Location& loc);
+        static Statement* make_expression(Arena* arena, Expression* expr, const Location& loc);
 
         static Statement* make_compound
-        (Statement* first, Statement* second, const Location& loc);
+        (Arena* arena, Statement* first, Statement* second, const Location& loc);
 
         // Make a return statement (expr may be NULL for void return)
-        static Statement* make_return(Expression* expr, const Location& loc);
+        static Statement* make_return(Arena* arena, Expression* expr, const Location& loc);
 
         // Make a function declaration statement
         static Statement* make_function
-        (const std::string& name, const std::vector<std::string>& params,
+        (Arena* arena, const std::string& name, const std::vector<std::string>& params,
          Scope* body, const Location& loc);
 
         // Make a break statement
-        static Statement* make_break(const Location& loc);
+        static Statement* make_break(Arena* arena, const Location& loc);
 
         // Make a continue statement
-        static Statement* make_continue(const Location& loc);
+        static Statement* make_continue(Arena* arena, const Location& loc);
 
         // Cast statements to their higher-order types
         Invalid_statement* invalid_statement()
@@ -192,8 +195,6 @@ public:
                   _lhs(lhs), _rhs(rhs)
         {}
 
-        ~Assignment_statement() override;
-
         // Return left hand side of assignment
         Expression* lhs() const
         { return this->_lhs; }
@@ -222,8 +223,6 @@ public:
                   _var(var)
         {}
 
-        ~Variable_declaration_statement() override {}
-
         Named_object* var()
         { return this->_var; }
 
@@ -233,7 +232,6 @@ protected:
         Bstatement* do_get_backend(Backend* backend) override;
 
 private:
-        // Not owned: Named_object is owned by the Scope's ident_map.
         Named_object* _var;
 };
 
@@ -246,8 +244,6 @@ public:
                   _then_block(then_block)
         {}
 
-        ~If_statement() override;
-
         Expression* condition() const
         { return this->_cond; }
 
@@ -264,9 +260,9 @@ protected:
         Bstatement* do_get_backend(Backend* backend) override;
 
 private:
-        Expression* _cond;         // Owned: condition expression
-        Scope*      _then_block;   // Not owned: managed by Backend scope stack
-        Scope*      _else_block = NULL;  // Owned if set: deleted in destructor
+        Expression* _cond;
+        Scope*      _then_block;
+        Scope*      _else_block = NULL;
 };
 
 // For-loop statement
@@ -279,8 +275,6 @@ public:
                   _ind(ind), _cond(cond), _inc(inc)
         {}
 
-        ~For_statement() override;
-
         void add_statements(Scope* statements)
         { this->_statements = statements; }
 
@@ -303,12 +297,12 @@ protected:
         Bstatement* do_get_backend(Backend* backend) override;
 
 private:
-        // Owned: induction, condition, increment statements (may be NULL).
+        // Induction, condition and increment statements (may be NULL).
         Statement* _ind;
         Statement* _cond;
         Statement* _inc;
 
-        // Owned: the loop body scope, set via add_statements() (may be NULL).
+        // The loop body scope, set via add_statements() (may be NULL).
         Scope* _statements = NULL;
 };
 
@@ -321,9 +315,6 @@ public:
                   _is_inc(is_inc), _expr(expr)
         {}
 
-        ~Inc_dec_statement() override
-        { delete this->_expr; }
-
         bool is_inc()
         { return this->_is_inc; }
 
@@ -351,9 +342,6 @@ public:
                   _expr(expr)
         {}
 
-        ~Expression_statement() override
-        { delete this->_expr; }
-
         Expression* expr()
         { return this->_expr; }
 
@@ -381,8 +369,6 @@ public:
                 _second = second;
         }
 
-        ~Compound_statement() override;
-
         // Return the first statement.
         Statement* first()
         { return this->_first; }
@@ -411,9 +397,6 @@ public:
                   _expr(expr)
         {}
 
-        ~Return_statement() override
-        { delete this->_expr; }
-
         // Return the expression (may be NULL for void return)
         Expression* expr() const
         { return this->_expr; }
@@ -436,9 +419,6 @@ public:
                   _name(name), _params(params), _body(body)
         {}
 
-        ~Function_declaration_statement() override
-        { delete this->_body; }
-
         // Return the function name
         const std::string& name() const
         { return this->_name; }
@@ -457,7 +437,7 @@ protected:
 private:
         std::string _name;
         std::vector<std::string> _params;
-        Scope* _body;  // Owned: function body scope, deleted in destructor
+        Scope* _body;
 };
 
 // A break statement exits the innermost loop
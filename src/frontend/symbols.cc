@@ -0,0 +1,154 @@
+// symbols.cc - Identifier interning
+#include "symbols.hpp"
+#include "backend.hpp"
+
+struct Symbol_entry {
+        std::string name;
+        uint32_t hash;
+};
+
+/*
+ * Interned names, indexed by symbol. Slot 0 backs NO_SYMBOL. A deque
+ * keeps the names returned by symbol_name() in place as it grows.
+ */
+static std::deque<Symbol_entry> __symbols__(1, Symbol_entry{ "", 0 });
+
+/*
+ * Open-addressing hash table of symbols, probed linearly. An empty slot
+ * holds NO_SYMBOL. The table is a power of two in size and kept at most
+ * half full.
+ */
+static std::vector<Symbol> __symbol_slots__(256, NO_SYMBOL);
+
+// Guards both tables; functions may be parsed on several threads at once.
+static std::mutex __symbols_lock__;
+
+// FNV-1a
+static uint32_t hash_name(const char* name, size_t len)
+{
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < len; i++) {
+                hash ^= (unsigned char)name[i];
+                hash *= 16777619u;
+        }
+        return hash;
+}
+
+static void grow_symbol_slots()
+{
+        std::vector<Symbol> slots(__symbol_slots__.size() * 2, NO_SYMBOL);
+        size_t mask = slots.size() - 1;
+
+        for (Symbol sym = 1; sym < __symbols__.size(); sym++) {
+                size_t i = __symbols__[sym].hash & mask;
+                while (slots[i] != NO_SYMBOL)
+                        i = (i + 1) & mask;
+                slots[i] = sym;
+        }
+
+        __symbol_slots__.swap(slots);
+}
+
+Symbol intern(const char* name, size_t len)
+{
+        uint32_t hash = hash_name(name, len);
+        std::lock_guard<std::mutex> lock(__symbols_lock__);
+        size_t mask = __symbol_slots__.size() - 1;
+
+        size_t i = hash & mask;
+        for (; __symbol_slots__[i] != NO_SYMBOL; i = (i + 1) & mask) {
+                const Symbol_entry& entry = __symbols__[__symbol_slots__[i]];
+                if (entry.hash == hash && entry.name.size() == len &&
+                    memcmp(entry.name.data(), name, len) == 0)
+                        return __symbol_slots__[i];
+        }
+
+        RIN_ASSERT(__symbols__.size() < UINT32_MAX);
+        Symbol sym = __symbols__.size();
+        __symbols__.push_back(Symbol_entry{ std::string(name, len), hash });
+        __symbol_slots__[i] = sym;
+
+        if (__symbols__.size() * 2 > __symbol_slots__.size())
+                grow_symbol_slots();
+
+        return sym;
+}
+
+Symbol intern(const std::string& name)
+{ return intern(name.data(), name.size()); }
+
+const std::string& symbol_name(Symbol sym)
+{
+        std::lock_guard<std::mutex> lock(__symbols_lock__);
+        RIN_ASSERT(sym < __symbols__.size());
+        return __symbols__[sym].name;
+}
+
+// Fibonacci hashing spreads consecutive symbols across the table.
+static size_t symbol_hash(Symbol sym)
+{ return sym * 2654435769u; }
+
+Symbol_table::Symbol_table()
+        : slots(64, Slot{ NO_SYMBOL, NULL })
+{}
+
+const Symbol_table::Slot& Symbol_table::slot(Symbol sym) const
+{
+        size_t mask = this->slots.size() - 1;
+        size_t i = symbol_hash(sym) & mask;
+        while (this->slots[i].sym != sym && this->slots[i].sym != NO_SYMBOL)
+                i = (i + 1) & mask;
+        return this->slots[i];
+}
+
+Symbol_table::Slot& Symbol_table::slot(Symbol sym)
+{
+        const Symbol_table* self = this;
+        return const_cast<Slot&>(self->slot(sym));
+}
+
+void Symbol_table::grow()
+{
+        std::vector<Slot> old(this->slots.size() * 2, Slot{ NO_SYMBOL, NULL });
+        old.swap(this->slots);
+
+        for (const Slot& entry : old) {
+                if (entry.sym != NO_SYMBOL)
+                        this->slot(entry.sym) = entry;
+        }
+}
+
+Named_object* Symbol_table::lookup(Symbol sym) const
+{
+        return this->slot(sym).obj;
+}
+
+void Symbol_table::bind(Symbol sym, Named_object* obj)
+{
+        RIN_ASSERT(sym != NO_SYMBOL);
+
+        Slot* entry = &this->slot(sym);
+        if (entry->sym == NO_SYMBOL) {
+                // Slots are never freed; unwinding only clears the binding.
+                if ((this->used + 1) * 2 > this->slots.size()) {
+                        this->grow();
+                        entry = &this->slot(sym);
+                }
+                entry->sym = sym;
+                entry->obj = NULL;
+                this->used++;
+        }
+
+        this->undo_log.push_back(Undo{ sym, entry->obj });
+        entry->obj = obj;
+}
+
+void Symbol_table::unwind(size_t mark)
+{
+        RIN_ASSERT(mark <= this->undo_log.size());
+        while (this->undo_log.size() > mark) {
+                const Undo& undo = this->undo_log.back();
+                this->slot(undo.sym).obj = undo.shadowed;
+                this->undo_log.pop_back();
+        }
+}
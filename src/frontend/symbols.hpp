@@ -0,0 +1,78 @@
+// symbols.hpp - Identifier interning
+#ifndef RIN_SYMBOLS_HPP
+#define RIN_SYMBOLS_HPP
+
+#include <rin-system.hpp>
+
+/*
+ * A symbol is the id of an interned identifier. Interning the same name
+ * twice returns the same symbol, so identifiers can be compared and hashed
+ * as plain integers once the scanner has interned them. Symbol 0 is never
+ * handed out and stands for "no symbol".
+ */
+typedef uint32_t Symbol;
+
+#define NO_SYMBOL ((Symbol)0)
+
+// Return the symbol for name, interning it if it is new.
+Symbol intern(const char* name, size_t len);
+Symbol intern(const std::string& name);
+
+// Return the name a symbol was interned from.
+const std::string& symbol_name(Symbol sym);
+
+class Named_object;
+
+/*
+ * Maps each symbol to its innermost binding across every open scope, in
+ * a single open-addressing hash table, so resolving a name costs the same
+ * at any nesting depth. Each bind() records the binding it shadows in an
+ * undo log; unwind() replays the log back to an earlier mark(), which is
+ * how leaving a scope restores the bindings of its parent.
+ */
+class Symbol_table
+{
+public:
+        Symbol_table();
+
+        Symbol_table(const Symbol_table&) = delete;
+        Symbol_table& operator=(const Symbol_table&) = delete;
+
+        // Return the innermost binding of sym, or NULL.
+        Named_object* lookup(Symbol sym) const;
+
+        // Bind sym to obj, shadowing any outer binding.
+        void bind(Symbol sym, Named_object* obj);
+
+        // Return a mark for the current state of the table.
+        size_t mark() const
+        { return this->undo_log.size(); }
+
+        // Undo every bind() made since mark was taken.
+        void unwind(size_t mark);
+
+private:
+        struct Slot {
+                Symbol        sym;
+                Named_object* obj;
+        };
+
+        struct Undo {
+                Symbol        sym;
+                Named_object* shadowed;
+        };
+
+        // Return the slot holding sym, or the empty slot it belongs in.
+        Slot& slot(Symbol sym);
+        const Slot& slot(Symbol sym) const;
+
+        void grow();
+
+        // A power of two in size; a slot with NO_SYMBOL is empty.
+        std::vector<Slot> slots;
+        size_t used = 0;
+
+        std::vector<Undo> undo_log;
+};
+
+#endif /* RIN_SYMBOLS_HPP */
@@ -0,0 +1,319 @@
+// token-cache.cc - On-disk cache of lexed token streams
+#include "token-cache.hpp"
+
+#include <cstdio>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char __cache_magic__[8] = { 'R', 'I', 'N', 'T', 'O', 'K', 'S', '\n' };
+
+struct Cache_header {
+        char     magic[8];
+        uint32_t version;
+        uint32_t lines;         // entries in the line table
+        uint64_t source_hash;
+        uint64_t source_size;
+        uint64_t line_bytes;    // size of the encoded line table
+        uint64_t checksum;      // hash of everything after the header
+};
+
+// Names the temporary files entries are written to, unique per process.
+static std::atomic<unsigned> __temp_counter__(0);
+
+static void put_varint(std::string& out, uint32_t val)
+{
+        while (val >= 0x80) {
+                out.push_back((char)(val | 0x80));
+                val >>= 7;
+        }
+        out.push_back((char)val);
+}
+
+static uint32_t get_varint(const uint8_t** p)
+{
+        const uint8_t* q = *p;
+        uint32_t val = *q & 0x7f;
+        for (unsigned shift = 7; *q++ & 0x80; shift += 7)
+                val |= (uint32_t)(*q & 0x7f) << shift;
+        *p = q;
+        return val;
+}
+
+// As get_varint(), but fails rather than read end or past it.
+static bool get_varint_checked(const uint8_t** p, const uint8_t* end, uint32_t* val)
+{
+        const uint8_t* q = *p;
+        uint32_t v = 0;
+        for (unsigned shift = 0; q < end && shift < 35; shift += 7) {
+                v |= (uint32_t)(*q & 0x7f) << shift;
+                if (!(*q++ & 0x80)) {
+                        *val = v;
+                        *p = q;
+                        return true;
+                }
+        }
+        return false;
+}
+
+/*
+ * One multiply per eight bytes, then a final mix. This is not meant to
+ * withstand a chosen collision, only to tell edited sources apart; the
+ * size is checked as well.
+ */
+uint64_t Token_cache::hash(const char* data, size_t size)
+{
+        const uint64_t k = 0xff51afd7ed558ccdull;
+        uint64_t h = 0x9e3779b97f4a7c15ull ^ size;
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+                uint64_t w;
+                memcpy(&w, data + i, 8);
+                h = (h ^ w) * k;
+                h ^= h >> 32;
+        }
+
+        uint64_t w = 0;
+        memcpy(&w, data + i, size - i);
+        h = (h ^ w) * k;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return h;
+}
+
+std::string Token_cache::path(uint64_t hash) const
+{
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.rintok", (unsigned long long)hash);
+        return this->_dir + "/" + name;
+}
+
+// Read path whole, mapped if it can be. Returns false if it cannot be read.
+static bool read_entry(const std::string& path, const char** data, size_t* size,
+                       std::string* owned)
+{
+#ifndef _WIN32
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+                return false;
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+                void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                ::close(fd);
+                if (map == MAP_FAILED)
+                        return false;
+                *data = static_cast<const char*>(map);
+                *size = st.st_size;
+                return true;
+        }
+        ::close(fd);
+        return false;
+#else
+        std::ifstream stream(path, std::ifstream::in | std::ifstream::binary);
+        if (!stream.is_open())
+                return false;
+        owned->assign(std::istreambuf_iterator<char>(stream),
+                      std::istreambuf_iterator<char>());
+        *data = NULL;
+        *size = 0;
+        return true;
+#endif
+}
+
+Cached_tokens* Token_cache::find(uint64_t hash, size_t size) const
+{
+        Cached_tokens* tokens = new Cached_tokens;
+        if (!read_entry(this->path(hash), &tokens->_map, &tokens->_map_size, &tokens->_owned)) {
+                delete tokens;
+                return NULL;
+        }
+
+        const char* data = (tokens->_map) ? tokens->_map : tokens->_owned.data();
+        size_t entry_size = (tokens->_map) ? tokens->_map_size : tokens->_owned.size();
+
+        Cache_header header;
+        if (entry_size < sizeof(header)) {
+                delete tokens;
+                return NULL;
+        }
+        memcpy(&header, data, sizeof(header));
+
+        const uint8_t* p = (const uint8_t*)data + sizeof(header);
+        const uint8_t* end = (const uint8_t*)data + entry_size;
+        if (memcmp(header.magic, __cache_magic__, sizeof(header.magic)) != 0
+            || header.version != FORMAT_VERSION
+            || header.source_hash != hash || header.source_size != size
+            || header.line_bytes >= (uint64_t)(end - p)
+            || header.checksum != Token_cache::hash((const char*)p, end - p)) {
+                delete tokens;
+                return NULL;
+        }
+
+        // Line starts rise from 0 and stay within the source.
+        const uint8_t* lines_end = p + header.line_bytes;
+        tokens->_line_starts.reserve(header.lines);
+        uint64_t line = 0;
+        for (uint32_t i = 0; i < header.lines; i++) {
+                uint32_t delta;
+                if (!get_varint_checked(&p, lines_end, &delta) || line + delta > size) {
+                        delete tokens;
+                        return NULL;
+                }
+                line += delta;
+                tokens->_line_starts.push_back(line);
+        }
+        if (p != lines_end || tokens->_line_starts.empty() || tokens->_line_starts[0] != 0) {
+                delete tokens;
+                return NULL;
+        }
+
+        tokens->_begin = tokens->_pos = p;
+        tokens->_end = end;
+        return tokens;
+}
+
+Cached_tokens* Token_cache::store(uint64_t hash, size_t size,
+                                  std::vector<uint32_t> line_starts, Encoder* encoder) const
+{
+        std::string lines;
+        uint32_t last = 0;
+        for (uint32_t start : line_starts) {
+                put_varint(lines, start - last);
+                last = start;
+        }
+
+        Cached_tokens* tokens = new Cached_tokens;
+        std::string& entry = tokens->_owned;
+        entry.resize(sizeof(Cache_header));
+        entry += lines;
+        entry += encoder->bytes();
+
+        Cache_header header;
+        memcpy(header.magic, __cache_magic__, sizeof(header.magic));
+        header.version = FORMAT_VERSION;
+        header.lines = line_starts.size();
+        header.source_hash = hash;
+        header.source_size = size;
+        header.line_bytes = lines.size();
+        header.checksum = Token_cache::hash(entry.data() + sizeof(header),
+                                            entry.size() - sizeof(header));
+        memcpy(&entry[0], &header, sizeof(header));
+
+        std::string path = this->path(hash);
+        std::string temp = path + ".tmp";
+#ifndef _WIN32
+        temp += "." + std::to_string(getpid());
+#endif
+        temp += "." + std::to_string(__temp_counter__++);
+
+        std::ofstream out(temp, std::ofstream::out | std::ofstream::binary);
+        if (out.is_open()) {
+                out.write(entry.data(), entry.size());
+                out.close();
+                if (!out || rename(temp.c_str(), path.c_str()) != 0)
+                        remove(temp.c_str());
+        }
+
+        tokens->_begin = (const uint8_t*)entry.data() + sizeof(header) + lines.size();
+        tokens->_pos = tokens->_begin;
+        tokens->_end = (const uint8_t*)entry.data() + entry.size();
+        tokens->_line_starts.swap(line_starts);
+        return tokens;
+}
+
+// Token_cache::Encoder implementation:
+
+void Token_cache::Encoder::add(const Token& tok)
+{
+        std::string& out = this->_bytes;
+        out.push_back((char)tok.classification());
+        put_varint(out, tok.offset() - this->_last_end);
+        put_varint(out, tok.length());
+        this->_last_end = tok.offset() + tok.length();
+
+        switch (tok.classification()) {
+        case Token::TOKEN_RID:
+                out.push_back((char)tok.rid());
+                break;
+        case Token::TOKEN_OPERATOR:
+                out.push_back((char)tok.op());
+                break;
+        case Token::TOKEN_IDENT: {
+                auto added = this->_identifiers.emplace(tok.symbol(), this->_identifiers.size());
+                put_varint(out, added.first->second);
+                break;
+        }
+        default:
+                break;
+        }
+}
+
+// Cached_tokens implementation:
+
+Cached_tokens::~Cached_tokens()
+{
+#ifndef _WIN32
+        if (this->_map)
+                munmap(const_cast<char*>(this->_map), this->_map_size);
+#endif
+}
+
+Token Cached_tokens::next(const File& src)
+{
+        RIN_ASSERT(this->has_next());
+
+        const uint8_t* p = this->_pos;
+        unsigned classification = *p++;
+        uint32_t offset = this->_last_end + get_varint(&p);
+        uint32_t length = get_varint(&p);
+        RIN_ASSERT(offset + length <= (uint32_t)(src.end() - src.begin()));
+
+        Location loc;
+        loc.source = src.id();
+        loc.offset = offset + length;
+        this->_last_end = loc.offset;
+
+        Token tok;
+        switch (classification) {
+        case Token::TOKEN_EOF:
+                tok = Token::make_eof_token(loc);
+                break;
+        case Token::TOKEN_EOL:
+                tok = Token::make_eol_token(loc);
+                break;
+        case Token::TOKEN_RID:
+                tok = Token::make_rid_token((RID)*p++, loc, length);
+                break;
+        case Token::TOKEN_OPERATOR:
+                tok = Token::make_operator_token((RIN_OPERATOR)*p++, loc, length);
+                break;
+        case Token::TOKEN_INTEGER:
+                tok = Token::make_integer_token(loc, length);
+                break;
+        case Token::TOKEN_FLOAT:
+                tok = Token::make_float_token(loc, length);
+                break;
+        case Token::TOKEN_IDENT: {
+                uint32_t index = get_varint(&p);
+                if (index == this->_identifiers.size())
+                        this->_identifiers.push_back(intern(src.begin() + offset, length));
+                RIN_ASSERT(index < this->_identifiers.size());
+                tok = Token::make_ident_token(this->_identifiers[index], loc, length);
+                break;
+        }
+        case Token::TOKEN_INVALID:
+                tok = Token::make_invalid_token(loc, length);
+                break;
+        default:
+                RIN_UNREACHABLE();
+        }
+
+        this->_pos = p;
+        return tok;
+}
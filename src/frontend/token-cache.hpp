@@ -0,0 +1,134 @@
+// token-cache.hpp - On-disk cache of lexed token streams
+#ifndef RIN_TOKEN_CACHE_HPP
+#define RIN_TOKEN_CACHE_HPP
+
+#include "scanner.hpp"
+
+class Cached_tokens;
+
+/*
+ * A token cache keeps, in a directory, the token stream and line table of
+ * every source it is handed, one entry per source content. An entry is
+ * named after a hash of the source's text, so an unchanged source finds
+ * its entry whatever its path, and an edited one misses. A scanner given a
+ * cache (see Scanner(path, cache)) replays the entry's tokens instead of
+ * lexing; on a miss it lexes the source once and stores what it read.
+ *
+ * An entry is used only if its format version, the hash and size of its
+ * source, and a checksum of its own contents all match; anything else is
+ * a miss, and the entry is written again. Entries are read through mmap,
+ * and written to a temporary file that is renamed over the entry, so a
+ * compilation never sees another's half-written entry.
+ *
+ * An entry is, in host byte order:
+ *
+ *      Cache_header            (see token-cache.cc)
+ *      line table              varint deltas between line starts
+ *      tokens                  one record per token, the last is EOF
+ *
+ * A token record is its classification (one byte), the varint gap from the
+ * end of the token before it, its varint length, and its payload: the RID
+ * or operator (one byte), or for identifiers a varint index into the
+ * identifiers seen so far, where the next new index marks a first sighting.
+ * Identifier text is not stored; it is read back from the source, so each
+ * identifier is interned once per replay rather than once per token.
+ */
+class Token_cache
+{
+public:
+        // Bump on any change to the encoding, or to the RID and operator values.
+        static const uint32_t FORMAT_VERSION = 1;
+
+        explicit Token_cache(const std::string& dir) : _dir(dir) {}
+
+        const std::string& dir() const
+        { return this->_dir; }
+
+        // Hash a source's text: the key of its entry.
+        static uint64_t hash(const char* data, size_t size);
+
+        // The path of the entry for sources with this hash.
+        std::string path(uint64_t hash) const;
+
+        // Return the stored tokens of a source with this hash and size, or NULL.
+        Cached_tokens* find(uint64_t hash, size_t size) const;
+
+        /*
+         * Encodes a token stream, a token at a time, for store(). Tokens
+         * must be added in source order, up to and including the EOF token.
+         */
+        class Encoder
+        {
+        public:
+                void add(const Token& tok);
+
+                std::string& bytes()
+                { return this->_bytes; }
+
+        private:
+                std::string _bytes;
+                uint32_t _last_end = 0;
+                std::unordered_map<Symbol, uint32_t> _identifiers;
+        };
+
+        /*
+         * Store tokens, encoded from a source with this hash and size, and
+         * line_starts, its line table, and return them to be read back.
+         * The entry is written as well as it can be: a cache that cannot be
+         * written to is not an error, it just never hits.
+         */
+        Cached_tokens* store(uint64_t hash, size_t size,
+                             std::vector<uint32_t> line_starts, Encoder* tokens) const;
+
+private:
+        std::string _dir;
+};
+
+// The tokens of one source, from a token cache, read back in order.
+class Cached_tokens
+{
+public:
+        ~Cached_tokens();
+
+        Cached_tokens(const Cached_tokens&) = delete;
+        Cached_tokens& operator=(const Cached_tokens&) = delete;
+
+        // The source's line table; File::publish() may take it.
+        std::vector<uint32_t>* line_starts()
+        { return &this->_line_starts; }
+
+        bool has_next() const
+        { return this->_pos < this->_end; }
+
+        // Decode the next token, which was scanned from src.
+        Token next(const File& src);
+
+        // Replay the tokens again from the first.
+        void rewind()
+        {
+                this->_pos = this->_begin;
+                this->_last_end = 0;
+                this->_identifiers.clear();
+        }
+
+private:
+        friend class Token_cache;
+        Cached_tokens() {}
+
+        // The entry's bytes, mapped or owned.
+        const char* _map = NULL;
+        size_t _map_size = 0;
+        std::string _owned;
+
+        // Token records not yet read, and where the token before them ended.
+        const uint8_t* _begin = NULL;
+        const uint8_t* _pos = NULL;
+        const uint8_t* _end = NULL;
+        uint32_t _last_end = 0;
+
+        // Identifiers by index, as they were first sighted.
+        std::vector<Symbol> _identifiers;
+        std::vector<uint32_t> _line_starts;
+};
+
+#endif // RIN_TOKEN_CACHE_HPP
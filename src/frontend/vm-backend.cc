@@ -0,0 +1,1686 @@
+// vm-backend.cc - A backend that compiles programs to register bytecode
+#include "vm-backend.hpp"
+#include "file.hpp"
+#include "vm-jit.hpp"
+
+#include <algorithm>
+
+/*
+ * Dispatch jumps straight from one instruction's handler to the next
+ * through a table of label addresses where the compiler allows it, and
+ * through a switch elsewhere.
+ */
+#if defined(__GNUC__)
+#define VM_THREADED 1
+#endif
+
+// What is known of a value before the program runs.
+enum Vm_type : uint8_t {
+        TYPE_NONE,      // nothing yet
+        TYPE_INT,
+        TYPE_FLOAT,
+        TYPE_DYNAMIC    // either
+};
+
+static Vm_type widen(Vm_type a, Vm_type b)
+{
+        if (a == b || b == TYPE_NONE)
+                return a;
+        return (a == TYPE_NONE) ? b : TYPE_DYNAMIC;
+}
+
+/*
+ * A variable lives in slot of the globals, unless owner is a function, in
+ * which case it lives in slot of the frame of the function's current call.
+ */
+struct Vm_variable {
+        Vm_variable(Named_object* obj, Scope* scope) : obj(obj), scope(scope) {}
+
+        Named_object* obj;
+
+        // The scope the variable was first seen in.
+        Scope* scope;
+
+        // The index of the function it belongs to, or 0 for a global.
+        uint32_t owner = 0;
+        uint32_t slot = 0;
+        Vm_type type = TYPE_NONE;
+};
+
+/*
+ * The compiler walks nodes by recursion, so each records how deeply it
+ * nests, as in the interpreter. The backend reports code nested deeper
+ * than Vm_backend::MAX_DEPTH as it is built.
+ */
+struct Vm_expression {
+        enum Kind : uint8_t {
+                EXPR_CONSTANT,
+                EXPR_VARIABLE,
+                EXPR_UNARY,
+                EXPR_BINARY,
+                EXPR_CALL,
+                EXPR_INVALID
+        };
+
+        Vm_expression(Kind kind, const Location& loc, uint32_t depth = 0)
+                : kind(kind), location(loc), depth(depth)
+        {}
+
+        Kind kind;
+        Location location;
+        uint32_t depth;
+};
+
+struct Vm_constant : Vm_expression {
+        Vm_constant(Interp_value value, const Location& loc)
+                : Vm_expression(EXPR_CONSTANT, loc), value(value)
+        {}
+
+        Interp_value value;
+};
+
+struct Vm_reference : Vm_expression {
+        Vm_reference(Vm_variable* var, const Location& loc)
+                : Vm_expression(EXPR_VARIABLE, loc), var(var)
+        {}
+
+        Vm_variable* var;
+};
+
+// A unary operation has no right operand.
+struct Vm_operation : Vm_expression {
+        Vm_operation(RIN_OPERATOR op, Vm_expression* left, Vm_expression* right,
+                     const Location& loc)
+                : Vm_expression((right) ? EXPR_BINARY : EXPR_UNARY, loc,
+                                (right) ? std::max(left->depth, right->depth) + 1
+                                        : left->depth + 1),
+                  op(op), left(left), right(right)
+        {}
+
+        RIN_OPERATOR op;
+        Vm_expression* left;
+        Vm_expression* right;
+};
+
+struct Vm_call : Vm_expression {
+        Vm_call(const std::string& name, const Location& loc)
+                : Vm_expression(EXPR_CALL, loc), name(name)
+        {}
+
+        std::string name;
+        std::vector<Vm_expression*> args;
+};
+
+struct Vm_statement {
+        enum Kind : uint8_t {
+                STMT_DECLARE,
+                STMT_ASSIGN,
+                STMT_STEP,
+                STMT_EXPRESSION,
+                STMT_IF,
+                STMT_FOR,
+                STMT_COMPOUND,
+                STMT_RETURN,
+                STMT_BREAK,
+                STMT_CONTINUE,
+                STMT_NOTHING,
+                STMT_INVALID
+        };
+
+        Vm_statement(Kind kind, const Location& loc, uint32_t depth = 0)
+                : kind(kind), location(loc), depth(depth)
+        {}
+
+        Kind kind;
+        Location location;
+        uint32_t depth;
+};
+
+// Declarations, assignments and steps of a variable.
+struct Vm_store : Vm_statement {
+        Vm_store(Kind kind, Vm_variable* var, Vm_expression* value, int step,
+                 const Location& loc)
+                : Vm_statement(kind, loc, (value) ? value->depth : 0),
+                  var(var), value(value), step(step)
+        {}
+
+        Vm_variable* var;
+        Vm_expression* value;
+        int step;
+};
+
+// Expression statements and returns.
+struct Vm_evaluate : Vm_statement {
+        Vm_evaluate(Kind kind, Vm_expression* expr, const Location& loc)
+                : Vm_statement(kind, loc, (expr) ? expr->depth : 0), expr(expr)
+        {}
+
+        Vm_expression* expr;
+};
+
+// If statements and loops. A loop's condition may be missing.
+struct Vm_branch : Vm_statement {
+        Vm_branch(Kind kind, Vm_expression* cond, const Location& loc)
+                : Vm_statement(kind, loc, (cond) ? cond->depth : 0), cond(cond)
+        {}
+
+        Vm_expression* cond;
+        std::vector<Vm_statement*> then_block;
+        std::vector<Vm_statement*> else_block;
+
+        // A loop's induction and increment, either of which may be missing.
+        Vm_statement* ind = NULL;
+        Vm_statement* inc = NULL;
+};
+
+struct Vm_compound : Vm_statement {
+        Vm_compound(Vm_statement* first, Vm_statement* second, const Location& loc)
+                : Vm_statement(STMT_COMPOUND, loc, std::max(first->depth, second->depth)),
+                  first(first), second(second)
+        {}
+
+        Vm_statement* first;
+        Vm_statement* second;
+};
+
+/*
+ * The backend types are incomplete in the frontend, so nodes are handed
+ * to the parser, and back, through casts.
+ */
+static Bexpression* bexpression(Vm_expression* expr)
+{ return reinterpret_cast<Bexpression*>(expr); }
+
+static Vm_expression* node(Bexpression* expr)
+{ return reinterpret_cast<Vm_expression*>(expr); }
+
+static Bstatement* bstatement(Vm_statement* stmt)
+{ return reinterpret_cast<Bstatement*>(stmt); }
+
+static Vm_statement* node(Bstatement* stmt)
+{ return reinterpret_cast<Vm_statement*>(stmt); }
+
+static Bvariable* bvariable(Vm_variable* var)
+{ return reinterpret_cast<Bvariable*>(var); }
+
+static Vm_variable* node(Bvariable* var)
+{ return reinterpret_cast<Vm_variable*>(var); }
+
+// The depth of the deepest statement of list, or at least depth.
+static uint32_t deepest(const std::vector<Vm_statement*>& list, uint32_t depth)
+{
+        for (auto itr = list.begin(); itr != list.end(); ++itr)
+                depth = std::max(depth, (*itr)->depth);
+        return depth;
+}
+
+// Report e if it is the first node on its path nested deeper than compile() can walk.
+static Vm_expression* check_depth(Vm_expression* e)
+{
+        if (e->depth == Vm_backend::MAX_DEPTH + 1)
+                rin_error_at(e->location, "Expression nesting exceeds the VM's limit of %u",
+                             Vm_backend::MAX_DEPTH);
+        return e;
+}
+
+static Vm_statement* check_depth(Vm_statement* s)
+{
+        if (s->depth == Vm_backend::MAX_DEPTH + 1)
+                rin_error_at(s->location, "Block nesting exceeds the VM's limit of %u",
+                             Vm_backend::MAX_DEPTH);
+        return s;
+}
+
+const char* vm_opcode_name(Vm_opcode op)
+{
+#define VM_OPCODE_NAME(name) #name,
+        static const char* const names[] = { VM_OPCODES(VM_OPCODE_NAME) };
+#undef VM_OPCODE_NAME
+        return (op < VM_OPCODE_COUNT) ? names[op] : "?";
+}
+
+static bool is_comparison(RIN_OPERATOR op)
+{
+        return op == OPER_EQL || op == OPER_NEQ || op == OPER_LSS
+                || op == OPER_GTR || op == OPER_LEQ || op == OPER_GEQ;
+}
+
+static bool is_arithmetic(RIN_OPERATOR op)
+{
+        return op == OPER_ADD || op == OPER_SUB || op == OPER_MUL
+                || op == OPER_QUO || op == OPER_REM;
+}
+
+// The type an expression's value may have, given its variables' types.
+static Vm_type type_of(const Vm_expression* e)
+{
+        switch (e->kind) {
+        case Vm_expression::EXPR_CONSTANT:
+                return (static_cast<const Vm_constant*>(e)->value.is_float()) ?
+                        TYPE_FLOAT : TYPE_INT;
+        case Vm_expression::EXPR_VARIABLE:
+                return static_cast<const Vm_reference*>(e)->var->type;
+        case Vm_expression::EXPR_UNARY: {
+                const Vm_operation* n = static_cast<const Vm_operation*>(e);
+                return (n->op == OPER_NEG) ? type_of(n->left) : TYPE_INT;
+        }
+        case Vm_expression::EXPR_BINARY: {
+                const Vm_operation* n = static_cast<const Vm_operation*>(e);
+                if (!is_arithmetic(n->op))
+                        return TYPE_INT;
+
+                Vm_type a = type_of(n->left);
+                Vm_type b = type_of(n->right);
+                if (a == TYPE_NONE || b == TYPE_NONE)
+                        return TYPE_NONE;
+                if (a == TYPE_DYNAMIC || b == TYPE_DYNAMIC)
+                        return TYPE_DYNAMIC;
+                return (a == TYPE_INT && b == TYPE_INT) ? TYPE_INT : TYPE_FLOAT;
+        }
+        default:
+                return TYPE_DYNAMIC;
+        }
+}
+
+// Whether e reads var.
+static bool mentions(const Vm_expression* e, const Vm_variable* var)
+{
+        switch (e->kind) {
+        case Vm_expression::EXPR_VARIABLE:
+                return static_cast<const Vm_reference*>(e)->var == var;
+        case Vm_expression::EXPR_UNARY:
+        case Vm_expression::EXPR_BINARY: {
+                const Vm_operation* n = static_cast<const Vm_operation*>(e);
+                return mentions(n->left, var) || (n->right && mentions(n->right, var));
+        }
+        case Vm_expression::EXPR_CALL: {
+                // A call may read any global.
+                const std::vector<Vm_expression*>& args = static_cast<const Vm_call*>(e)->args;
+                return var->owner == 0 || std::any_of(args.begin(), args.end(),
+                        [var](const Vm_expression* arg) { return mentions(arg, var); });
+        }
+        default:
+                return false;
+        }
+}
+
+static void find_zeroes(const Vm_statement* s, const Vm_statement* next,
+                        std::vector<const Vm_store*>* zeroes);
+
+/*
+ * Every declaration of body, its loop headers and the blocks nested in it,
+ * whose integer zero may be read: all but those the next statement assigns
+ * without reading, as an initialized variable's declaration is.
+ */
+static void find_zeroes(const std::vector<Vm_statement*>& body, std::vector<const Vm_store*>* zeroes)
+{
+        for (size_t i = 0; i < body.size(); i++)
+                find_zeroes(body[i], (i + 1 < body.size()) ? body[i + 1] : NULL, zeroes);
+}
+
+static void find_zeroes(const Vm_statement* s, const Vm_statement* next,
+                        std::vector<const Vm_store*>* zeroes)
+{
+        switch (s->kind) {
+        case Vm_statement::STMT_DECLARE: {
+                const Vm_store* d = static_cast<const Vm_store*>(s);
+                const Vm_store* a = static_cast<const Vm_store*>(next);
+                if (!a || a->kind != Vm_statement::STMT_ASSIGN || a->var != d->var
+                    || mentions(a->value, a->var))
+                        zeroes->push_back(d);
+                return;
+        }
+        case Vm_statement::STMT_COMPOUND: {
+                const Vm_compound* c = static_cast<const Vm_compound*>(s);
+                find_zeroes(c->first, c->second, zeroes);
+                find_zeroes(c->second, NULL, zeroes);
+                return;
+        }
+        case Vm_statement::STMT_IF:
+        case Vm_statement::STMT_FOR: {
+                const Vm_branch* b = static_cast<const Vm_branch*>(s);
+                if (b->ind)
+                        find_zeroes(b->ind, NULL, zeroes);
+                if (b->inc)
+                        find_zeroes(b->inc, NULL, zeroes);
+                find_zeroes(b->then_block, zeroes);
+                find_zeroes(b->else_block, zeroes);
+                return;
+        }
+        default:
+                return;
+        }
+}
+
+// --- Compilation ---
+
+// Compiles the statements of one function, or of the top level, to bytecode.
+class Vm_compiler
+{
+public:
+        Vm_compiler(Vm_function* fn, uint32_t index, uint32_t first_temp,
+                    const std::vector<Vm_function*>& functions,
+                    const std::unordered_map<std::string, uint32_t>& function_index)
+                : _fn(fn), _index(index), _first_temp(first_temp),
+                  _temp(first_temp), _max_temp(first_temp),
+                  _functions(functions), _function_index(function_index)
+        {}
+
+        void compile(const std::vector<Vm_statement*>& body)
+        {
+                this->block(body);
+                this->emit(VM_RET0, 0, 0, 0, this->_fn->location);
+                this->_fn->first_temp = this->_first_temp;
+                this->_fn->frame_size = this->_max_temp;
+        }
+
+private:
+        Vm_function* _fn;
+        uint32_t _index;
+
+        // Temporaries are handed out upwards from _first_temp, a statement at a time.
+        uint32_t _first_temp;
+        uint32_t _temp;
+        uint32_t _max_temp;
+
+        const std::vector<Vm_function*>& _functions;
+        const std::unordered_map<std::string, uint32_t>& _function_index;
+
+        // The jumps out of each loop being compiled, to patch once its end is known.
+        struct Loop {
+                std::vector<size_t> breaks;
+                std::vector<size_t> continues;
+        };
+        std::vector<Loop> _loops;
+
+        size_t emit(Vm_opcode op, uint32_t a, uint32_t b, uint32_t c, const Location& loc,
+                    RIN_OPERATOR oper = OPER_ILLEGAL)
+        {
+                Vm_instruction ins;
+                ins.op = op;
+                ins.oper = (uint8_t)oper;
+                ins.unused = 0;
+                ins.a = a;
+                ins.b = b;
+                ins.c = c;
+                this->_fn->code.push_back(ins);
+                this->_fn->locations.push_back(loc);
+                return this->_fn->code.size() - 1;
+        }
+
+        size_t here() const
+        { return this->_fn->code.size(); }
+
+        // Point the jump at from to target.
+        void patch(size_t from, size_t target)
+        {
+                Vm_instruction& ins = this->_fn->code[from];
+                if (ins.op == VM_JMP)
+                        ins.a = target;
+                else
+                        ins.b = target;
+        }
+
+        uint32_t temp()
+        {
+                uint32_t reg = this->_temp++;
+                this->_max_temp = std::max(this->_max_temp, this->_temp);
+                return reg;
+        }
+
+        uint32_t constant(Interp_value value)
+        {
+                this->_fn->constants.push_back(value);
+                return this->_fn->constants.size() - 1;
+        }
+
+        void error(const Location& loc, const std::string& message)
+        {
+                this->_fn->messages.push_back(message);
+                this->emit(VM_ERROR, this->_fn->messages.size() - 1, 0, 0, loc);
+        }
+
+        // Whether var is a register of this code's frame, rather than a global.
+        bool in_frame(const Vm_variable* var, const Location& loc)
+        {
+                if (var->owner == this->_index)
+                        return true;
+                if (var->owner != 0) {
+                        this->error(loc, "'" + var->obj->identifier()
+                                    + "' belongs to an enclosing function");
+                }
+                return false;
+        }
+
+        // Return a register holding e's value, which may be a variable's own.
+        uint32_t expression(const Vm_expression* e)
+        {
+                if (e->kind == Vm_expression::EXPR_VARIABLE) {
+                        const Vm_variable* var = static_cast<const Vm_reference*>(e)->var;
+                        if (this->in_frame(var, e->location))
+                                return var->slot;
+                }
+
+                uint32_t reg = this->temp();
+                this->expression_into(e, reg);
+                return reg;
+        }
+
+        // Evaluate e into dest, which is only written once e's operands are read.
+        void expression_into(const Vm_expression* e, uint32_t dest)
+        {
+                switch (e->kind) {
+                case Vm_expression::EXPR_CONSTANT:
+                        this->emit(VM_LOADK, dest,
+                                   this->constant(static_cast<const Vm_constant*>(e)->value),
+                                   0, e->location);
+                        return;
+                case Vm_expression::EXPR_VARIABLE: {
+                        const Vm_variable* var = static_cast<const Vm_reference*>(e)->var;
+                        if (!this->in_frame(var, e->location))
+                                this->emit(VM_GETG, dest, var->slot, 0, e->location);
+                        else if (var->slot != dest)
+                                this->emit(VM_MOVE, dest, var->slot, 0, e->location);
+                        return;
+                }
+                case Vm_expression::EXPR_UNARY:
+                        this->unary(static_cast<const Vm_operation*>(e), dest);
+                        return;
+                case Vm_expression::EXPR_BINARY:
+                        this->binary(static_cast<const Vm_operation*>(e), dest);
+                        return;
+                case Vm_expression::EXPR_CALL:
+                        this->call(static_cast<const Vm_call*>(e), dest);
+                        return;
+                default:
+                        this->error(e->location, "Cannot run an invalid expression");
+                        return;
+                }
+        }
+
+        void unary(const Vm_operation* e, uint32_t dest)
+        {
+                Vm_type type = type_of(e->left);
+                uint32_t a = this->expression(e->left);
+
+                Vm_opcode op;
+                if (e->op == OPER_NOT)
+                        op = VM_NOT;
+                else if (e->op == OPER_NEG)
+                        op = (type == TYPE_INT) ? VM_NEG_I : (type == TYPE_FLOAT) ? VM_NEG_F : VM_NEG;
+                else
+                        op = (type == TYPE_INT) ? VM_BNOT_I : VM_BNOT;
+                this->emit(op, dest, a, 0, e->location);
+        }
+
+        // && and || only evaluate their right operand if they need it.
+        void logical(const Vm_operation* e, uint32_t dest)
+        {
+                Vm_opcode skip = (e->op == OPER_LAND) ? VM_JMPF : VM_JMPT;
+                uint32_t a = this->expression(e->left);
+                size_t short_circuit = this->emit(skip, a, 0, 0, e->location);
+
+                uint32_t b = this->expression(e->right);
+                this->emit(VM_TRUTH, dest, b, 0, e->location);
+                size_t done = this->emit(VM_JMP, 0, 0, 0, e->location);
+
+                this->patch(short_circuit, this->here());
+                this->emit(VM_LOADK, dest, this->constant(Interp_value::of_int(e->op == OPER_LOR)),
+                           0, e->location);
+                this->patch(done, this->here());
+        }
+
+        void binary(const Vm_operation* e, uint32_t dest)
+        {
+                if (e->op == OPER_LAND || e->op == OPER_LOR) {
+                        this->logical(e, dest);
+                        return;
+                }
+
+                Vm_type ta = type_of(e->left);
+                Vm_type tb = type_of(e->right);
+                uint32_t a = this->expression(e->left);
+                uint32_t b = this->expression(e->right);
+
+                Vm_opcode op = VM_BINARY;
+                if (ta == TYPE_INT && tb == TYPE_INT) {
+                        op = int_opcode(e->op);
+                } else if ((ta == TYPE_INT || ta == TYPE_FLOAT) && (tb == TYPE_INT || tb == TYPE_FLOAT)
+                           && float_opcode(e->op) != VM_BINARY) {
+                        // Mixed operands are widened, as they would be at run time.
+                        if (ta == TYPE_INT) {
+                                uint32_t wide = this->temp();
+                                this->emit(VM_I2F, wide, a, 0, e->location);
+                                a = wide;
+                        }
+                        if (tb == TYPE_INT) {
+                                uint32_t wide = this->temp();
+                                this->emit(VM_I2F, wide, b, 0, e->location);
+                                b = wide;
+                        }
+                        op = float_opcode(e->op);
+                }
+                this->emit(op, dest, a, b, e->location, e->op);
+        }
+
+        static Vm_opcode int_opcode(RIN_OPERATOR op)
+        {
+                switch (op) {
+                case OPER_ADD:    return VM_ADD_II;
+                case OPER_SUB:    return VM_SUB_II;
+                case OPER_MUL:    return VM_MUL_II;
+                case OPER_QUO:    return VM_QUO_II;
+                case OPER_REM:    return VM_REM_II;
+                case OPER_EQL:    return VM_EQL_II;
+                case OPER_NEQ:    return VM_NEQ_II;
+                case OPER_LSS:    return VM_LSS_II;
+                case OPER_GTR:    return VM_GTR_II;
+                case OPER_LEQ:    return VM_LEQ_II;
+                case OPER_GEQ:    return VM_GEQ_II;
+                case OPER_BAND:   return VM_BAND_II;
+                case OPER_BOR:    return VM_BOR_II;
+                case OPER_BXOR:   return VM_BXOR_II;
+                case OPER_LSHIFT: return VM_LSHIFT_II;
+                case OPER_RSHIFT: return VM_RSHIFT_II;
+                default:          return VM_BINARY;
+                }
+        }
+
+        // Bitwise operators have no float form; they fail on floats.
+        static Vm_opcode float_opcode(RIN_OPERATOR op)
+        {
+                switch (op) {
+                case OPER_ADD:    return VM_ADD_FF;
+                case OPER_SUB:    return VM_SUB_FF;
+                case OPER_MUL:    return VM_MUL_FF;
+                case OPER_QUO:    return VM_QUO_FF;
+                case OPER_REM:    return VM_REM_FF;
+                case OPER_EQL:    return VM_EQL_FF;
+                case OPER_NEQ:    return VM_NEQ_FF;
+                case OPER_LSS:    return VM_LSS_FF;
+                case OPER_GTR:    return VM_GTR_FF;
+                case OPER_LEQ:    return VM_LEQ_FF;
+                case OPER_GEQ:    return VM_GEQ_FF;
+                default:          return VM_BINARY;
+                }
+        }
+
+        // Arguments go in consecutive temporaries, where the callee's frame starts.
+        void call(const Vm_call* e, uint32_t dest)
+        {
+                auto found = this->_function_index.find(e->name);
+                if (found == this->_function_index.end()) {
+                        this->error(e->location, "Call to undeclared function '" + e->name + "'");
+                        return;
+                }
+
+                const Vm_function* callee = this->_functions[found->second];
+                if (e->args.size() != callee->params) {
+                        this->error(e->location, "Function '" + e->name + "' takes "
+                                    + std::to_string(callee->params) + " arguments, but "
+                                    + std::to_string(e->args.size()) + " were given");
+                        return;
+                }
+
+                uint32_t args = this->_temp;
+                for (size_t i = 0; i < e->args.size(); i++)
+                        this->temp();
+                for (size_t i = 0; i < e->args.size(); i++)
+                        this->expression_into(e->args[i], args + i);
+                this->emit(VM_CALL, dest, found->second, args, e->location);
+        }
+
+        void block(const std::vector<Vm_statement*>& body)
+        {
+                for (auto itr = body.begin(); itr != body.end(); ++itr)
+                        this->statement(*itr);
+        }
+
+        // Nothing in a temporary outlives the statement that made it.
+        void start_statement()
+        {
+                this->_temp = this->_first_temp;
+                std::vector<uint32_t>& starts = this->_fn->statements;
+                if (starts.empty() || starts.back() != this->here())
+                        starts.push_back(this->here());
+        }
+
+        void statement(const Vm_statement* s)
+        {
+                this->start_statement();
+
+                switch (s->kind) {
+                case Vm_statement::STMT_DECLARE:
+                case Vm_statement::STMT_ASSIGN:
+                case Vm_statement::STMT_STEP:
+                        this->store(static_cast<const Vm_store*>(s));
+                        return;
+                case Vm_statement::STMT_EXPRESSION:
+                        this->expression(static_cast<const Vm_evaluate*>(s)->expr);
+                        return;
+                case Vm_statement::STMT_IF:
+                        this->if_statement(static_cast<const Vm_branch*>(s));
+                        return;
+                case Vm_statement::STMT_FOR:
+                        this->for_statement(static_cast<const Vm_branch*>(s));
+                        return;
+                case Vm_statement::STMT_COMPOUND:
+                        this->statement(static_cast<const Vm_compound*>(s)->first);
+                        this->statement(static_cast<const Vm_compound*>(s)->second);
+                        return;
+                case Vm_statement::STMT_RETURN: {
+                        const Vm_expression* expr = static_cast<const Vm_evaluate*>(s)->expr;
+                        if (expr)
+                                this->emit(VM_RET, this->expression(expr), 0, 0, s->location);
+                        else
+                                this->emit(VM_RET0, 0, 0, 0, s->location);
+                        return;
+                }
+                case Vm_statement::STMT_BREAK:
+                case Vm_statement::STMT_CONTINUE:
+                        this->leave_loop(s);
+                        return;
+                case Vm_statement::STMT_NOTHING:
+                        return;
+                default:
+                        this->error(s->location, "Cannot run an invalid statement");
+                        return;
+                }
+        }
+
+        void store(const Vm_store* s)
+        {
+                Vm_variable* var = s->var;
+                bool local = this->in_frame(var, s->location);
+                uint32_t reg = (local) ? var->slot : this->temp();
+
+                if (s->kind == Vm_statement::STMT_DECLARE) {
+                        /*
+                         * A declaration zeroes the variable to integer 0, as the
+                         * interpreter's does. A float variable is only declared so
+                         * when an assignment overwrites the zero before it is read.
+                         */
+                        this->emit(VM_LOADK, reg, this->constant(Interp_value()), 0, s->location);
+                } else if (s->kind == Vm_statement::STMT_ASSIGN) {
+                        if (local) {
+                                this->expression_into(s->value, reg);
+                        } else {
+                                // The global is only written once the value is complete.
+                                reg = this->expression(s->value);
+                        }
+                } else {
+                        if (!local)
+                                this->emit(VM_GETG, reg, var->slot, 0, s->location);
+                        Vm_opcode op = (var->type == TYPE_INT) ? VM_STEP_I :
+                                (var->type == TYPE_FLOAT) ? VM_STEP_F : VM_STEP;
+                        this->emit(op, reg, (uint32_t)s->step, 0, s->location);
+                }
+
+                if (!local)
+                        this->emit(VM_SETG, var->slot, reg, 0, s->location);
+        }
+
+        void if_statement(const Vm_branch* s)
+        {
+                size_t skip = this->emit(VM_JMPF, this->expression(s->cond), 0, 0, s->location);
+                this->block(s->then_block);
+                if (s->else_block.empty()) {
+                        this->patch(skip, this->here());
+                        return;
+                }
+
+                size_t done = this->emit(VM_JMP, 0, 0, 0, s->location);
+                this->patch(skip, this->here());
+                this->block(s->else_block);
+                this->patch(done, this->here());
+        }
+
+        void for_statement(const Vm_branch* s)
+        {
+                if (s->ind)
+                        this->statement(s->ind);
+
+                this->start_statement();
+                size_t top = this->here();
+                size_t exit = SIZE_MAX;
+                if (s->cond)
+                        exit = this->emit(VM_JMPF, this->expression(s->cond), 0, 0, s->location);
+
+                this->_loops.push_back(Loop());
+                this->block(s->then_block);
+                Loop loop = this->_loops.back();
+                this->_loops.pop_back();
+
+                size_t next = this->here();
+                if (s->inc)
+                        this->statement(s->inc);
+                this->emit(VM_JMP, top, 0, 0, s->location);
+
+                size_t end = this->here();
+                if (exit != SIZE_MAX)
+                        this->patch(exit, end);
+                for (auto itr = loop.breaks.begin(); itr != loop.breaks.end(); ++itr)
+                        this->patch(*itr, end);
+                for (auto itr = loop.continues.begin(); itr != loop.continues.end(); ++itr)
+                        this->patch(*itr, next);
+        }
+
+        void leave_loop(const Vm_statement* s)
+        {
+                if (this->_loops.empty()) {
+                        if (this->_index == 0)
+                                this->error(s->location, "Left a loop outside of any loop");
+                        else
+                                this->error(s->location, "Function '" + this->_fn->name
+                                            + "' left a loop it is not in");
+                        return;
+                }
+
+                size_t jump = this->emit(VM_JMP, 0, 0, 0, s->location);
+                if (s->kind == Vm_statement::STMT_BREAK)
+                        this->_loops.back().breaks.push_back(jump);
+                else
+                        this->_loops.back().continues.push_back(jump);
+        }
+};
+
+void Vm_backend::infer_types()
+{
+        std::vector<std::pair<Vm_variable*, Vm_expression*> > sites(this->_assignments);
+
+        // Arguments are assigned to the parameters they are passed to.
+        for (auto call = this->_calls.begin(); call != this->_calls.end(); ++call) {
+                auto found = this->_function_index.find((*call)->name);
+                if (found == this->_function_index.end())
+                        continue;
+
+                const std::vector<Vm_variable*>& params = this->_params[found->second];
+                if (params.size() != (*call)->args.size())
+                        continue;
+                for (size_t i = 0; i < params.size(); i++) {
+                        if (params[i])
+                                sites.push_back(std::make_pair(params[i], (*call)->args[i]));
+                }
+        }
+
+        // A declaration whose zero may be read assigns the integer zero.
+        std::vector<const Vm_store*> zeroes;
+        for (auto body = this->_bodies.begin(); body != this->_bodies.end(); ++body)
+                find_zeroes(*body, &zeroes);
+        for (auto decl = zeroes.begin(); decl != zeroes.end(); ++decl)
+                (*decl)->var->type = widen((*decl)->var->type, TYPE_INT);
+
+        /*
+         * Types only ever widen, so this settles within a few passes. A
+         * variable nothing has been assigned to holds the integer zero.
+         */
+        for (int settle = 0; settle < 2; settle++) {
+                bool changed = true;
+                while (changed) {
+                        changed = false;
+                        for (auto site = sites.begin(); site != sites.end(); ++site) {
+                                Vm_type type = widen(site->first->type, type_of(site->second));
+                                if (type != site->first->type) {
+                                        site->first->type = type;
+                                        changed = true;
+                                }
+                        }
+                }
+
+                for (auto var = this->_made.begin(); var != this->_made.end(); ++var) {
+                        if ((*var)->type == TYPE_NONE)
+                                (*var)->type = TYPE_INT;
+                }
+        }
+
+        for (auto var = this->_made.begin(); var != this->_made.end(); ++var) {
+                if ((*var)->owner == 0)
+                        (*var)->slot = this->_globals++;
+        }
+}
+
+void Vm_backend::compile()
+{
+        if (this->_compiled)
+                return;
+        this->_compiled = true;
+
+        this->_bodies[0] = this->take_statements(this->supercontext());
+        this->infer_types();
+
+        for (size_t i = 0; i < this->_functions.size(); i++) {
+                Vm_function* fn = this->_functions[i];
+                uint32_t first_temp = (i == 0) ? this->_globals : fn->params + fn->locals;
+                Vm_compiler compiler(fn, i, first_temp, this->_functions, this->_function_index);
+                compiler.compile(this->_bodies[i]);
+                if (this->_peephole)
+                        vm_peephole(fn, this->_functions);
+        }
+}
+
+const std::vector<Vm_function*>& Vm_backend::functions()
+{
+        this->compile();
+        return this->_functions;
+}
+
+std::string Vm_backend::disassemble()
+{
+        this->compile();
+
+        std::string out;
+        char line[128];
+        for (auto itr = this->_functions.begin(); itr != this->_functions.end(); ++itr) {
+                const Vm_function* fn = *itr;
+                snprintf(line, sizeof(line), "%s: %u params, %u locals, %u registers\n",
+                         fn->name.c_str(), fn->params, fn->locals, fn->frame_size);
+                out += line;
+
+                for (size_t pc = 0; pc < fn->code.size(); pc++) {
+                        const Vm_instruction& ins = fn->code[pc];
+                        snprintf(line, sizeof(line), "%6zu  %-10s %u %u %u", pc,
+                                 vm_opcode_name(ins.op), ins.a, ins.b, ins.c);
+                        out += line;
+                        if (ins.op == VM_BINARY)
+                                out += "  " + operator_name((RIN_OPERATOR)ins.oper);
+                        else if (ins.op == VM_LOADK || ins.op == VM_ADDG_IK
+                                 || (ins.op >= VM_JNOT_EQL_IK && ins.op <= VM_JNOT_GEQ_FK))
+                                out += "  " + fn->constants[ins.b].str();
+                        else if (ins.op >= VM_ADD_IK && ins.op <= VM_MUL_FK)
+                                out += "  " + fn->constants[ins.c].str();
+                        else if (ins.op == VM_CALL)
+                                out += "  " + this->_functions[ins.b]->name;
+                        out += "\n";
+                }
+        }
+        return out;
+}
+
+// --- Running ---
+
+// The checked form of every binary operator, as Interp_backend has it.
+static bool checked_binary(RIN_OPERATOR op, Interp_value a, Interp_value b,
+                           Interp_value* out, std::string* error)
+{
+        if (!a.is_float() && !b.is_float()) {
+                int64_t x = a.i;
+                int64_t y = b.i;
+                switch (op) {
+                case OPER_ADD: *out = Interp_value::of_int((int64_t)((uint64_t)x + (uint64_t)y)); return true;
+                case OPER_SUB: *out = Interp_value::of_int((int64_t)((uint64_t)x - (uint64_t)y)); return true;
+                case OPER_MUL: *out = Interp_value::of_int((int64_t)((uint64_t)x * (uint64_t)y)); return true;
+                case OPER_QUO:
+                case OPER_REM:
+                        if (y == 0) {
+                                *error = "Division by zero";
+                                return false;
+                        }
+                        if (y == -1)
+                                *out = Interp_value::of_int((op == OPER_QUO) ? (int64_t)(0 - (uint64_t)x) : 0);
+                        else
+                                *out = Interp_value::of_int((op == OPER_QUO) ? x / y : x % y);
+                        return true;
+                case OPER_EQL: *out = Interp_value::of_int(x == y); return true;
+                case OPER_NEQ: *out = Interp_value::of_int(x != y); return true;
+                case OPER_LSS: *out = Interp_value::of_int(x < y); return true;
+                case OPER_GTR: *out = Interp_value::of_int(x > y); return true;
+                case OPER_LEQ: *out = Interp_value::of_int(x <= y); return true;
+                case OPER_GEQ: *out = Interp_value::of_int(x >= y); return true;
+                case OPER_BAND: *out = Interp_value::of_int(x & y); return true;
+                case OPER_BOR: *out = Interp_value::of_int(x | y); return true;
+                case OPER_BXOR: *out = Interp_value::of_int(x ^ y); return true;
+                case OPER_LSHIFT: *out = Interp_value::of_int((int64_t)((uint64_t)x << (y & 63))); return true;
+                case OPER_RSHIFT: *out = Interp_value::of_int(x >> (y & 63)); return true;
+                default: RIN_UNREACHABLE();
+                }
+        }
+
+        double x = a.as_float();
+        double y = b.as_float();
+        switch (op) {
+        case OPER_ADD: *out = Interp_value::of_float(x + y); return true;
+        case OPER_SUB: *out = Interp_value::of_float(x - y); return true;
+        case OPER_MUL: *out = Interp_value::of_float(x * y); return true;
+        case OPER_QUO: *out = Interp_value::of_float(x / y); return true;
+        case OPER_REM: *out = Interp_value::of_float(fmod(x, y)); return true;
+        case OPER_EQL: *out = Interp_value::of_int(x == y); return true;
+        case OPER_NEQ: *out = Interp_value::of_int(x != y); return true;
+        case OPER_LSS: *out = Interp_value::of_int(x < y); return true;
+        case OPER_GTR: *out = Interp_value::of_int(x > y); return true;
+        case OPER_LEQ: *out = Interp_value::of_int(x <= y); return true;
+        case OPER_GEQ: *out = Interp_value::of_int(x >= y); return true;
+        default:
+                *error = "Operands of " + operator_name(op) + " must be integers";
+                return false;
+        }
+}
+
+void Vm_profile::add(const Vm_profile& other)
+{
+        this->dispatches += other.dispatches;
+        for (unsigned i = 0; i < VM_OPCODE_COUNT; i++) {
+                this->opcodes[i] += other.opcodes[i];
+                for (unsigned j = 0; j < VM_OPCODE_COUNT; j++)
+                        this->pairs[i][j] += other.pairs[i][j];
+        }
+}
+
+std::string Vm_profile::report(unsigned top) const
+{
+        std::vector<std::pair<uint64_t, std::string> > opcodes, pairs;
+        for (unsigned i = 0; i < VM_OPCODE_COUNT; i++) {
+                if (this->opcodes[i])
+                        opcodes.push_back(std::make_pair(this->opcodes[i],
+                                                         vm_opcode_name((Vm_opcode)i)));
+                for (unsigned j = 0; j < VM_OPCODE_COUNT; j++) {
+                        if (this->pairs[i][j])
+                                pairs.push_back(std::make_pair(this->pairs[i][j],
+                                        std::string(vm_opcode_name((Vm_opcode)i)) + " "
+                                        + vm_opcode_name((Vm_opcode)j)));
+                }
+        }
+
+        // Most frequent first, then by name.
+        auto order = [](const std::pair<uint64_t, std::string>& a,
+                        const std::pair<uint64_t, std::string>& b) {
+                return (a.first != b.first) ? a.first > b.first : a.second < b.second;
+        };
+        std::sort(opcodes.begin(), opcodes.end(), order);
+        std::sort(pairs.begin(), pairs.end(), order);
+
+        char line[128];
+        snprintf(line, sizeof(line), "%llu dispatches\n", (unsigned long long)this->dispatches);
+        std::string out = line;
+        for (size_t i = 0; i < opcodes.size() && i < top; i++) {
+                snprintf(line, sizeof(line), "%12llu  %s\n", (unsigned long long)opcodes[i].first,
+                         opcodes[i].second.c_str());
+                out += line;
+        }
+        for (size_t i = 0; i < pairs.size() && i < top; i++) {
+                snprintf(line, sizeof(line), "%12llu  %s\n", (unsigned long long)pairs[i].first,
+                         pairs[i].second.c_str());
+                out += line;
+        }
+        return out;
+}
+
+bool Vm_backend::run(Vm_profile* profile)
+{
+        this->compile();
+        this->_result = Interp_value();
+
+        // Profiles count what the VM dispatches, so loops stay with it.
+        this->_jit.reset();
+        if (!profile && this->_jit_threshold > 0 && Vm_jit::supported())
+                this->_jit.reset(new Vm_jit(this->_functions.size(), this->_jit_threshold));
+
+        return (profile) ? this->execute<true>(profile) : this->execute<false>(NULL);
+}
+
+// Profiling runs count each dispatch, and what was dispatched before it.
+template<bool PROFILE>
+bool Vm_backend::execute(Vm_profile* profile)
+{
+        struct Frame {
+                const Vm_function* fn;
+                uint32_t index;
+                const Vm_instruction* pc;
+                size_t base;
+                uint32_t dest;
+        };
+        std::vector<Frame> frames;
+
+        const Vm_function* fn = this->_functions[0];
+        uint32_t index = 0;
+        const Vm_instruction* code = fn->code.data();
+        const Vm_instruction* pc = code;
+        const Vm_instruction* ins;
+        Vm_opcode last = VM_NOP;
+        size_t base = 0;
+        std::string error;
+        Interp_value returned;
+
+        this->_stack.assign(std::max<size_t>(fn->frame_size, 1), Interp_value());
+        Interp_value* globals = this->_stack.data();
+        Interp_value* r = globals;
+
+#ifdef VM_THREADED
+#define VM_LABEL(name) &&op_##name,
+        static const void* const dispatch[] = { VM_OPCODES(VM_LABEL) };
+#undef VM_LABEL
+#define CASE(name) op_##name:
+#define NEXT() do { ins = pc++; COUNT(); goto *dispatch[ins->op]; } while (0)
+#else
+#define CASE(name) case VM_##name:
+#define NEXT() continue
+#endif
+#define COUNT()                                                                \
+        do {                                                                   \
+                if (PROFILE) {                                                 \
+                        profile->dispatches++;                                 \
+                        profile->opcodes[ins->op]++;                           \
+                        profile->pairs[last][ins->op]++;                       \
+                        last = ins->op;                                        \
+                }                                                              \
+        } while (0)
+
+#ifdef VM_THREADED
+        NEXT();
+#else
+        for (;;) {
+                ins = pc++;
+                COUNT();
+                switch (ins->op) {
+#endif
+
+#define INT_BINARY(name, expr)                                                 \
+        CASE(name) {                                                           \
+                int64_t x = r[ins->b].i;                                       \
+                int64_t y = r[ins->c].i;                                       \
+                r[ins->a] = Interp_value::of_int(expr);                        \
+                NEXT();                                                        \
+        }
+#define FLOAT_BINARY(name, expr, make)                                         \
+        CASE(name) {                                                           \
+                double x = r[ins->b].f;                                        \
+                double y = r[ins->c].f;                                        \
+                r[ins->a] = Interp_value::make(expr);                          \
+                NEXT();                                                        \
+        }
+
+        CASE(NOP) NEXT();
+        CASE(MOVE) { r[ins->a] = r[ins->b]; NEXT(); }
+        CASE(LOADK) { r[ins->a] = fn->constants[ins->b]; NEXT(); }
+        CASE(GETG) { r[ins->a] = globals[ins->b]; NEXT(); }
+        CASE(SETG) { globals[ins->a] = r[ins->b]; NEXT(); }
+        CASE(I2F) { r[ins->a] = Interp_value::of_float((double)r[ins->b].i); NEXT(); }
+
+        // Integer arithmetic wraps, as it does in two's complement hardware.
+        INT_BINARY(ADD_II, (int64_t)((uint64_t)x + (uint64_t)y))
+        INT_BINARY(SUB_II, (int64_t)((uint64_t)x - (uint64_t)y))
+        INT_BINARY(MUL_II, (int64_t)((uint64_t)x * (uint64_t)y))
+        CASE(QUO_II) {
+                int64_t x = r[ins->b].i;
+                int64_t y = r[ins->c].i;
+                if (y == 0) {
+                        error = "Division by zero";
+                        goto fail;
+                }
+                r[ins->a] = Interp_value::of_int((y == -1) ? (int64_t)(0 - (uint64_t)x) : x / y);
+                NEXT();
+        }
+        CASE(REM_II) {
+                int64_t x = r[ins->b].i;
+                int64_t y = r[ins->c].i;
+                if (y == 0) {
+                        error = "Division by zero";
+                        goto fail;
+                }
+                r[ins->a] = Interp_value::of_int((y == -1) ? 0 : x % y);
+                NEXT();
+        }
+        INT_BINARY(EQL_II, x == y)
+        INT_BINARY(NEQ_II, x != y)
+        INT_BINARY(LSS_II, x < y)
+        INT_BINARY(GTR_II, x > y)
+        INT_BINARY(LEQ_II, x <= y)
+        INT_BINARY(GEQ_II, x >= y)
+        INT_BINARY(BAND_II, x & y)
+        INT_BINARY(BOR_II, x | y)
+        INT_BINARY(BXOR_II, x ^ y)
+        INT_BINARY(LSHIFT_II, (int64_t)((uint64_t)x << (y & 63)))
+        INT_BINARY(RSHIFT_II, x >> (y & 63))
+
+        FLOAT_BINARY(ADD_FF, x + y, of_float)
+        FLOAT_BINARY(SUB_FF, x - y, of_float)
+        FLOAT_BINARY(MUL_FF, x * y, of_float)
+        FLOAT_BINARY(QUO_FF, x / y, of_float)
+        FLOAT_BINARY(REM_FF, fmod(x, y), of_float)
+        FLOAT_BINARY(EQL_FF, x == y, of_int)
+        FLOAT_BINARY(NEQ_FF, x != y, of_int)
+        FLOAT_BINARY(LSS_FF, x < y, of_int)
+        FLOAT_BINARY(GTR_FF, x > y, of_int)
+        FLOAT_BINARY(LEQ_FF, x <= y, of_int)
+        FLOAT_BINARY(GEQ_FF, x >= y, of_int)
+
+        CASE(BINARY) {
+                if (!checked_binary((RIN_OPERATOR)ins->oper, r[ins->b], r[ins->c], &r[ins->a], &error))
+                        goto fail;
+                NEXT();
+        }
+
+        CASE(NEG_I) { r[ins->a] = Interp_value::of_int((int64_t)(0 - (uint64_t)r[ins->b].i)); NEXT(); }
+        CASE(NEG_F) { r[ins->a] = Interp_value::of_float(-r[ins->b].f); NEXT(); }
+        CASE(NEG) {
+                Interp_value v = r[ins->b];
+                r[ins->a] = (v.is_float()) ? Interp_value::of_float(-v.f) :
+                        Interp_value::of_int((int64_t)(0 - (uint64_t)v.i));
+                NEXT();
+        }
+        CASE(NOT) { r[ins->a] = Interp_value::of_int(!r[ins->b].truth()); NEXT(); }
+        CASE(BNOT_I) { r[ins->a] = Interp_value::of_int(~r[ins->b].i); NEXT(); }
+        CASE(BNOT) {
+                if (r[ins->b].is_float()) {
+                        error = "Operand of " + operator_name(OPER_BNOT) + " must be an integer";
+                        goto fail;
+                }
+                r[ins->a] = Interp_value::of_int(~r[ins->b].i);
+                NEXT();
+        }
+        CASE(TRUTH) { r[ins->a] = Interp_value::of_int(r[ins->b].truth()); NEXT(); }
+
+        CASE(STEP_I) {
+                r[ins->a] = Interp_value::of_int((int64_t)((uint64_t)r[ins->a].i + (uint64_t)(int32_t)ins->b));
+                NEXT();
+        }
+        CASE(STEP_F) { r[ins->a] = Interp_value::of_float(r[ins->a].f + (int32_t)ins->b); NEXT(); }
+        CASE(STEP) {
+                Interp_value& v = r[ins->a];
+                if (v.is_float())
+                        v.f += (int32_t)ins->b;
+                else
+                        v.i = (int64_t)((uint64_t)v.i + (uint64_t)(int32_t)ins->b);
+                NEXT();
+        }
+
+        CASE(JMP) {
+                pc = code + ins->a;
+                if (pc <= ins)
+                        goto back_edge;
+                NEXT();
+        }
+        CASE(JMPF) {
+                if (!r[ins->a].truth())
+                        pc = code + ins->b;
+                NEXT();
+        }
+        CASE(JMPT) {
+                if (r[ins->a].truth())
+                        pc = code + ins->b;
+                NEXT();
+        }
+
+        CASE(CALL) {
+                if (frames.size() >= MAX_CALL_DEPTH) {
+                        error = "Call depth exceeds the limit of " + std::to_string(MAX_CALL_DEPTH);
+                        goto fail;
+                }
+                frames.push_back(Frame{ fn, index, pc, base, ins->a });
+
+                // The arguments are already in place, at the start of the new frame.
+                index = ins->b;
+                fn = this->_functions[index];
+                base += ins->c;
+                size_t needed = base + fn->frame_size;
+                if (needed > this->_stack.size())
+                        this->_stack.resize(std::max(needed, this->_stack.size() * 2));
+                globals = this->_stack.data();
+                r = globals + base;
+                for (uint32_t i = fn->params; i < fn->params + fn->locals; i++)
+                        r[i] = Interp_value();
+
+                code = fn->code.data();
+                pc = code;
+                NEXT();
+        }
+        CASE(RET) {
+                returned = r[ins->a];
+                goto leave;
+        }
+        CASE(RET0) {
+                returned = Interp_value();
+                goto leave;
+        }
+        CASE(ERROR) {
+                error = fn->messages[ins->a];
+                goto fail;
+        }
+
+        // Superinstructions; see vm-peephole.cc for the sequences each replaces.
+
+#define JUMP_UNLESS(name, x, y, cmp)                                           \
+        CASE(name) {                                                           \
+                if (!((x) cmp (y)))                                            \
+                        pc = code + ins->c;                                    \
+                NEXT();                                                        \
+        }
+#define INT_CONSTANT(name, expr)                                               \
+        CASE(name) {                                                           \
+                int64_t x = r[ins->b].i;                                       \
+                int64_t y = fn->constants[ins->c].i;                           \
+                r[ins->a] = Interp_value::of_int(expr);                        \
+                NEXT();                                                        \
+        }
+#define K(field) fn->constants[ins->field]
+
+        JUMP_UNLESS(JNOT_EQL_II, r[ins->a].i, r[ins->b].i, ==)
+        JUMP_UNLESS(JNOT_NEQ_II, r[ins->a].i, r[ins->b].i, !=)
+        JUMP_UNLESS(JNOT_LSS_II, r[ins->a].i, r[ins->b].i, <)
+        JUMP_UNLESS(JNOT_GTR_II, r[ins->a].i, r[ins->b].i, >)
+        JUMP_UNLESS(JNOT_LEQ_II, r[ins->a].i, r[ins->b].i, <=)
+        JUMP_UNLESS(JNOT_GEQ_II, r[ins->a].i, r[ins->b].i, >=)
+        JUMP_UNLESS(JNOT_LSS_FF, r[ins->a].f, r[ins->b].f, <)
+        JUMP_UNLESS(JNOT_GTR_FF, r[ins->a].f, r[ins->b].f, >)
+        JUMP_UNLESS(JNOT_LEQ_FF, r[ins->a].f, r[ins->b].f, <=)
+        JUMP_UNLESS(JNOT_GEQ_FF, r[ins->a].f, r[ins->b].f, >=)
+        JUMP_UNLESS(JNOT_EQL_IK, r[ins->a].i, K(b).i, ==)
+        JUMP_UNLESS(JNOT_NEQ_IK, r[ins->a].i, K(b).i, !=)
+        JUMP_UNLESS(JNOT_LSS_IK, r[ins->a].i, K(b).i, <)
+        JUMP_UNLESS(JNOT_GTR_IK, r[ins->a].i, K(b).i, >)
+        JUMP_UNLESS(JNOT_LEQ_IK, r[ins->a].i, K(b).i, <=)
+        JUMP_UNLESS(JNOT_GEQ_IK, r[ins->a].i, K(b).i, >=)
+        JUMP_UNLESS(JNOT_LSS_FK, r[ins->a].f, K(b).f, <)
+        JUMP_UNLESS(JNOT_GTR_FK, r[ins->a].f, K(b).f, >)
+        JUMP_UNLESS(JNOT_LEQ_FK, r[ins->a].f, K(b).f, <=)
+        JUMP_UNLESS(JNOT_GEQ_FK, r[ins->a].f, K(b).f, >=)
+
+        INT_CONSTANT(ADD_IK, (int64_t)((uint64_t)x + (uint64_t)y))
+        INT_CONSTANT(SUB_IK, (int64_t)((uint64_t)x - (uint64_t)y))
+        INT_CONSTANT(MUL_IK, (int64_t)((uint64_t)x * (uint64_t)y))
+
+        // The pass only folds a divisor other than 0 and -1 into REM_IK.
+        INT_CONSTANT(REM_IK, x % y)
+        INT_CONSTANT(BAND_IK, x & y)
+        CASE(ADD_FK) { r[ins->a] = Interp_value::of_float(r[ins->b].f + K(c).f); NEXT(); }
+        CASE(MUL_FK) { r[ins->a] = Interp_value::of_float(r[ins->b].f * K(c).f); NEXT(); }
+
+        CASE(STEP_JMP_I) {
+                r[ins->a] = Interp_value::of_int((int64_t)((uint64_t)r[ins->a].i + (uint64_t)(int32_t)ins->b));
+                pc = code + ins->c;
+                if (pc <= ins)
+                        goto back_edge;
+                NEXT();
+        }
+        CASE(STEP_JMP_F) {
+                r[ins->a] = Interp_value::of_float(r[ins->a].f + (int32_t)ins->b);
+                pc = code + ins->c;
+                if (pc <= ins)
+                        goto back_edge;
+                NEXT();
+        }
+        CASE(STEPG_I) {
+                Interp_value& g = globals[ins->a];
+                g = Interp_value::of_int((int64_t)((uint64_t)g.i + (uint64_t)(int32_t)ins->b));
+                NEXT();
+        }
+        CASE(ADDG_II) {
+                Interp_value& g = globals[ins->a];
+                g = Interp_value::of_int((int64_t)((uint64_t)g.i + (uint64_t)r[ins->b].i));
+                NEXT();
+        }
+        CASE(ADDG_IK) {
+                Interp_value& g = globals[ins->a];
+                g = Interp_value::of_int((int64_t)((uint64_t)g.i + (uint64_t)K(b).i));
+                NEXT();
+        }
+        CASE(ADDG_FF) {
+                Interp_value& g = globals[ins->a];
+                g = Interp_value::of_float(g.f + r[ins->b].f);
+                NEXT();
+        }
+
+#undef JUMP_UNLESS
+#undef INT_CONSTANT
+#undef K
+
+leave:
+        // Returning from the top level ends the run.
+        if (frames.empty()) {
+                this->_result = returned;
+                return true;
+        } else {
+                const Frame& caller = frames.back();
+                fn = caller.fn;
+                index = caller.index;
+                code = fn->code.data();
+                pc = caller.pc;
+                base = caller.base;
+                r = globals + base;
+                r[caller.dest] = returned;
+                frames.pop_back();
+                NEXT();
+        }
+
+back_edge:
+        // A loop has come round again; once it is hot, it runs as machine code.
+        if (!PROFILE && this->_jit) {
+                Vm_jit::Loop_code native = this->_jit->loop(index, fn, pc - code, ins - code);
+                if (native)
+                        pc = code + native(r, globals);
+        }
+        NEXT();
+
+#undef INT_BINARY
+#undef FLOAT_BINARY
+#ifndef VM_THREADED
+                default:
+                        RIN_UNREACHABLE();
+                }
+        }
+#endif
+
+fail:
+        rin_error_at(fn->locations[ins - code], "%s", error.c_str());
+        return false;
+#undef CASE
+#undef NEXT
+#undef COUNT
+}
+
+unsigned Vm_backend::jit_loops() const
+{
+        return (this->_jit) ? this->_jit->compiled() : 0;
+}
+
+Interp_value Vm_backend::value(Named_object* obj) const
+{
+        auto itr = this->_variables.find(obj);
+        if (itr == this->_variables.end() || itr->second->owner != 0
+            || itr->second->slot >= this->_stack.size())
+                return Interp_value();
+        return this->_stack[itr->second->slot];
+}
+
+// --- Building ---
+
+Vm_backend::Vm_backend()
+{
+        // The top level is function 0.
+        Vm_function* top = this->arena()->make<Vm_function>();
+        top->name = "<top level>";
+        top->location = File::unknown_location();
+        this->_functions.push_back(top);
+        this->_bodies.push_back(Statement_list());
+        this->_params.push_back(std::vector<Vm_variable*>());
+}
+
+Vm_backend::~Vm_backend()
+{
+}
+
+Scope* Vm_backend::enter_scope()
+{
+        Scope* scope = Backend::enter_scope();
+        this->_scope_marks[scope] = this->_made.size();
+        return scope;
+}
+
+void Vm_backend::push_statement(Bstatement* statement)
+{
+        if (statement)
+                this->_statements[this->current_scope()].push_back(node(statement));
+}
+
+Vm_backend::Statement_list Vm_backend::take_statements(Scope* scope)
+{
+        Statement_list list;
+        auto itr = this->_statements.find(scope);
+        if (scope && itr != this->_statements.end()) {
+                list.swap(itr->second);
+                this->_statements.erase(itr);
+        }
+        return list;
+}
+
+Vm_variable* Vm_backend::variable_in(Named_object* obj, Scope* scope)
+{
+        auto itr = this->_variables.find(obj);
+        if (itr != this->_variables.end())
+                return itr->second;
+
+        Vm_variable* var = this->arena()->make<Vm_variable>(obj, scope);
+        this->_variables[obj] = var;
+        this->_made.push_back(var);
+        return var;
+}
+
+Bvariable* Vm_backend::variable(Named_object* obj)
+{
+        RIN_ASSERT(obj);
+        return bvariable(this->variable_in(obj, this->current_scope()));
+}
+
+Bexpression* Vm_backend::invalid_expression()
+{
+        return bexpression(this->arena()->make<Vm_expression>(Vm_expression::EXPR_INVALID,
+                                                              File::unknown_location()));
+}
+
+Bexpression* Vm_backend::unary_expression
+(RIN_OPERATOR op, Bexpression* expr, const Location& loc)
+{
+        RIN_ASSERT(expr);
+
+        // The variable itself, which inc_statement() and dec_statement() step.
+        if (op == OPER_INC || op == OPER_DEC)
+                return expr;
+
+        RIN_ASSERT(op == OPER_NOT || op == OPER_NEG || op == OPER_BNOT);
+        return bexpression(check_depth(this->arena()->make<Vm_operation>(op, node(expr),
+                                                                         nullptr, loc)));
+}
+
+Bexpression* Vm_backend::binary_expression
+(RIN_OPERATOR op, Bexpression* left, Bexpression* right, const Location& loc)
+{
+        RIN_ASSERT(left && right);
+        RIN_ASSERT(is_arithmetic(op) || is_comparison(op) || op == OPER_LAND || op == OPER_LOR
+                   || op == OPER_BAND || op == OPER_BOR || op == OPER_BXOR
+                   || op == OPER_LSHIFT || op == OPER_RSHIFT);
+        return bexpression(check_depth(this->arena()->make<Vm_operation>(op, node(left),
+                                                                         node(right), loc)));
+}
+
+Bexpression* Vm_backend::var_reference(Bvariable* var, const Location& loc)
+{
+        RIN_ASSERT(var);
+        return bexpression(this->arena()->make<Vm_reference>(node(var), loc));
+}
+
+Bexpression* Vm_backend::float_expression(const mpfr_t* val, const Location& loc)
+{
+        RIN_ASSERT(val);
+        return this->native_float_expression(mpfr_get_d(*val, MPFR_RNDN), loc);
+}
+
+Bexpression* Vm_backend::integer_expression(const mpfr_t* val, const Location& loc)
+{
+        RIN_ASSERT(val);
+        return this->native_integer_expression(mpfr_get_si(*val, MPFR_RNDN), loc);
+}
+
+Bexpression* Vm_backend::native_float_expression(double val, const Location& loc)
+{
+        return bexpression(this->arena()->make<Vm_constant>(Interp_value::of_float(val), loc));
+}
+
+Bexpression* Vm_backend::native_integer_expression(int64_t val, const Location& loc)
+{
+        return bexpression(this->arena()->make<Vm_constant>(Interp_value::of_int(val), loc));
+}
+
+Bexpression* Vm_backend::call_expression
+(const std::string& name, const std::vector<Bexpression*>& args, const Location& loc)
+{
+        Vm_call* call = this->arena()->make<Vm_call>(name, loc);
+        for (auto itr = args.begin(); itr != args.end(); ++itr) {
+                call->args.push_back(node(*itr));
+                call->depth = std::max(call->depth, node(*itr)->depth + 1);
+        }
+        this->_calls.push_back(call);
+        return bexpression(check_depth(call));
+}
+
+Bstatement* Vm_backend::invalid_statement()
+{
+        return bstatement(this->arena()->make<Vm_statement>(Vm_statement::STMT_INVALID,
+                                                            File::unknown_location()));
+}
+
+Bstatement* Vm_backend::var_dec_statement(Bvariable* var)
+{
+        RIN_ASSERT(var);
+        Vm_variable* v = node(var);
+        return bstatement(this->arena()->make<Vm_store>(Vm_statement::STMT_DECLARE, v, nullptr, 0,
+                                                        v->obj->location()));
+}
+
+Bstatement* Vm_backend::assignment_statement
+(Bexpression* lhs, Bexpression* rhs, const Location& loc)
+{
+        RIN_ASSERT(lhs && rhs);
+        if (node(lhs)->kind != Vm_expression::EXPR_VARIABLE)
+                return this->invalid_statement();
+
+        Vm_variable* var = static_cast<Vm_reference*>(node(lhs))->var;
+        this->_assignments.push_back(std::make_pair(var, node(rhs)));
+        return bstatement(this->arena()->make<Vm_store>(Vm_statement::STMT_ASSIGN, var, node(rhs),
+                                                        0, loc));
+}
+
+Bstatement* Vm_backend::inc_statement(Bexpression* expr, const Location& loc)
+{
+        RIN_ASSERT(expr);
+        if (node(expr)->kind != Vm_expression::EXPR_VARIABLE)
+                return this->invalid_statement();
+
+        Vm_variable* var = static_cast<Vm_reference*>(node(expr))->var;
+        return bstatement(this->arena()->make<Vm_store>(Vm_statement::STMT_STEP, var, nullptr,
+                                                        1, loc));
+}
+
+Bstatement* Vm_backend::dec_statement(Bexpression* expr, const Location& loc)
+{
+        RIN_ASSERT(expr);
+        if (node(expr)->kind != Vm_expression::EXPR_VARIABLE)
+                return this->invalid_statement();
+
+        Vm_variable* var = static_cast<Vm_reference*>(node(expr))->var;
+        return bstatement(this->arena()->make<Vm_store>(Vm_statement::STMT_STEP, var, nullptr,
+                                                        -1, loc));
+}
+
+Bstatement* Vm_backend::if_statement
+(Bexpression* cond, Scope* then, Scope* else_block, const Location& loc)
+{
+        RIN_ASSERT(cond);
+        RIN_ASSERT(then);
+
+        Vm_branch* stmt = this->arena()->make<Vm_branch>(Vm_statement::STMT_IF, node(cond), loc);
+        stmt->then_block = this->take_statements(then);
+        stmt->else_block = this->take_statements(else_block);
+        stmt->depth = deepest(stmt->else_block, deepest(stmt->then_block, stmt->depth) + 1);
+        return bstatement(check_depth(stmt));
+}
+
+Bstatement* Vm_backend::for_statement
+(Bstatement* ind, Bstatement* cond, Bstatement* inc, Scope* then_block, const Location& loc)
+{
+        // The condition comes wrapped in an expression statement.
+        Vm_expression* cond_expr = NULL;
+        if (cond) {
+                if (node(cond)->kind != Vm_statement::STMT_EXPRESSION)
+                        return this->invalid_statement();
+                cond_expr = static_cast<Vm_evaluate*>(node(cond))->expr;
+        }
+
+        Vm_branch* stmt = this->arena()->make<Vm_branch>(Vm_statement::STMT_FOR, cond_expr, loc);
+        stmt->ind = (ind) ? node(ind) : NULL;
+        stmt->inc = (inc) ? node(inc) : NULL;
+        stmt->then_block = this->take_statements(then_block);
+        if (stmt->ind)
+                stmt->depth = std::max(stmt->depth, stmt->ind->depth);
+        if (stmt->inc)
+                stmt->depth = std::max(stmt->depth, stmt->inc->depth);
+        stmt->depth = deepest(stmt->then_block, stmt->depth) + 1;
+        return bstatement(check_depth(stmt));
+}
+
+Bstatement* Vm_backend::expression_statement(Bexpression* expr, const Location& loc)
+{
+        RIN_ASSERT(expr);
+        return bstatement(this->arena()->make<Vm_evaluate>(Vm_statement::STMT_EXPRESSION,
+                                                           node(expr), loc));
+}
+
+Bstatement* Vm_backend::compound_statement
+(Bstatement* first, Bstatement* second, const Location& loc)
+{
+        RIN_ASSERT(first && second);
+        return bstatement(this->arena()->make<Vm_compound>(node(first), node(second), loc));
+}
+
+Bstatement* Vm_backend::return_statement(Bexpression* expr, const Location& loc)
+{
+        Vm_expression* value = (expr) ? node(expr) : NULL;
+        return bstatement(this->arena()->make<Vm_evaluate>(Vm_statement::STMT_RETURN, value, loc));
+}
+
+// Whether scope is inner, or nested in it.
+static bool is_within(Scope* scope, Scope* inner)
+{
+        for (; scope; scope = scope->parent()) {
+                if (scope == inner)
+                        return true;
+        }
+        return false;
+}
+
+Bstatement* Vm_backend::function_statement
+(const std::string& name, const std::vector<std::string>& params,
+ Scope* body, const Location& loc)
+{
+        RIN_ASSERT(body);
+        if (this->_function_index.count(name)) {
+                rin_error_at(loc, "Redefinition of function '%s'", name.c_str());
+                return this->invalid_statement();
+        }
+
+        uint32_t index = this->_functions.size();
+        Vm_function* fn = this->arena()->make<Vm_function>();
+        fn->name = name;
+        fn->location = loc;
+
+        // Parameters are the body's first objects, in order, and the frame's first slots.
+        std::vector<Vm_variable*> param_vars;
+        Scope::Var_map* objects = body->variables();
+        for (auto param = params.begin(); param != params.end(); ++param) {
+                Symbol sym = intern(*param);
+                Vm_variable* var = NULL;
+                for (auto obj = objects->begin(); obj != objects->end(); ++obj) {
+                        if ((*obj)->symbol() != sym)
+                                continue;
+                        var = this->variable_in(*obj, body);
+                        var->owner = index;
+                        var->slot = fn->params;
+                        break;
+                }
+                param_vars.push_back(var);
+                fn->params++;
+        }
+
+        /*
+         * Every other variable first seen within the body is a local, bar
+         * those of functions nested in it, which have claimed theirs.
+         */
+        auto mark = this->_scope_marks.find(body);
+        size_t first = (mark != this->_scope_marks.end()) ? mark->second : 0;
+        for (size_t i = first; i < this->_made.size(); i++) {
+                Vm_variable* var = this->_made[i];
+                if (var->owner != 0 || !is_within(var->scope, body))
+                        continue;
+                var->owner = index;
+                var->slot = fn->params + fn->locals++;
+        }
+
+        this->_function_index[name] = index;
+        this->_functions.push_back(fn);
+        this->_bodies.push_back(this->take_statements(body));
+        this->_params.push_back(param_vars);
+        return bstatement(this->arena()->make<Vm_statement>(Vm_statement::STMT_NOTHING, loc));
+}
+
+Bstatement* Vm_backend::break_statement(const Location& loc)
+{ return bstatement(this->arena()->make<Vm_statement>(Vm_statement::STMT_BREAK, loc)); }
+
+Bstatement* Vm_backend::continue_statement(const Location& loc)
+{ return bstatement(this->arena()->make<Vm_statement>(Vm_statement::STMT_CONTINUE, loc)); }
@@ -0,0 +1,337 @@
+// vm-backend.hpp - A backend that compiles programs to register bytecode
+#ifndef RIN_VM_BACKEND_HPP
+#define RIN_VM_BACKEND_HPP
+
+#include "backend.hpp"
+#include "interp-backend.hpp"
+
+/*
+ * The VM's instruction set. Operands a, b and c are registers of the
+ * current frame unless noted. Typed instructions (_I, _F, _II, _FF) read
+ * their operands as integers or doubles without looking at what they
+ * hold; the compiler only emits them where it has proved the types.
+ * Anything it could not prove goes through the generic instructions,
+ * which check at run time, as the tree-walking interpreter does.
+ */
+#define VM_OPCODES(X)                                                          \
+        X(NOP)          /* nothing */                                          \
+        X(MOVE)         /* a = b */                                            \
+        X(LOADK)        /* a = constant b */                                   \
+        X(GETG)         /* a = global b */                                     \
+        X(SETG)         /* global a = b */                                     \
+        X(I2F)          /* a = (double)b */                                    \
+        X(ADD_II) X(SUB_II) X(MUL_II) X(QUO_II) X(REM_II)                      \
+        X(EQL_II) X(NEQ_II) X(LSS_II) X(GTR_II) X(LEQ_II) X(GEQ_II)            \
+        X(BAND_II) X(BOR_II) X(BXOR_II) X(LSHIFT_II) X(RSHIFT_II)              \
+        X(ADD_FF) X(SUB_FF) X(MUL_FF) X(QUO_FF) X(REM_FF)                      \
+        X(EQL_FF) X(NEQ_FF) X(LSS_FF) X(GTR_FF) X(LEQ_FF) X(GEQ_FF)            \
+        X(BINARY)       /* a = b <operator> c, checked */                      \
+        X(NEG_I) X(NEG_F)                                                      \
+        X(NEG)          /* a = -b, checked */                                  \
+        X(NOT)          /* a = !b */                                           \
+        X(BNOT_I)                                                              \
+        X(BNOT)         /* a = ~b, checked */                                  \
+        X(TRUTH)        /* a = b != 0 */                                       \
+        X(STEP_I) X(STEP_F)                                                    \
+        X(STEP)         /* a += (int32_t)b, checked */                         \
+        X(JMP)          /* go to a */                                          \
+        X(JMPF)         /* go to b if a is zero */                             \
+        X(JMPT)         /* go to b unless a is zero */                         \
+        X(CALL)         /* a = function b, with arguments from register c */   \
+        X(RET)          /* return a */                                         \
+        X(RET0)         /* return 0 */                                         \
+        X(ERROR)        /* stop with message a */                              \
+        VM_SUPERINSTRUCTIONS(X)
+
+/*
+ * Superinstructions, which only the peephole pass emits (see vm-peephole.cc).
+ * Each does the work of the sequence it replaces in one dispatch; a K
+ * operand is a constant, a G operand a global.
+ */
+#define VM_SUPERINSTRUCTIONS(X)                                                \
+        X(JNOT_EQL_II) X(JNOT_NEQ_II) X(JNOT_LSS_II)   /* go to c unless */    \
+        X(JNOT_GTR_II) X(JNOT_LEQ_II) X(JNOT_GEQ_II)   /* a <op> b */          \
+        X(JNOT_LSS_FF) X(JNOT_GTR_FF) X(JNOT_LEQ_FF) X(JNOT_GEQ_FF)            \
+        X(JNOT_EQL_IK) X(JNOT_NEQ_IK) X(JNOT_LSS_IK)   /* go to c unless */    \
+        X(JNOT_GTR_IK) X(JNOT_LEQ_IK) X(JNOT_GEQ_IK)   /* a <op> constant b */ \
+        X(JNOT_LSS_FK) X(JNOT_GTR_FK) X(JNOT_LEQ_FK) X(JNOT_GEQ_FK)            \
+        X(ADD_IK) X(SUB_IK) X(MUL_IK) X(REM_IK)        /* a = b <op> */        \
+        X(BAND_IK) X(ADD_FK) X(MUL_FK)                 /* constant c */        \
+        X(STEP_JMP_I) X(STEP_JMP_F)    /* a += (int32_t)b, then go to c */     \
+        X(STEPG_I)                     /* global a += (int32_t)b */            \
+        X(ADDG_II) X(ADDG_FF)          /* global a += b */                     \
+        X(ADDG_IK)                     /* global a += constant b */
+
+#define VM_OPCODE_ENUM(name) VM_##name,
+enum Vm_opcode : uint8_t {
+        VM_OPCODES(VM_OPCODE_ENUM)
+        VM_OPCODE_COUNT
+};
+#undef VM_OPCODE_ENUM
+
+// Returns an opcode's name, for disassembly.
+const char* vm_opcode_name(Vm_opcode op);
+
+struct Vm_instruction {
+        Vm_opcode op;
+
+        // The operator of a BINARY instruction.
+        uint8_t oper;
+
+        uint16_t unused;
+        uint32_t a;
+        uint32_t b;
+        uint32_t c;
+};
+
+static_assert(sizeof(Vm_instruction) == 16, "Vm_instruction should stay four words");
+
+/*
+ * The bytecode of a function, or of the program's top-level code. A
+ * frame holds the parameters, then the other locals, then temporaries.
+ * The top level's frame is the globals themselves, then its temporaries.
+ */
+struct Vm_function {
+        std::string name;
+        Location location;
+
+        uint32_t params = 0;
+        uint32_t locals = 0;
+        uint32_t frame_size = 0;
+
+        // The first register past the variables: temporaries, dead after each statement.
+        uint32_t first_temp = 0;
+
+        std::vector<Vm_instruction> code;
+
+        // Where each instruction came from, for runtime errors.
+        std::vector<Location> locations;
+
+        // Where each statement starts, in order: no temporary is live there.
+        std::vector<uint32_t> statements;
+
+        std::vector<Interp_value> constants;
+        std::vector<std::string> messages;
+};
+
+/*
+ * Fuse the sequences of fn's code that the compiler emits most often into
+ * superinstructions, where no jump lands inside them and the registers
+ * they no longer write are temporaries. Jumps are retargeted to match.
+ * Functions are those fn's calls may go to, all compiled or not.
+ */
+void vm_peephole(Vm_function* fn, const std::vector<Vm_function*>& functions);
+
+// Counts of what a run dispatched, to choose superinstructions by.
+struct Vm_profile {
+        uint64_t dispatches = 0;
+        uint64_t opcodes[VM_OPCODE_COUNT] = {};
+
+        // How often each opcode was dispatched right after each other one.
+        uint64_t pairs[VM_OPCODE_COUNT][VM_OPCODE_COUNT] = {};
+
+        void add(const Vm_profile& other);
+
+        // The most dispatched opcodes and pairs, top of each, one per line.
+        std::string report(unsigned top) const;
+};
+
+// Compiles hot loops to machine code; see vm-jit.hpp.
+class Vm_jit;
+
+// Built by the backend and compiled by run(); see vm-backend.cc.
+struct Vm_expression;
+struct Vm_statement;
+struct Vm_variable;
+struct Vm_call;
+
+/*
+ * The VM backend compiles a program to bytecode for a register machine
+ * and runs it. The callbacks build a small tree, as the interpreter's do;
+ * once the whole program has been parsed, run() infers a type for every
+ * variable, compiles each function and the top level, and runs the top
+ * level in a dispatch loop.
+ *
+ * Values behave exactly as in Interp_backend. A variable only ever
+ * assigned integers, or only doubles, gets typed instructions; one
+ * assigned both is checked at run time. A declaration's integer zero
+ * counts as an assignment unless it is overwritten before it is read.
+ *
+ * Variables are resolved to registers as they are compiled: a global to
+ * its slot in the globals, a local to its slot in the frame of every call
+ * to its function. No name is looked up while a program runs, and calls
+ * run in the same loop, so deep recursion does not use the native stack.
+ */
+class Vm_backend : public Backend
+{
+public:
+        Vm_backend();
+        ~Vm_backend();
+
+        /*
+         * Compile the program and run the supercontext's statements until
+         * they are done or one of them returns. Returns false if the run
+         * stopped on a runtime error, which is reported. A program should
+         * only be run if it parsed without errors. Given a profile, what
+         * the run dispatched is counted into it.
+         */
+        bool run(Vm_profile* profile = NULL);
+
+        // Whether to run the peephole pass; it does unless told before compiling.
+        void set_peephole(bool peephole)
+        { this->_peephole = peephole; }
+
+        /*
+         * How many times round a loop run() goes before compiling it to
+         * machine code, where that can be done; 0 never compiles any.
+         */
+        void set_jit_threshold(unsigned threshold)
+        { this->_jit_threshold = threshold; }
+
+        static const unsigned JIT_THRESHOLD = 1000;
+
+        // How many loops the last run compiled to machine code.
+        unsigned jit_loops() const;
+
+        // Deepest function call run() allows before stopping with an error.
+        static const unsigned MAX_CALL_DEPTH = Interp_backend::MAX_CALL_DEPTH;
+
+        // Deepest nesting of operations, or of blocks, the compiler accepts.
+        static const unsigned MAX_DEPTH = 1 << 12;
+
+        // The value of a variable at the top level, once the program has run.
+        Interp_value value(Named_object* obj) const;
+
+        // The value returned by a top-level return statement, or 0.
+        const Interp_value& result() const
+        { return this->_result; }
+
+        /*
+         * Compile the program, if run() has not yet, and return its code:
+         * the top level first, then every function in the order declared.
+         */
+        const std::vector<Vm_function*>& functions();
+
+        // A listing of the compiled program, an instruction per line.
+        std::string disassemble();
+
+        // Scopes and statements
+
+        Scope* enter_scope() override;
+        void push_statement(Bstatement* statement) override;
+
+        // Variables
+
+        Bvariable* variable(Named_object* obj) override;
+
+        // Expressions
+
+        Bexpression* invalid_expression() override;
+
+        Bexpression* unary_expression
+        (RIN_OPERATOR op, Bexpression* expr, const Location& loc) override;
+
+        Bexpression* binary_expression
+        (RIN_OPERATOR op, Bexpression* left, Bexpression* right, const Location& loc) override;
+
+        Bexpression* var_reference(Bvariable* var, const Location& loc) override;
+
+        Bexpression* float_expression(const mpfr_t* val, const Location& loc) override;
+        Bexpression* integer_expression(const mpfr_t* val, const Location& loc) override;
+        Bexpression* native_float_expression(double val, const Location& loc) override;
+        Bexpression* native_integer_expression(int64_t val, const Location& loc) override;
+
+        // A condition is the value of its expression.
+        Bexpression* conditional_expression(Bexpression* cond, const Location&) override
+        { return cond; }
+
+        Bexpression* call_expression
+        (const std::string& name, const std::vector<Bexpression*>& args,
+         const Location& loc) override;
+
+        // Statements
+
+        Bstatement* invalid_statement() override;
+
+        Bstatement* var_dec_statement(Bvariable* var) override;
+
+        Bstatement* assignment_statement
+        (Bexpression* lhs, Bexpression* rhs, const Location& loc) override;
+
+        Bstatement* inc_statement(Bexpression* expr, const Location& loc) override;
+        Bstatement* dec_statement(Bexpression* expr, const Location& loc) override;
+
+        Bstatement* if_statement
+        (Bexpression* cond, Scope* then, Scope* else_block, const Location& loc) override;
+
+        Bstatement* for_statement
+        (Bstatement* ind, Bstatement* cond, Bstatement* inc,
+         Scope* then_block, const Location& loc) override;
+
+        Bstatement* expression_statement(Bexpression* expr, const Location& loc) override;
+
+        Bstatement* compound_statement
+        (Bstatement* first, Bstatement* second, const Location& loc) override;
+
+        Bstatement* return_statement(Bexpression* expr, const Location& loc) override;
+
+        Bstatement* function_statement
+        (const std::string& name, const std::vector<std::string>& params,
+         Scope* body, const Location& loc) override;
+
+        Bstatement* break_statement(const Location& loc) override;
+        Bstatement* continue_statement(const Location& loc) override;
+
+private:
+        typedef std::vector<Vm_statement*> Statement_list;
+
+        // The statements pushed to each scope, taken by the statement it is the body of.
+        std::unordered_map<Scope*, Statement_list> _statements;
+
+        // Take the statements pushed to scope, which may be NULL.
+        Statement_list take_statements(Scope* scope);
+
+        // Every variable, by its object, and in the order they were made.
+        std::unordered_map<Named_object*, Vm_variable*> _variables;
+        std::vector<Vm_variable*> _made;
+
+        // For each scope, how many variables had been made when it was entered.
+        std::unordered_map<Scope*, size_t> _scope_marks;
+
+        // Return the variable for obj, made in scope if it is new.
+        Vm_variable* variable_in(Named_object* obj, Scope* scope);
+
+        // What variables are assigned, and every call, for type inference.
+        std::vector<std::pair<Vm_variable*, Vm_expression*> > _assignments;
+        std::vector<Vm_call*> _calls;
+
+        // Give every variable a type, and every global its slot.
+        void infer_types();
+
+        /*
+         * The top level, then the functions in the order declared, with the
+         * statements each is compiled from, and the functions by name.
+         */
+        std::vector<Vm_function*> _functions;
+        std::vector<Statement_list> _bodies;
+        std::unordered_map<std::string, uint32_t> _function_index;
+
+        // The parameters of each function, in order.
+        std::vector<std::vector<Vm_variable*> > _params;
+
+        bool _compiled = false;
+        bool _peephole = true;
+        void compile();
+
+        template<bool PROFILE>
+        bool execute(Vm_profile* profile);
+
+        unsigned _jit_threshold = JIT_THRESHOLD;
+        std::unique_ptr<Vm_jit> _jit;
+
+        uint32_t _globals = 0;
+        std::vector<Interp_value> _stack;
+        Interp_value _result;
+};
+
+#endif // RIN_VM_BACKEND_HPP
@@ -0,0 +1,631 @@
+// vm-jit.cc - Compiles hot VM loops to x86-64 machine code
+#include "vm-jit.hpp"
+
+#if defined(__linux__) && defined(__x86_64__)
+#define VM_JIT 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+bool Vm_jit::supported()
+{
+#ifdef VM_JIT
+        return true;
+#else
+        return false;
+#endif
+}
+
+Vm_jit::~Vm_jit()
+{
+#ifdef VM_JIT
+        for (auto map = this->_maps.begin(); map != this->_maps.end(); ++map)
+                munmap(map->first, map->second);
+#endif
+}
+
+#ifndef VM_JIT
+
+Vm_jit::Loop_code Vm_jit::compile(const Vm_function*, uint32_t, uint32_t, Loop* loop)
+{
+        loop->given_up = true;
+        return NULL;
+}
+
+#else
+
+static_assert(sizeof(Interp_value) == 16 && offsetof(Interp_value, kind) == 0
+              && offsetof(Interp_value, i) == 8,
+              "The stencils address a register's kind and value by its offset");
+
+// The machine registers stencils use. The VM's frame is in rdi, its globals in rsi.
+enum Jit_register : uint8_t {
+        RAX = 0, RCX = 1, RDX = 2,
+        XMM0 = 0, XMM1 = 1
+};
+
+enum Jit_base : uint8_t {
+        FRAME = 7,      // rdi
+        GLOBALS = 6     // rsi
+};
+
+// Condition codes, as the low nibble of jcc and setcc.
+enum Jit_condition : uint8_t {
+        CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_BE = 0x6, CC_A = 0x7,
+        CC_P = 0xa, CC_NP = 0xb, CC_L = 0xc, CC_GE = 0xd, CC_LE = 0xe, CC_G = 0xf
+};
+
+static Jit_condition negated(Jit_condition cc)
+{ return (Jit_condition)(cc ^ 1); }
+
+// The bits of a value, as a 64-bit immediate.
+static uint64_t bits_of(const Interp_value& v)
+{
+        uint64_t bits;
+        memcpy(&bits, &v.i, sizeof(bits));
+        return bits;
+}
+
+// Stencils address registers with 32-bit displacements.
+static const uint32_t MAX_JIT_REGISTER = 1u << 26;
+
+/*
+ * Compiles one loop, from its head to the jump back to it. Each stencil
+ * is the bytes of one or a few machine instructions, with holes for a
+ * register's displacement, an immediate or a jump offset. Jumps inside
+ * the loop go to the code for their target; all others, and stops the
+ * VM has to take over at, go to an exit that returns an instruction.
+ */
+class Vm_loop_compiler
+{
+public:
+        Vm_loop_compiler(const Vm_function* fn, uint32_t head, uint32_t back_edge)
+                : _fn(fn), _head(head), _back_edge(back_edge),
+                  _labels(back_edge - head + 1)
+        {}
+
+        // Compile the loop. Returns false if some instruction in it has no stencil.
+        bool compile();
+
+        const std::vector<uint8_t>& code() const
+        { return this->_code; }
+
+private:
+        const Vm_function* _fn;
+        uint32_t _head;
+        uint32_t _back_edge;
+
+        std::vector<uint8_t> _code;
+
+        // Where the code for each instruction of the loop starts.
+        std::vector<size_t> _labels;
+
+        // A jump offset to fill in, to an instruction or to the exit for one.
+        struct Fixup {
+                size_t at;
+                uint32_t target;
+                bool exit;
+        };
+        std::vector<Fixup> _fixups;
+
+        // Set if a register is out of the stencils' reach.
+        bool _out_of_reach = false;
+
+        bool instruction(const Vm_instruction& ins, uint32_t pc);
+
+        // Pieces of stencils.
+
+        void bytes(std::initializer_list<uint8_t> b)
+        { this->_code.insert(this->_code.end(), b); }
+
+        void put32(uint32_t v)
+        {
+                for (int i = 0; i < 4; i++)
+                        this->_code.push_back((uint8_t)(v >> (8 * i)));
+        }
+
+        void put64(uint64_t v)
+        {
+                for (int i = 0; i < 8; i++)
+                        this->_code.push_back((uint8_t)(v >> (8 * i)));
+        }
+
+        int32_t kind_at(uint32_t reg)
+        {
+                if (reg >= MAX_JIT_REGISTER) {
+                        this->_out_of_reach = true;
+                        return 0;
+                }
+                return (int32_t)(reg * sizeof(Interp_value));
+        }
+
+        int32_t value_at(uint32_t reg)
+        { return this->kind_at(reg) + (int32_t)offsetof(Interp_value, i); }
+
+        // An instruction op with operand [base + disp], and reg in its ModRM byte.
+        void memory(std::initializer_list<uint8_t> op, uint8_t reg, Jit_base base, int32_t disp)
+        {
+                this->bytes(op);
+                this->_code.push_back(0x80 | (reg << 3) | base);
+                this->put32(disp);
+        }
+
+        void jump_to(size_t at, uint32_t target, bool exit)
+        {
+                this->_fixups.push_back(Fixup{ at, target, exit });
+                this->put32(0);
+        }
+
+        // Stencils.
+
+        // mov reg, [base + value]
+        void load(Jit_register reg, Jit_base base, uint32_t vm)
+        { this->memory({ 0x48, 0x8b }, reg, base, this->value_at(vm)); }
+
+        // mov [base + value], reg; mov byte [base + kind], kind
+        void store(Jit_register reg, Jit_base base, uint32_t vm,
+                   Interp_value::Value_kind kind = Interp_value::VALUE_INT)
+        {
+                this->memory({ 0x48, 0x89 }, reg, base, this->value_at(vm));
+                this->memory({ 0xc6 }, 0, base, this->kind_at(vm));
+                this->_code.push_back(kind);
+        }
+
+        // movsd xmm, [base + value]
+        void load_float(Jit_register xmm, Jit_base base, uint32_t vm)
+        { this->memory({ 0xf2, 0x0f, 0x10 }, xmm, base, this->value_at(vm)); }
+
+        // movsd [base + value], xmm; mov byte [base + kind], VALUE_FLOAT
+        void store_float(Jit_register xmm, Jit_base base, uint32_t vm)
+        {
+                this->memory({ 0xf2, 0x0f, 0x11 }, xmm, base, this->value_at(vm));
+                this->memory({ 0xc6 }, 0, base, this->kind_at(vm));
+                this->_code.push_back(Interp_value::VALUE_FLOAT);
+        }
+
+        // movups xmm0, [from + src]; movups [to + dst], xmm0
+        void copy(Jit_base from, uint32_t src, Jit_base to, uint32_t dst)
+        {
+                this->memory({ 0x0f, 0x10 }, XMM0, from, this->kind_at(src));
+                this->memory({ 0x0f, 0x11 }, XMM0, to, this->kind_at(dst));
+        }
+
+        // mov reg, imm64
+        void constant(Jit_register reg, uint64_t bits)
+        {
+                this->bytes({ 0x48, (uint8_t)(0xb8 + reg) });
+                this->put64(bits);
+        }
+
+        // mov rcx, imm64; movq xmm, rcx
+        void float_constant(Jit_register xmm, uint64_t bits)
+        {
+                this->constant(RCX, bits);
+                this->bytes({ 0x66, 0x48, 0x0f, 0x6e, (uint8_t)(0xc1 | (xmm << 3)) });
+        }
+
+        // setcc al; movzx eax, al
+        void set(Jit_condition cc)
+        { this->bytes({ 0x0f, (uint8_t)(0x90 | cc), 0xc0, 0x0f, 0xb6, 0xc0 }); }
+
+        // jmp target
+        void jump(uint32_t target)
+        {
+                this->bytes({ 0xe9 });
+                this->jump_to(this->_code.size(), target, false);
+        }
+
+        // jcc target
+        void jump_if(Jit_condition cc, uint32_t target)
+        {
+                this->bytes({ 0x0f, (uint8_t)(0x80 | cc) });
+                this->jump_to(this->_code.size(), target, false);
+        }
+
+        // jcc to the exit that leaves the VM to run pc
+        void exit_if(Jit_condition cc, uint32_t pc)
+        {
+                this->bytes({ 0x0f, (uint8_t)(0x80 | cc) });
+                this->jump_to(this->_code.size(), pc, true);
+        }
+
+        // mov eax, pc; ret
+        void exit(uint32_t pc)
+        {
+                this->bytes({ 0xb8 });
+                this->put32(pc);
+                this->bytes({ 0xc3 });
+        }
+
+        // Stencils made of stencils.
+
+        void step_int(Jit_base base, uint32_t vm, int32_t step)
+        {
+                this->load(RAX, base, vm);
+                this->bytes({ 0x48, 0x05 });
+                this->put32((uint32_t)step);
+                this->store(RAX, base, vm);
+        }
+
+        void step_float(Jit_base base, uint32_t vm, int32_t step)
+        {
+                this->load_float(XMM0, base, vm);
+                this->float_constant(XMM1, bits_of(Interp_value::of_float(step)));
+                this->bytes({ 0xf2, 0x0f, 0x58, 0xc1 });
+                this->store_float(XMM0, base, vm);
+        }
+
+        // Integer division, left to the VM where it would fail or overflow.
+        void divide(const Vm_instruction& ins, uint32_t pc)
+        {
+                this->load(RCX, FRAME, ins.c);
+                this->bytes({ 0x48, 0x85, 0xc9 });              // test rcx, rcx
+                this->exit_if(CC_E, pc);
+                this->bytes({ 0x48, 0x83, 0xf9, 0xff });        // cmp rcx, -1
+                this->exit_if(CC_E, pc);
+                this->load(RAX, FRAME, ins.b);
+                this->bytes({ 0x48, 0x99, 0x48, 0xf7, 0xf9 });  // cqo; idiv rcx
+                this->store((ins.op == VM_QUO_II) ? RAX : RDX, FRAME, ins.a);
+        }
+
+        /*
+         * Compare register x with y, a register or, if constant, a double's
+         * bits, and return the condition under which x <op> y holds. The
+         * operands are swapped for < and <=, so that an unordered result,
+         * from a NaN, fails every ordered comparison as it does in C++.
+         */
+        Jit_condition compare_floats(RIN_OPERATOR op, uint32_t x, uint64_t y, bool constant)
+        {
+                bool swap = (op == OPER_LSS || op == OPER_LEQ);
+                if (swap && constant) {
+                        this->float_constant(XMM0, y);
+                        this->memory({ 0x66, 0x0f, 0x2e }, XMM0, FRAME, this->value_at(x));
+                } else if (swap) {
+                        this->load_float(XMM0, FRAME, y);
+                        this->memory({ 0x66, 0x0f, 0x2e }, XMM0, FRAME, this->value_at(x));
+                } else if (constant) {
+                        this->load_float(XMM0, FRAME, x);
+                        this->float_constant(XMM1, y);
+                        this->bytes({ 0x66, 0x0f, 0x2e, 0xc1 });
+                } else {
+                        this->load_float(XMM0, FRAME, x);
+                        this->memory({ 0x66, 0x0f, 0x2e }, XMM0, FRAME, this->value_at(y));
+                }
+                return (op == OPER_LSS || op == OPER_GTR) ? CC_A : CC_AE;
+        }
+};
+
+// The comparison an instruction makes, or OPER_ILLEGAL.
+static RIN_OPERATOR comparison(Vm_opcode op)
+{
+        switch (op) {
+        case VM_EQL_II: case VM_EQL_FF: case VM_JNOT_EQL_II: case VM_JNOT_EQL_IK:
+                return OPER_EQL;
+        case VM_NEQ_II: case VM_NEQ_FF: case VM_JNOT_NEQ_II: case VM_JNOT_NEQ_IK:
+                return OPER_NEQ;
+        case VM_LSS_II: case VM_LSS_FF: case VM_JNOT_LSS_II: case VM_JNOT_LSS_IK:
+        case VM_JNOT_LSS_FF: case VM_JNOT_LSS_FK:
+                return OPER_LSS;
+        case VM_GTR_II: case VM_GTR_FF: case VM_JNOT_GTR_II: case VM_JNOT_GTR_IK:
+        case VM_JNOT_GTR_FF: case VM_JNOT_GTR_FK:
+                return OPER_GTR;
+        case VM_LEQ_II: case VM_LEQ_FF: case VM_JNOT_LEQ_II: case VM_JNOT_LEQ_IK:
+        case VM_JNOT_LEQ_FF: case VM_JNOT_LEQ_FK:
+                return OPER_LEQ;
+        case VM_GEQ_II: case VM_GEQ_FF: case VM_JNOT_GEQ_II: case VM_JNOT_GEQ_IK:
+        case VM_JNOT_GEQ_FF: case VM_JNOT_GEQ_FK:
+                return OPER_GEQ;
+        default:
+                return OPER_ILLEGAL;
+        }
+}
+
+// The condition under which a signed integer comparison holds.
+static Jit_condition int_condition(RIN_OPERATOR op)
+{
+        switch (op) {
+        case OPER_EQL: return CC_E;
+        case OPER_NEQ: return CC_NE;
+        case OPER_LSS: return CC_L;
+        case OPER_GTR: return CC_G;
+        case OPER_LEQ: return CC_LE;
+        default:       return CC_GE;
+        }
+}
+
+bool Vm_loop_compiler::instruction(const Vm_instruction& ins, uint32_t pc)
+{
+        const std::vector<Interp_value>& k = this->_fn->constants;
+        switch (ins.op) {
+        case VM_NOP:
+                return true;
+        case VM_MOVE:
+                this->copy(FRAME, ins.b, FRAME, ins.a);
+                return true;
+        case VM_LOADK:
+                this->constant(RAX, bits_of(k[ins.b]));
+                this->store(RAX, FRAME, ins.a, k[ins.b].kind);
+                return true;
+        case VM_GETG:
+                this->copy(GLOBALS, ins.b, FRAME, ins.a);
+                return true;
+        case VM_SETG:
+                this->copy(FRAME, ins.b, GLOBALS, ins.a);
+                return true;
+        case VM_I2F:
+                this->load(RAX, FRAME, ins.b);
+                this->bytes({ 0xf2, 0x48, 0x0f, 0x2a, 0xc0 });  // cvtsi2sd xmm0, rax
+                this->store_float(XMM0, FRAME, ins.a);
+                return true;
+
+        case VM_ADD_II:
+        case VM_SUB_II:
+        case VM_MUL_II:
+        case VM_BAND_II:
+        case VM_BOR_II:
+        case VM_BXOR_II:
+                this->load(RAX, FRAME, ins.b);
+                if (ins.op == VM_MUL_II) {
+                        this->memory({ 0x48, 0x0f, 0xaf }, RAX, FRAME, this->value_at(ins.c));
+                } else {
+                        uint8_t op = (ins.op == VM_ADD_II) ? 0x03 : (ins.op == VM_SUB_II) ? 0x2b :
+                                (ins.op == VM_BAND_II) ? 0x23 : (ins.op == VM_BOR_II) ? 0x0b : 0x33;
+                        this->memory({ 0x48, op }, RAX, FRAME, this->value_at(ins.c));
+                }
+                this->store(RAX, FRAME, ins.a);
+                return true;
+        case VM_QUO_II:
+        case VM_REM_II:
+                this->divide(ins, pc);
+                return true;
+        case VM_LSHIFT_II:
+        case VM_RSHIFT_II:
+                // The shift count is masked to six bits, as the VM masks it.
+                this->load(RAX, FRAME, ins.b);
+                this->load(RCX, FRAME, ins.c);
+                this->bytes({ 0x48, 0xd3, (uint8_t)((ins.op == VM_LSHIFT_II) ? 0xe0 : 0xf8) });
+                this->store(RAX, FRAME, ins.a);
+                return true;
+        case VM_EQL_II:
+        case VM_NEQ_II:
+        case VM_LSS_II:
+        case VM_GTR_II:
+        case VM_LEQ_II:
+        case VM_GEQ_II:
+                this->load(RAX, FRAME, ins.b);
+                this->memory({ 0x48, 0x3b }, RAX, FRAME, this->value_at(ins.c));
+                this->set(int_condition(comparison(ins.op)));
+                this->store(RAX, FRAME, ins.a);
+                return true;
+
+        case VM_ADD_FF:
+        case VM_SUB_FF:
+        case VM_MUL_FF:
+        case VM_QUO_FF: {
+                uint8_t op = (ins.op == VM_ADD_FF) ? 0x58 : (ins.op == VM_SUB_FF) ? 0x5c :
+                        (ins.op == VM_MUL_FF) ? 0x59 : 0x5e;
+                this->load_float(XMM0, FRAME, ins.b);
+                this->memory({ 0xf2, 0x0f, op }, XMM0, FRAME, this->value_at(ins.c));
+                this->store_float(XMM0, FRAME, ins.a);
+                return true;
+        }
+        case VM_EQL_FF:
+        case VM_NEQ_FF:
+                this->compare_floats(OPER_EQL, ins.b, ins.c, false);
+                if (ins.op == VM_EQL_FF) {
+                        // sete al; setnp cl; and al, cl
+                        this->bytes({ 0x0f, 0x94, 0xc0, 0x0f, 0x9b, 0xc1, 0x20, 0xc8 });
+                } else {
+                        // setne al; setp cl; or al, cl
+                        this->bytes({ 0x0f, 0x95, 0xc0, 0x0f, 0x9a, 0xc1, 0x08, 0xc8 });
+                }
+                this->bytes({ 0x0f, 0xb6, 0xc0 });
+                this->store(RAX, FRAME, ins.a);
+                return true;
+        case VM_LSS_FF:
+        case VM_GTR_FF:
+        case VM_LEQ_FF:
+        case VM_GEQ_FF:
+                this->set(this->compare_floats(comparison(ins.op), ins.b, ins.c, false));
+                this->store(RAX, FRAME, ins.a);
+                return true;
+
+        case VM_NEG_I:
+        case VM_BNOT_I:
+                this->load(RAX, FRAME, ins.b);
+                this->bytes({ 0x48, 0xf7, (uint8_t)((ins.op == VM_NEG_I) ? 0xd8 : 0xd0) });
+                this->store(RAX, FRAME, ins.a);
+                return true;
+        case VM_NEG_F:
+                this->load(RAX, FRAME, ins.b);
+                this->constant(RCX, 1ull << 63);
+                this->bytes({ 0x48, 0x31, 0xc8 });              // xor rax, rcx
+                this->store(RAX, FRAME, ins.a, Interp_value::VALUE_FLOAT);
+                return true;
+        case VM_STEP_I:
+                this->step_int(FRAME, ins.a, (int32_t)ins.b);
+                return true;
+        case VM_STEP_F:
+                this->step_float(FRAME, ins.a, (int32_t)ins.b);
+                return true;
+
+        case VM_JMP:
+                this->jump(ins.a);
+                return true;
+        case VM_JMPF:
+        case VM_JMPT:
+                // The truth of a float is left to the VM.
+                this->memory({ 0x80 }, 7, FRAME, this->kind_at(ins.a));
+                this->_code.push_back(Interp_value::VALUE_FLOAT);
+                this->exit_if(CC_E, pc);
+                this->memory({ 0x48, 0x83 }, 7, FRAME, this->value_at(ins.a));
+                this->_code.push_back(0);
+                this->jump_if((ins.op == VM_JMPF) ? CC_E : CC_NE, ins.b);
+                return true;
+
+        case VM_JNOT_EQL_II:
+        case VM_JNOT_NEQ_II:
+        case VM_JNOT_LSS_II:
+        case VM_JNOT_GTR_II:
+        case VM_JNOT_LEQ_II:
+        case VM_JNOT_GEQ_II:
+                this->load(RAX, FRAME, ins.a);
+                this->memory({ 0x48, 0x3b }, RAX, FRAME, this->value_at(ins.b));
+                this->jump_if(negated(int_condition(comparison(ins.op))), ins.c);
+                return true;
+        case VM_JNOT_EQL_IK:
+        case VM_JNOT_NEQ_IK:
+        case VM_JNOT_LSS_IK:
+        case VM_JNOT_GTR_IK:
+        case VM_JNOT_LEQ_IK:
+        case VM_JNOT_GEQ_IK:
+                this->load(RAX, FRAME, ins.a);
+                this->constant(RCX, bits_of(k[ins.b]));
+                this->bytes({ 0x48, 0x39, 0xc8 });              // cmp rax, rcx
+                this->jump_if(negated(int_condition(comparison(ins.op))), ins.c);
+                return true;
+        case VM_JNOT_LSS_FF:
+        case VM_JNOT_GTR_FF:
+        case VM_JNOT_LEQ_FF:
+        case VM_JNOT_GEQ_FF:
+                this->jump_if(negated(this->compare_floats(comparison(ins.op), ins.a, ins.b, false)),
+                              ins.c);
+                return true;
+        case VM_JNOT_LSS_FK:
+        case VM_JNOT_GTR_FK:
+        case VM_JNOT_LEQ_FK:
+        case VM_JNOT_GEQ_FK: {
+                uint64_t y = bits_of(k[ins.b]);
+                this->jump_if(negated(this->compare_floats(comparison(ins.op), ins.a, y, true)), ins.c);
+                return true;
+        }
+
+        case VM_ADD_IK:
+        case VM_SUB_IK:
+        case VM_MUL_IK:
+        case VM_BAND_IK:
+                this->load(RAX, FRAME, ins.b);
+                this->constant(RCX, bits_of(k[ins.c]));
+                if (ins.op == VM_ADD_IK)
+                        this->bytes({ 0x48, 0x01, 0xc8 });
+                else if (ins.op == VM_SUB_IK)
+                        this->bytes({ 0x48, 0x29, 0xc8 });
+                else if (ins.op == VM_MUL_IK)
+                        this->bytes({ 0x48, 0x0f, 0xaf, 0xc1 });
+                else
+                        this->bytes({ 0x48, 0x21, 0xc8 });
+                this->store(RAX, FRAME, ins.a);
+                return true;
+        case VM_REM_IK:
+                // The peephole pass never divides by 0 or -1 here.
+                this->constant(RCX, bits_of(k[ins.c]));
+                this->load(RAX, FRAME, ins.b);
+                this->bytes({ 0x48, 0x99, 0x48, 0xf7, 0xf9 });  // cqo; idiv rcx
+                this->store(RDX, FRAME, ins.a);
+                return true;
+        case VM_ADD_FK:
+        case VM_MUL_FK:
+                this->load_float(XMM0, FRAME, ins.b);
+                this->float_constant(XMM1, bits_of(k[ins.c]));
+                this->bytes({ 0xf2, 0x0f, (uint8_t)((ins.op == VM_ADD_FK) ? 0x58 : 0x59), 0xc1 });
+                this->store_float(XMM0, FRAME, ins.a);
+                return true;
+
+        case VM_STEP_JMP_I:
+                this->step_int(FRAME, ins.a, (int32_t)ins.b);
+                this->jump(ins.c);
+                return true;
+        case VM_STEP_JMP_F:
+                this->step_float(FRAME, ins.a, (int32_t)ins.b);
+                this->jump(ins.c);
+                return true;
+        case VM_STEPG_I:
+                this->step_int(GLOBALS, ins.a, (int32_t)ins.b);
+                return true;
+        case VM_ADDG_II:
+                this->load(RAX, GLOBALS, ins.a);
+                this->memory({ 0x48, 0x03 }, RAX, FRAME, this->value_at(ins.b));
+                this->store(RAX, GLOBALS, ins.a);
+                return true;
+        case VM_ADDG_IK:
+                this->load(RAX, GLOBALS, ins.a);
+                this->constant(RCX, bits_of(k[ins.b]));
+                this->bytes({ 0x48, 0x01, 0xc8 });
+                this->store(RAX, GLOBALS, ins.a);
+                return true;
+        case VM_ADDG_FF:
+                this->load_float(XMM0, GLOBALS, ins.a);
+                this->memory({ 0xf2, 0x0f, 0x58 }, XMM0, FRAME, this->value_at(ins.b));
+                this->store_float(XMM0, GLOBALS, ins.a);
+                return true;
+
+        default:
+                // Calls, returns, errors and whatever checks types as it runs.
+                return false;
+        }
+}
+
+bool Vm_loop_compiler::compile()
+{
+        for (uint32_t pc = this->_head; pc <= this->_back_edge; pc++) {
+                this->_labels[pc - this->_head] = this->_code.size();
+                if (!this->instruction(this->_fn->code[pc], pc))
+                        return false;
+        }
+        if (this->_out_of_reach)
+                return false;
+
+        // Leaving the loop at its end, then at each other place it can be left.
+        this->exit(this->_back_edge + 1);
+
+        std::unordered_map<uint32_t, size_t> exits;
+        for (auto fixup = this->_fixups.begin(); fixup != this->_fixups.end(); ++fixup) {
+                bool inside = !fixup->exit && fixup->target >= this->_head
+                        && fixup->target <= this->_back_edge;
+                size_t target;
+                if (inside) {
+                        target = this->_labels[fixup->target - this->_head];
+                } else {
+                        auto found = exits.find(fixup->target);
+                        if (found == exits.end()) {
+                                found = exits.emplace(fixup->target, this->_code.size()).first;
+                                this->exit(fixup->target);
+                        }
+                        target = found->second;
+                }
+
+                int32_t offset = (int32_t)(target - (fixup->at + 4));
+                memcpy(&this->_code[fixup->at], &offset, sizeof(offset));
+        }
+        return true;
+}
+
+Vm_jit::Loop_code Vm_jit::compile(const Vm_function* fn, uint32_t head, uint32_t back_edge, Loop* loop)
+{
+        // Whatever happens, the loop is not tried again.
+        loop->given_up = true;
+
+        Vm_loop_compiler compiler(fn, head, back_edge);
+        if (!compiler.compile())
+                return NULL;
+
+        // The code is written, then made executable, never both at once.
+        const std::vector<uint8_t>& code = compiler.code();
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t size = (code.size() + page - 1) / page * page;
+        void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (map == MAP_FAILED)
+                return NULL;
+        memcpy(map, code.data(), code.size());
+        if (mprotect(map, size, PROT_READ | PROT_EXEC) != 0) {
+                munmap(map, size);
+                return NULL;
+        }
+
+        this->_maps.push_back(std::make_pair(map, size));
+        loop->given_up = false;
+        loop->code = reinterpret_cast<Loop_code>(map);
+        return loop->code;
+}
+
+#endif // VM_JIT
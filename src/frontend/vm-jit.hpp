@@ -0,0 +1,78 @@
+// vm-jit.hpp - Compiles hot VM loops to x86-64 machine code
+#ifndef RIN_VM_JIT_HPP
+#define RIN_VM_JIT_HPP
+
+#include "vm-backend.hpp"
+
+/*
+ * Loops of bytecode that run often enough are compiled to machine code by
+ * copying a stencil of x86-64 instructions for each of their instructions
+ * into executable memory and patching in the registers, constants and
+ * jump offsets. The code works on the VM's registers in place, so it can
+ * stop at any instruction and leave the VM to carry on from there.
+ *
+ * A loop is only compiled if every instruction in it has a stencil:
+ * typed arithmetic and comparisons, constants, moves, globals and jumps.
+ * One that calls a function, or checks types at run time, stays with the
+ * VM. Where a stencil cannot finish an instruction as the VM would, as
+ * for a division by zero, the code stops there and the VM runs it.
+ *
+ * Code is only ever compiled on Linux on x86-64. Elsewhere, supported()
+ * is false and nothing is compiled.
+ */
+class Vm_jit
+{
+public:
+        // Machine code for a loop. Returns the instruction the VM goes on from.
+        typedef uint32_t (*Loop_code)(Interp_value* frame, Interp_value* globals);
+
+        // Compile loops of functions, numbered as the VM numbers them, once threshold trips round.
+        Vm_jit(size_t functions, unsigned threshold)
+                : _loops(functions), _threshold(threshold)
+        {}
+
+        ~Vm_jit();
+
+        // Whether loops can be compiled on this machine.
+        static bool supported();
+
+        /*
+         * Count another trip round the loop of function index from head
+         * to back_edge, the jump back to head. Returns the loop's machine
+         * code once it has been compiled, which it is when the loop first
+         * gets hot, and NULL until then or if it cannot be.
+         */
+        Loop_code loop(uint32_t index, const Vm_function* fn, uint32_t head, uint32_t back_edge)
+        {
+                std::vector<Loop>& loops = this->_loops[index];
+                if (loops.empty())
+                        loops.resize(fn->code.size());
+
+                Loop& loop = loops[head];
+                if (loop.code || loop.given_up || ++loop.trips < this->_threshold)
+                        return loop.code;
+                return this->compile(fn, head, back_edge, &loop);
+        }
+
+        // How many loops have been compiled.
+        unsigned compiled() const
+        { return this->_maps.size(); }
+
+private:
+        struct Loop {
+                uint32_t trips = 0;
+                bool given_up = false;
+                Loop_code code = NULL;
+        };
+
+        // For each function, a loop for each instruction a loop could start at.
+        std::vector<std::vector<Loop> > _loops;
+        unsigned _threshold;
+
+        Loop_code compile(const Vm_function* fn, uint32_t head, uint32_t back_edge, Loop* loop);
+
+        // The executable memory of every compiled loop, and its size.
+        std::vector<std::pair<void*, size_t> > _maps;
+};
+
+#endif // RIN_VM_JIT_HPP
@@ -0,0 +1,662 @@
+// vm-peephole.cc - Fuses common bytecode sequences into superinstructions
+#include "vm-backend.hpp"
+
+#include <algorithm>
+
+/*
+ * The sequences fused are the pairs that dispatched most often when the
+ * examples/ corpus was profiled (rin-debug-parser --profile): a comparison
+ * feeding a conditional jump, usually against a constant loaded just for
+ * it; arithmetic on a constant, as x += 1 compiles to; the step and jump
+ * that end a for loop; and, in a function, a global loaded, stepped or
+ * added to, and stored back.
+ *
+ * The compiler gives each statement fresh temporaries, so the value one
+ * instruction of a sequence hands the next is nearly always dead once the
+ * sequence is done. The pass checks rather than assumes it: a write may
+ * only be dropped if it is to a temporary that nothing reads afterwards,
+ * and no jump may land inside a sequence that is fused.
+ */
+
+static const uint32_t NO_REGISTER = UINT32_MAX;
+
+// The registers of the frame an instruction reads and writes.
+struct Vm_effects {
+        uint32_t reads[2] = { NO_REGISTER, NO_REGISTER };
+        uint32_t write = NO_REGISTER;
+
+        // A call reads its arguments, which start at this register.
+        uint32_t args = NO_REGISTER;
+        uint32_t arg_count = 0;
+};
+
+static Vm_effects effects_of(const Vm_instruction& ins, const std::vector<Vm_function*>& functions)
+{
+        Vm_effects e;
+        switch (ins.op) {
+        case VM_NOP:
+        case VM_JMP:
+        case VM_RET0:
+        case VM_ERROR:
+        case VM_STEPG_I:
+        case VM_ADDG_IK:
+                break;
+        case VM_LOADK:
+        case VM_GETG:
+                e.write = ins.a;
+                break;
+        case VM_SETG:
+        case VM_ADDG_II:
+        case VM_ADDG_FF:
+                e.reads[0] = ins.b;
+                break;
+        case VM_JMPF:
+        case VM_JMPT:
+        case VM_RET:
+        case VM_JNOT_EQL_IK:
+        case VM_JNOT_NEQ_IK:
+        case VM_JNOT_LSS_IK:
+        case VM_JNOT_GTR_IK:
+        case VM_JNOT_LEQ_IK:
+        case VM_JNOT_GEQ_IK:
+        case VM_JNOT_LSS_FK:
+        case VM_JNOT_GTR_FK:
+        case VM_JNOT_LEQ_FK:
+        case VM_JNOT_GEQ_FK:
+                e.reads[0] = ins.a;
+                break;
+        case VM_JNOT_EQL_II:
+        case VM_JNOT_NEQ_II:
+        case VM_JNOT_LSS_II:
+        case VM_JNOT_GTR_II:
+        case VM_JNOT_LEQ_II:
+        case VM_JNOT_GEQ_II:
+        case VM_JNOT_LSS_FF:
+        case VM_JNOT_GTR_FF:
+        case VM_JNOT_LEQ_FF:
+        case VM_JNOT_GEQ_FF:
+                e.reads[0] = ins.a;
+                e.reads[1] = ins.b;
+                break;
+        case VM_STEP_I:
+        case VM_STEP_F:
+        case VM_STEP:
+        case VM_STEP_JMP_I:
+        case VM_STEP_JMP_F:
+                e.reads[0] = ins.a;
+                e.write = ins.a;
+                break;
+        case VM_CALL:
+                e.write = ins.a;
+                e.args = ins.c;
+                e.arg_count = functions[ins.b]->params;
+                break;
+        case VM_MOVE:
+        case VM_I2F:
+        case VM_NEG_I:
+        case VM_NEG_F:
+        case VM_NEG:
+        case VM_NOT:
+        case VM_BNOT_I:
+        case VM_BNOT:
+        case VM_TRUTH:
+        case VM_ADD_IK:
+        case VM_SUB_IK:
+        case VM_MUL_IK:
+        case VM_REM_IK:
+        case VM_BAND_IK:
+        case VM_ADD_FK:
+        case VM_MUL_FK:
+                e.write = ins.a;
+                e.reads[0] = ins.b;
+                break;
+        default:
+                // The rest are a = b <op> c.
+                e.write = ins.a;
+                e.reads[0] = ins.b;
+                e.reads[1] = ins.c;
+                break;
+        }
+        return e;
+}
+
+// The operand an instruction keeps where it jumps to, or NULL if it never jumps.
+static uint32_t Vm_instruction::* jump_field(Vm_opcode op)
+{
+        switch (op) {
+        case VM_JMP:
+                return &Vm_instruction::a;
+        case VM_JMPF:
+        case VM_JMPT:
+                return &Vm_instruction::b;
+        case VM_STEP_JMP_I:
+        case VM_STEP_JMP_F:
+                return &Vm_instruction::c;
+        default:
+                return (op >= VM_JNOT_EQL_II && op <= VM_JNOT_GEQ_FK) ? &Vm_instruction::c : NULL;
+        }
+}
+
+// Whether the instruction after op can run next.
+static bool falls_through(Vm_opcode op)
+{
+        return op != VM_JMP && op != VM_STEP_JMP_I && op != VM_STEP_JMP_F
+                && op != VM_RET && op != VM_RET0 && op != VM_ERROR;
+}
+
+/*
+ * Whether a temporary of a function may still be read after an instruction.
+ * Temporaries die with their statement, so rather than solve liveness for
+ * the whole function, each question follows the code on from the
+ * instruction until the temporary is written or the next statement starts.
+ * The code is split into blocks that only run from their first instruction,
+ * and each temporary's reads and writes are listed in order, so a question
+ * goes straight to the temporary's next use in a block, or on to the
+ * blocks after it when there is none.
+ */
+class Vm_liveness
+{
+public:
+        Vm_liveness(const Vm_function* fn, const std::vector<Vm_function*>& functions,
+                    const std::vector<bool>& targets, const std::vector<bool>& starts);
+
+        // Whether reg may be read after the instruction at pc. Variables always may.
+        bool live_after(size_t pc, uint32_t reg) const;
+
+private:
+        const Vm_function* _fn;
+        const std::vector<bool>& _starts;
+
+        // The first instruction of each block, then the end of the code.
+        std::vector<uint32_t> _heads;
+
+        // The block each instruction is in.
+        std::vector<uint32_t> _block;
+
+        // For each temporary, the instructions that read or write it, and whether they read it.
+        std::vector<std::vector<std::pair<uint32_t, bool> > > _uses;
+
+        // The blocks a question has reached, marked with its number.
+        mutable std::vector<uint32_t> _seen;
+        mutable uint32_t _question = 0;
+        mutable std::vector<uint32_t> _pending;
+
+        // Note that the instruction at pc reads or writes reg.
+        void use(uint32_t pc, uint32_t reg, bool read);
+
+        // Go on to the blocks that can run after block b.
+        void follow(uint32_t b) const;
+};
+
+Vm_liveness::Vm_liveness(const Vm_function* fn, const std::vector<Vm_function*>& functions,
+                         const std::vector<bool>& targets, const std::vector<bool>& starts)
+        : _fn(fn), _starts(starts)
+{
+        const std::vector<Vm_instruction>& code = fn->code;
+        uint32_t first = fn->first_temp;
+        size_t temps = (fn->frame_size > first) ? fn->frame_size - first : 0;
+        this->_uses.resize(temps);
+        this->_block.resize(code.size());
+
+        for (size_t pc = 0; pc < code.size(); pc++) {
+                if (pc == 0 || targets[pc] || starts[pc] || !falls_through(code[pc - 1].op)
+                    || jump_field(code[pc - 1].op))
+                        this->_heads.push_back(pc);
+                this->_block[pc] = this->_heads.size() - 1;
+
+                // A register read and written by one instruction is read first.
+                Vm_effects e = effects_of(code[pc], functions);
+                for (int i = 0; i < 2; i++)
+                        this->use(pc, e.reads[i], true);
+                for (uint32_t i = 0; i < e.arg_count; i++)
+                        this->use(pc, e.args + i, true);
+                this->use(pc, e.write, false);
+        }
+        this->_heads.push_back(code.size());
+        this->_seen.resize(this->_heads.size());
+}
+
+void Vm_liveness::use(uint32_t pc, uint32_t reg, bool read)
+{
+        if (reg == NO_REGISTER || reg < this->_fn->first_temp)
+                return;
+
+        std::vector<std::pair<uint32_t, bool> >& uses = this->_uses[reg - this->_fn->first_temp];
+        if (uses.empty() || uses.back().first != pc)
+                uses.push_back(std::make_pair(pc, read));
+}
+
+bool Vm_liveness::live_after(size_t pc, uint32_t reg) const
+{
+        if (reg < this->_fn->first_temp)
+                return true;
+
+        const std::vector<std::pair<uint32_t, bool> >& uses = this->_uses[reg - this->_fn->first_temp];
+        this->_question++;
+        this->_pending.clear();
+
+        // The rest of pc's own block, then each block reached in turn from its start.
+        uint32_t b = this->_block[pc];
+        uint32_t from = pc + 1;
+        for (;;) {
+                if (from < this->_heads[b + 1]) {
+                        auto next = std::lower_bound(uses.begin(), uses.end(),
+                                                     std::make_pair(from, false));
+                        if (next != uses.end() && next->first < this->_heads[b + 1]) {
+                                if (next->second)
+                                        return true;
+                        } else {
+                                this->follow(b);
+                        }
+                } else {
+                        this->follow(b);
+                }
+
+                if (this->_pending.empty())
+                        return false;
+                b = this->_pending.back();
+                this->_pending.pop_back();
+                from = this->_heads[b];
+        }
+}
+
+void Vm_liveness::follow(uint32_t b) const
+{
+        const std::vector<Vm_instruction>& code = this->_fn->code;
+        size_t last = this->_heads[b + 1] - 1;
+        const Vm_instruction& ins = code[last];
+
+        size_t next[2];
+        int count = 0;
+        if (falls_through(ins.op) && last + 1 < code.size())
+                next[count++] = last + 1;
+        uint32_t Vm_instruction::* field = jump_field(ins.op);
+        if (field && ins.*field < code.size())
+                next[count++] = ins.*field;
+
+        // Nothing is live where a statement starts.
+        for (int i = 0; i < count; i++) {
+                uint32_t to = this->_block[next[i]];
+                if (this->_starts[next[i]] || this->_seen[to] == this->_question)
+                        continue;
+                this->_seen[to] = this->_question;
+                this->_pending.push_back(to);
+        }
+}
+
+// The superinstruction that jumps unless cmp holds, or NOP.
+static Vm_opcode jump_unless(Vm_opcode cmp)
+{
+        switch (cmp) {
+        case VM_EQL_II: return VM_JNOT_EQL_II;
+        case VM_NEQ_II: return VM_JNOT_NEQ_II;
+        case VM_LSS_II: return VM_JNOT_LSS_II;
+        case VM_GTR_II: return VM_JNOT_GTR_II;
+        case VM_LEQ_II: return VM_JNOT_LEQ_II;
+        case VM_GEQ_II: return VM_JNOT_GEQ_II;
+        case VM_LSS_FF: return VM_JNOT_LSS_FF;
+        case VM_GTR_FF: return VM_JNOT_GTR_FF;
+        case VM_LEQ_FF: return VM_JNOT_LEQ_FF;
+        case VM_GEQ_FF: return VM_JNOT_GEQ_FF;
+        default:        return VM_NOP;
+        }
+}
+
+// The jump with its operands swapped: it tests (b, a) as jump tests (a, b).
+static Vm_opcode mirrored(Vm_opcode jump)
+{
+        switch (jump) {
+        case VM_JNOT_LSS_II: return VM_JNOT_GTR_II;
+        case VM_JNOT_GTR_II: return VM_JNOT_LSS_II;
+        case VM_JNOT_LEQ_II: return VM_JNOT_GEQ_II;
+        case VM_JNOT_GEQ_II: return VM_JNOT_LEQ_II;
+        case VM_JNOT_LSS_FF: return VM_JNOT_GTR_FF;
+        case VM_JNOT_GTR_FF: return VM_JNOT_LSS_FF;
+        case VM_JNOT_LEQ_FF: return VM_JNOT_GEQ_FF;
+        case VM_JNOT_GEQ_FF: return VM_JNOT_LEQ_FF;
+        default:             return jump;
+        }
+}
+
+// The jump comparing against a constant rather than a register, or NOP.
+static Vm_opcode against_constant(Vm_opcode jump)
+{
+        switch (jump) {
+        case VM_JNOT_EQL_II: return VM_JNOT_EQL_IK;
+        case VM_JNOT_NEQ_II: return VM_JNOT_NEQ_IK;
+        case VM_JNOT_LSS_II: return VM_JNOT_LSS_IK;
+        case VM_JNOT_GTR_II: return VM_JNOT_GTR_IK;
+        case VM_JNOT_LEQ_II: return VM_JNOT_LEQ_IK;
+        case VM_JNOT_GEQ_II: return VM_JNOT_GEQ_IK;
+        case VM_JNOT_LSS_FF: return VM_JNOT_LSS_FK;
+        case VM_JNOT_GTR_FF: return VM_JNOT_GTR_FK;
+        case VM_JNOT_LEQ_FF: return VM_JNOT_LEQ_FK;
+        case VM_JNOT_GEQ_FF: return VM_JNOT_GEQ_FK;
+        default:             return VM_NOP;
+        }
+}
+
+// The superinstruction for op with a constant right operand, or NOP.
+static Vm_opcode with_constant(Vm_opcode op)
+{
+        switch (op) {
+        case VM_ADD_II:  return VM_ADD_IK;
+        case VM_SUB_II:  return VM_SUB_IK;
+        case VM_MUL_II:  return VM_MUL_IK;
+        case VM_REM_II:  return VM_REM_IK;
+        case VM_BAND_II: return VM_BAND_IK;
+        case VM_ADD_FF:  return VM_ADD_FK;
+        case VM_MUL_FF:  return VM_MUL_FK;
+        default:         return VM_NOP;
+        }
+}
+
+static bool commutes(Vm_opcode op)
+{
+        return op == VM_ADD_II || op == VM_MUL_II || op == VM_BAND_II
+                || op == VM_ADD_FF || op == VM_MUL_FF;
+}
+
+// Whether the constant operand of a superinstruction is a double.
+static bool takes_float_constant(Vm_opcode op)
+{
+        return op == VM_ADD_FK || op == VM_MUL_FK || (op >= VM_JNOT_LSS_FK && op <= VM_JNOT_GEQ_FK);
+}
+
+static Vm_instruction instruction(Vm_opcode op, uint32_t a, uint32_t b, uint32_t c)
+{
+        Vm_instruction ins;
+        ins.op = op;
+        ins.oper = (uint8_t)OPER_ILLEGAL;
+        ins.unused = 0;
+        ins.a = a;
+        ins.b = b;
+        ins.c = c;
+        return ins;
+}
+
+// Looks for a sequence to fuse at each instruction of one function.
+class Vm_fuser
+{
+public:
+        Vm_fuser(Vm_function* fn, const Vm_liveness& live, const std::vector<bool>& targets)
+                : _fn(fn), _code(fn->code), _live(live), _targets(targets)
+        {}
+
+        /*
+         * Fuse the sequence at pc, if there is one, into *fused. Returns how
+         * many instructions it replaces, or 0, and sets *origin to the one
+         * whose location it takes: the one that does the work.
+         */
+        size_t fuse(size_t pc, Vm_instruction* fused, size_t* origin);
+
+private:
+        Vm_function* _fn;
+        const std::vector<Vm_instruction>& _code;
+        const Vm_liveness& _live;
+        const std::vector<bool>& _targets;
+
+        // Whether the n instructions from pc exist, and only the first is jumped to.
+        bool straight(size_t pc, size_t n) const
+        {
+                if (pc + n > this->_code.size())
+                        return false;
+                for (size_t i = pc + 1; i < pc + n; i++) {
+                        if (this->_targets[i])
+                                return false;
+                }
+                return true;
+        }
+
+        // Whether nothing reads reg once the instruction at pc has run.
+        bool dead(uint32_t reg, size_t pc) const
+        { return !this->_live.live_after(pc, reg); }
+
+        // Whether constant k suits superinstruction op.
+        bool fits(Vm_opcode op, uint32_t k) const
+        {
+                const Interp_value& v = this->_fn->constants[k];
+                if (v.is_float() != takes_float_constant(op))
+                        return false;
+
+                // Division by these is left to REM_II, which checks for it.
+                return op != VM_REM_IK || (v.i != 0 && v.i != -1);
+        }
+
+        bool global_update(size_t pc, Vm_instruction* fused, size_t* origin);
+        bool compare_and_jump(size_t pc, Vm_instruction* fused, size_t* origin);
+        bool compare_constant(size_t pc, Vm_instruction* fused, size_t* origin);
+        bool constant_operand(size_t pc, Vm_instruction* fused, size_t* origin);
+        bool widen_constant(size_t pc, Vm_instruction* fused, size_t* origin);
+        bool step_and_jump(size_t pc, Vm_instruction* fused, size_t* origin);
+};
+
+size_t Vm_fuser::fuse(size_t pc, Vm_instruction* fused, size_t* origin)
+{
+        if (this->global_update(pc, fused, origin))
+                return 3;
+        if (this->compare_and_jump(pc, fused, origin)
+            || this->compare_constant(pc, fused, origin)
+            || this->constant_operand(pc, fused, origin)
+            || this->widen_constant(pc, fused, origin)
+            || this->step_and_jump(pc, fused, origin))
+                return 2;
+        return 0;
+}
+
+/*
+ * GETG t g; STEP_I t s; SETG g t       =>  STEPG_I g s
+ * GETG t g; ADD_II d t x; SETG g d     =>  ADDG_II g x, and so for FF
+ * GETG t g; ADD_IK d t k; SETG g d     =>  ADDG_IK g k
+ */
+bool Vm_fuser::global_update(size_t pc, Vm_instruction* fused, size_t* origin)
+{
+        if (!this->straight(pc, 3))
+                return false;
+
+        const Vm_instruction& get = this->_code[pc];
+        const Vm_instruction& op = this->_code[pc + 1];
+        const Vm_instruction& set = this->_code[pc + 2];
+        uint32_t t = get.a;
+        if (get.op != VM_GETG || set.op != VM_SETG || set.a != get.b || set.b != op.a
+            || !this->dead(t, pc + 2) || !this->dead(op.a, pc + 2))
+                return false;
+
+        *origin = pc + 1;
+        switch (op.op) {
+        case VM_STEP_I:
+                if (op.a != t)
+                        return false;
+                *fused = instruction(VM_STEPG_I, get.b, op.b, 0);
+                return true;
+        case VM_ADD_IK:
+                if (op.b != t)
+                        return false;
+                *fused = instruction(VM_ADDG_IK, get.b, op.c, 0);
+                return true;
+        case VM_ADD_II:
+        case VM_ADD_FF: {
+                uint32_t x;
+                if (op.b == t && op.c != t)
+                        x = op.c;
+                else if (op.c == t && op.b != t)
+                        x = op.b;
+                else
+                        return false;
+                *fused = instruction((op.op == VM_ADD_II) ? VM_ADDG_II : VM_ADDG_FF, get.b, x, 0);
+                return true;
+        }
+        default:
+                return false;
+        }
+}
+
+// CMP d x y; JMPF d L  =>  JNOT_CMP x y L
+bool Vm_fuser::compare_and_jump(size_t pc, Vm_instruction* fused, size_t* origin)
+{
+        if (!this->straight(pc, 2))
+                return false;
+
+        const Vm_instruction& cmp = this->_code[pc];
+        const Vm_instruction& jump = this->_code[pc + 1];
+        Vm_opcode op = jump_unless(cmp.op);
+        if (op == VM_NOP || jump.op != VM_JMPF || jump.a != cmp.a || !this->dead(cmp.a, pc + 1))
+                return false;
+
+        *fused = instruction(op, cmp.b, cmp.c, jump.b);
+        *origin = pc;
+        return true;
+}
+
+// LOADK t k; JNOT_CMP x t L  =>  JNOT_CMP_K x k L
+bool Vm_fuser::compare_constant(size_t pc, Vm_instruction* fused, size_t* origin)
+{
+        if (!this->straight(pc, 2))
+                return false;
+
+        const Vm_instruction& load = this->_code[pc];
+        const Vm_instruction& jump = this->_code[pc + 1];
+        if (load.op != VM_LOADK || against_constant(jump.op) == VM_NOP)
+                return false;
+
+        uint32_t t = load.a;
+        Vm_opcode op = jump.op;
+        uint32_t x;
+        if (jump.b == t && jump.a != t) {
+                x = jump.a;
+        } else if (jump.a == t && jump.b != t) {
+                op = mirrored(op);
+                x = jump.b;
+        } else {
+                return false;
+        }
+
+        op = against_constant(op);
+        if (!this->fits(op, load.b) || !this->dead(t, pc + 1))
+                return false;
+
+        *fused = instruction(op, x, load.b, jump.c);
+        *origin = pc + 1;
+        return true;
+}
+
+// LOADK t k; OP d x t  =>  OP_K d x k
+bool Vm_fuser::constant_operand(size_t pc, Vm_instruction* fused, size_t* origin)
+{
+        if (!this->straight(pc, 2))
+                return false;
+
+        const Vm_instruction& load = this->_code[pc];
+        const Vm_instruction& arith = this->_code[pc + 1];
+        Vm_opcode op = with_constant(arith.op);
+        if (load.op != VM_LOADK || op == VM_NOP || !this->fits(op, load.b))
+                return false;
+
+        uint32_t t = load.a;
+        uint32_t x;
+        if (arith.c == t && arith.b != t)
+                x = arith.b;
+        else if (arith.b == t && arith.c != t && commutes(arith.op))
+                x = arith.c;
+        else
+                return false;
+
+        if (arith.a != t && !this->dead(t, pc + 1))
+                return false;
+
+        *fused = instruction(op, arith.a, x, load.b);
+        *origin = pc + 1;
+        return true;
+}
+
+// LOADK t k; I2F d t  =>  LOADK d (double)k
+bool Vm_fuser::widen_constant(size_t pc, Vm_instruction* fused, size_t* origin)
+{
+        if (!this->straight(pc, 2))
+                return false;
+
+        const Vm_instruction& load = this->_code[pc];
+        const Vm_instruction& widen = this->_code[pc + 1];
+        if (load.op != VM_LOADK || widen.op != VM_I2F || widen.b != load.a
+            || this->_fn->constants[load.b].is_float()
+            || (widen.a != load.a && !this->dead(load.a, pc + 1)))
+                return false;
+
+        this->_fn->constants.push_back(Interp_value::of_float((double)this->_fn->constants[load.b].i));
+        *fused = instruction(VM_LOADK, widen.a, this->_fn->constants.size() - 1, 0);
+        *origin = pc;
+        return true;
+}
+
+// STEP_I a s; JMP L  =>  STEP_JMP_I a s L, and so for F
+bool Vm_fuser::step_and_jump(size_t pc, Vm_instruction* fused, size_t* origin)
+{
+        if (!this->straight(pc, 2))
+                return false;
+
+        const Vm_instruction& step = this->_code[pc];
+        const Vm_instruction& jump = this->_code[pc + 1];
+        if ((step.op != VM_STEP_I && step.op != VM_STEP_F) || jump.op != VM_JMP)
+                return false;
+
+        *fused = instruction((step.op == VM_STEP_I) ? VM_STEP_JMP_I : VM_STEP_JMP_F,
+                             step.a, step.b, jump.a);
+        *origin = pc;
+        return true;
+}
+
+void vm_peephole(Vm_function* fn, const std::vector<Vm_function*>& functions)
+{
+        // One fusion can make room for another, so go over the code until none is left.
+        for (;;) {
+                const std::vector<Vm_instruction>& old = fn->code;
+                std::vector<bool> targets(old.size() + 1);
+                for (auto ins = old.begin(); ins != old.end(); ++ins) {
+                        uint32_t Vm_instruction::* field = jump_field(ins->op);
+                        if (field)
+                                targets[(*ins).*field] = true;
+                }
+                std::vector<bool> starts(old.size() + 1);
+                for (auto pc = fn->statements.begin(); pc != fn->statements.end(); ++pc)
+                        starts[*pc] = true;
+
+                Vm_liveness live(fn, functions, targets, starts);
+                Vm_fuser fuser(fn, live, targets);
+
+                // Where each instruction went; a fused sequence all goes to one place.
+                std::vector<uint32_t> moved(old.size() + 1);
+                std::vector<Vm_instruction> code;
+                std::vector<Location> locations;
+                for (size_t pc = 0; pc < old.size();) {
+                        Vm_instruction fused;
+                        size_t origin = pc;
+                        size_t n = fuser.fuse(pc, &fused, &origin);
+                        if (n == 0) {
+                                fused = old[pc];
+                                n = 1;
+                        }
+
+                        for (size_t i = pc; i < pc + n; i++)
+                                moved[i] = code.size();
+                        code.push_back(fused);
+                        locations.push_back(fn->locations[origin]);
+                        pc += n;
+                }
+                moved[old.size()] = code.size();
+
+                if (code.size() == old.size())
+                        return;
+
+                for (auto ins = code.begin(); ins != code.end(); ++ins) {
+                        uint32_t Vm_instruction::* field = jump_field(ins->op);
+                        if (field)
+                                (*ins).*field = moved[(*ins).*field];
+                }
+                for (auto pc = fn->statements.begin(); pc != fn->statements.end(); ++pc)
+                        *pc = moved[*pc];
+                fn->statements.erase(std::unique(fn->statements.begin(), fn->statements.end()),
+                                     fn->statements.end());
+                fn->code.swap(code);
+                fn->locations.swap(locations);
+        }
+}
@@ -20,13 +20,13 @@ location_t gcc_location(const Location& loc)
                 linemap_add(line_table, LC_LEAVE, 0, NULL, 0);
 
         // Enter a file.
-        linemap_add(line_table, LC_ENTER, 0, loc.filename.c_str(), LOC_LINE_BEGIN);
+        linemap_add(line_table, LC_ENTER, 0, loc.filename().c_str(), LOC_LINE_BEGIN);
 
         // Enter a line. Line counts on the frontend begin at 0.
-        linemap_line_start(line_table, loc.line + LOC_LINE_BEGIN, 1);
+        linemap_line_start(line_table, loc.line() + LOC_LINE_BEGIN, 1);
         gcc_loc_infile = true;
 
-        return linemap_position_for_column(line_table, loc.column + LOC_COLUMN_BEGIN);
+        return linemap_position_for_column(line_table, loc.column() + LOC_COLUMN_BEGIN);
 }
 
 // Build the supercontext.
@@ -213,6 +213,12 @@ Bexpression* Gcc_backend::integer_expression(const mpfr_t* val, const Location&
         return new Bexpression(ret);
 }
 
+Bexpression* Gcc_backend::native_integer_expression(int64_t val, const Location& loc)
+{
+        tree ret = build_int_cst(integer_type_node, val);
+        return new Bexpression(ret);
+}
+
 inline tree Gcc_backend::unfold_scope(Scope* scope)
 {
         RIN_ASSERT(scope);
@@ -336,7 +342,7 @@ Bstatement* Gcc_backend::for_statement
         // Gather variable declaration chain.
         Scope::Var_map* vars = then_block->variables();
         for (auto itr = vars->begin(); itr != vars->end(); ++itr) {
-                Named_object* obj = itr->second;
+                Named_object* obj = *itr;
                 tree var = this->_var_map[obj]->get_tree();
                 var_decl_chain.append(var);
         }
@@ -498,26 +504,6 @@ Bstatement* Gcc_backend::continue_statement(const Location& loc)
         return this->invalid_statement();
 }
 
-Gcc_backend* grin_be = new Gcc_backend;
-Parser* grin_parse = NULL;
-
-// Get the GRIN instance of the backend.
-Gcc_backend* rin_get_backend()
-{ return grin_be; }
-
-// Delete GRIN instance of backend.
-void rin_delete_backend()
-{ delete grin_be; }
-
-void rin_set_parser(Parser* parser)
-{ grin_parse = parser; }
-
-Parser* rin_get_parser()
-{ return grin_parse; }
-
-void rin_delete_parser()
-{ delete grin_parse; }
-
 // Convert a frontend operator to an equivalent GCC tree_code.
 enum tree_code operator_to_tree_code(RIN_OPERATOR op, tree type)
 {
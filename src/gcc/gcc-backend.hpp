@@ -137,6 +137,7 @@ public:
 
         // Build an integer expression tree.
         Bexpression* integer_expression(const mpfr_t* val, const Location& loc) override;
+        Bexpression* native_integer_expression(int64_t val, const Location& loc) override;
 
         /*
          * A conditional expression usually wraps a binary
@@ -217,16 +218,6 @@ private:
 // Converts a frontend location to location_t.
 extern location_t gcc_location(const Location& loc);
 
-// Returns/deletes the backend instance.
-extern Gcc_backend* rin_get_backend();
-extern void rin_delete_backend();
-
-// Returns/delets the parser instance.
-extern Parser* rin_get_parser();
-extern void rin_delete_parser();
-
-extern void rin_set_parser(Parser* parser);
-
 // Converts a RIN_OPERATOR to a GCC tree_code.
 extern enum tree_code operator_to_tree_code(RIN_OPERATOR op, tree type);
 
@@ -13,18 +13,33 @@
 #include <mpfr.h>
 #include <unordered_map>
 #include <algorithm>
+#include <atomic>
+#include <climits>
+#include <condition_variable>
+#include <cmath>
 #include <string>
+#include <cstdint>
 #include <cstring>
+#include <deque>
 #include <list>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <set>
 #include <vector>
 #include <stdexcept>
 #include <sstream>
 #include <stack>
-#include <regex>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <iostream>
 
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
 #include "system.h"
 #include "ansidecl.h"
 #include "coretypes.h"
@@ -7,6 +7,8 @@
  */
 
 #include "gcc-backend.hpp"
+#include <frontend/null-backend.hpp>
+#include <frontend/token-cache.hpp>
 
 // Language-dependent contents of a type.
 struct GTY(()) lang_type
@@ -51,11 +53,18 @@ static bool rin_langhook_init(void)
         return true;
 }
 
-// Called at the end of compilation.
-static void rin_langhook_finish(void)
+/*
+ * Scan path, replaying its tokens from the token cache in the directory
+ * RINTO_TOKEN_CACHE names, if it is set (see frontend/token-cache.hpp).
+ */
+static Scanner* rin_open_source(const std::string& path)
 {
-        rin_delete_backend();
-        rin_delete_parser();
+        const char* dir = getenv("RINTO_TOKEN_CACHE");
+        if (dir == NULL || *dir == '\0')
+                return new Scanner(path);
+
+        Token_cache cache(dir);
+        return new Scanner(path, &cache);
 }
 
 // GCC calls this to parse a file.
@@ -75,10 +84,17 @@ static void rin_langhook_parse_file(void)
                         "Can only parse one file at a time."
                         "Currently parsing: %s", in_fnames[0]);
 
-        // Open file with parser.
-        Parser* parse = new Parser(path, (Backend*)rin_get_backend());
-        rin_set_parser(parse);
-        parse->parse();
+        // -fsyntax-only: report diagnostics without building any trees.
+        if (flag_syntax_only) {
+                Parser check(rin_open_source(path), new Null_backend);
+                check.parse();
+                return;
+        }
+
+        // The parser owns the backend; both live for this compilation only.
+        Gcc_backend* backend = new Gcc_backend;
+        Parser parse(rin_open_source(path), backend);
+        parse.parse();
 
         TreeChain main_subblocks;
         TreeChain main_decl_chain;
@@ -86,9 +102,9 @@ static void rin_langhook_parse_file(void)
         // Gather main fn body statements.
 
         tree main_list = alloc_stmt_list();
-        tree& main_cx = *rin_get_backend()->supercx_tree();
+        tree& main_cx = *backend->supercx_tree();
 
-        Scope::Statement_list* stmts = parse->backend()->supercontext()->statements();
+        Scope::Statement_list* stmts = backend->supercontext()->statements();
         for (auto itr = stmts->begin(); itr != stmts->end(); ++itr) {
                 if (!(*itr)->is_block()) {
                         append_to_statement_list((*itr)->get_tree(), &main_list);
@@ -99,10 +115,10 @@ static void rin_langhook_parse_file(void)
         }
 
         // Gather variable declaration chain.
-        Scope::Var_map* vars = parse->backend()->supercontext()->variables();
-        std::unordered_map<Named_object*, Bvariable*> var_map = *rin_get_backend()->var_map();
+        Scope::Var_map* vars = backend->supercontext()->variables();
+        std::unordered_map<Named_object*, Bvariable*> var_map = *backend->var_map();
         for (auto itr = vars->begin(); itr != vars->end(); ++itr) {
-                Named_object* obj = itr->second;
+                Named_object* obj = *itr;
                 main_decl_chain.append(var_map[obj]->get_tree());
         }
 
@@ -142,8 +158,6 @@ static void rin_langhook_parse_file(void)
         // Insert it into GCC graph.
         cgraph_node::finalize_function(main_cx, true);
         main_cx = NULL_TREE;
-
-        rin_langhook_finish();
 }
 
 /*